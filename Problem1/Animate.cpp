@@ -0,0 +1,568 @@
+/**
+ * Headless animation renderer.
+ *
+ * Reads keyframed circles or ellipses, rasterizes every frame onto the grid
+ * and writes the frames as raw video: YUV4MPEG2 (4:4:4) when the output
+ * ends in .y4m, otherwise a stream of binary PPM images, which ffmpeg reads
+ * with -f image2pipe -c:v ppm.
+ *
+ * Console program; it opens no window and links no Win32 libraries:
+ *   g++ -std=c++11 -O2 -pthread Animate.cpp -o Animate.exe
+ *   Animate.exe keyframes.txt out.y4m [-grid 20] [-cell 40] [-fps 60]
+ *       [-threshold 0.7071] [-config Problem1.cfg]
+ *
+ * The grid size, rasterization threshold and colors default to the
+ * interactive program's settings file (see Settings.h); -grid and
+ * -threshold override it.
+ *
+ * The keyframe file has one keyframe per line, "frame cx cy rx [ry angle]",
+ * in grid units and degrees; ry defaults to rx, which gives a circle. Lines
+ * starting with '#' are ignored. Parameters are interpolated linearly
+ * between keyframes, and the video ends at the last keyframe.
+ *
+ * Consecutive frames differ in few grid points, so frames are rendered
+ * incrementally: the framebuffer persists from frame to frame and only the
+ * points whose membership changed are repainted. Each finished frame is
+ * copied into one of two buffers that a writer thread streams to the file
+ * while the next frame renders.
+ */
+
+#include "Rasterizer.h"
+#include "Settings.h"
+#include "TiledBitset.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+/**
+ * Ellipse parameters in grid space; a circle has radiusX == radiusY.
+ */
+struct Shape {
+    double cx, cy;
+    double radiusX, radiusY;
+    double angle;  // Degrees, counter-clockwise from the x axis
+
+    static Shape lerp(const Shape& a, const Shape& b, double t) {
+        Shape s;
+        s.cx = a.cx + (b.cx - a.cx) * t;
+        s.cy = a.cy + (b.cy - a.cy) * t;
+        s.radiusX = a.radiusX + (b.radiusX - a.radiusX) * t;
+        s.radiusY = a.radiusY + (b.radiusY - a.radiusY) * t;
+        s.angle = a.angle + (b.angle - a.angle) * t;
+        return s;
+    }
+};
+
+struct Keyframe {
+    int frame;
+    Shape shape;
+
+    bool operator<(const Keyframe& other) const {
+        return frame < other.frame;
+    }
+};
+
+/**
+ * Read keyframes, sorted by frame.
+ * @return false with a message on error
+ */
+bool loadKeyframes(const char* path, std::vector<Keyframe>& keys, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        Keyframe key;
+        if (!(fields >> key.frame >> key.shape.cx >> key.shape.cy >> key.shape.radiusX) || key.frame < 0) {
+            error = "bad keyframe on line " + std::to_string(lineNumber);
+            return false;
+        }
+        if (!(fields >> key.shape.radiusY)) {
+            key.shape.radiusY = key.shape.radiusX;
+        }
+        if (!(fields >> key.shape.angle)) {
+            key.shape.angle = 0.0;
+        }
+        keys.push_back(key);
+    }
+
+    if (keys.empty()) {
+        error = "no keyframes";
+        return false;
+    }
+    std::stable_sort(keys.begin(), keys.end());
+    for (size_t k = 1; k < keys.size(); ++k) {
+        if (keys[k].frame == keys[k - 1].frame) {
+            error = "two keyframes for frame " + std::to_string(keys[k].frame);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The grid points on one frame's shape.
+ *
+ * A point is on the shape when its distance from the outline is within the
+ * rasterization threshold. Circles are rasterized by the interactive
+ * program's CircleRasterizer. For ellipses the distance is the first-order
+ * estimate |q - 1| / |grad q|, where q is the point's normalized radius
+ * (1 on the outline), which is exactly |d - r| for circles.
+ */
+class Annulus {
+private:
+    Shape shape;
+    RuntimeRasterParams params;
+    double cosAngle, sinAngle;
+
+public:
+    int minRow, maxRow, minCol, maxCol;  // Empty when minRow > maxRow
+
+    Annulus(const Shape& shape, int gridSize, double threshold) : shape(shape) {
+        params.gridSize = gridSize;
+        params.distance = threshold;
+        double radians = shape.angle * PI / 180.0;
+        cosAngle = std::cos(radians);
+        sinAngle = std::sin(radians);
+
+        if (!(shape.radiusX > 0.0 && shape.radiusY > 0.0)) {
+            minRow = minCol = 0;
+            maxRow = maxCol = -1;
+            return;
+        }
+
+        // Half extents of the rotated ellipse, widened by the threshold
+        double a = shape.radiusX, b = shape.radiusY;
+        double extentX = std::sqrt(a * a * cosAngle * cosAngle + b * b * sinAngle * sinAngle) + threshold;
+        double extentY = std::sqrt(a * a * sinAngle * sinAngle + b * b * cosAngle * cosAngle) + threshold;
+        minRow = std::max(0, static_cast<int>(std::floor(shape.cy - extentY)));
+        maxRow = std::min(gridSize - 1, static_cast<int>(std::ceil(shape.cy + extentY)));
+        minCol = std::max(0, static_cast<int>(std::floor(shape.cx - extentX)));
+        maxCol = std::min(gridSize - 1, static_cast<int>(std::ceil(shape.cx + extentX)));
+    }
+
+    bool contains(int row, int col) const {
+        if (row < minRow || row > maxRow || col < minCol || col > maxCol) {
+            return false;
+        }
+        // Grid point (row, col) sits at grid position (col, row)
+        double dx = col - shape.cx, dy = row - shape.cy;
+        double u = dx * cosAngle + dy * sinAngle;
+        double v = -dx * sinAngle + dy * cosAngle;
+        double a2 = shape.radiusX * shape.radiusX, b2 = shape.radiusY * shape.radiusY;
+        double q = std::sqrt(u * u / a2 + v * v / b2);
+        if (q == 0.0) {
+            return std::min(shape.radiusX, shape.radiusY) <= params.threshold();
+        }
+        double gradient = std::sqrt(u * u / (a2 * a2) + v * v / (b2 * b2)) / q;
+        return std::abs(q - 1.0) <= params.threshold() * gradient;
+    }
+
+    /**
+     * Call visit(row, col) for every grid point on the shape; all of them
+     * lie within the bounds.
+     */
+    template <typename Visitor>
+    void forEachPoint(Visitor visit) const {
+        if (minRow > maxRow || minCol > maxCol) {
+            return;
+        }
+        if (shape.radiusX == shape.radiusY) {
+            Circle circle(shape.cx, shape.cy, shape.radiusX);
+            CircleRasterizer::forEachPointNearWith(params, circle, visit);
+            return;
+        }
+        Morton::forEachCellTiled(minRow, maxRow, minCol, maxCol, [&](int row, int col) {
+            if (contains(row, col)) {
+                visit(row, col);
+            }
+        });
+    }
+};
+
+/**
+ * Software framebuffer stored directly in the output's pixel format:
+ * planar Y, U, V (BT.601, limited range) for Y4M, packed RGB for PPM.
+ */
+class Framebuffer {
+public:
+    struct Color {
+        uint8_t c[3];
+    };
+
+private:
+    int frameWidth;
+    int frameHeight;
+    bool planar;
+    std::vector<uint8_t> pixels;
+
+public:
+    Framebuffer(int width, int height, bool yuv)
+        : frameWidth(width), frameHeight(height), planar(yuv),
+          pixels(static_cast<size_t>(width) * height * 3) {}
+
+    int width() const { return frameWidth; }
+    int height() const { return frameHeight; }
+    const std::vector<uint8_t>& data() const { return pixels; }
+
+    Color color(int r, int g, int b) const {
+        Color color;
+        if (planar) {
+            color.c[0] = static_cast<uint8_t>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+            color.c[1] = static_cast<uint8_t>(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+            color.c[2] = static_cast<uint8_t>(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+        } else {
+            color.c[0] = static_cast<uint8_t>(r);
+            color.c[1] = static_cast<uint8_t>(g);
+            color.c[2] = static_cast<uint8_t>(b);
+        }
+        return color;
+    }
+
+    void fill(const Color& color) {
+        size_t count = static_cast<size_t>(frameWidth) * frameHeight;
+        if (planar) {
+            for (int k = 0; k < 3; ++k) {
+                std::memset(&pixels[k * count], color.c[k], count);
+            }
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                std::memcpy(&pixels[3 * i], color.c, 3);
+            }
+        }
+    }
+
+    void set(int x, int y, const Color& color) {
+        size_t i = static_cast<size_t>(y) * frameWidth + x;
+        if (planar) {
+            size_t plane = static_cast<size_t>(frameWidth) * frameHeight;
+            pixels[i] = color.c[0];
+            pixels[plane + i] = color.c[1];
+            pixels[2 * plane + i] = color.c[2];
+        } else {
+            std::memcpy(&pixels[3 * i], color.c, 3);
+        }
+    }
+};
+
+/**
+ * Streams frames to a file from a background thread. Two buffers alternate:
+ * the renderer fills one while the thread writes the other, and submit()
+ * only waits when the writer has fallen a whole frame behind.
+ */
+class FrameWriter {
+private:
+    std::FILE* file;
+    std::string frameHeader;
+    std::vector<uint8_t> buffers[2];
+    bool full[2];
+    int nextBuffer;    // Buffer the renderer fills next
+    bool closing;
+    bool failed;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+
+    void run() {
+        int current = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            changed.wait(lock, [&] { return full[current] || closing; });
+            if (!full[current]) {
+                return;
+            }
+            lock.unlock();
+            const std::vector<uint8_t>& frame = buffers[current];
+            bool ok = std::fwrite(frameHeader.data(), 1, frameHeader.size(), file) == frameHeader.size() &&
+                      std::fwrite(frame.data(), 1, frame.size(), file) == frame.size();
+            lock.lock();
+            failed = failed || !ok;
+            full[current] = false;
+            changed.notify_all();
+            current ^= 1;
+        }
+    }
+
+public:
+    FrameWriter(std::FILE* file, size_t frameBytes, const std::string& frameHeader)
+        : file(file), frameHeader(frameHeader), nextBuffer(0), closing(false), failed(false) {
+        for (int k = 0; k < 2; ++k) {
+            buffers[k].resize(frameBytes);
+            full[k] = false;
+        }
+        thread = std::thread(&FrameWriter::run, this);
+    }
+
+    ~FrameWriter() {
+        finish();
+    }
+
+    void submit(const std::vector<uint8_t>& frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !full[nextBuffer]; });
+        lock.unlock();
+        std::memcpy(buffers[nextBuffer].data(), frame.data(), frame.size());
+        lock.lock();
+        full[nextBuffer] = true;
+        nextBuffer ^= 1;
+        changed.notify_all();
+    }
+
+    /**
+     * Write the remaining frames and stop the thread.
+     * @return false if any write failed
+     */
+    bool finish() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closing = true;
+            }
+            changed.notify_all();
+            thread.join();
+        }
+        return !failed;
+    }
+};
+
+/**
+ * Renders the grid into a persistent framebuffer, repainting only the
+ * points whose membership changed since the previous frame.
+ */
+class Animator {
+private:
+    int gridSize;
+    int cellSize;
+    double threshold;
+    Framebuffer framebuffer;
+    TiledBitset shown;                          // Points drawn highlighted
+    TiledBitset onShape;                        // Points on the frame's shape; clear between frames
+    std::vector<std::pair<int, int> > dot;      // Pixel offsets of a point's disc
+    Framebuffer::Color pointColor;
+    Framebuffer::Color highlightColor;
+    int lastMinRow, lastMaxRow, lastMinCol, lastMaxCol;
+    size_t repaintCount;
+
+    Framebuffer::Color toColor(COLORREF color) const {
+        return framebuffer.color(GetRValue(color), GetGValue(color), GetBValue(color));
+    }
+
+    void paintPoint(int row, int col, const Framebuffer::Color& color) {
+        int x = col * cellSize + cellSize / 2;
+        int y = row * cellSize + cellSize / 2;
+        for (size_t k = 0; k < dot.size(); ++k) {
+            framebuffer.set(x + dot[k].first, y + dot[k].second, color);
+        }
+    }
+
+public:
+    Animator(int gridSize, int cellSize, double threshold, bool yuv)
+        : gridSize(gridSize), cellSize(cellSize), threshold(threshold),
+          framebuffer(gridSize * cellSize, gridSize * cellSize, yuv),
+          shown(gridSize, gridSize, TiledBitset::Layout::ZOrder),
+          onShape(gridSize, gridSize, TiledBitset::Layout::ZOrder),
+          lastMinRow(0), lastMaxRow(-1), lastMinCol(0), lastMaxCol(-1), repaintCount(0) {
+        // Same colors as the interactive program
+        const Settings& settings = Settings::current();
+        pointColor = toColor(settings.pointColor);
+        highlightColor = toColor(settings.highlightColor);
+
+        int radius = std::max(1, cellSize / 10);
+        for (int dy = -radius; dy <= radius; ++dy) {
+            for (int dx = -radius; dx <= radius; ++dx) {
+                if (dx * dx + dy * dy <= radius * radius) {
+                    dot.push_back(std::make_pair(dx, dy));
+                }
+            }
+        }
+
+        framebuffer.fill(toColor(settings.backgroundColor));
+        for (int row = 0; row < gridSize; ++row) {
+            for (int col = 0; col < gridSize; ++col) {
+                paintPoint(row, col, pointColor);
+            }
+        }
+    }
+
+    const Framebuffer& frame() const { return framebuffer; }
+
+    /**
+     * Total points repainted so far.
+     */
+    size_t repainted() const { return repaintCount; }
+
+    /**
+     * Update the framebuffer to show a shape. Every point drawn highlighted
+     * lies within the previous shape's bounding box, so only the union of
+     * the two boxes is examined.
+     */
+    void render(const Shape& shape) {
+        Annulus annulus(shape, gridSize, threshold);
+        annulus.forEachPoint([&](int row, int col) {
+            onShape.set(row, col, true);
+        });
+
+        int minRow = std::min(lastMinRow, annulus.minRow), maxRow = std::max(lastMaxRow, annulus.maxRow);
+        int minCol = std::min(lastMinCol, annulus.minCol), maxCol = std::max(lastMaxCol, annulus.maxCol);
+        if (lastMinRow > lastMaxRow) {
+            minRow = annulus.minRow;
+            maxRow = annulus.maxRow;
+            minCol = annulus.minCol;
+            maxCol = annulus.maxCol;
+        }
+
+        if (minRow <= maxRow && minCol <= maxCol) {
+            Morton::forEachCellTiled(minRow, maxRow, minCol, maxCol, [&](int row, int col) {
+                bool on = onShape.get(row, col);
+                onShape.set(row, col, false);
+                if (on != shown.get(row, col)) {
+                    shown.set(row, col, on);
+                    paintPoint(row, col, on ? highlightColor : pointColor);
+                    ++repaintCount;
+                }
+            });
+        }
+
+        lastMinRow = annulus.minRow;
+        lastMaxRow = annulus.maxRow;
+        lastMinCol = annulus.minCol;
+        lastMaxCol = annulus.maxCol;
+    }
+};
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: Animate keyframes.txt output(.y4m|.ppm) [-grid N] [-cell PIXELS] [-fps N]\n"
+                 "               [-threshold T] [-config settings.cfg]\n");
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    // The settings file comes first, so -grid and -threshold override it
+    std::string configPath = Config::SETTINGS_FILE;
+    bool configGiven = false;
+    for (int k = 1; k + 1 < argc; ++k) {
+        if (std::string(argv[k]) == "-config") {
+            configPath = argv[k + 1];
+            configGiven = true;
+        }
+    }
+    Settings& settings = Settings::current();
+    std::string error;
+    if (!settings.loadFile(configPath, !configGiven, error)) {
+        std::fprintf(stderr, "Animate: %s\n", error.c_str());
+        return 1;
+    }
+
+    int cellSize = 40;
+    int fps = 60;
+    std::vector<const char*> paths;
+    for (int k = 1; k < argc; ++k) {
+        std::string arg = argv[k];
+        if ((arg == "-grid" || arg == "-threshold") && k + 1 < argc) {
+            if (!settings.set(arg.substr(1), argv[++k], error)) {
+                std::fprintf(stderr, "Animate: %s\n", error.c_str());
+                return 1;
+            }
+        } else if (arg == "-config" && k + 1 < argc) {
+            ++k;
+        } else if (arg == "-cell" && k + 1 < argc) {
+            cellSize = std::atoi(argv[++k]);
+        } else if (arg == "-fps" && k + 1 < argc) {
+            fps = std::atoi(argv[++k]);
+        } else {
+            paths.push_back(argv[k]);
+        }
+    }
+    if (paths.size() != 2 || cellSize < 2 || fps < 1) {
+        usage();
+        return 1;
+    }
+
+    std::vector<Keyframe> keys;
+    if (!loadKeyframes(paths[0], keys, error)) {
+        std::fprintf(stderr, "Animate: %s\n", error.c_str());
+        return 1;
+    }
+
+    std::FILE* file = std::fopen(paths[1], "wb");
+    if (!file) {
+        std::fprintf(stderr, "Animate: cannot create %s\n", paths[1]);
+        return 1;
+    }
+
+    bool yuv = endsWith(paths[1], ".y4m");
+    Animator animator(settings.gridSize, cellSize, settings.threshold, yuv);
+    const Framebuffer& frame = animator.frame();
+    char header[96];
+    if (yuv) {
+        std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", frame.width(), frame.height(), fps);
+        std::snprintf(header, sizeof(header), "FRAME\n");
+    } else {
+        std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", frame.width(), frame.height());
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    const int frameCount = keys.back().frame + 1;
+    bool ok;
+    {
+        FrameWriter writer(file, frame.data().size(), header);
+        size_t segment = 0;
+        for (int f = 0; f < frameCount; ++f) {
+            while (segment + 1 < keys.size() && keys[segment + 1].frame <= f) {
+                ++segment;
+            }
+            Shape shape = keys[segment].shape;
+            if (f > keys[segment].frame && segment + 1 < keys.size()) {
+                double t = static_cast<double>(f - keys[segment].frame) /
+                           (keys[segment + 1].frame - keys[segment].frame);
+                shape = Shape::lerp(keys[segment].shape, keys[segment + 1].shape, t);
+            }
+            animator.render(shape);
+            writer.submit(frame.data());
+        }
+        ok = writer.finish();
+    }
+    ok = std::fclose(file) == 0 && ok;
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (!ok) {
+        std::fprintf(stderr, "Animate: error writing %s\n", paths[1]);
+        return 1;
+    }
+    std::fprintf(stderr, "%d frames of %dx%d in %.2f s (%.0f fps), %.1f points repainted per frame\n",
+                 frameCount, frame.width(), frame.height(), seconds, frameCount / std::max(seconds, 1e-9),
+                 static_cast<double>(animator.repainted()) / frameCount);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#ifndef BATCH_TRANSFORM_H
+#define BATCH_TRANSFORM_H
+
+#include <cstddef>
+#include <cmath>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_TRANSFORM_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Kernels for converting whole arrays of coordinates at once.
+ *
+ * Coordinates are passed as separate x and y arrays (structure of arrays),
+ * so each kernel streams over contiguous doubles. The kernels use AVX2 when
+ * the CPU running the program has it, compiled with a target attribute
+ * rather than -mavx2, and a scalar loop otherwise; both paths produce
+ * identical results.
+ */
+namespace BatchTransform {
+    /**
+     * Whether the AVX2 kernels can run, checked once.
+     */
+    inline bool hasAvx2() {
+#if defined(BATCH_TRANSFORM_X86)
+        static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+        return avx2;
+#else
+        return false;
+#endif
+    }
+
+#if defined(BATCH_TRANSFORM_X86)
+    // AVX2 parts of the kernels below: they handle the whole groups of four
+    // and return how many coordinates that was
+
+    __attribute__((target("avx2")))
+    inline size_t scaleOffsetAvx2(const double* in, double* out, size_t n, double scale, double offset) {
+        size_t k = 0;
+        const __m256d vScale = _mm256_set1_pd(scale);
+        const __m256d vOffset = _mm256_set1_pd(offset);
+        for (; k + 4 <= n; k += 4) {
+            __m256d v = _mm256_loadu_pd(in + k);
+            _mm256_storeu_pd(out + k, _mm256_add_pd(_mm256_mul_pd(v, vScale), vOffset));
+        }
+        return k;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t offsetDivideAvx2(const double* in, double* out, size_t n, double offset, double divisor) {
+        size_t k = 0;
+        const __m256d vOffset = _mm256_set1_pd(offset);
+        const __m256d vDivisor = _mm256_set1_pd(divisor);
+        for (; k + 4 <= n; k += 4) {
+            __m256d v = _mm256_loadu_pd(in + k);
+            _mm256_storeu_pd(out + k, _mm256_div_pd(_mm256_sub_pd(v, vOffset), vDivisor));
+        }
+        return k;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t roundToIndicesAvx2(const double* in, int* out, size_t n,
+                                     double offset, double spacing, int count, size_t& hits) {
+        size_t k = 0;
+        const __m256d vOffset = _mm256_set1_pd(offset);
+        const __m256d vSpacing = _mm256_set1_pd(spacing);
+        const __m256d vHalf = _mm256_set1_pd(0.5);
+        const __m256d vZero = _mm256_setzero_pd();
+        const __m256d vCount = _mm256_set1_pd(count);
+        const __m256d vMiss = _mm256_set1_pd(-1.0);
+        for (; k + 4 <= n; k += 4) {
+            __m256d t = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(in + k), vOffset), vSpacing);
+            t = _mm256_floor_pd(_mm256_add_pd(t, vHalf));
+            __m256d inside = _mm256_and_pd(_mm256_cmp_pd(t, vZero, _CMP_GE_OQ),
+                                           _mm256_cmp_pd(t, vCount, _CMP_LT_OQ));
+            t = _mm256_blendv_pd(vMiss, t, inside);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k), _mm256_cvttpd_epi32(t));
+            hits += __builtin_popcount(_mm256_movemask_pd(inside));
+        }
+        return k;
+    }
+#endif
+
+    /**
+     * out[k] = in[k] * scale + offset
+     */
+    inline void scaleOffset(const double* in, double* out, size_t n, double scale, double offset) {
+        size_t k = 0;
+#if defined(BATCH_TRANSFORM_X86)
+        if (hasAvx2()) {
+            k = scaleOffsetAvx2(in, out, n, scale, offset);
+        }
+#endif
+        for (; k < n; ++k) {
+            out[k] = in[k] * scale + offset;
+        }
+    }
+    
+    /**
+     * out[k] = (in[k] - offset) / divisor
+     */
+    inline void offsetDivide(const double* in, double* out, size_t n, double offset, double divisor) {
+        size_t k = 0;
+#if defined(BATCH_TRANSFORM_X86)
+        if (hasAvx2()) {
+            k = offsetDivideAvx2(in, out, n, offset, divisor);
+        }
+#endif
+        for (; k < n; ++k) {
+            out[k] = (in[k] - offset) / divisor;
+        }
+    }
+    
+    /**
+     * Index of the nearest lattice point to each coordinate, for a lattice at
+     * offset + k * spacing with k in [0, count).
+     *
+     * Coordinates are rounded to the nearest point, not truncated; out[k] is
+     * -1 when that point is off the lattice.
+     *
+     * @return Number of coordinates that hit the lattice
+     */
+    inline size_t roundToIndices(const double* in, int* out, size_t n,
+                                 double offset, double spacing, int count) {
+        size_t hits = 0;
+        size_t k = 0;
+#if defined(BATCH_TRANSFORM_X86)
+        if (hasAvx2()) {
+            k = roundToIndicesAvx2(in, out, n, offset, spacing, count, hits);
+        }
+#endif
+        for (; k < n; ++k) {
+            double t = std::floor((in[k] - offset) / spacing + 0.5);
+            bool inside = t >= 0 && t < count;  // Also rejects NaN
+            out[k] = inside ? static_cast<int>(t) : -1;
+            hits += inside ? 1 : 0;
+        }
+        return hits;
+    }
+}
+
+#endif // BATCH_TRANSFORM_H
@@ -0,0 +1,295 @@
+#ifndef CIRCLE_BVH_H
+#define CIRCLE_BVH_H
+
+#include "Geometry.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/**
+ * Bounds of a group of circles: a box around their centers and the range
+ * of their radii. Together these bound the union of the circles' annuli
+ * from outside (centers plus the largest radius) and from inside (no ring
+ * comes closer to the centers than the smallest radius), so a query can
+ * skip a group whose rings all pass far outside or far around a point.
+ *
+ * The default bounds are empty: they hold no circle, fail every test and
+ * leave any bounds they are merged into unchanged.
+ */
+struct CircleBounds {
+    double minX, minY, maxX, maxY;   // Centers
+    double minRadius, maxRadius;
+
+    CircleBounds()
+        : minX(std::numeric_limits<double>::infinity()), minY(std::numeric_limits<double>::infinity()),
+          maxX(-std::numeric_limits<double>::infinity()), maxY(-std::numeric_limits<double>::infinity()),
+          minRadius(std::numeric_limits<double>::infinity()),
+          maxRadius(-std::numeric_limits<double>::infinity()) {}
+
+    explicit CircleBounds(const Circle& circle)
+        : minX(circle.center.x), minY(circle.center.y), maxX(circle.center.x), maxY(circle.center.y),
+          minRadius(circle.radius), maxRadius(circle.radius) {}
+
+    bool isEmpty() const {
+        return !(minX <= maxX && minY <= maxY && minRadius <= maxRadius);
+    }
+
+    void expand(const CircleBounds& other) {
+        minX = std::min(minX, other.minX);
+        minY = std::min(minY, other.minY);
+        maxX = std::max(maxX, other.maxX);
+        maxY = std::max(maxY, other.maxY);
+        minRadius = std::min(minRadius, other.minRadius);
+        maxRadius = std::max(maxRadius, other.maxRadius);
+    }
+
+    /**
+     * Smallest and largest distance from a point to the box of centers.
+     */
+    void centerDistances(const Point2D& point, double& nearest, double& farthest) const {
+        double dx = std::max(0.0, std::max(minX - point.x, point.x - maxX));
+        double dy = std::max(0.0, std::max(minY - point.y, point.y - maxY));
+        double fx = std::max(point.x - minX, maxX - point.x);
+        double fy = std::max(point.y - minY, maxY - point.y);
+        nearest = std::sqrt(dx * dx + dy * dy);
+        farthest = std::sqrt(fx * fx + fy * fy);
+    }
+
+    /**
+     * Lower bound on the distance from a point to the boundary of any circle
+     * in the group; infinite for empty bounds.
+     */
+    double boundaryDistanceBound(const Point2D& point) const {
+        if (isEmpty()) {
+            return std::numeric_limits<double>::infinity();
+        }
+        double nearest, farthest;
+        centerDistances(point, nearest, farthest);
+        return std::max(0.0, std::max(nearest - maxRadius, minRadius - farthest));
+    }
+};
+
+/**
+ * Bounding-volume hierarchy over a dynamic set of circles, identified by
+ * small non-negative ids.
+ *
+ * Nodes live in one array; the tree is built top-down by splitting the
+ * circles at the median of whichever of center x, center y and radius
+ * varies most, so rings of very different sizes end up in different
+ * subtrees. The two children of a node are stored next to each other.
+ *
+ * Moving or removing a circle refits its leaf and the leaf's ancestors in
+ * O(log n). Circles added since the last build wait in a short list that
+ * queries scan linearly. The tree is rebuilt once that list, or the number
+ * of refits since the last build, grows past a fraction of the circle
+ * count, which keeps every operation O(log n) amortized.
+ */
+class CircleBvh {
+private:
+    static const int LEAF_SIZE = 4;
+
+    struct Node {
+        CircleBounds bounds;
+        int first;    // Leaf: index of its first item; internal: index of its left child
+        int count;    // Leaf: number of items; internal: 0
+        int parent;   // -1 for the root
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> items;              // Ids in leaf order
+    std::vector<CircleBounds> circles;   // Current circle of every id; empty if absent
+    std::vector<int> leafOf;             // Leaf holding each id, or -1 if pending or absent
+    std::vector<int> pending;            // Ids added since the last build
+    size_t itemCount;                    // Ids with a circle
+    size_t refits;                       // Moves and removals since the last build
+
+    static double axisValue(const CircleBounds& circle, int axis) {
+        return axis == 0 ? circle.minX : (axis == 1 ? circle.minY : circle.minRadius);
+    }
+
+    void buildNode(int node, int begin, int end, int parent) {
+        nodes[node].parent = parent;
+        CircleBounds bounds;
+        for (int k = begin; k < end; ++k) {
+            bounds.expand(circles[items[k]]);
+        }
+        nodes[node].bounds = bounds;
+
+        if (end - begin <= LEAF_SIZE) {
+            nodes[node].first = begin;
+            nodes[node].count = end - begin;
+            for (int k = begin; k < end; ++k) {
+                leafOf[items[k]] = node;
+            }
+            return;
+        }
+
+        double extents[3] = {bounds.maxX - bounds.minX, bounds.maxY - bounds.minY,
+                             bounds.maxRadius - bounds.minRadius};
+        int axis = static_cast<int>(std::max_element(extents, extents + 3) - extents);
+        int mid = begin + (end - begin) / 2;
+        const std::vector<CircleBounds>& all = circles;
+        std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+                         [&all, axis](int a, int b) {
+                             return axisValue(all[a], axis) < axisValue(all[b], axis);
+                         });
+
+        int left = static_cast<int>(nodes.size());
+        nodes.resize(nodes.size() + 2);
+        nodes[node].first = left;
+        nodes[node].count = 0;
+        buildNode(left, begin, mid, node);
+        buildNode(left + 1, mid, end, node);
+    }
+
+    /**
+     * Recompute a leaf's bounds from its circles, then its ancestors' bounds.
+     */
+    void refit(int leaf) {
+        CircleBounds bounds;
+        for (int k = nodes[leaf].first; k < nodes[leaf].first + nodes[leaf].count; ++k) {
+            bounds.expand(circles[items[k]]);
+        }
+        nodes[leaf].bounds = bounds;
+        for (int node = nodes[leaf].parent; node >= 0; node = nodes[node].parent) {
+            CircleBounds merged = nodes[nodes[node].first].bounds;
+            merged.expand(nodes[nodes[node].first + 1].bounds);
+            nodes[node].bounds = merged;
+        }
+
+        if (++refits > std::max<size_t>(64, itemCount)) {
+            build();
+        }
+    }
+
+public:
+    CircleBvh() : itemCount(0), refits(0) {}
+
+    size_t size() const { return itemCount; }
+
+    void clear() {
+        nodes.clear();
+        items.clear();
+        circles.clear();
+        leafOf.clear();
+        pending.clear();
+        itemCount = 0;
+        refits = 0;
+    }
+
+    /**
+     * Rebuild the tree over every current circle.
+     */
+    void build() {
+        items.clear();
+        for (size_t id = 0; id < circles.size(); ++id) {
+            leafOf[id] = -1;
+            if (!circles[id].isEmpty()) {
+                items.push_back(static_cast<int>(id));
+            }
+        }
+        pending.clear();
+        refits = 0;
+
+        nodes.clear();
+        if (items.empty()) {
+            return;
+        }
+        nodes.reserve(2 * (items.size() / LEAF_SIZE + 1));
+        nodes.resize(1);
+        buildNode(0, 0, static_cast<int>(items.size()), -1);
+    }
+
+    /**
+     * Replace every circle at once: id k gets all[k], and ids with empty
+     * bounds are absent.
+     */
+    void build(const std::vector<CircleBounds>& all) {
+        circles = all;
+        leafOf.assign(circles.size(), -1);
+        itemCount = 0;
+        for (size_t id = 0; id < circles.size(); ++id) {
+            itemCount += circles[id].isEmpty() ? 0 : 1;
+        }
+        build();
+    }
+
+    void insert(int id, const Circle& circle) {
+        if (static_cast<size_t>(id) >= circles.size()) {
+            circles.resize(id + 1);
+            leafOf.resize(id + 1, -1);
+        }
+        if (!circles[id].isEmpty()) {
+            update(id, circle);
+            return;
+        }
+        circles[id] = CircleBounds(circle);
+        ++itemCount;
+        pending.push_back(id);
+        if (pending.size() > std::max<size_t>(32, itemCount / 16)) {
+            build();
+        }
+    }
+
+    void update(int id, const Circle& circle) {
+        circles[id] = CircleBounds(circle);
+        if (leafOf[id] >= 0) {
+            refit(leafOf[id]);
+        }
+    }
+
+    void remove(int id) {
+        if (static_cast<size_t>(id) >= circles.size() || circles[id].isEmpty()) {
+            return;
+        }
+        circles[id] = CircleBounds();
+        --itemCount;
+        if (leafOf[id] >= 0) {
+            refit(leafOf[id]);
+        } else {
+            pending.erase(std::find(pending.begin(), pending.end(), id));
+        }
+    }
+
+    /**
+     * Call visit(id) for every circle whose own bounds, and whose subtrees'
+     * bounds, pass mayMatch(const CircleBounds&). The test must be
+     * conservative: if it rejects a group's bounds, it must reject every
+     * circle in the group.
+     */
+    template <typename Test, typename Visitor>
+    void query(Test mayMatch, Visitor visit) const {
+        for (size_t k = 0; k < pending.size(); ++k) {
+            if (mayMatch(circles[pending[k]])) {
+                visit(pending[k]);
+            }
+        }
+        if (nodes.empty()) {
+            return;
+        }
+
+        int stack[128];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (node.bounds.isEmpty() || !mayMatch(node.bounds)) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (int k = node.first; k < node.first + node.count; ++k) {
+                    if (!circles[items[k]].isEmpty() && mayMatch(circles[items[k]])) {
+                        visit(items[k]);
+                    }
+                }
+            } else {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+    }
+};
+
+#endif // CIRCLE_BVH_H
@@ -0,0 +1,434 @@
+#ifndef CIRCLE_SCENE_H
+#define CIRCLE_SCENE_H
+
+#include "Config.h"
+#include "Settings.h"
+#include "Geometry.h"
+#include "Grid.h"
+#include "Rasterizer.h"
+#include "CircleBvh.h"
+#include "RadiusSweep.h"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+/**
+ * Copy-on-write array of circles, stored in fixed-size chunks.
+ *
+ * Like TiledBitset, copying the array only copies a pointer to its chunk
+ * table; the first edit after a copy duplicates the table and the chunk it
+ * touches. Undo snapshots of a scene with many circles therefore cost
+ * memory proportional to the circles edited.
+ *
+ * Slots are never reused: a removed circle leaves a dead slot, so ids stay
+ * valid across snapshots.
+ */
+class CircleStore {
+private:
+    static const size_t CHUNK_SIZE = 1024;
+
+    struct Slot {
+        Circle circle;
+        bool alive;
+
+        Slot() : alive(false) {}
+    };
+    typedef std::vector<Slot> Chunk;
+    typedef std::vector<std::shared_ptr<Chunk> > ChunkTable;
+
+    std::shared_ptr<ChunkTable> table;
+    size_t slotCount;
+    size_t aliveCount;
+
+    Slot& mutableSlot(size_t id) {
+        if (!table.unique()) {
+            table = std::make_shared<ChunkTable>(*table);
+        }
+        std::shared_ptr<Chunk>& chunk = (*table)[id / CHUNK_SIZE];
+        if (!chunk.unique()) {
+            chunk = std::make_shared<Chunk>(*chunk);
+        }
+        return (*chunk)[id % CHUNK_SIZE];
+    }
+
+    const Slot& slot(size_t id) const {
+        return (*(*table)[id / CHUNK_SIZE])[id % CHUNK_SIZE];
+    }
+
+public:
+    CircleStore() : table(std::make_shared<ChunkTable>()), slotCount(0), aliveCount(0) {}
+
+    /**
+     * Number of slots ever used; ids are below this.
+     */
+    size_t slots() const { return slotCount; }
+
+    /**
+     * Number of circles currently in the store.
+     */
+    size_t size() const { return aliveCount; }
+
+    bool contains(int id) const {
+        return id >= 0 && static_cast<size_t>(id) < slotCount && slot(id).alive;
+    }
+
+    const Circle& get(int id) const {
+        return slot(id).circle;
+    }
+
+    int add(const Circle& circle) {
+        if (slotCount % CHUNK_SIZE == 0) {
+            if (!table.unique()) {
+                table = std::make_shared<ChunkTable>(*table);
+            }
+            table->push_back(std::make_shared<Chunk>(CHUNK_SIZE));
+        }
+        int id = static_cast<int>(slotCount++);
+        Slot& added = mutableSlot(id);
+        added.circle = circle;
+        added.alive = true;
+        ++aliveCount;
+        return id;
+    }
+
+    void set(int id, const Circle& circle) {
+        mutableSlot(id).circle = circle;
+    }
+
+    void remove(int id) {
+        mutableSlot(id).alive = false;
+        --aliveCount;
+    }
+};
+
+/**
+ * Copy-on-write grid of per-point counts, stored in square tiles.
+ *
+ * Copies share the tile table until one of them is edited, as in
+ * CircleStore, and tiles no count was ever raised in are not allocated.
+ * Undo snapshots therefore cost memory proportional to the tiles edited,
+ * not to the grid.
+ */
+class CoverageCounts {
+private:
+    static const int TILE_SHIFT = 6;  // 64 x 64 counts per tile
+    static const int TILE_SIZE = 1 << TILE_SHIFT;
+
+    typedef std::vector<uint32_t> Tile;
+    typedef std::vector<std::shared_ptr<Tile> > TileTable;  // Null tiles are all zero
+
+    std::shared_ptr<TileTable> table;
+    int tilesPerRow;
+
+    size_t tileIndex(int row, int col) const {
+        return static_cast<size_t>(row >> TILE_SHIFT) * tilesPerRow + (col >> TILE_SHIFT);
+    }
+
+    static size_t offset(int row, int col) {
+        return static_cast<size_t>(row & (TILE_SIZE - 1)) * TILE_SIZE + (col & (TILE_SIZE - 1));
+    }
+
+public:
+    explicit CoverageCounts(int gridSize = 0)
+        : tilesPerRow((gridSize + TILE_SIZE - 1) / TILE_SIZE) {
+        table = std::make_shared<TileTable>(static_cast<size_t>(tilesPerRow) * tilesPerRow);
+    }
+
+    uint32_t get(int row, int col) const {
+        const std::shared_ptr<Tile>& tile = (*table)[tileIndex(row, col)];
+        return tile ? (*tile)[offset(row, col)] : 0;
+    }
+
+    /**
+     * Count of one point for writing; copies the table and the tile first
+     * if a snapshot still shares them.
+     */
+    uint32_t& at(int row, int col) {
+        if (!table.unique()) {
+            table = std::make_shared<TileTable>(*table);
+        }
+        std::shared_ptr<Tile>& tile = (*table)[tileIndex(row, col)];
+        if (!tile) {
+            tile = std::make_shared<Tile>(TILE_SIZE * TILE_SIZE, 0);
+        } else if (!tile.unique()) {
+            tile = std::make_shared<Tile>(*tile);
+        }
+        return (*tile)[offset(row, col)];
+    }
+
+    /**
+     * Set every count to zero.
+     */
+    void clear() {
+        table = std::make_shared<TileTable>(table->size());
+    }
+};
+
+/**
+ * A scene of many persistent circles rasterized onto one grid.
+ *
+ * The grid's highlights are the union of every circle's rasterization. Each
+ * grid point keeps a count of the circles that cover it, so adding, moving
+ * or removing a circle re-rasterizes only that circle: points whose count
+ * goes from 0 to 1 are highlighted and points whose count drops to 0 are
+ * cleared, whatever else overlaps them.
+ *
+ * A bounding-volume hierarchy over the circles' annuli (the circle widened
+ * by the rasterization threshold on both sides) answers hit tests and
+ * overlap queries without scanning every circle; see CircleBvh. Snapshots
+ * share it like the circles and counts, and the first edit after a
+ * snapshot copies it, so undo never rebuilds it.
+ */
+class CircleScene {
+public:
+    /**
+     * Everything needed to restore the scene. Copying it is O(1): the
+     * circles and the counts share their chunks and tiles with the scene,
+     * and the hierarchy is shared whole.
+     */
+    struct Snapshot {
+        CircleStore circles;
+        CoverageCounts coverage;
+        std::shared_ptr<CircleBvh> bvh;
+    };
+
+private:
+    int gridSize;
+    CircleStore circles;
+    CoverageCounts coverage;  // Circles covering each grid point
+    std::shared_ptr<CircleBvh> bvh;  // Shared with snapshots until edited
+
+    /**
+     * Add (delta = 1) or remove (delta = -1) one circle's cover of a point.
+     */
+    void adjust(Grid& grid, int row, int col, int delta) {
+        uint32_t& count = coverage.at(row, col);
+        if (delta > 0) {
+            if (count++ == 0) {
+                grid.setHighlighted(row, col, true);
+            }
+        } else if (count > 0 && --count == 0) {
+            // A count already at zero means the circle is removed from a
+            // point it never covered (counts built with another threshold);
+            // wrapping it would highlight the point for good
+            grid.setHighlighted(row, col, false);
+        }
+    }
+
+    /**
+     * The hierarchy for writing; copies it first if a snapshot shares it.
+     */
+    CircleBvh& mutableBvh() {
+        if (!bvh.unique()) {
+            bvh = std::make_shared<CircleBvh>(*bvh);
+        }
+        return *bvh;
+    }
+
+    /**
+     * Add (delta = 1) or remove (delta = -1) one circle's points from the union.
+     */
+    void cover(Grid& grid, const Circle& circle, int delta) {
+        CircleRasterizer::forEachPointNear(gridSize, circle, [&](int row, int col) {
+            adjust(grid, row, col, delta);
+        });
+    }
+
+    void rebuildHierarchy() {
+        std::vector<CircleBounds> bounds(circles.slots());
+        for (size_t id = 0; id < bounds.size(); ++id) {
+            if (circles.contains(static_cast<int>(id))) {
+                bounds[id] = CircleBounds(circles.get(static_cast<int>(id)));
+            }
+        }
+        mutableBvh().build(bounds);
+    }
+
+public:
+    explicit CircleScene(int gridSize)
+        : gridSize(gridSize), coverage(gridSize), bvh(std::make_shared<CircleBvh>()) {}
+
+    size_t size() const { return circles.size(); }
+
+    bool contains(int id) const { return circles.contains(id); }
+
+    const Circle& get(int id) const { return circles.get(id); }
+
+    /**
+     * Add a circle and rasterize it into the grid.
+     * @return Id of the new circle
+     */
+    int add(Grid& grid, const Circle& circle) {
+        int id = circles.add(circle);
+        mutableBvh().insert(id, circle);
+        cover(grid, circle, 1);
+        return id;
+    }
+
+    /**
+     * Add many circles at once, building the hierarchy once at the end.
+     */
+    void addAll(Grid& grid, const std::vector<Circle>& added) {
+        for (size_t k = 0; k < added.size(); ++k) {
+            cover(grid, added[k], 1);
+            circles.add(added[k]);
+        }
+        rebuildHierarchy();
+    }
+    
+    /**
+     * Add circles whose union the grid already highlights, e.g. restored
+     * from a session with its highlights: only the counts are rebuilt.
+     */
+    void adoptAll(const std::vector<Circle>& adopted) {
+        for (size_t k = 0; k < adopted.size(); ++k) {
+            CircleRasterizer::forEachPointNear(gridSize, adopted[k], [&](int row, int col) {
+                ++coverage.at(row, col);
+            });
+            circles.add(adopted[k]);
+        }
+        rebuildHierarchy();
+    }
+
+    /**
+     * Replace a circle (move or resize it), re-rasterizing only that circle.
+     */
+    void move(Grid& grid, int id, const Circle& circle) {
+        cover(grid, circles.get(id), -1);
+        circles.set(id, circle);
+        mutableBvh().update(id, circle);
+        cover(grid, circle, 1);
+    }
+
+    /**
+     * Change a circle's radius, updating only the points that enter or
+     * leave its annulus. The sweep must be centered on the circle and
+     * positioned at its current radius; it is left at the new one.
+     *
+     * @param radius New radius, positive and at most the sweep's limit
+     */
+    void resize(Grid& grid, int id, RadiusSweep& sweep, double radius) {
+        sweep.advance(radius, [&](int row, int col, bool entered) {
+            adjust(grid, row, col, entered ? 1 : -1);
+        });
+        Circle resized(circles.get(id).center, sweep.radius());
+        circles.set(id, resized);
+        mutableBvh().update(id, resized);
+    }
+
+    void remove(Grid& grid, int id) {
+        cover(grid, circles.get(id), -1);
+        circles.remove(id);
+        mutableBvh().remove(id);
+    }
+
+    /**
+     * Remove every circle and clear the grid's highlights.
+     */
+    void clear(Grid& grid) {
+        circles = CircleStore();
+        coverage.clear();
+        bvh = std::make_shared<CircleBvh>();
+        grid.resetHighlights();
+    }
+
+    /**
+     * The circle whose boundary is closest to a point, if within tolerance.
+     *
+     * @param point Point in grid space
+     * @param tolerance Largest distance from the boundary, in grid units
+     * @return Id of the circle, or -1 if none is close enough
+     */
+    int pick(const Point2D& point, double tolerance) const {
+        int best = -1;
+        double bestDistance = tolerance;
+        bvh->query([&](const CircleBounds& bounds) {
+            return bounds.boundaryDistanceBound(point) <= bestDistance;
+        }, [&](int id) {
+            double distance = circles.get(id).distanceFromBoundary(point);
+            if (distance <= bestDistance) {
+                best = id;
+                bestDistance = distance;
+            }
+        });
+        return best;
+    }
+
+    /**
+     * Call visit(id) for every circle whose rasterized annulus can overlap
+     * the given circle's, i.e. that may share highlighted points with it.
+     */
+    template <typename Visitor>
+    void forEachOverlapping(const Circle& circle, Visitor visit) const {
+        // Annuli [a1, b1] and [a2, b2] around centers d apart intersect iff
+        // max(a1 - b2, a2 - b1) <= d <= b1 + b2. For a group, d ranges over
+        // the distances to its centers and [a2, b2] over its radii.
+        const double t = Settings::current().threshold;
+        const double a1 = circle.radius - t, b1 = circle.radius + t;
+        bvh->query([&](const CircleBounds& bounds) {
+            double nearest, farthest;
+            bounds.centerDistances(circle.center, nearest, farthest);
+            double a2 = bounds.minRadius - t, b2 = bounds.maxRadius + t;
+            return nearest <= b1 + b2 && std::max(a1 - b2, a2 - b1) <= farthest;
+        }, visit);
+    }
+    
+    /**
+     * Call visit(id, circle) for every circle in the scene.
+     */
+    template <typename Visitor>
+    void forEach(Visitor visit) const {
+        for (size_t id = 0; id < circles.slots(); ++id) {
+            if (circles.contains(static_cast<int>(id))) {
+                visit(static_cast<int>(id), circles.get(static_cast<int>(id)));
+            }
+        }
+    }
+
+    /**
+     * Inner and outer bounds of one circle's own rasterized points, about
+     * its center. Other circles' points in the union are not considered.
+     *
+     * @return false if the circle highlights no points
+     */
+    bool boundingCircles(int id, Circle& innerCircle, Circle& outerCircle) const {
+        const Circle& circle = circles.get(id);
+        double minDistance = std::numeric_limits<double>::max();
+        double maxDistance = 0.0;
+        bool hasPoints = false;
+        CircleRasterizer::forEachPointNear(gridSize, circle, [&](int row, int col) {
+            double dist = circle.center.distanceTo(Point2D(col, row));
+            minDistance = std::min(minDistance, dist);
+            maxDistance = std::max(maxDistance, dist);
+            hasPoints = true;
+        });
+        if (!hasPoints) {
+            return false;
+        }
+        innerCircle = Circle(circle.center, minDistance);
+        outerCircle = Circle(circle.center, maxDistance);
+        return true;
+    }
+
+    Snapshot snapshot() const {
+        Snapshot state;
+        state.circles = circles;
+        state.coverage = coverage;
+        state.bvh = bvh;
+        return state;
+    }
+
+    /**
+     * Restore a snapshot in O(1). The grid's highlights must be restored to
+     * the matching snapshot separately.
+     */
+    void restore(const Snapshot& state) {
+        circles = state.circles;
+        coverage = state.coverage;
+        bvh = state.bvh ? state.bvh : std::make_shared<CircleBvh>();
+    }
+};
+
+#endif // CIRCLE_SCENE_H
@@ -21,6 +21,9 @@ namespace Config {
     constexpr int WINDOW_HEIGHT = 800;               
     constexpr int GRID_PADDING = 50;                 
     
+    // Store highlight bits in Z-order 8x8 blocks rather than row-major words
+    constexpr bool Z_ORDER_BITS = true;
+    
     // Visual Configuration
     constexpr int POINT_RADIUS = 4;                  
     constexpr int CIRCLE_THICK_WIDTH = 3;            
@@ -32,12 +35,28 @@ namespace Config {
     constexpr COLORREF COL_RED = RGB(255, 0, 0);           
     constexpr COLORREF COL_BACKGROUND = RGB(255, 255, 255); 
     constexpr COLORREF COL_PREVIEW = RGB(150, 150, 255);   
+    constexpr COLORREF COL_SCENE_CIRCLE = RGB(170, 170, 170);  // Unselected circles
     
     // Algorithm Configuration
     // Threshold for determining if a point is "nearest" to the circle boundary
     // A point is considered on the circle if its distance from the circle boundary
     // is within RASTERIZATION_THRESHOLD units in grid space
     constexpr double RASTERIZATION_THRESHOLD = 0.7071;  // sqrt(2)/2 for diagonal neighbors
+    
+    // Scene of circles
+    constexpr double PICK_TOLERANCE = 6.0;           // Pixels from a circle's outline that select it
+    constexpr double RADIUS_STEP = 0.25;             // Grid units per mouse wheel notch
+    constexpr int MAX_DRAWN_CIRCLES = 2000;          // Larger scenes draw highlights only
+    
+    // Persistence
+    constexpr const char* SESSION_FILE = "Problem1.session";
+    constexpr const char* HIGHLIGHTS_SVG_FILE = "Problem1-highlights.svg";  // E key
+    constexpr const char* SETTINGS_FILE = "Problem1.cfg";  // Optional overrides, see Settings.h
+    
+    // Delta stream of highlight changes (see DeltaStream.h). The ring should
+    // hold a keyframe of the whole grid; a fuller ring drops records.
+    constexpr size_t DELTA_RING_BYTES = 1 << 20;
+    constexpr const char* DELTA_LOG_FILE = "Problem1.delta";
 }
 
 #endif // CONFIG_H
@@ -0,0 +1,556 @@
+#ifndef DELTA_STREAM_H
+#define DELTA_STREAM_H
+
+#include "TiledBitset.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+/**
+ * Compact change log of the highlights and the selected circle, for a
+ * recorder, a remote viewer or a test oracle to replay the state with
+ * bandwidth proportional to each change.
+ *
+ * Record format (integers are LEB128 varints, shape parameters raw doubles):
+ *   record = size type sequence [rows cols] shape rowCount row*
+ *   type   = 0 for a delta, 1 for a keyframe (rows and cols follow; the
+ *            state is cleared before its runs are applied)
+ *   shape  = 0 if unchanged, else 1 + parameter count, then the parameters
+ *   row    = rowGap runCount (gap ((length << 1) | set))*
+ * rowGap is the distance from the previous changed row (the first is
+ * row + 1), so it is at least 1; each gap is measured from the end of the
+ * previous run. A keyframe's rows and cols are at most MAX_SIDE.
+ */
+namespace DeltaFormat {
+    const int MAX_SHAPE_PARAMS = 8;
+    const uint64_t MAX_SIDE = 1 << 16;      // Rows or columns of a keyframe
+    const uint64_t MAX_RECORD = 1 << 30;    // Bytes of a recorded record
+
+    inline void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    /**
+     * Read a varint at data[pos], advancing pos.
+     *
+     * @return false if it runs past size
+     */
+    inline bool getVarint(const uint8_t* data, size_t size, size_t& pos, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < size; shift += 7) {
+            uint8_t byte = data[pos++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+/**
+ * Byte ring for one producer thread and one consumer thread. Each record
+ * is stored behind its varint size and published by a single release
+ * store, so the consumer only ever sees whole records. Neither side takes
+ * a lock, and the producer never waits: a record that does not fit is
+ * refused.
+ */
+class DeltaRing {
+private:
+    std::vector<uint8_t> buffer;
+    size_t mask;
+
+    // Monotonic byte counts; the producer writes head, the consumer tail.
+    // Padded apart rather than aligned, since C++11 new ignores alignas.
+    std::atomic<size_t> head;
+    size_t cachedTail;  // Producer's last view of tail
+    char padding[64];
+    std::atomic<size_t> tail;
+    size_t cachedHead;  // Consumer's last view of head
+
+    void copyIn(size_t at, const uint8_t* data, size_t n) {
+        size_t offset = at & mask;
+        size_t first = std::min(n, buffer.size() - offset);
+        std::memcpy(buffer.data() + offset, data, first);
+        std::memcpy(buffer.data(), data + first, n - first);
+    }
+
+    void copyOut(size_t at, uint8_t* data, size_t n) const {
+        size_t offset = at & mask;
+        size_t first = std::min(n, buffer.size() - offset);
+        std::memcpy(data, buffer.data() + offset, first);
+        std::memcpy(data + first, buffer.data(), n - first);
+    }
+
+public:
+    /**
+     * @param capacity Bytes, rounded up to a power of two
+     */
+    explicit DeltaRing(size_t capacity) : head(0), cachedTail(0), tail(0), cachedHead(0) {
+        size_t size = 64;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    size_t capacity() const {
+        return buffer.size();
+    }
+
+    /**
+     * Producer: append one record.
+     *
+     * @return false, at once, if it does not fit
+     */
+    bool tryPush(const uint8_t* record, size_t n) {
+        uint8_t prefix[10];
+        size_t prefixSize = 0;
+        for (uint64_t value = n; ; value >>= 7) {
+            prefix[prefixSize++] = static_cast<uint8_t>(value >= 0x80 ? (value | 0x80) : value);
+            if (value < 0x80) {
+                break;
+            }
+        }
+
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h + prefixSize + n - cachedTail > buffer.size()) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h + prefixSize + n - cachedTail > buffer.size()) {
+                return false;
+            }
+        }
+        copyIn(h, prefix, prefixSize);
+        copyIn(h + prefixSize, record, n);
+        head.store(h + prefixSize + n, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer: take the oldest record.
+     *
+     * @return false if there is none
+     */
+    bool tryPop(std::vector<uint8_t>& record) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t == cachedHead) {
+                return false;
+            }
+        }
+
+        uint64_t n = 0;
+        for (int shift = 0; ; shift += 7) {
+            uint8_t byte = buffer[t++ & mask];
+            n |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        record.resize(n);
+        copyOut(t, record.data(), n);
+        tail.store(t + n, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * Producer side of the stream. Keeps an O(1) snapshot of the bitset it
+ * last published and diffs the next one against it: tiles the two still
+ * share were not edited in between and are skipped without reading their
+ * words, so an update costs time proportional to the tiles it touched.
+ *
+ * A record the ring refuses is dropped, and the next one is a keyframe
+ * carrying the whole state.
+ */
+class DeltaEncoder {
+private:
+    DeltaRing& ring;
+    TiledBitset last;          // State as of the last record the ring took
+    double shape[DeltaFormat::MAX_SHAPE_PARAMS];
+    int shapeCount;
+    bool shapeChanged;
+    bool resync;               // Next record must be a keyframe
+    uint64_t sequence;
+    size_t droppedCount;
+    size_t keyframeCount;
+    std::vector<uint8_t> record;
+
+    /**
+     * Runs of before ^ after in row i over the given words, merged across
+     * words, appended to runs as (gap, length, set).
+     */
+    static int encodeRow(const TiledBitset& before, const TiledBitset& after, int i,
+                         const std::vector<int>& words, std::vector<uint8_t>& runs) {
+        int runCount = 0;
+        int cursor = 0;  // End of the last run written
+        int openBegin = -1, openEnd = -1;
+        bool openSet = false;
+        auto flush = [&]() {
+            if (openBegin >= 0) {
+                DeltaFormat::putVarint(runs, openBegin - cursor);
+                DeltaFormat::putVarint(runs, (static_cast<uint64_t>(openEnd - openBegin) << 1) | (openSet ? 1 : 0));
+                cursor = openEnd;
+                ++runCount;
+            }
+        };
+
+        for (size_t k = 0; k < words.size(); ++k) {
+            int w = words[k];
+            uint64_t old = before.word(i, w);
+            uint64_t now = after.word(i, w);
+            uint64_t changed = old ^ now;
+            int base = w * 64;
+            while (changed) {
+                int begin = __builtin_ctzll(changed);
+                bool set = (now >> begin) & 1;
+                uint64_t same = (set ? now : old) & changed;
+                uint64_t rest = ~(same >> begin);
+                int length = rest ? __builtin_ctzll(rest) : 64 - begin;
+                if (openEnd == base + begin && openSet == set) {
+                    openEnd += length;  // Continues a run from the previous word
+                } else {
+                    flush();
+                    openBegin = base + begin;
+                    openEnd = base + begin + length;
+                    openSet = set;
+                }
+                changed &= (begin + length == 64) ? 0 : ~0ULL << (begin + length);
+            }
+        }
+        flush();
+        return runCount;
+    }
+
+    /**
+     * Build the record of the changes from before to current.
+     *
+     * @return false if nothing changed
+     */
+    bool encode(const TiledBitset& before, const TiledBitset& current, bool keyframe) {
+        record.clear();
+        record.push_back(keyframe ? 1 : 0);
+        DeltaFormat::putVarint(record, sequence);
+        if (keyframe) {
+            DeltaFormat::putVarint(record, current.rows());
+            DeltaFormat::putVarint(record, current.cols());
+        }
+        if (shapeChanged || keyframe) {
+            record.push_back(static_cast<uint8_t>(1 + shapeCount));
+            for (int k = 0; k < shapeCount; ++k) {
+                uint8_t bytes[sizeof(double)];
+                std::memcpy(bytes, &shape[k], sizeof(double));
+                record.insert(record.end(), bytes, bytes + sizeof(double));
+            }
+        } else {
+            record.push_back(0);
+        }
+
+        std::vector<uint8_t> rows, runs;
+        std::vector<int> words;
+        int rowCount = 0;
+        int previousRow = -1;
+        const int tileBits = TiledBitset::TILE_BITS;
+        for (int top = 0; top < current.rows(); top += tileBits) {
+            words.clear();
+            for (int w = 0; w < current.wordsPerRow(); ++w) {
+                if (!current.sharesTile(before, top, w)) {
+                    words.push_back(w);  // Edited since before
+                }
+            }
+            if (words.empty()) {
+                continue;
+            }
+            int bottom = std::min(top + tileBits, current.rows());
+            for (int i = top; i < bottom; ++i) {
+                runs.clear();
+                int runCount = encodeRow(before, current, i, words, runs);
+                if (runCount == 0) {
+                    continue;
+                }
+                DeltaFormat::putVarint(rows, i - previousRow);
+                DeltaFormat::putVarint(rows, runCount);
+                rows.insert(rows.end(), runs.begin(), runs.end());
+                previousRow = i;
+                ++rowCount;
+            }
+        }
+        if (!keyframe && rowCount == 0 && !shapeChanged) {
+            return false;
+        }
+        DeltaFormat::putVarint(record, rowCount);
+        record.insert(record.end(), rows.begin(), rows.end());
+        return true;
+    }
+
+public:
+    explicit DeltaEncoder(DeltaRing& ring)
+        : ring(ring), shapeCount(0), shapeChanged(false), resync(true),
+          sequence(0), droppedCount(0), keyframeCount(0) {}
+
+    /**
+     * Shape parameters to send with the next record; count 0 for none.
+     */
+    void setShape(const double* params, int count) {
+        count = std::min(count, DeltaFormat::MAX_SHAPE_PARAMS);
+        if (count <= 0) {
+            clearShape();
+            return;
+        }
+        if (count == shapeCount && std::equal(params, params + count, shape)) {
+            return;
+        }
+        std::copy(params, params + count, shape);
+        shapeCount = count;
+        shapeChanged = true;
+    }
+
+    /**
+     * No shape to send with the next record.
+     */
+    void clearShape() {
+        shapeChanged = shapeChanged || shapeCount != 0;
+        shapeCount = 0;
+    }
+
+    /**
+     * Push the changes since the last published state, if any. Never waits.
+     *
+     * @return false if the ring was full and the record was dropped
+     */
+    bool publish(const TiledBitset& current) {
+        bool keyframe = resync;
+        if (!encode(keyframe ? TiledBitset(current.rows(), current.cols(), current.layout()) : last,
+                    current, keyframe)) {
+            return true;
+        }
+        if (!ring.tryPush(record.data(), record.size())) {
+            resync = true;
+            ++droppedCount;
+            return false;
+        }
+        if (keyframe) {
+            ++keyframeCount;
+        }
+        resync = false;
+        shapeChanged = false;
+        ++sequence;
+        last = current;  // O(1); later edits copy only the tiles they touch
+        return true;
+    }
+
+    size_t dropped() const {
+        return droppedCount;
+    }
+
+    size_t keyframes() const {
+        return keyframeCount;
+    }
+};
+
+/**
+ * Consumer side of the stream: rebuilds the state from records. After a
+ * gap in sequence numbers it ignores deltas until the next keyframe.
+ */
+class DeltaReplay {
+private:
+    TiledBitset bits;
+    std::vector<double> shape;
+    uint64_t expected;
+    bool synced;
+
+    /**
+     * apply() without touching synced on failure.
+     */
+    bool applyRecord(const uint8_t* data, size_t size) {
+        size_t pos = 0;
+        uint64_t sequence, rows = 0, cols = 0;
+        if (size < 1) {
+            return false;
+        }
+        bool keyframe = data[pos++] == 1;
+        if (!DeltaFormat::getVarint(data, size, pos, sequence)) {
+            return false;
+        }
+        if (keyframe) {
+            if (!DeltaFormat::getVarint(data, size, pos, rows) || !DeltaFormat::getVarint(data, size, pos, cols) ||
+                rows < 1 || rows > DeltaFormat::MAX_SIDE || cols < 1 || cols > DeltaFormat::MAX_SIDE) {
+                return false;
+            }
+        } else if (!synced || sequence != expected) {
+            return false;
+        }
+
+        if (pos >= size) {
+            return false;
+        }
+        int shapeTag = data[pos++];
+        if (shapeTag > DeltaFormat::MAX_SHAPE_PARAMS + 1 ||
+            (shapeTag && pos + (shapeTag - 1) * sizeof(double) > size)) {
+            return false;
+        }
+        if (keyframe) {
+            bits = TiledBitset(static_cast<int>(rows), static_cast<int>(cols));
+        }
+        if (shapeTag) {
+            shape.resize(shapeTag - 1);
+            for (size_t k = 0; k < shape.size(); ++k) {
+                std::memcpy(&shape[k], data + pos, sizeof(double));
+                pos += sizeof(double);
+            }
+        }
+
+        uint64_t rowCount;
+        if (!DeltaFormat::getVarint(data, size, pos, rowCount)) {
+            return false;
+        }
+        int64_t i = -1;
+        for (uint64_t r = 0; r < rowCount; ++r) {
+            uint64_t rowGap, runCount;
+            if (!DeltaFormat::getVarint(data, size, pos, rowGap) ||
+                !DeltaFormat::getVarint(data, size, pos, runCount) ||
+                rowGap < 1 || rowGap > DeltaFormat::MAX_SIDE) {
+                return false;
+            }
+            i += static_cast<int64_t>(rowGap);
+            int64_t cursor = 0;
+            for (uint64_t k = 0; k < runCount; ++k) {
+                uint64_t gap, lengthAndSet;
+                if (!DeltaFormat::getVarint(data, size, pos, gap) ||
+                    !DeltaFormat::getVarint(data, size, pos, lengthAndSet) ||
+                    gap > DeltaFormat::MAX_SIDE || (lengthAndSet >> 1) > DeltaFormat::MAX_SIDE) {
+                    return false;
+                }
+                int64_t begin = cursor + static_cast<int64_t>(gap);
+                int64_t end = begin + static_cast<int64_t>(lengthAndSet >> 1);
+                if (i < 0 || i >= bits.rows() || begin < 0 || end > bits.cols() || begin >= end) {
+                    return false;
+                }
+                bits.setRange(static_cast<int>(i), static_cast<int>(begin), static_cast<int>(end), lengthAndSet & 1);
+                cursor = end;
+            }
+        }
+        synced = true;
+        expected = sequence + 1;
+        return true;
+    }
+
+public:
+    DeltaReplay() : expected(0), synced(false) {}
+
+    /**
+     * Apply one record, without its size prefix. After a failure the deltas
+     * that follow are skipped until the next keyframe, since a malformed
+     * record may have been applied in part.
+     *
+     * @return false if it was skipped while waiting for a keyframe, or is
+     *         malformed
+     */
+    bool apply(const uint8_t* data, size_t size) {
+        if (!applyRecord(data, size)) {
+            synced = false;
+            return false;
+        }
+        return true;
+    }
+
+    bool isSynced() const {
+        return synced;
+    }
+
+    const TiledBitset& getBits() const {
+        return bits;
+    }
+
+    const std::vector<double>& getShape() const {
+        return shape;
+    }
+
+    /**
+     * Read the next size-prefixed record of a recorded stream.
+     */
+    static bool readRecord(FILE* file, std::vector<uint8_t>& record) {
+        uint64_t n = 0;
+        for (int shift = 0; ; shift += 7) {
+            int byte = std::fgetc(file);
+            if (byte == EOF || shift >= 64) {
+                return false;
+            }
+            n |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        if (n > DeltaFormat::MAX_RECORD) {
+            return false;
+        }
+        record.resize(n);
+        return std::fread(record.data(), 1, n, file) == n;
+    }
+};
+
+/**
+ * Consumer thread that drains a ring into a file in the same size-prefixed
+ * format, for DeltaReplay::readRecord to play back.
+ */
+class DeltaRecorder {
+private:
+    DeltaRing& ring;
+    FILE* file;
+    std::atomic<bool> running;
+    std::thread worker;
+
+    void drain() {
+        std::vector<uint8_t> record, prefix;
+        while (ring.tryPop(record)) {
+            prefix.clear();
+            DeltaFormat::putVarint(prefix, record.size());
+            std::fwrite(prefix.data(), 1, prefix.size(), file);
+            std::fwrite(record.data(), 1, record.size(), file);
+        }
+    }
+
+public:
+    /**
+     * Start recording; does nothing if the file cannot be opened.
+     */
+    DeltaRecorder(DeltaRing& ring, const char* path)
+        : ring(ring), file(std::fopen(path, "wb")), running(file != nullptr) {
+        if (file) {
+            worker = std::thread([this]() {
+                while (running.load(std::memory_order_acquire)) {
+                    drain();
+                    std::fflush(file);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+                drain();
+            });
+        }
+    }
+
+    ~DeltaRecorder() {
+        running.store(false, std::memory_order_release);
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (file) {
+            std::fclose(file);
+        }
+    }
+
+    bool isRecording() const {
+        return file != nullptr;
+    }
+};
+
+#endif // DELTA_STREAM_H
@@ -0,0 +1,259 @@
+#ifndef DISTANCE_TRANSFORM_H
+#define DISTANCE_TRANSFORM_H
+
+#include "TiledBitset.h"
+#include "TaskGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * Exact Euclidean distance transform of a TiledBitset.
+ *
+ * For every cell, the squared distance in grid units to the nearest set
+ * cell and which cell that is. Computed in linear time with the
+ * Felzenszwalb-Huttenlocher lower envelope of parabolas, separably: one 1D
+ * pass along every row, then one along every column over the row results.
+ * The rows of a pass are independent, as are the columns, so each pass is
+ * split into tasks on the shared pool.
+ *
+ * Once built, the distance from any cell to the highlights, snapping to the
+ * nearest highlighted point and Chamfer / Hausdorff comparison of two
+ * rasterizations are lookups.
+ */
+class DistanceTransform {
+private:
+    int rowCount;
+    int colCount;
+    std::vector<double> squared;    // Squared distance to the nearest set cell, row-major
+    std::vector<int> nearestCell;   // Flat index of that cell, or -1 for an empty bitset
+
+    /**
+     * Scratch space for one 1D transform.
+     */
+    struct Envelope {
+        std::vector<int> v;       // Positions of the parabolas in the lower envelope
+        std::vector<double> z;    // Boundaries between consecutive parabolas
+
+        explicit Envelope(int n) : v(n), z(n + 1) {}
+    };
+
+    /**
+     * 1D transform: d[q] = min over p of (q - p)^2 + f[p], with arg[q] the
+     * minimizing p, or -1 if every f is infinite. Infinite samples add no
+     * parabola to the envelope.
+     */
+    static void transform1D(const double* f, int n, double* d, int* arg, Envelope& env) {
+        const double inf = std::numeric_limits<double>::infinity();
+        int k = -1;
+        for (int q = 0; q < n; ++q) {
+            if (f[q] == inf) {
+                continue;
+            }
+            double s = -inf;
+            while (k >= 0) {
+                int p = env.v[k];
+                s = ((f[q] + double(q) * q) - (f[p] + double(p) * p)) / (2.0 * (q - p));
+                if (s > env.z[k]) {
+                    break;
+                }
+                --k;
+            }
+            ++k;
+            env.v[k] = q;
+            env.z[k] = (k == 0) ? -inf : s;
+            env.z[k + 1] = inf;
+        }
+
+        if (k < 0) {
+            std::fill(d, d + n, inf);
+            std::fill(arg, arg + n, -1);
+            return;
+        }
+        k = 0;
+        for (int q = 0; q < n; ++q) {
+            while (env.z[k + 1] < q) {
+                ++k;
+            }
+            int p = env.v[k];
+            d[q] = double(q - p) * (q - p) + f[p];
+            arg[q] = p;
+        }
+    }
+
+    /**
+     * Run body(begin, end) over [0, count) in one task per pool thread, on
+     * the pool rather than on threads started for the call. At least 256
+     * lines go to a task.
+     */
+    template <typename Body>
+    static void forEachChunk(int count, Body body) {
+        unsigned chunks = TaskScheduler::shared().workerCount() + 1;
+        chunks = std::min<unsigned>(chunks, count / 256 + 1);
+        if (chunks == 1) {
+            body(0, count);
+            return;
+        }
+        TaskGraph graph;
+        int chunk = static_cast<int>((count + chunks - 1) / chunks);
+        for (unsigned t = 0; t < chunks; ++t) {
+            int begin = std::min(count, static_cast<int>(t) * chunk);
+            int end = std::min(count, begin + chunk);
+            graph.add([=, &body]() { body(begin, end); });
+        }
+        graph.run();
+    }
+
+    size_t index(int row, int col) const {
+        return static_cast<size_t>(row) * colCount + col;
+    }
+
+public:
+    DistanceTransform() : rowCount(0), colCount(0) {}
+
+    explicit DistanceTransform(const TiledBitset& bits) {
+        build(bits);
+    }
+
+    /**
+     * Recompute the transform for a bitset.
+     */
+    void build(const TiledBitset& bits) {
+        const double inf = std::numeric_limits<double>::infinity();
+        rowCount = bits.rows();
+        colCount = bits.cols();
+        squared.assign(static_cast<size_t>(rowCount) * colCount, inf);
+        nearestCell.assign(static_cast<size_t>(rowCount) * colCount, -1);
+        std::vector<int> nearestCol(static_cast<size_t>(rowCount) * colCount);
+
+        // Rows: distance along the row to the nearest set cell in that row
+        forEachChunk(rowCount, [&](int begin, int end) {
+            Envelope env(colCount);
+            std::vector<double> f(colCount);
+            for (int row = begin; row < end; ++row) {
+                std::fill(f.begin(), f.end(), inf);
+                for (int w = 0; w < bits.wordsPerRow(); ++w) {
+                    for (uint64_t word = bits.word(row, w); word; word &= word - 1) {
+                        f[w * 64 + __builtin_ctzll(word)] = 0.0;
+                    }
+                }
+                transform1D(f.data(), colCount, &squared[index(row, 0)], &nearestCol[index(row, 0)], env);
+            }
+        });
+
+        // Columns: combine the row results, gathering each column contiguously
+        forEachChunk(colCount, [&](int begin, int end) {
+            Envelope env(rowCount);
+            std::vector<double> f(rowCount), d(rowCount);
+            std::vector<int> arg(rowCount);
+            for (int col = begin; col < end; ++col) {
+                for (int row = 0; row < rowCount; ++row) {
+                    f[row] = squared[index(row, col)];
+                }
+                transform1D(f.data(), rowCount, d.data(), arg.data(), env);
+                for (int row = 0; row < rowCount; ++row) {
+                    squared[index(row, col)] = d[row];
+                    nearestCell[index(row, col)] = (arg[row] < 0) ? -1
+                        : static_cast<int>(index(arg[row], nearestCol[index(arg[row], col)]));
+                }
+            }
+        });
+    }
+
+    int rows() const { return rowCount; }
+    int cols() const { return colCount; }
+
+    /**
+     * True if the bitset had no set cells (every distance is infinite).
+     */
+    bool empty() const {
+        return nearestCell.empty() || nearestCell[0] < 0;
+    }
+
+    double squaredDistance(int row, int col) const {
+        return squared[index(row, col)];
+    }
+
+    /**
+     * Distance in grid units from (row, col) to the nearest set cell.
+     */
+    double distance(int row, int col) const {
+        return std::sqrt(squared[index(row, col)]);
+    }
+
+    /**
+     * Snap (row, col) to the nearest set cell.
+     * @return false if the bitset is empty
+     */
+    bool nearest(int row, int col, int& snapRow, int& snapCol) const {
+        int cell = nearestCell[index(row, col)];
+        if (cell < 0) {
+            return false;
+        }
+        snapRow = cell / colCount;
+        snapCol = cell % colCount;
+        return true;
+    }
+
+    /**
+     * Mean distance from the set cells of another bitset of the same size to
+     * this transform's cells (directed Chamfer distance); 0 if it is empty.
+     */
+    double meanDistanceFrom(const TiledBitset& bits) const {
+        double sum = 0.0;
+        size_t count = 0;
+        forEachSetCell(bits, [&](int row, int col) {
+            sum += distance(row, col);
+            ++count;
+        });
+        return count ? sum / count : 0.0;
+    }
+
+    /**
+     * Largest distance from a set cell of another bitset to this transform's
+     * cells (directed Hausdorff distance); 0 if it is empty.
+     */
+    double maxDistanceFrom(const TiledBitset& bits) const {
+        double largest = 0.0;
+        forEachSetCell(bits, [&](int row, int col) {
+            largest = std::max(largest, distance(row, col));
+        });
+        return largest;
+    }
+
+    /**
+     * Symmetric Chamfer distance between two bitsets: the average of both
+     * directed means.
+     */
+    static double chamfer(const TiledBitset& a, const DistanceTransform& aDistance,
+                          const TiledBitset& b, const DistanceTransform& bDistance) {
+        return 0.5 * (bDistance.meanDistanceFrom(a) + aDistance.meanDistanceFrom(b));
+    }
+
+    /**
+     * Symmetric Hausdorff distance between two bitsets: the larger directed
+     * maximum.
+     */
+    static double hausdorff(const TiledBitset& a, const DistanceTransform& aDistance,
+                            const TiledBitset& b, const DistanceTransform& bDistance) {
+        return std::max(bDistance.maxDistanceFrom(a), aDistance.maxDistanceFrom(b));
+    }
+
+    /**
+     * Call visit(row, col) for every set cell of a bitset, a word at a time.
+     */
+    template <typename Visitor>
+    static void forEachSetCell(const TiledBitset& bits, Visitor visit) {
+        for (int row = 0; row < bits.rows(); ++row) {
+            for (int w = 0; w < bits.wordsPerRow(); ++w) {
+                for (uint64_t word = bits.word(row, w); word; word &= word - 1) {
+                    visit(row, w * 64 + __builtin_ctzll(word));
+                }
+            }
+        }
+    }
+};
+
+#endif // DISTANCE_TRANSFORM_H
@@ -1,6 +1,7 @@
 #ifndef GEOMETRY_H
 #define GEOMETRY_H
 
+#include "BatchTransform.h"
 #include <cmath>
 #include <vector>
 #include <algorithm>
@@ -70,16 +71,16 @@ public:
 };
 
 /**
- * Represents a grid point that can be highlighted or not.
+ * Represents a grid point's position in both coordinate systems.
+ * Its highlight state is stored by the Grid.
  */
 struct GridPoint {
     Point2D gridPosition;    // Position in grid space (0-19)
     Point2D canvasPosition;  // Position in canvas/pixel space
-    bool highlighted;
     
-    GridPoint() : highlighted(false) {}
+    GridPoint() {}
     GridPoint(const Point2D& grid, const Point2D& canvas)
-        : gridPosition(grid), canvasPosition(canvas), highlighted(false) {}
+        : gridPosition(grid), canvasPosition(canvas) {}
 };
 
 /**
@@ -127,6 +128,48 @@ public:
         );
     }
     
+    /**
+     * Convert n canvas points to grid space at once.
+     * Inputs and outputs are separate x and y arrays; results match canvasToGrid.
+     */
+    void canvasToGrid(const double* canvasX, const double* canvasY, size_t n,
+                      double* gridX, double* gridY) const {
+        BatchTransform::offsetDivide(canvasX, gridX, n, gridOrigin.x, gridSpacing);
+        BatchTransform::offsetDivide(canvasY, gridY, n, gridOrigin.y, gridSpacing);
+    }
+    
+    /**
+     * Convert n grid points to canvas space at once.
+     * Inputs and outputs are separate x and y arrays; results match gridToCanvas.
+     */
+    void gridToCanvas(const double* gridX, const double* gridY, size_t n,
+                      double* canvasX, double* canvasY) const {
+        BatchTransform::scaleOffset(gridX, canvasX, n, gridSpacing, gridOrigin.x);
+        BatchTransform::scaleOffset(gridY, canvasY, n, gridSpacing, gridOrigin.y);
+    }
+    
+    /**
+     * Hit-test n canvas samples (clicks, stroke samples) against the grid.
+     * Each sample is rounded to the nearest grid point; row and col are -1
+     * for samples whose nearest point would be off the grid.
+     *
+     * @return Number of samples that hit the grid
+     */
+    size_t nearestGridPoints(const double* canvasX, const double* canvasY, size_t n,
+                             int* row, int* col) const {
+        BatchTransform::roundToIndices(canvasX, col, n, gridOrigin.x, gridSpacing, gridSize);
+        BatchTransform::roundToIndices(canvasY, row, n, gridOrigin.y, gridSpacing, gridSize);
+        size_t hits = 0;
+        for (size_t k = 0; k < n; ++k) {
+            if (row[k] < 0 || col[k] < 0) {
+                row[k] = col[k] = -1;
+            } else {
+                ++hits;
+            }
+        }
+        return hits;
+    }
+    
     /**
      * Convert a distance in canvas space to grid space.
      */
@@ -3,18 +3,23 @@
 
 #include "Geometry.h"
 #include "Config.h"
+#include "TiledBitset.h"
 #include <vector>
 #include <limits>
 
 /**
  * Manages the 20x20 grid of points and their states.
  * Handles grid initialization, point highlighting, and bound calculations.
+ *
+ * Highlight state is kept in a copy-on-write TiledBitset, so snapshots for
+ * undo/redo cost O(1) and share every tile that was not edited since.
  */
 class Grid {
 private:
     std::vector<GridPoint> points;
     int size;
     CoordinateTransform transform;
+    TiledBitset highlights;
     
 public:
     /**
@@ -22,26 +27,112 @@ public:
      */
     Grid(int gridSize, int canvasWidth, int canvasHeight, int padding)
         : size(gridSize),
-          transform(gridSize, canvasWidth, canvasHeight, padding) {
+          transform(gridSize, canvasWidth, canvasHeight, padding),
+          highlights(gridSize, gridSize, highlightLayout()) {
         
-        // Create all grid points
-        points.reserve(size * size);
+        // Create all grid points, converting their positions in one batch
+        const size_t count = static_cast<size_t>(size) * size;
+        std::vector<double> gridX(count), gridY(count), canvasX(count), canvasY(count);
         for (int row = 0; row < size; ++row) {
             for (int col = 0; col < size; ++col) {
-                Point2D gridPos(col, row);
-                Point2D canvasPos = transform.gridToCanvas(gridPos);
-                points.emplace_back(gridPos, canvasPos);
+                gridX[row * size + col] = col;
+                gridY[row * size + col] = row;
             }
         }
+        transform.gridToCanvas(gridX.data(), gridY.data(), count, canvasX.data(), canvasY.data());
+        
+        points.reserve(count);
+        for (size_t k = 0; k < count; ++k) {
+            points.emplace_back(Point2D(gridX[k], gridY[k]), Point2D(canvasX[k], canvasY[k]));
+        }
+    }
+    
+    /**
+     * Storage layout of the highlight bits, from Config::Z_ORDER_BITS.
+     */
+    static TiledBitset::Layout highlightLayout() {
+        return Config::Z_ORDER_BITS ? TiledBitset::Layout::ZOrder : TiledBitset::Layout::RowMajor;
     }
     
     /**
      * Reset all points to non-highlighted state.
      */
     void resetHighlights() {
-        for (auto& point : points) {
-            point.highlighted = false;
-        }
+        highlights.clear();
+    }
+    
+    /**
+     * Check whether the point at row, col is highlighted.
+     */
+    bool isHighlighted(int row, int col) const {
+        return highlights.get(row, col);
+    }
+    
+    /**
+     * Set the highlight state of the point at row, col.
+     */
+    void setHighlighted(int row, int col, bool highlighted) {
+        highlights.set(row, col, highlighted);
+    }
+    
+    /**
+     * Set the highlight state of columns [beginCol, endCol) of a row.
+     */
+    void setHighlightedRange(int row, int beginCol, int endCol, bool highlighted) {
+        highlights.setRange(row, beginCol, endCol, highlighted);
+    }
+    
+    /**
+     * Number of highlighted points.
+     */
+    size_t highlightedCount() const {
+        return highlights.count();
+    }
+    
+    /**
+     * Number of highlighted points also set in mask, e.g. a rasterized
+     * circle or an earlier snapshot.
+     */
+    size_t highlightedCountIn(const TiledBitset& mask) const {
+        return highlights.intersectionCount(mask);
+    }
+    
+    /**
+     * Combine a mask of the grid's size into the highlights: highlight its
+     * points, keep only its points, or clear its points.
+     */
+    void highlightMask(const TiledBitset& mask) {
+        highlights.unionWith(mask);
+    }
+    
+    void restrictHighlights(const TiledBitset& mask) {
+        highlights.intersectWith(mask);
+    }
+    
+    void clearMask(const TiledBitset& mask) {
+        highlights.subtract(mask);
+    }
+    
+    /**
+     * Empty bitset with the grid's size and highlight layout, to rasterize
+     * a mask into.
+     */
+    TiledBitset emptyMask() const {
+        return TiledBitset(size, size, highlights.layout());
+    }
+    
+    /**
+     * O(1) snapshot of the highlight state.
+     */
+    TiledBitset snapshotHighlights() const {
+        return highlights;
+    }
+    
+    /**
+     * Restore a snapshot taken with snapshotHighlights().
+     */
+    void restoreHighlights(const TiledBitset& snapshot) {
+        highlights = snapshot;
     }
     
     /**
@@ -58,13 +149,6 @@ public:
         return points[row * size + col];
     }
     
-    /**
-     * Get mutable reference to grid point.
-     */
-    GridPoint& getPointMutable(int row, int col) {
-        return points[row * size + col];
-    }
-    
     /**
      * Get coordinate transform.
      */
@@ -99,13 +183,11 @@ public:
         bool hasHighlightedPoints = false;
         
         // Find the minimum and maximum distances from center to highlighted points
-        for (const auto& point : points) {
-            if (point.highlighted) {
-                hasHighlightedPoints = true;
-                double dist = center.distanceTo(point.gridPosition);
-                minDistance = std::min(minDistance, dist);
-                maxDistance = std::max(maxDistance, dist);
-            }
+        for (int row = 0, col = 0; highlights.findNext(row, col); ++col) {
+            hasHighlightedPoints = true;
+            double dist = center.distanceTo(getPoint(row, col).gridPosition);
+            minDistance = std::min(minDistance, dist);
+            maxDistance = std::max(maxDistance, dist);
         }
         
         if (!hasHighlightedPoints) {
@@ -126,10 +208,9 @@ public:
      */
     std::vector<Point2D> getHighlightedPoints() const {
         std::vector<Point2D> highlighted;
-        for (const auto& point : points) {
-            if (point.highlighted) {
-                highlighted.push_back(point.gridPosition);
-            }
+        highlighted.reserve(highlights.count());
+        for (int row = 0, col = 0; highlights.findNext(row, col); ++col) {
+            highlighted.push_back(getPoint(row, col).gridPosition);
         }
         return highlighted;
     }
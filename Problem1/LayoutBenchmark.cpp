@@ -0,0 +1,173 @@
+/**
+ * Highlight storage benchmark: row-major vs Z-order tiles.
+ *
+ * Rasterizes circles of increasing radius into a large TiledBitset in both
+ * layouts and reports, for each, the wall-clock time and the cache misses
+ * of the word accesses in a simulated 32 KiB, 8-way, 64-byte-line L1 data
+ * cache. The row-major run walks the bounding box row by row as the
+ * rasterizer used to; the Z-order run walks it tile by tile.
+ *
+ * Console program, independent of Win32:
+ *   g++ -std=c++11 -O2 LayoutBenchmark.cpp -o LayoutBenchmark.exe
+ * Add -mbmi2 to use pdep/pext for the Morton index.
+ */
+
+#include "TiledBitset.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const int BENCH_GRID_SIZE = 4096;
+const int REPETITIONS = 20;
+const double THRESHOLD = 0.7071;  // Config::RASTERIZATION_THRESHOLD
+
+/**
+ * Set-associative LRU cache model; counts misses for a stream of addresses.
+ */
+class CacheModel {
+private:
+    static const int LINE_BYTES = 64;
+    static const int WAYS = 8;
+    static const int SETS = 32 * 1024 / (LINE_BYTES * WAYS);
+
+    std::vector<uint64_t> tags;      // SETS x WAYS, most recent first
+    std::vector<int> fill;
+    size_t misses;
+
+public:
+    CacheModel() : tags(SETS * WAYS, 0), fill(SETS, 0), misses(0) {}
+
+    void access(uint64_t address) {
+        uint64_t line = address / LINE_BYTES;
+        int set = static_cast<int>(line % SETS);
+        uint64_t* ways = &tags[set * WAYS];
+        int hit = -1;
+        for (int k = 0; k < fill[set]; ++k) {
+            if (ways[k] == line) {
+                hit = k;
+                break;
+            }
+        }
+        if (hit < 0) {
+            ++misses;
+            hit = fill[set] < WAYS ? fill[set]++ : WAYS - 1;
+        }
+        for (int k = hit; k > 0; --k) {
+            ways[k] = ways[k - 1];
+        }
+        ways[0] = line;
+    }
+
+    size_t missCount() const { return misses; }
+};
+
+struct Annulus {
+    double cx, cy, radius;
+    int minRow, maxRow, minCol, maxCol;
+
+    Annulus(double radius)
+        : cx(BENCH_GRID_SIZE / 2.0 + 0.3), cy(BENCH_GRID_SIZE / 2.0 - 0.4), radius(radius) {
+        double reach = radius + THRESHOLD;
+        minRow = std::max(0, static_cast<int>(std::floor(cy - reach)));
+        maxRow = std::min(BENCH_GRID_SIZE - 1, static_cast<int>(std::ceil(cy + reach)));
+        minCol = std::max(0, static_cast<int>(std::floor(cx - reach)));
+        maxCol = std::min(BENCH_GRID_SIZE - 1, static_cast<int>(std::ceil(cx + reach)));
+    }
+
+    bool contains(int row, int col) const {
+        double d = std::sqrt((col - cx) * (col - cx) + (row - cy) * (row - cy));
+        return std::abs(d - radius) <= THRESHOLD;
+    }
+};
+
+/**
+ * Walk the annulus's bounding box in the order used for a layout.
+ */
+template <typename Visitor>
+void walk(TiledBitset::Layout layout, const Annulus& annulus, Visitor visit) {
+    if (layout == TiledBitset::Layout::ZOrder) {
+        Morton::forEachCellTiled(annulus.minRow, annulus.maxRow, annulus.minCol, annulus.maxCol, visit);
+    } else {
+        for (int row = annulus.minRow; row <= annulus.maxRow; ++row) {
+            for (int col = annulus.minCol; col <= annulus.maxCol; ++col) {
+                visit(row, col);
+            }
+        }
+    }
+}
+
+/**
+ * Misses of the highlight writes, with tiles laid out contiguously as in a
+ * session file image.
+ */
+size_t simulateMisses(TiledBitset::Layout layout, const Annulus& annulus) {
+    const int tileCols = (BENCH_GRID_SIZE + TiledBitset::TILE_BITS - 1) / TiledBitset::TILE_BITS;
+    const uint64_t tileBytes = TiledBitset::TILE_BITS * sizeof(uint64_t);
+    CacheModel cache;
+    walk(layout, annulus, [&](int row, int col) {
+        if (!annulus.contains(row, col)) {
+            return;
+        }
+        int word, bit;
+        TiledBitset::locate(layout, row % TiledBitset::TILE_BITS, col % TiledBitset::TILE_BITS, word, bit);
+        uint64_t tile = static_cast<uint64_t>(row / TiledBitset::TILE_BITS) * tileCols +
+                        col / TiledBitset::TILE_BITS;
+        cache.access(tile * tileBytes + word * sizeof(uint64_t));
+    });
+    return cache.missCount();
+}
+
+/**
+ * Average time of one rasterization into a fresh bitset, in microseconds.
+ */
+double timeRasterize(TiledBitset::Layout layout, const Annulus& annulus, size_t& pointCount) {
+    typedef std::chrono::steady_clock Clock;
+    TiledBitset bits(BENCH_GRID_SIZE, BENCH_GRID_SIZE, layout);
+    double total = 0.0;
+    for (int rep = 0; rep < REPETITIONS; ++rep) {
+        bits.clear();
+        pointCount = 0;
+        Clock::time_point start = Clock::now();
+        walk(layout, annulus, [&](int row, int col) {
+            if (annulus.contains(row, col)) {
+                bits.set(row, col, true);
+                ++pointCount;
+            }
+        });
+        total += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    }
+    return total / REPETITIONS;
+}
+
+}  // namespace
+
+int main() {
+    const double radii[] = {8, 32, 128, 512, 1800};
+
+    std::printf("Grid %dx%d, simulated 32 KiB 8-way L1, %s Morton index\n\n",
+                BENCH_GRID_SIZE, BENCH_GRID_SIZE,
+#if defined(__BMI2__)
+                "pdep/pext"
+#else
+                "software"
+#endif
+    );
+    std::printf("%8s %8s | %12s %12s | %12s %12s\n",
+                "radius", "points", "row misses", "z misses", "row us", "z us");
+
+    for (size_t k = 0; k < sizeof(radii) / sizeof(radii[0]); ++k) {
+        Annulus annulus(radii[k]);
+        size_t points = 0;
+        size_t rowMisses = simulateMisses(TiledBitset::Layout::RowMajor, annulus);
+        size_t zMisses = simulateMisses(TiledBitset::Layout::ZOrder, annulus);
+        double rowTime = timeRasterize(TiledBitset::Layout::RowMajor, annulus, points);
+        double zTime = timeRasterize(TiledBitset::Layout::ZOrder, annulus, points);
+        std::printf("%8.0f %8zu | %12zu %12zu | %12.1f %12.1f\n",
+                    radii[k], points, rowMisses, zMisses, rowTime, zTime);
+    }
+    return 0;
+}
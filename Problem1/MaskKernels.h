@@ -0,0 +1,229 @@
+#ifndef MASK_KERNELS_H
+#define MASK_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MASK_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Kernels for bit masks stored as arrays of 64-bit words.
+ *
+ * Combining uses AVX-512 or AVX2 and counting the AVX-512 population count
+ * instruction or a nibble lookup table under AVX2, whichever the CPU
+ * running the program supports. The vector kernels are compiled for their
+ * instruction sets with target attributes, so no -m flag is needed and one
+ * executable runs everywhere; elsewhere the kernels work one word at a
+ * time. All paths give identical results.
+ */
+namespace MaskKernels {
+    enum class Op {
+        Or,      // a | b
+        And,     // a & b
+        AndNot,  // a & ~b
+        Xor      // a ^ b
+    };
+
+    /**
+     * Widest kernels the CPU runs.
+     */
+    enum class Level {
+        Scalar,
+        Avx2,
+        Avx512,          // AVX-512F: combining only
+        Avx512Popcount   // and VPOPCNTDQ for counting
+    };
+
+    inline Level detectLevel() {
+#if defined(MASK_KERNELS_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return __builtin_cpu_supports("avx512vpopcntdq") ? Level::Avx512Popcount : Level::Avx512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return Level::Avx2;
+        }
+#endif
+        return Level::Scalar;
+    }
+
+    /**
+     * The level in use, checked once on first use.
+     */
+    inline Level level() {
+        static const Level current = detectLevel();
+        return current;
+    }
+
+    template <Op op>
+    inline uint64_t apply(uint64_t a, uint64_t b) {
+        switch (op) {
+            case Op::Or:     return a | b;
+            case Op::And:    return a & b;
+            case Op::AndNot: return a & ~b;
+            default:         return a ^ b;
+        }
+    }
+
+#if defined(MASK_KERNELS_X86)
+    template <Op op>
+    __attribute__((target("avx512f")))
+    inline __m512i apply(__m512i a, __m512i b) {
+        switch (op) {
+            case Op::Or:     return _mm512_or_si512(a, b);
+            case Op::And:    return _mm512_and_si512(a, b);
+            case Op::AndNot: return _mm512_ternarylogic_epi64(a, b, b, 0x30);  // a & ~b
+            default:         return _mm512_xor_si512(a, b);
+        }
+    }
+
+    template <Op op>
+    __attribute__((target("avx2")))
+    inline __m256i apply(__m256i a, __m256i b) {
+        switch (op) {
+            case Op::Or:     return _mm256_or_si256(a, b);
+            case Op::And:    return _mm256_and_si256(a, b);
+            case Op::AndNot: return _mm256_andnot_si256(b, a);
+            default:         return _mm256_xor_si256(a, b);
+        }
+    }
+
+    /**
+     * Number of set bits in each 64-bit lane, from a 16-entry table of
+     * nibble counts.
+     */
+    __attribute__((target("avx2")))
+    inline __m256i laneCounts(__m256i v) {
+        const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                               0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+        __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        return _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+    }
+
+    // The vector parts of combine and countCombined. Each handles the whole
+    // vectors of the n words and returns how many words that was; the
+    // caller finishes the rest one word at a time.
+
+    template <Op op>
+    __attribute__((target("avx512f")))
+    inline size_t combineAvx512(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n, bool& any) {
+        size_t k = 0;
+        __m512i vAny = _mm512_setzero_si512();
+        for (; k < n - n % 8; k += 8) {
+            __m512i v = apply<op>(_mm512_loadu_si512(a + k), _mm512_loadu_si512(b + k));
+            _mm512_storeu_si512(out + k, v);
+            vAny = _mm512_or_si512(vAny, v);
+        }
+        any = _mm512_test_epi64_mask(vAny, vAny) != 0;
+        return k;
+    }
+
+    template <Op op>
+    __attribute__((target("avx2")))
+    inline size_t combineAvx2(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n, bool& any) {
+        size_t k = 0;
+        __m256i vAny = _mm256_setzero_si256();
+        for (; k < n - n % 4; k += 4) {
+            __m256i v = apply<op>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)),
+                                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k), v);
+            vAny = _mm256_or_si256(vAny, v);
+        }
+        any = !_mm256_testz_si256(vAny, vAny);
+        return k;
+    }
+
+    template <Op op>
+    __attribute__((target("avx512f,avx512vpopcntdq")))
+    inline size_t countAvx512(const uint64_t* a, const uint64_t* b, size_t n, size_t& total) {
+        size_t k = 0;
+        __m512i vTotal = _mm512_setzero_si512();
+        for (; k < n - n % 8; k += 8) {
+            __m512i v = apply<op>(_mm512_loadu_si512(a + k), _mm512_loadu_si512(b + k));
+            vTotal = _mm512_add_epi64(vTotal, _mm512_popcnt_epi64(v));
+        }
+        uint64_t lanes[8];
+        _mm512_storeu_si512(lanes, vTotal);
+        total = 0;
+        for (int l = 0; l < 8; ++l) {
+            total += static_cast<size_t>(lanes[l]);
+        }
+        return k;
+    }
+
+    template <Op op>
+    __attribute__((target("avx2")))
+    inline size_t countAvx2(const uint64_t* a, const uint64_t* b, size_t n, size_t& total) {
+        size_t k = 0;
+        __m256i vTotal = _mm256_setzero_si256();
+        for (; k < n - n % 4; k += 4) {
+            __m256i v = apply<op>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)),
+                                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k)));
+            vTotal = _mm256_add_epi64(vTotal, laneCounts(v));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), vTotal);
+        total = static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+        return k;
+    }
+#endif
+
+    /**
+     * out[k] = a[k] op b[k] for n words. out may be a or b.
+     *
+     * @return true if any word of out is non-zero
+     */
+    template <Op op>
+    inline bool combine(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+        size_t k = 0;
+        bool any = false;
+#if defined(MASK_KERNELS_X86)
+        switch (level()) {
+            case Level::Avx512:
+            case Level::Avx512Popcount: k = combineAvx512<op>(a, b, out, n, any); break;
+            case Level::Avx2:           k = combineAvx2<op>(a, b, out, n, any); break;
+            default:                    break;
+        }
+#endif
+        for (; k < n; ++k) {
+            out[k] = apply<op>(a[k], b[k]);
+            any = any || out[k] != 0;
+        }
+        return any;
+    }
+
+    /**
+     * Number of set bits of a[k] op b[k] over n words, without storing
+     * the words.
+     */
+    template <Op op>
+    inline size_t countCombined(const uint64_t* a, const uint64_t* b, size_t n) {
+        size_t k = 0;
+        size_t total = 0;
+#if defined(MASK_KERNELS_X86)
+        switch (level()) {
+            case Level::Avx512Popcount: k = countAvx512<op>(a, b, n, total); break;
+            case Level::Avx512:
+            case Level::Avx2:           k = countAvx2<op>(a, b, n, total); break;
+            default:                    break;
+        }
+#endif
+        for (; k < n; ++k) {
+            total += __builtin_popcountll(apply<op>(a[k], b[k]));
+        }
+        return total;
+    }
+
+    /**
+     * Number of set bits over n words.
+     */
+    inline size_t count(const uint64_t* words, size_t n) {
+        return countCombined<Op::Or>(words, words, n);  // w | w = w
+    }
+}
+
+#endif // MASK_KERNELS_H
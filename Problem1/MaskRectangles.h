@@ -0,0 +1,136 @@
+#ifndef MASK_RECTANGLES_H
+#define MASK_RECTANGLES_H
+
+#include "TiledBitset.h"
+#include <cstdio>
+#include <vector>
+
+/**
+ * Grid points in rows [top, bottom) and columns [left, right).
+ */
+struct CellRect {
+    int top;
+    int left;
+    int bottom;
+    int right;
+
+    CellRect() : top(0), left(0), bottom(0), right(0) {}
+    CellRect(int t, int l, int b, int r) : top(t), left(l), bottom(b), right(r) {}
+
+    size_t area() const {
+        return static_cast<size_t>(bottom - top) * (right - left);
+    }
+};
+
+/**
+ * Greedy decomposition of a bitset into rectangles of set points, for
+ * drawing and exporting with one primitive per rectangle.
+ *
+ * The maximal runs of set points in each row are found a word at a time,
+ * and a run with exactly the columns of a rectangle ending in the row
+ * above extends that rectangle downward instead of starting a new one. A
+ * region then costs about one rectangle per row where its outline moves,
+ * so the count follows the boundary rather than the area.
+ */
+class MaskRectangles {
+public:
+    /**
+     * Call visit(begin, end) for each maximal run of set points
+     * [begin, end) in row i, left to right; runs may cross words.
+     */
+    template <typename Visitor>
+    static void forEachRun(const TiledBitset& bits, int i, Visitor visit) {
+        int open = -1;  // Start of a run reaching the end of the previous word
+        for (int w = 0; w < bits.wordsPerRow(); ++w) {
+            uint64_t word = bits.word(i, w);
+            int base = w * 64;
+            if (open >= 0) {
+                if (word == ~0ULL) {
+                    continue;
+                }
+                int length = __builtin_ctzll(~word);
+                visit(open, base + length);
+                open = -1;
+                word &= ~((1ULL << length) - 1);
+            }
+            while (word) {
+                int begin = __builtin_ctzll(word);
+                uint64_t rest = ~(word >> begin);
+                int length = rest ? __builtin_ctzll(rest) : 64;
+                if (begin + length >= 64) {
+                    open = base + begin;
+                    break;
+                }
+                visit(base + begin, base + begin + length);
+                word &= ~(((1ULL << length) - 1) << begin);
+            }
+        }
+        if (open >= 0) {
+            visit(open, bits.wordsPerRow() * 64);
+        }
+    }
+
+    /**
+     * Call visit(rect) for each rectangle. Every set point is in exactly
+     * one; rectangles come out as they close, roughly top to bottom.
+     */
+    template <typename Visitor>
+    static void forEach(const TiledBitset& bits, Visitor visit) {
+        std::vector<CellRect> open, next;  // Rectangles reaching the previous row, left to right
+        for (int i = 0; i < bits.rows(); ++i) {
+            next.clear();
+            size_t k = 0;
+            forEachRun(bits, i, [&](int begin, int end) {
+                // Rectangles starting left of this run cannot match a later run
+                while (k < open.size() && open[k].left < begin) {
+                    visit(open[k++]);
+                }
+                if (k < open.size() && open[k].left == begin && open[k].right == end) {
+                    open[k].bottom = i + 1;
+                    next.push_back(open[k++]);
+                } else {
+                    next.push_back(CellRect(i, begin, i + 1, end));
+                }
+            });
+            while (k < open.size()) {
+                visit(open[k++]);
+            }
+            open.swap(next);
+        }
+        for (size_t k = 0; k < open.size(); ++k) {
+            visit(open[k]);
+        }
+    }
+
+    static std::vector<CellRect> decompose(const TiledBitset& bits) {
+        std::vector<CellRect> rects;
+        forEach(bits, [&](const CellRect& rect) { rects.push_back(rect); });
+        return rects;
+    }
+
+    /**
+     * Write the set points as an SVG image in grid units, each point the
+     * unit square around it, one <rect> per rectangle.
+     *
+     * @param rgb Fill color as 0xRRGGBB
+     * @return false if the file could not be written
+     */
+    static bool writeSvg(const char* path, const TiledBitset& bits, unsigned rgb) {
+        FILE* file = std::fopen(path, "w");
+        if (!file) {
+            return false;
+        }
+        std::fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"-0.5 -0.5 %d %d\" "
+                           "shape-rendering=\"crispEdges\">\n<g fill=\"#%06x\">\n",
+                     bits.cols(), bits.rows(), rgb & 0xFFFFFF);
+        forEach(bits, [&](const CellRect& rect) {
+            std::fprintf(file, "<rect x=\"%g\" y=\"%g\" width=\"%d\" height=\"%d\"/>\n", rect.left - 0.5,
+                         rect.top - 0.5, rect.right - rect.left, rect.bottom - rect.top);
+        });
+        std::fprintf(file, "</g>\n</svg>\n");
+        bool written = !std::ferror(file);
+        return std::fclose(file) == 0 && written;
+    }
+};
+
+#endif // MASK_RECTANGLES_H
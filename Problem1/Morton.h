@@ -0,0 +1,143 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstdint>
+#include <algorithm>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Morton (Z-order) indexing.
+ *
+ * Interleaves the bits of a row and a column so that points that are close
+ * in 2D get indices that are close in memory. Uses the BMI2 pdep/pext
+ * instructions when the compiler targets them (-mbmi2) and an equivalent
+ * shift-and-mask sequence otherwise.
+ *
+ * TiledBitset uses this to store each 64x64 tile as 8x8 blocks: every
+ * 64-bit word holds one block in Z-order, and the blocks of a tile are in
+ * Z-order as well.
+ */
+namespace Morton {
+    const int BLOCK_SIZE = 8;    // Rows and columns of a block (one word)
+    const int TILE_SIZE = 64;    // Rows and columns of a tile
+    
+    // Bits of block row 0 within a Z-ordered 8x8 block
+    const uint64_t ROW_MASK = 0x0000000000330033ULL;
+    
+    /**
+     * Spread the low 16 bits of v to the even bit positions.
+     */
+    inline uint32_t spread(uint32_t v) {
+#if defined(__BMI2__)
+        return _pdep_u32(v, 0x55555555u);
+#else
+        v &= 0x0000FFFFu;
+        v = (v | (v << 8)) & 0x00FF00FFu;
+        v = (v | (v << 4)) & 0x0F0F0F0Fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+#endif
+    }
+    
+    /**
+     * Inverse of spread: gather the even bit positions.
+     */
+    inline uint32_t compact(uint32_t v) {
+#if defined(__BMI2__)
+        return _pext_u32(v, 0x55555555u);
+#else
+        v &= 0x55555555u;
+        v = (v | (v >> 1)) & 0x33333333u;
+        v = (v | (v >> 2)) & 0x0F0F0F0Fu;
+        v = (v | (v >> 4)) & 0x00FF00FFu;
+        v = (v | (v >> 8)) & 0x0000FFFFu;
+        return v;
+#endif
+    }
+    
+    /**
+     * Z-order index of (row, col): column bits at even positions, row bits at odd.
+     */
+    inline uint32_t encode(uint32_t row, uint32_t col) {
+        return (spread(row) << 1) | spread(col);
+    }
+    
+    inline void decode(uint32_t index, uint32_t& row, uint32_t& col) {
+        row = compact(index >> 1);
+        col = compact(index);
+    }
+    
+    /**
+     * Bits of row r (0..7) within a Z-ordered 8x8 block.
+     */
+    inline uint64_t rowMask(int r) {
+        return ROW_MASK << (spread(r) << 1);
+    }
+    
+    /**
+     * Row r of a Z-ordered 8x8 block as 8 column bits.
+     */
+    inline uint64_t rowBits(uint64_t block, int r) {
+#if defined(__BMI2__)
+        return _pext_u64(block, rowMask(r));
+#else
+        uint64_t v = (block >> (spread(r) << 1)) & ROW_MASK;
+        v = (v | (v >> 2)) & 0x000F000FULL;
+        return (v | (v >> 12)) & 0xFFULL;
+#endif
+    }
+    
+    /**
+     * Inverse of rowBits: place 8 column bits at row r of a block.
+     */
+    inline uint64_t rowDeposit(uint64_t bits, int r) {
+#if defined(__BMI2__)
+        return _pdep_u64(bits, rowMask(r));
+#else
+        uint64_t v = bits & 0xFFULL;
+        v = (v | (v << 12)) & 0x000F000FULL;
+        v = (v | (v << 2)) & ROW_MASK;
+        return v << (spread(r) << 1);
+#endif
+    }
+    
+    /**
+     * Call visit(row, col) for every cell in rows [minRow, maxRow] and
+     * columns [minCol, maxCol] (inclusive, non-negative) one 8x8 block at a
+     * time, with the blocks of each 64x64 tile in Z-order.
+     *
+     * This is the storage order of a Z-ordered TiledBitset, so consecutive
+     * visits stay within a cache line.
+     */
+    template <typename Visitor>
+    inline void forEachCellTiled(int minRow, int maxRow, int minCol, int maxCol, Visitor visit) {
+        if (minRow > maxRow || minCol > maxCol) {
+            return;
+        }
+        const int blocksPerTile = (TILE_SIZE / BLOCK_SIZE) * (TILE_SIZE / BLOCK_SIZE);
+        for (int tileRow = minRow / TILE_SIZE; tileRow <= maxRow / TILE_SIZE; ++tileRow) {
+            for (int tileCol = minCol / TILE_SIZE; tileCol <= maxCol / TILE_SIZE; ++tileCol) {
+                for (uint32_t block = 0; block < static_cast<uint32_t>(blocksPerTile); ++block) {
+                    uint32_t blockRow, blockCol;
+                    decode(block, blockRow, blockCol);
+                    int row0 = tileRow * TILE_SIZE + static_cast<int>(blockRow) * BLOCK_SIZE;
+                    int col0 = tileCol * TILE_SIZE + static_cast<int>(blockCol) * BLOCK_SIZE;
+                    int rowBegin = std::max(row0, minRow);
+                    int rowEnd = std::min(row0 + BLOCK_SIZE - 1, maxRow);
+                    int colBegin = std::max(col0, minCol);
+                    int colEnd = std::min(col0 + BLOCK_SIZE - 1, maxCol);
+                    for (int row = rowBegin; row <= rowEnd; ++row) {
+                        for (int col = colBegin; col <= colEnd; ++col) {
+                            visit(row, col);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+#endif // MORTON_H
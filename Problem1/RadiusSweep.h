@@ -0,0 +1,162 @@
+#ifndef RADIUS_SWEEP_H
+#define RADIUS_SWEEP_H
+
+#include "Settings.h"
+#include "Geometry.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * Incremental rasterization of concentric circles.
+ *
+ * For a fixed center, the distance from the center to every grid point in
+ * range is computed once and the points are sorted by it. A point is on
+ * the circle of radius r when |d - r| <= threshold, the same test the
+ * rasterizer uses, so for any r the points on the circle are one
+ * contiguous run of the sorted array. Changing the radius moves the two
+ * ends of that run and reports each point that enters or leaves the
+ * annulus.
+ *
+ * A sweep through many radii costs O(P log P) for the sort plus O(1) per
+ * event, where P is the number of points in range, instead of a full
+ * bounding-box rasterization per step. The radius may move in either
+ * direction.
+ */
+class RadiusSweep {
+private:
+    struct SweepPoint {
+        double distance;  // From the center, in grid units
+        int row;
+        int col;
+
+        bool operator<(const SweepPoint& other) const {
+            return distance < other.distance;
+        }
+    };
+
+    Point2D sweepCenter;
+    double sweepRadius;
+    double maxRadius;
+    double threshold;                 // Settings::current().threshold
+    std::vector<SweepPoint> points;   // Sorted by distance
+    size_t begin;                     // First point on the circle
+    size_t end;                       // One past the last point on the circle
+
+    // |d - r| <= threshold splits exactly into these two tests failing
+    bool below(double distance, double radius) const {
+        return distance - radius < -threshold;
+    }
+
+    bool beyond(double distance, double radius) const {
+        return distance - radius > threshold;
+    }
+
+    /**
+     * Report the points of [from, to) as entering (true) or exiting (false).
+     */
+    template <typename Visitor>
+    void emit(size_t from, size_t to, bool entered, Visitor& visit) const {
+        for (size_t k = from; k < to; ++k) {
+            visit(points[k].row, points[k].col, entered);
+        }
+    }
+
+public:
+    RadiusSweep() : sweepRadius(0.0), maxRadius(0.0), threshold(0.0), begin(0), end(0) {}
+
+    /**
+     * Prepare a sweep about a circle's center, starting at its radius.
+     *
+     * @param gridSize Grid size
+     * @param circle Starting circle (in grid space)
+     * @param limit Largest radius the sweep will reach
+     */
+    RadiusSweep(int gridSize, const Circle& circle, double limit)
+        : sweepCenter(circle.center), sweepRadius(circle.radius), maxRadius(limit),
+          threshold(Settings::current().threshold), begin(0), end(0) {
+        const double reach = limit + threshold;
+        int minRow = std::max(0, static_cast<int>(std::floor(sweepCenter.y - reach)));
+        int maxRow = std::min(gridSize - 1, static_cast<int>(std::ceil(sweepCenter.y + reach)));
+        int minCol = std::max(0, static_cast<int>(std::floor(sweepCenter.x - reach)));
+        int maxCol = std::min(gridSize - 1, static_cast<int>(std::ceil(sweepCenter.x + reach)));
+
+        for (int row = minRow; row <= maxRow; ++row) {
+            for (int col = minCol; col <= maxCol; ++col) {
+                SweepPoint point;
+                point.distance = sweepCenter.distanceTo(Point2D(col, row));
+                point.row = row;
+                point.col = col;
+                if (!beyond(point.distance, limit)) {
+                    points.push_back(point);
+                }
+            }
+        }
+        std::sort(points.begin(), points.end());
+
+        while (begin < points.size() && below(points[begin].distance, sweepRadius)) {
+            ++begin;
+        }
+        end = begin;
+        while (end < points.size() && !beyond(points[end].distance, sweepRadius)) {
+            ++end;
+        }
+    }
+
+    const Point2D& center() const { return sweepCenter; }
+    double radius() const { return sweepRadius; }
+    double limit() const { return maxRadius; }
+
+    /**
+     * Call visit(row, col) for every point on the circle at the current radius.
+     */
+    template <typename Visitor>
+    void forEachOnCircle(Visitor visit) const {
+        for (size_t k = begin; k < end; ++k) {
+            visit(points[k].row, points[k].col);
+        }
+    }
+
+    /**
+     * Move to a new radius (clamped to [0, limit]) and call
+     * visit(row, col, entered) for every point that enters (true) or
+     * leaves (false) the circle. Afterwards the points on the circle are
+     * exactly those CircleRasterizer::forEachPointNear visits for a
+     * positive radius.
+     */
+    template <typename Visitor>
+    void advance(double radius, Visitor visit) {
+        radius = std::max(0.0, std::min(radius, maxRadius));
+
+        // Both ends of the run move the same way as the radius
+        size_t newBegin = begin;
+        size_t newEnd = end;
+        if (radius >= sweepRadius) {
+            while (newBegin < points.size() && below(points[newBegin].distance, radius)) {
+                ++newBegin;
+            }
+            while (newEnd < points.size() && !beyond(points[newEnd].distance, radius)) {
+                ++newEnd;
+            }
+        } else {
+            while (newBegin > 0 && !below(points[newBegin - 1].distance, radius)) {
+                --newBegin;
+            }
+            while (newEnd > 0 && beyond(points[newEnd - 1].distance, radius)) {
+                --newEnd;
+            }
+        }
+
+        // Points only in the old run leave; points only in the new run enter
+        emit(begin, std::min(end, newBegin), false, visit);
+        emit(std::max(begin, newEnd), end, false, visit);
+        emit(newBegin, std::min(newEnd, begin), true, visit);
+        emit(std::max(newBegin, end), newEnd, true, visit);
+
+        begin = newBegin;
+        end = newEnd;
+        sweepRadius = radius;
+    }
+};
+
+#endif // RADIUS_SWEEP_H
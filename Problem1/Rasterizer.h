@@ -4,6 +4,62 @@
 #include "Grid.h"
 #include "Geometry.h"
 #include "Config.h"
+#include "Settings.h"
+
+/**
+ * Parameters of the rasterization kernels. FixedRasterParams makes the grid
+ * size and threshold compile-time constants, so the bounding box clamps and
+ * the distance test fold into the specialized kernel; RuntimeRasterParams
+ * carries any other values to the generic one.
+ */
+template <int Size, int ThresholdTenThousandths>
+struct FixedRasterParams {
+    static constexpr int size() { return Size; }
+    static constexpr double threshold() { return ThresholdTenThousandths / 10000.0; }
+};
+
+struct RuntimeRasterParams {
+    int gridSize;
+    double distance;
+
+    int size() const { return gridSize; }
+    double threshold() const { return distance; }
+};
+
+namespace RasterDispatch {
+    template <int Size, typename Kernel>
+    inline void withThreshold(double threshold, Kernel& kernel) {
+        // 7071 / 10000.0 rounds to the same double as the literal 0.7071
+        if (threshold == FixedRasterParams<Size, 7071>::threshold()) {
+            kernel(FixedRasterParams<Size, 7071>());
+        } else if (threshold == FixedRasterParams<Size, 5000>::threshold()) {
+            kernel(FixedRasterParams<Size, 5000>());
+        } else {
+            RuntimeRasterParams params = {Size, threshold};
+            kernel(params);
+        }
+    }
+
+    /**
+     * Call kernel(params) with the specialized parameters for the common
+     * grid sizes and thresholds (sqrt(2)/2 and 1/2), or the runtime ones.
+     */
+    template <typename Kernel>
+    inline void run(int size, double threshold, Kernel& kernel) {
+        static_assert(Config::RASTERIZATION_THRESHOLD == 0.7071,
+                      "Add a specialization for the configured threshold");
+        if (size == Config::GRID_SIZE) {
+            withThreshold<Config::GRID_SIZE>(threshold, kernel);
+        } else if (size == 64) {
+            withThreshold<64>(threshold, kernel);
+        } else if (size == 256) {
+            withThreshold<256>(threshold, kernel);
+        } else {
+            RuntimeRasterParams params = {size, threshold};
+            kernel(params);
+        }
+    }
+}
 
 /**
  * Circle rasterization algorithm.
@@ -15,7 +71,9 @@
  *    circle boundary is within a threshold
  * 
  * Threshold Selection:
- * - The threshold is set to sqrt(2)/2 ≈ 0.707 in grid units
+ * - The threshold defaults to Config::RASTERIZATION_THRESHOLD and can be
+ *   changed at startup (see Settings.h)
+ * - The default is sqrt(2)/2 ≈ 0.707 in grid units
  * - This value is chosen because:
  *   * Grid points are 1 unit apart
  *   * The farthest a circle can be from any grid point is when it passes through
@@ -26,6 +84,18 @@
  * 
  */
 class CircleRasterizer {
+private:
+    template <typename Visitor>
+    struct PointsNearKernel {
+        const Circle& circle;
+        Visitor& visit;
+        
+        template <typename Params>
+        void operator()(const Params& params) const {
+            forEachPointNearWith(params, circle, visit);
+        }
+    };
+    
 public:
     /**
      * Rasterize a circle onto the grid by highlighting points near the boundary.
@@ -39,35 +109,45 @@ public:
         }
         
         const int size = grid.getSize();
-        const double threshold = Config::RASTERIZATION_THRESHOLD;
+        const double threshold = Settings::current().threshold;
         
-        // Check each grid point
-        for (int row = 0; row < size; ++row) {
-            for (int col = 0; col < size; ++col) {
-                GridPoint& point = grid.getPointMutable(row, col);
-                
-                double distToCenter = circle.center.distanceTo(point.gridPosition);
-                double distToBoundary = std::abs(distToCenter - circle.radius);
-                
-                point.highlighted = (distToBoundary <= threshold);
-            }
-        }
+        // Check each grid point, tile by tile in the highlight storage order
+        Morton::forEachCellTiled(0, size - 1, 0, size - 1, [&](int row, int col) {
+            const GridPoint& point = grid.getPoint(row, col);
+            
+            double distToCenter = circle.center.distanceTo(point.gridPosition);
+            double distToBoundary = std::abs(distToCenter - circle.radius);
+            
+            grid.setHighlighted(row, col, distToBoundary <= threshold);
+        });
     }
     
     /**
-     * Alternative rasterization using optimized bounding box.
-     * This version only checks points within a bounding box around the circle.
+     * Call visit(row, col) for every grid point within the threshold of the
+     * circle's boundary. Only points within the circle's bounding box are
+     * checked, tile by tile in the highlight storage order. The threshold
+     * is Settings::current().threshold.
      * 
-     * @param grid The grid to rasterize onto
-     * @param circle The circle to rasterize (in grid space)
+     * @param size Grid size
+     * @param circle The circle (in grid space)
      */
-    static void rasterizeOptimized(Grid& grid, const Circle& circle) {
+    template <typename Visitor>
+    static void forEachPointNear(int size, const Circle& circle, Visitor visit) {
         if (!circle.isValid()) {
             return;
         }
-        
-        const int size = grid.getSize();
-        const double threshold = Config::RASTERIZATION_THRESHOLD;
+        PointsNearKernel<Visitor> kernel = {circle, visit};
+        RasterDispatch::run(size, Settings::current().threshold, kernel);
+    }
+    
+    /**
+     * forEachPointNear for one set of parameters; Params is FixedRasterParams
+     * or RuntimeRasterParams.
+     */
+    template <typename Params, typename Visitor>
+    static void forEachPointNearWith(const Params& params, const Circle& circle, Visitor& visit) {
+        const int size = params.size();
+        const double threshold = params.threshold();
         
         // Calculate bounding box in grid space
         int minRow = std::max(0, static_cast<int>(std::floor(circle.center.y - circle.radius - threshold)));
@@ -75,26 +155,35 @@ public:
         int minCol = std::max(0, static_cast<int>(std::floor(circle.center.x - circle.radius - threshold)));
         int maxCol = std::min(size - 1, static_cast<int>(std::ceil(circle.center.x + circle.radius + threshold)));
         
-        // Only check points within bounding box
-        for (int row = minRow; row <= maxRow; ++row) {
-            for (int col = minCol; col <= maxCol; ++col) {
-                GridPoint& point = grid.getPointMutable(row, col);
-                
-                double distToCenter = circle.center.distanceTo(point.gridPosition);
-                double distToBoundary = std::abs(distToCenter - circle.radius);
-                
-                point.highlighted = (distToBoundary <= threshold);
+        Morton::forEachCellTiled(minRow, maxRow, minCol, maxCol, [&](int row, int col) {
+            // Grid point (row, col) sits at grid position (col, row)
+            double distToCenter = circle.center.distanceTo(Point2D(col, row));
+            double distToBoundary = std::abs(distToCenter - circle.radius);
+            
+            if (distToBoundary <= threshold) {
+                visit(row, col);
             }
+        });
+    }
+    
+    /**
+     * Alternative rasterization using optimized bounding box.
+     * This version only checks points within a bounding box around the circle.
+     * 
+     * @param grid The grid to rasterize onto
+     * @param circle The circle to rasterize (in grid space)
+     */
+    static void rasterizeOptimized(Grid& grid, const Circle& circle) {
+        if (!circle.isValid()) {
+            return;
         }
         
-        // Clear points outside the bounding box
-        for (int row = 0; row < size; ++row) {
-            for (int col = 0; col < size; ++col) {
-                if (row < minRow || row > maxRow || col < minCol || col > maxCol) {
-                    grid.getPointMutable(row, col).highlighted = false;
-                }
-            }
-        }
+        // Start from a clear grid, so points outside the bounding box need no pass
+        grid.resetHighlights();
+        
+        forEachPointNear(grid.getSize(), circle, [&](int row, int col) {
+            grid.setHighlighted(row, col, true);
+        });
     }
 };
 
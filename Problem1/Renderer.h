@@ -2,8 +2,11 @@
 #define RENDERER_H
 
 #include "Config.h"
+#include "Settings.h"
 #include "Grid.h"
+#include "CircleScene.h"
 #include "Geometry.h"
+#include <cwchar>
 
 /**
  * Handles all rendering operations for the application.
@@ -54,26 +57,47 @@ public:
      * Clear the entire canvas with background color.
      */
     void clearCanvas(RECT rect) {
-        HBRUSH brush = CreateSolidBrush(Config::COL_BACKGROUND);
+        HBRUSH brush = CreateSolidBrush(Settings::current().backgroundColor);
         FillRect(hdc, &rect, brush);
         DeleteObject(brush);
     }
     
+    /**
+     * Draw a line of text in the top-left corner.
+     *
+     * @param line Line number from the top, for several status lines
+     */
+    void drawStatus(const wchar_t* text, int line = 0) {
+        SetBkMode(hdc, TRANSPARENT);
+        SetTextColor(hdc, Settings::current().boundsColor);
+        TextOut(hdc, 8, 8 + 18 * line, text, static_cast<int>(wcslen(text)));
+    }
+    
     /**
      * Draw all grid points with their current states.
+     * 
+     * @param previous Optional earlier highlight snapshot; points it highlights
+     *                 that are no longer highlighted are drawn in the preview color
      */
-    void drawGrid(const Grid& grid) {
-        const auto& points = grid.getPoints();
+    void drawGrid(const Grid& grid, const TiledBitset* previous = nullptr) {
+        const int size = grid.getSize();
         
-        for (const auto& point : points) {
-            COLORREF color = point.highlighted ? Config::COL_BLUE : Config::COL_GRAY;
+        // Tile by tile, in the storage order of the highlight bits
+        Morton::forEachCellTiled(0, size - 1, 0, size - 1, [&](int row, int col) {
+            const GridPoint& point = grid.getPoint(row, col);
+            COLORREF color = Settings::current().pointColor;
+            if (grid.isHighlighted(row, col)) {
+                color = Settings::current().highlightColor;
+            } else if (previous && previous->get(row, col)) {
+                color = Settings::current().previewColor;
+            }
             drawFilledCircle(
                 static_cast<int>(point.canvasPosition.x),
                 static_cast<int>(point.canvasPosition.y),
                 Config::POINT_RADIUS,
                 color
             );
-        }
+        });
     }
     
     /**
@@ -86,12 +110,53 @@ public:
                 static_cast<int>(center.x),
                 static_cast<int>(center.y),
                 static_cast<int>(radius),
-                Config::COL_PREVIEW,
+                Settings::current().previewColor,
+                Config::CIRCLE_THIN_WIDTH
+            );
+        }
+    }
+    
+    /**
+     * Draw an earlier user circle (thin, preview color) for comparison.
+     */
+    void drawPreviousCircle(const Circle& circle, const CoordinateTransform& transform) {
+        if (circle.isValid()) {
+            Point2D centerCanvas = transform.gridToCanvas(circle.center);
+            double radiusCanvas = transform.gridDistanceToCanvas(circle.radius);
+            
+            drawCircleOutline(
+                static_cast<int>(centerCanvas.x),
+                static_cast<int>(centerCanvas.y),
+                static_cast<int>(radiusCanvas),
+                Settings::current().previewColor,
                 Config::CIRCLE_THIN_WIDTH
             );
         }
     }
     
+    /**
+     * Draw every circle of the scene except the selected one as a thin
+     * outline. Large scenes are shown by their highlights only.
+     */
+    void drawSceneCircles(const CircleScene& scene, int selected, const CoordinateTransform& transform) {
+        if (scene.size() > static_cast<size_t>(Config::MAX_DRAWN_CIRCLES)) {
+            return;
+        }
+        scene.forEach([&](int id, const Circle& circle) {
+            if (id == selected) {
+                return;
+            }
+            Point2D centerCanvas = transform.gridToCanvas(circle.center);
+            drawCircleOutline(
+                static_cast<int>(centerCanvas.x),
+                static_cast<int>(centerCanvas.y),
+                static_cast<int>(transform.gridDistanceToCanvas(circle.radius)),
+                Settings::current().sceneColor,
+                Config::CIRCLE_THIN_WIDTH
+            );
+        });
+    }
+    
     /**
      * Draw the final circle visualization with all three circles.
      * 
@@ -111,7 +176,7 @@ public:
                 static_cast<int>(centerCanvas.x),
                 static_cast<int>(centerCanvas.y),
                 static_cast<int>(radiusCanvas),
-                Config::COL_BLUE,
+                Settings::current().highlightColor,
                 Config::CIRCLE_THICK_WIDTH
             );
         }
@@ -125,7 +190,7 @@ public:
                 static_cast<int>(centerCanvas.x),
                 static_cast<int>(centerCanvas.y),
                 static_cast<int>(radiusCanvas),
-                Config::COL_RED,
+                Settings::current().boundsColor,
                 Config::CIRCLE_THIN_WIDTH
             );
         }
@@ -139,7 +204,7 @@ public:
                 static_cast<int>(centerCanvas.x),
                 static_cast<int>(centerCanvas.y),
                 static_cast<int>(radiusCanvas),
-                Config::COL_RED,
+                Settings::current().boundsColor,
                 Config::CIRCLE_THIN_WIDTH
             );
         }
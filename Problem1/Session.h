@@ -0,0 +1,296 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "Config.h"
+#include "Geometry.h"
+#include "Grid.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Session persistence for the highlight state and the circles drawn over it.
+ *
+ * The session file is laid out for use in place: a fixed header followed by
+ * three slots of highlight tiles. Loading maps the file and hands the active
+ * slot's tiles straight to the grid's highlight bitset, so startup costs only
+ * the page faults of the tiles actually read. Saving writes a slot that is
+ * neither the active one nor the loaded one, flushes it, and then flips the
+ * header's active slot. Tiles of the loaded slot, which the live grid and
+ * undo history may still share, are never overwritten, and neither is the
+ * active slot, so a crash mid-save leaves the previous session intact.
+ *
+ * Each slot also lists every circle of the scene, in a region of its own
+ * that is moved to the end of the file when the scene outgrows it.
+ */
+
+/**
+ * A read-write view of a whole file.
+ */
+class MappedFile {
+private:
+    HANDLE file;
+    HANDLE mapping;
+    void* view;
+    size_t byteCount;
+
+    MappedFile() : file(INVALID_HANDLE_VALUE), mapping(NULL), view(nullptr), byteCount(0) {}
+
+public:
+    /**
+     * Map the file, creating it or growing it to minSize bytes if needed.
+     * Returns nullptr on failure.
+     */
+    static std::shared_ptr<MappedFile> open(const char* path, size_t minSize) {
+        std::shared_ptr<MappedFile> mapped(new MappedFile());
+        // Shared for writing: a grown mapping of the file is opened while
+        // the loaded one is still in use
+        mapped->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                   NULL, minSize ? OPEN_ALWAYS : OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL, NULL);
+        if (mapped->file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(mapped->file, &fileSize)) {
+            return nullptr;
+        }
+        size_t size = std::max(static_cast<size_t>(fileSize.QuadPart), minSize);
+        if (size == 0) {
+            return nullptr;
+        }
+
+        mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READWRITE,
+                                             static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                             static_cast<DWORD>(size & 0xFFFFFFFFu), NULL);
+        if (mapped->mapping == NULL) {
+            return nullptr;
+        }
+        mapped->view = MapViewOfFile(mapped->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (!mapped->view) {
+            return nullptr;
+        }
+        mapped->byteCount = size;
+        return mapped;
+    }
+
+    ~MappedFile() {
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    uint8_t* data() { return static_cast<uint8_t*>(view); }
+    size_t size() const { return byteCount; }
+
+    /**
+     * Write a range of the view back to disk.
+     */
+    bool flush(size_t offset, size_t bytes) {
+        return FlushViewOfFile(data() + offset, bytes) && FlushFileBuffers(file);
+    }
+};
+
+/**
+ * A circle as stored in the session file.
+ */
+struct SessionCircle {
+    double centerX;
+    double centerY;
+    double radius;
+    
+    void store(const Circle& circle) {
+        centerX = circle.center.x;
+        centerY = circle.center.y;
+        radius = circle.radius;
+    }
+    
+    Circle load() const {
+        return Circle(centerX, centerY, radius);
+    }
+};
+
+/**
+ * One saved state: where its highlight tiles and the scene's circles are.
+ */
+struct SessionSlot {
+    uint64_t offset;           // Byte offset of the highlight tiles
+    uint64_t circlesOffset;    // Byte offset of the circles, grid space
+    uint64_t circleCount;
+    uint64_t circleCapacity;   // Circles that fit at circlesOffset
+    int32_t selectedIndex;     // Selected circle's position in the list, or -1
+    uint32_t reserved;
+    double threshold;          // Rasterization threshold the highlights were drawn with
+};
+
+/**
+ * File header, used in place. Plain fixed-size fields only.
+ */
+struct SessionHeader {
+    char magic[8];             // "P1SESS"
+    uint32_t version;
+    uint32_t activeSlot;       // Slot holding the current state
+    int32_t rows;
+    int32_t cols;
+    uint32_t layout;           // TiledBitset::Layout of the tiles
+    uint32_t reserved;
+    uint64_t slotBytes;
+    SessionSlot slots[3];      // Active, loaded and one to write next
+};
+
+class Session {
+private:
+    static const uint32_t VERSION = 4;
+    static const size_t HEADER_BYTES = 4096;  // Keeps tile slots page aligned
+
+    std::string path;
+    int gridSize;
+    std::shared_ptr<MappedFile> file;
+    int loadedSlot;  // Slot the live selection may share tiles with, or -1
+
+    size_t slotBytes() const {
+        return TiledBitset::tileWordCount(gridSize, gridSize) * sizeof(uint64_t);
+    }
+
+    size_t fileBytes() const {
+        return HEADER_BYTES + 3 * slotBytes();
+    }
+
+    SessionHeader* headerView() {
+        return reinterpret_cast<SessionHeader*>(file->data());
+    }
+
+    bool isValid() {
+        if (!file || file->size() < fileBytes()) {
+            return false;
+        }
+        const SessionHeader* header = headerView();
+        return std::memcmp(header->magic, "P1SESS", 7) == 0 &&
+               header->version == VERSION &&
+               header->rows == gridSize && header->cols == gridSize &&
+               header->layout == static_cast<uint32_t>(Grid::highlightLayout()) &&
+               header->activeSlot < 3 && header->slotBytes == slotBytes() &&
+               header->slots[0].offset + slotBytes() <= file->size() &&
+               header->slots[1].offset + slotBytes() <= file->size() &&
+               header->slots[2].offset + slotBytes() <= file->size();
+    }
+
+    bool circlesFit(const SessionSlot& slot) const {
+        return slot.circleCount <= slot.circleCapacity &&
+               slot.circleCapacity <= (file->size() - slot.circlesOffset) / sizeof(SessionCircle) &&
+               slot.circlesOffset <= file->size();
+    }
+
+public:
+    Session(const std::string& path, int gridSize) : path(path), gridSize(gridSize), loadedSlot(-1) {}
+
+    /**
+     * Restore a saved session. The highlight tiles are used straight from
+     * the mapped file; the circles are the scene they are the union of,
+     * drawn with the given threshold. Returns false if there is no usable session.
+     */
+    bool load(Grid& grid, std::vector<Circle>& circles, int& selectedIndex, double& threshold) {
+        file = MappedFile::open(path.c_str(), 0);
+        if (!isValid() || !circlesFit(headerView()->slots[headerView()->activeSlot])) {
+            file.reset();
+            return false;
+        }
+
+        const SessionHeader* header = headerView();
+        loadedSlot = static_cast<int>(header->activeSlot);
+        const SessionSlot& slot = header->slots[loadedSlot];
+        uint64_t* tiles = reinterpret_cast<uint64_t*>(file->data() + slot.offset);
+
+        grid.restoreHighlights(TiledBitset::adopt(grid.getSize(), grid.getSize(),
+                                                   Grid::highlightLayout(), file, tiles));
+        const SessionCircle* stored = reinterpret_cast<const SessionCircle*>(file->data() + slot.circlesOffset);
+        circles.clear();
+        for (uint64_t k = 0; k < slot.circleCount; ++k) {
+            circles.push_back(stored[k].load());
+        }
+        selectedIndex = slot.selectedIndex < static_cast<int64_t>(circles.size()) ? slot.selectedIndex : -1;
+        threshold = slot.threshold;
+        return true;
+    }
+
+    /**
+     * Save the grid and the scene's circles. Writes the slot that is neither
+     * active nor loaded, flushes it, then publishes it by flipping the
+     * header's active slot.
+     *
+     * @param selectedIndex Position of the selected circle in circles, or -1
+     * @param threshold Rasterization threshold the highlights were drawn with
+     */
+    bool save(const Grid& grid, const std::vector<Circle>& circles, int selectedIndex, double threshold) {
+        if (!file || !isValid()) {
+            // New or incompatible file: lay it out from scratch
+            loadedSlot = -1;
+            file = MappedFile::open(path.c_str(), fileBytes());
+            if (!file) {
+                return false;
+            }
+            SessionHeader* header = headerView();
+            *header = SessionHeader();
+            std::memcpy(header->magic, "P1SESS", 7);
+            header->version = VERSION;
+            header->activeSlot = 1;
+            header->rows = gridSize;
+            header->cols = gridSize;
+            header->layout = static_cast<uint32_t>(Grid::highlightLayout());
+            header->slotBytes = slotBytes();
+            header->slots[0].offset = HEADER_BYTES;
+            header->slots[1].offset = HEADER_BYTES + slotBytes();
+            header->slots[2].offset = HEADER_BYTES + 2 * slotBytes();
+        }
+
+        SessionHeader* header = headerView();
+        // Never write the published state, nor the loaded one the live tiles
+        // may still share
+        uint32_t target = 0;
+        while (target == header->activeSlot || static_cast<int>(target) == loadedSlot) {
+            target++;
+        }
+        if (circles.size() > header->slots[target].circleCapacity) {
+            // Give the slot a larger circle region at the end of the file.
+            // The old mapping stays alive while loaded tiles still use it.
+            size_t end = file->size();
+            size_t capacity = std::max<size_t>(2 * circles.size(), 256);
+            std::shared_ptr<MappedFile> grown = MappedFile::open(path.c_str(), end + capacity * sizeof(SessionCircle));
+            if (!grown) {
+                return false;
+            }
+            file = grown;
+            header = headerView();
+            header->slots[target].circlesOffset = end;
+            header->slots[target].circleCapacity = capacity;
+        }
+        SessionSlot& slot = header->slots[target];
+
+        grid.snapshotHighlights().copyTiles(reinterpret_cast<uint64_t*>(file->data() + slot.offset));
+        SessionCircle* stored = reinterpret_cast<SessionCircle*>(file->data() + slot.circlesOffset);
+        for (size_t k = 0; k < circles.size(); ++k) {
+            stored[k].store(circles[k]);
+        }
+        slot.circleCount = circles.size();
+        slot.selectedIndex = selectedIndex;
+        slot.threshold = threshold;
+        if (!file->flush(static_cast<size_t>(slot.offset), slotBytes()) ||
+            (!circles.empty() && !file->flush(static_cast<size_t>(slot.circlesOffset), circles.size() * sizeof(SessionCircle))) ||
+            !file->flush(0, sizeof(SessionHeader))) {
+            return false;
+        }
+
+        // Publish the new state only once it is on disk
+        header->activeSlot = target;
+        return file->flush(0, sizeof(SessionHeader));
+    }
+};
+
+#endif // SESSION_H
@@ -0,0 +1,247 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "Config.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/**
+ * Runtime settings.
+ *
+ * The values in Config are the defaults. They can be overridden by a
+ * settings file of "key = value" lines ('#' starts a comment) and then by
+ * "--key value" options on the command line; "--config path" names a
+ * different settings file. Settings are fixed once the application starts.
+ *
+ * Keys: grid, width, height, padding, threshold, step, and the colors
+ * point, highlight, bounds, background, preview and scene as
+ * red,green,blue (0 to 255 each).
+ */
+struct Settings {
+    int gridSize;
+    int windowWidth;
+    int windowHeight;
+    int gridPadding;
+    double threshold;      // Config::RASTERIZATION_THRESHOLD
+    double radiusStep;     // Config::RADIUS_STEP
+
+    COLORREF pointColor;        // Config::COL_GRAY
+    COLORREF highlightColor;    // Config::COL_BLUE, also the user's circle
+    COLORREF boundsColor;       // Config::COL_RED, also the status text
+    COLORREF backgroundColor;   // Config::COL_BACKGROUND
+    COLORREF previewColor;      // Config::COL_PREVIEW
+    COLORREF sceneColor;        // Config::COL_SCENE_CIRCLE
+
+    Settings()
+        : gridSize(Config::GRID_SIZE),
+          windowWidth(Config::WINDOW_WIDTH),
+          windowHeight(Config::WINDOW_HEIGHT),
+          gridPadding(Config::GRID_PADDING),
+          threshold(Config::RASTERIZATION_THRESHOLD),
+          radiusStep(Config::RADIUS_STEP),
+          pointColor(Config::COL_GRAY),
+          highlightColor(Config::COL_BLUE),
+          boundsColor(Config::COL_RED),
+          backgroundColor(Config::COL_BACKGROUND),
+          previewColor(Config::COL_PREVIEW),
+          sceneColor(Config::COL_SCENE_CIRCLE) {}
+
+    /**
+     * The settings in effect for the whole program.
+     */
+    static Settings& current() {
+        static Settings settings;
+        return settings;
+    }
+
+    /**
+     * Set one value by key. Returns false with a message for an unknown
+     * key or a value out of range.
+     */
+    bool set(const std::string& key, const std::string& value, std::string& error) {
+        if (key == "grid") {
+            return parseInt(key, value, 2, 4096, gridSize, error);
+        } else if (key == "width") {
+            return parseInt(key, value, 100, 8192, windowWidth, error);
+        } else if (key == "height") {
+            return parseInt(key, value, 100, 8192, windowHeight, error);
+        } else if (key == "padding") {
+            return parseInt(key, value, 0, 1000, gridPadding, error);
+        } else if (key == "threshold") {
+            return parseDouble(key, value, 0.0, 10.0, threshold, error);
+        } else if (key == "step") {
+            return parseDouble(key, value, 0.01, 100.0, radiusStep, error);
+        }
+
+        const struct { const char* key; COLORREF Settings::*color; } colors[] = {
+            {"point", &Settings::pointColor},
+            {"highlight", &Settings::highlightColor},
+            {"bounds", &Settings::boundsColor},
+            {"background", &Settings::backgroundColor},
+            {"preview", &Settings::previewColor},
+            {"scene", &Settings::sceneColor},
+        };
+        for (size_t k = 0; k < sizeof(colors) / sizeof(colors[0]); ++k) {
+            if (key == colors[k].key) {
+                return parseColor(key, value, this->*colors[k].color, error);
+            }
+        }
+        error = "unknown setting '" + key + "'";
+        return false;
+    }
+
+    /**
+     * Apply a settings file. A missing file is not an error when optional.
+     */
+    bool loadFile(const std::string& path, bool optional, std::string& error) {
+        FILE* file = std::fopen(path.c_str(), "r");
+        if (!file) {
+            if (optional) {
+                return true;
+            }
+            error = "cannot open " + path;
+            return false;
+        }
+
+        char buffer[512];
+        int lineNumber = 0;
+        bool ok = true;
+        while (ok && std::fgets(buffer, sizeof(buffer), file)) {
+            ++lineNumber;
+            std::string line(buffer);
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) {
+                continue;
+            }
+            size_t equals = line.find('=');
+            if (equals == std::string::npos) {
+                error = "expected key = value";
+                ok = false;
+            } else {
+                ok = set(trim(line.substr(0, equals)), trim(line.substr(equals + 1)), error);
+            }
+            if (!ok) {
+                error = path + ":" + std::to_string(lineNumber) + ": " + error;
+            }
+        }
+        std::fclose(file);
+        return ok;
+    }
+
+    /**
+     * Apply "--key value" options from a command line. A "--config path"
+     * option is applied first, so the other options override the file.
+     */
+    bool parseCommandLine(const std::string& commandLine, std::string& error) {
+        std::string configPath = Config::SETTINGS_FILE;
+        bool configGiven = false;
+        std::vector<std::string> words = split(commandLine);
+        for (size_t k = 0; k + 1 < words.size(); ++k) {
+            if (words[k] == "--config") {
+                configPath = words[k + 1];
+                configGiven = true;
+            }
+        }
+        if (!loadFile(configPath, !configGiven, error)) {
+            return false;
+        }
+
+        for (size_t k = 0; k < words.size(); k += 2) {
+            if (words[k].compare(0, 2, "--") != 0 || k + 1 >= words.size()) {
+                error = "expected --key value, got '" + words[k] + "'";
+                return false;
+            }
+            if (words[k] != "--config" && !set(words[k].substr(2), words[k + 1], error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static std::string trim(const std::string& text) {
+        size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) {
+            return std::string();
+        }
+        size_t last = text.find_last_not_of(" \t\r\n");
+        return text.substr(first, last - first + 1);
+    }
+
+    // Whitespace-separated words; double quotes group a word with spaces
+    static std::vector<std::string> split(const std::string& text) {
+        std::vector<std::string> words;
+        size_t k = 0;
+        while (k < text.size()) {
+            while (k < text.size() && (text[k] == ' ' || text[k] == '\t')) {
+                ++k;
+            }
+            if (k == text.size()) {
+                break;
+            }
+            std::string word;
+            bool quoted = false;
+            while (k < text.size() && (quoted || (text[k] != ' ' && text[k] != '\t'))) {
+                if (text[k] == '"') {
+                    quoted = !quoted;
+                } else {
+                    word += text[k];
+                }
+                ++k;
+            }
+            words.push_back(word);
+        }
+        return words;
+    }
+
+    static bool parseInt(const std::string& key, const std::string& value, int low, int high,
+                         int& out, std::string& error) {
+        char* end = nullptr;
+        errno = 0;
+        long parsed = std::strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || errno != 0 || parsed < low || parsed > high) {
+            error = key + " must be an integer from " + std::to_string(low) + " to " + std::to_string(high);
+            return false;
+        }
+        out = static_cast<int>(parsed);
+        return true;
+    }
+
+    static bool parseDouble(const std::string& key, const std::string& value, double low, double high,
+                            double& out, std::string& error) {
+        char* end = nullptr;
+        errno = 0;
+        double parsed = std::strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0' || errno != 0 || !(parsed >= low && parsed <= high)) {
+            char range[64];
+            std::snprintf(range, sizeof(range), " must be a number from %g to %g", low, high);
+            error = key + range;
+            return false;
+        }
+        out = parsed;
+        return true;
+    }
+
+    // Red, green and blue from 0 to 255, separated by commas
+    static bool parseColor(const std::string& key, const std::string& value, COLORREF& out,
+                           std::string& error) {
+        int channels[3];
+        size_t begin = 0;
+        for (int c = 0; c < 3; ++c) {
+            size_t end = c < 2 ? value.find(',', begin) : value.size();
+            std::string part = end == std::string::npos ? std::string() : trim(value.substr(begin, end - begin));
+            if (!parseInt(key, part, 0, 255, channels[c], error)) {
+                error = key + " must be a color as red,green,blue from 0 to 255";
+                return false;
+            }
+            begin = end + 1;
+        }
+        out = RGB(channels[0], channels[1], channels[2]);
+        return true;
+    }
+};
+
+#endif // SETTINGS_H
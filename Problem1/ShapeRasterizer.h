@@ -0,0 +1,404 @@
+#ifndef SHAPE_RASTERIZER_H
+#define SHAPE_RASTERIZER_H
+
+#include "Grid.h"
+#include "Geometry.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * Columns [begin, end) of one grid row.
+ */
+struct GridSpan {
+    int row;
+    int begin;
+    int end;
+
+    GridSpan() : row(0), begin(0), end(0) {}
+    GridSpan(int r, int b, int e) : row(r), begin(b), end(e) {}
+};
+
+/**
+ * The region between two concentric circles and, unless it covers the full
+ * turn, between two rays from their center: a filled disc (inner radius 0),
+ * a thick ring, a pie slice or an arc of a thick ring. Both circles belong
+ * to the region.
+ *
+ * Angles are in radians from the +x axis toward +y. Grid rows grow
+ * downward, so increasing angles run clockwise on screen. The region runs
+ * from startAngle to endAngle through increasing angles; equal angles, or
+ * a sweep of 2 pi or more, give the full turn.
+ */
+class AnnularSector {
+private:
+    double startX, startY;  // Unit vector along the start ray
+    double endX, endY;      // Unit vector along the end ray
+    double sweep;           // Angle from the start ray to the end ray, in (0, 2 pi]
+
+public:
+    Point2D center;
+    double innerRadius;
+    double outerRadius;
+
+    AnnularSector(const Point2D& c, double inner, double outer, double startAngle, double endAngle)
+        : startX(std::cos(startAngle)), startY(std::sin(startAngle)),
+          endX(std::cos(endAngle)), endY(std::sin(endAngle)),
+          center(c), innerRadius(inner), outerRadius(outer) {
+        const double fullTurn = 2.0 * 3.14159265358979323846;
+        sweep = endAngle - startAngle;
+        if (!(sweep < fullTurn)) {
+            sweep = fullTurn;
+        } else {
+            sweep = std::fmod(sweep, fullTurn);
+            if (sweep <= 0.0) {
+                sweep += fullTurn;
+            }
+        }
+    }
+
+    static AnnularSector disc(const Point2D& center, double radius) {
+        return AnnularSector(center, 0.0, radius, 0.0, 0.0);
+    }
+
+    static AnnularSector ring(const Point2D& center, double innerRadius, double outerRadius) {
+        return AnnularSector(center, innerRadius, outerRadius, 0.0, 0.0);
+    }
+
+    /**
+     * The part of a circle's thick outline between two angles, halfWidth to
+     * either side of the circle; with the rasterization threshold as
+     * halfWidth it is a piece of the ring CircleRasterizer highlights.
+     */
+    static AnnularSector arc(const Circle& circle, double halfWidth, double startAngle, double endAngle) {
+        return AnnularSector(circle.center, circle.radius - halfWidth, circle.radius + halfWidth,
+                             startAngle, endAngle);
+    }
+
+    bool isFullTurn() const {
+        return sweep >= 2.0 * 3.14159265358979323846;
+    }
+
+    /**
+     * More than a half turn: inside either ray's half-plane rather than both.
+     */
+    bool isReflex() const {
+        return sweep > 3.14159265358979323846;
+    }
+
+    /**
+     * Half-plane tests for an offset (dx, dy) from the center: at least 0
+     * on the sweep's side of the start ray and of the end ray. Each is
+     * linear in dx, with slope startSlope() and endSlope().
+     */
+    double startSide(double dx, double dy) const { return startX * dy - startY * dx; }
+    double endSide(double dx, double dy) const { return endY * dx - endX * dy; }
+    double startSlope() const { return -startY; }
+    double endSlope() const { return endY; }
+
+    /**
+     * Exact membership of one point; the spans agree with it point for point.
+     */
+    bool contains(const Point2D& point) const {
+        double distance = center.distanceTo(point);
+        if (distance > outerRadius || distance < innerRadius) {
+            return false;
+        }
+        if (isFullTurn()) {
+            return true;
+        }
+        double dx = point.x - center.x;
+        double dy = point.y - center.y;
+        bool afterStart = startSide(dx, dy) >= 0.0;
+        bool beforeEnd = endSide(dx, dy) >= 0.0;
+        return isReflex() ? (afterStart || beforeEnd) : (afterStart && beforeEnd);
+    }
+};
+
+/**
+ * Span-based rasterization of discs, thick rings, sectors and arcs.
+ *
+ * Rather than testing every point of the bounding box, each row is solved
+ * for its interval of columns: the outer circle's chord, minus the inner
+ * circle's chord, cut by the half-planes of the two rays. The closed-form
+ * endpoints are then checked against the same distance and side tests
+ * AnnularSector::contains uses and moved by a column where rounding put
+ * them off, so spans match the per-point test exactly. A row costs O(1)
+ * plus the spans it produces, whatever its length.
+ */
+class ShapeRasterizer {
+private:
+    struct Interval {
+        int begin;
+        int end;
+    };
+
+    /**
+     * Column of [lo, hi] nearest x, without overflowing on huge or NaN x.
+     */
+    static int clampColumn(double x, int lo, int hi) {
+        if (!(x > lo)) {
+            return lo;
+        }
+        if (!(x < hi)) {
+            return hi;
+        }
+        return static_cast<int>(x);
+    }
+
+    /**
+     * First column of [lo, hi) where inside holds, or hi; inside must be
+     * false and then true across the range. Starts from guess and walks,
+     * which takes a step or two from a closed-form guess.
+     */
+    template <typename Predicate>
+    static int firstInside(int guess, int lo, int hi, const Predicate& inside) {
+        guess = std::max(lo, std::min(hi, guess));
+        while (guess > lo && inside(guess - 1)) {
+            --guess;
+        }
+        while (guess < hi && !inside(guess)) {
+            ++guess;
+        }
+        return guess;
+    }
+
+    template <typename Predicate>
+    struct Not {
+        const Predicate& predicate;
+        bool operator()(int col) const { return !predicate(col); }
+    };
+
+    template <typename Predicate>
+    static Not<Predicate> negate(const Predicate& predicate) {
+        Not<Predicate> result = {predicate};
+        return result;
+    }
+
+    /**
+     * Columns of [0, size) where side(col) >= 0, for side linear in col
+     * with the given slope and a root near column root.
+     */
+    template <typename Side>
+    static Interval halfLine(int size, double slope, double root, const Side& side) {
+        Interval columns = {0, size};
+        if (slope > 0.0) {
+            columns.begin = firstInside(clampColumn(std::ceil(root), 0, size), 0, size, side);
+        } else if (slope < 0.0) {
+            columns.end = firstInside(clampColumn(std::floor(root) + 1.0, 0, size), 0, size, negate(side));
+        } else if (!side(0)) {
+            columns.end = 0;
+        }
+        return columns;
+    }
+
+    /**
+     * Columns of [0, size) where side(col) < 0, the complement of halfLine.
+     */
+    template <typename Side>
+    static Interval outsideHalfLine(int size, double slope, double root, const Side& side) {
+        Interval inside = halfLine(size, slope, root, side);
+        Interval outside = {0, size};
+        if (inside.begin > 0) {
+            outside.end = inside.begin;
+        } else if (inside.end < size) {
+            outside.begin = inside.end;
+        } else {
+            outside.end = 0;
+        }
+        return outside;
+    }
+
+    static Interval intersect(const Interval& a, const Interval& b) {
+        Interval result = {std::max(a.begin, b.begin), std::min(a.end, b.end)};
+        return result;
+    }
+
+    struct RowSide {
+        const AnnularSector& shape;
+        double dy;
+        bool start;
+
+        bool operator()(int col) const {
+            double dx = col - shape.center.x;
+            return (start ? shape.startSide(dx, dy) : shape.endSide(dx, dy)) >= 0.0;
+        }
+    };
+
+    struct WithinRadius {
+        const AnnularSector& shape;
+        double row;
+        double radius;
+
+        bool operator()(int col) const {
+            return shape.center.distanceTo(Point2D(col, row)) <= radius;
+        }
+    };
+
+    struct BeyondRadius {
+        const AnnularSector& shape;
+        double row;
+        double radius;
+
+        bool operator()(int col) const {
+            return shape.center.distanceTo(Point2D(col, row)) >= radius;
+        }
+    };
+
+public:
+    /**
+     * Call visit(row, begin, end) for every run of columns [begin, end) of
+     * the grid inside the shape, rows in increasing order and runs left to
+     * right within a row. Grid point (row, col) sits at grid position
+     * (col, row), as for CircleRasterizer.
+     *
+     * @param size Grid size
+     * @param shape The region (in grid space)
+     */
+    template <typename Visitor>
+    static void forEachSpan(int size, const AnnularSector& shape, Visitor visit) {
+        const double cx = shape.center.x;
+        const double cy = shape.center.y;
+        const double outer = shape.outerRadius;
+        if (!(outer >= 0.0) || size <= 0) {
+            return;
+        }
+
+        const int minRow = clampColumn(std::floor(cy - outer), 0, size - 1);
+        const int maxRow = clampColumn(std::ceil(cy + outer), 0, size - 1);
+        const int mid = clampColumn(std::ceil(cx), 0, size);  // First column right of the center
+
+        for (int row = minRow; row <= maxRow; ++row) {
+            const double dy = row - cy;
+            if (std::abs(dy) > outer) {
+                continue;
+            }
+
+            // Outer chord: filling inward from each side of the center
+            const double outerHalf = std::sqrt(std::max(0.0, outer * outer - dy * dy));
+            WithinRadius withinOuter = {shape, static_cast<double>(row), outer};
+            Interval radial = {
+                firstInside(clampColumn(std::ceil(cx - outerHalf), 0, mid), 0, mid, withinOuter),
+                firstInside(clampColumn(std::floor(cx + outerHalf) + 1.0, mid, size), mid, size,
+                            negate(withinOuter))
+            };
+            if (radial.begin >= radial.end) {
+                continue;
+            }
+
+            // Inner chord, the hole between the two pieces of a ring
+            Interval hole = {mid, mid};
+            const double inner = shape.innerRadius;
+            if (inner > 0.0 && std::abs(dy) < inner) {
+                const double innerHalf = std::sqrt(inner * inner - dy * dy);
+                BeyondRadius beyondInner = {shape, static_cast<double>(row), inner};
+                hole.begin = firstInside(clampColumn(std::ceil(cx - innerHalf), 0, mid), 0, mid,
+                                         negate(beyondInner));
+                hole.end = firstInside(clampColumn(std::floor(cx + innerHalf) + 1.0, mid, size), mid, size,
+                                       beyondInner);
+            }
+            Interval pieces[2] = {
+                {radial.begin, std::min(radial.end, hole.begin)},
+                {std::max(radial.begin, hole.end), radial.end}
+            };
+            if (hole.begin >= hole.end) {
+                pieces[0] = radial;
+                pieces[1].begin = pieces[1].end = radial.end;
+            }
+
+            // Angular limits: one interval, or two around the excluded wedge
+            Interval angular[2] = {{0, size}, {size, size}};
+            if (!shape.isFullTurn()) {
+                RowSide afterStart = {shape, dy, true};
+                RowSide beforeEnd = {shape, dy, false};
+                // Each side is zero where dx = (ray x) dy / (ray y)
+                double startRoot = shape.startSlope() != 0.0 ? cx - shape.startSide(0.0, dy) / shape.startSlope() : 0.0;
+                double endRoot = shape.endSlope() != 0.0 ? cx - shape.endSide(0.0, dy) / shape.endSlope() : 0.0;
+                if (!shape.isReflex()) {
+                    angular[0] = intersect(halfLine(size, shape.startSlope(), startRoot, afterStart),
+                                           halfLine(size, shape.endSlope(), endRoot, beforeEnd));
+                } else {
+                    Interval excluded = intersect(outsideHalfLine(size, shape.startSlope(), startRoot, afterStart),
+                                                  outsideHalfLine(size, shape.endSlope(), endRoot, beforeEnd));
+                    if (excluded.begin < excluded.end) {
+                        angular[0].end = excluded.begin;
+                        angular[1].begin = excluded.end;
+                    }
+                }
+            }
+
+            // Both lists are sorted and disjoint, so their intersections are
+            // too; runs that touch are joined
+            int runBegin = 0, runEnd = 0;
+            for (int p = 0; p < 2; ++p) {
+                for (int a = 0; a < 2; ++a) {
+                    Interval run = intersect(pieces[p], angular[a]);
+                    if (run.begin >= run.end) {
+                        continue;
+                    }
+                    if (runBegin < runEnd && run.begin == runEnd) {
+                        runEnd = run.end;
+                        continue;
+                    }
+                    if (runBegin < runEnd) {
+                        visit(row, runBegin, runEnd);
+                    }
+                    runBegin = run.begin;
+                    runEnd = run.end;
+                }
+            }
+            if (runBegin < runEnd) {
+                visit(row, runBegin, runEnd);
+            }
+        }
+    }
+
+    /**
+     * The shape's runs of columns, as forEachSpan visits them.
+     */
+    static std::vector<GridSpan> spans(int size, const AnnularSector& shape) {
+        std::vector<GridSpan> result;
+        forEachSpan(size, shape, [&](int row, int begin, int end) {
+            result.push_back(GridSpan(row, begin, end));
+        });
+        return result;
+    }
+
+    /**
+     * Number of grid points inside the shape, for area and coverage.
+     */
+    static size_t countPoints(int size, const AnnularSector& shape) {
+        size_t count = 0;
+        forEachSpan(size, shape, [&](int, int begin, int end) {
+            count += static_cast<size_t>(end - begin);
+        });
+        return count;
+    }
+
+    /**
+     * Highlight (or clear) the shape's points on the grid, a word at a
+     * time. Points outside the shape keep their state.
+     *
+     * @param grid The grid to rasterize onto
+     * @param shape The region (in grid space)
+     * @param highlighted State to give the shape's points
+     */
+    static void fill(Grid& grid, const AnnularSector& shape, bool highlighted = true) {
+        forEachSpan(grid.getSize(), shape, [&](int row, int begin, int end) {
+            grid.setHighlightedRange(row, begin, end, highlighted);
+        });
+    }
+
+    /**
+     * Set (or clear) the shape's points in a mask, e.g. one from
+     * Grid::emptyMask() to compare or composite with the highlights.
+     */
+    static void fill(TiledBitset& mask, const AnnularSector& shape, bool value = true) {
+        const int size = std::min(mask.rows(), mask.cols());
+        forEachSpan(size, shape, [&](int row, int begin, int end) {
+            mask.setRange(row, begin, end, value);
+        });
+    }
+};
+
+#endif // SHAPE_RASTERIZER_H
@@ -0,0 +1,422 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TaskGraph;
+
+/**
+ * Work-stealing thread pool that runs graphs of tasks with dependencies.
+ *
+ * Each worker owns a deque of ready tasks: it pushes and pops at the back,
+ * so it goes on with the task it just made ready while its data is still
+ * in cache, and idle workers steal from the front of the others' deques.
+ * A thread waiting for a graph runs ready tasks instead of blocking, so a
+ * task can run a graph of its own (a distance transform inside a frame)
+ * without deadlock. Only graphs run here, so any ready task belongs to a
+ * graph someone is waiting for.
+ *
+ * Each worker counts the tasks it ran, how many it stole and the time it
+ * spent in them, for utilization reports.
+ *
+ * Each task costs a std::function, a push and pop on a spinlocked deque
+ * and two clock reads for the counts, about 0.2 us, so a task should do at
+ * least a few microseconds of work.
+ */
+class TaskScheduler {
+public:
+    struct WorkerStats {
+        uint64_t tasks;      // Tasks run
+        uint64_t steals;     // Of those, taken from another deque
+        double busySeconds;  // Time spent running tasks
+        double utilization;  // busySeconds over the time since resetStats
+    };
+
+private:
+    friend class TaskGraph;
+    typedef std::chrono::steady_clock Clock;
+
+    struct Task {
+        std::function<void()> work;
+        std::vector<Task*> successors;
+        std::atomic<int> dependencies;      // Predecessors not yet complete
+        std::atomic<int> unfinished;        // This task and its live children
+        int predecessorCount;
+        Task* parent;                       // Task that spawned this one
+        std::atomic<int>* remaining;        // Graph nodes left, for graph nodes
+        TaskScheduler* scheduler;
+
+        Task() : dependencies(0), unfinished(0), predecessorCount(0), parent(nullptr),
+                 remaining(nullptr), scheduler(nullptr) {}
+    };
+
+    /**
+     * Ready tasks behind a spinlock, held only to push or pop a pointer.
+     * The owner works at the back, thieves at the front. Padded apart
+     * rather than aligned, since C++11 new ignores alignas.
+     */
+    struct Queue {
+        std::atomic_flag flag;
+        std::deque<Task*> tasks;
+        std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> stolen;
+        std::atomic<uint64_t> busyNanoseconds;
+        char padding[64];
+
+        Queue() : executed(0), stolen(0), busyNanoseconds(0) { flag.clear(); }
+
+        void lock() {
+            while (flag.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+        void unlock() { flag.clear(std::memory_order_release); }
+    };
+
+    /**
+     * What the calling thread is doing for which scheduler.
+     */
+    struct ThreadState {
+        TaskScheduler* scheduler;   // Set for this scheduler's workers
+        size_t queue;
+        Task* task;                 // Task running on this thread
+
+        ThreadState() : scheduler(nullptr), queue(0), task(nullptr) {}
+    };
+
+    static ThreadState& current() {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    // One queue per worker, then one shared by every other thread
+    std::vector<std::unique_ptr<Queue> > queues;
+    std::vector<std::thread> workers;
+    std::atomic<long long> queued;      // Tasks in all queues
+    std::atomic<int> sleeping;
+    std::atomic<bool> stopping;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int64_t> statsStart;    // Clock ticks at the last resetStats
+
+    size_t ownQueue() const {
+        const ThreadState& state = current();
+        return state.scheduler == this ? state.queue : workers.size();
+    }
+
+    void push(Task* task) {
+        Queue& queue = *queues[ownQueue()];
+        queue.lock();
+        queue.tasks.push_back(task);
+        queue.unlock();
+        queued.fetch_add(1);
+        if (sleeping.load() > 0) {
+            // Taking the lock orders this with a worker between its check
+            // of queued and its wait, so the wakeup cannot be lost
+            std::lock_guard<std::mutex> guard(sleepMutex);
+            wake.notify_one();
+        }
+    }
+
+    /**
+     * Own queue's newest task, else the oldest task of another queue.
+     */
+    bool tryTake(size_t self, Task*& task, bool& stolen) {
+        if (queued.load(std::memory_order_relaxed) <= 0) {
+            return false;
+        }
+        for (size_t k = 0; k < queues.size(); ++k) {
+            Queue& queue = *queues[(self + k) % queues.size()];
+            queue.lock();
+            if (!queue.tasks.empty()) {
+                if (k == 0) {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                } else {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                }
+                queue.unlock();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                stolen = k != 0;
+                return true;
+            }
+            queue.unlock();
+        }
+        return false;
+    }
+
+    void execute(Task* task, size_t self, bool stolen) {
+        ThreadState& state = current();
+        Task* outer = state.task;
+        state.task = task;
+        Clock::time_point start = Clock::now();
+        task->work();
+        uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        state.task = outer;
+
+        Queue& queue = *queues[self];
+        queue.busyNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        queue.executed.fetch_add(1, std::memory_order_relaxed);
+        if (stolen) {
+            queue.stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        complete(task);
+    }
+
+    /**
+     * Called once for a task's own work and once per child; the last call
+     * releases its successors and completes its parent or graph node.
+     */
+    void complete(Task* task) {
+        if (task->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        for (size_t k = 0; k < task->successors.size(); ++k) {
+            Task* successor = task->successors[k];
+            if (successor->dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                push(successor);
+            }
+        }
+        if (task->parent) {
+            Task* parent = task->parent;
+            delete task;  // Children belong to no graph
+            complete(parent);
+        } else {
+            task->remaining->fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void workerLoop(size_t self) {
+        ThreadState& state = current();
+        state.scheduler = this;
+        state.queue = self;
+        Task* task;
+        bool stolen = false;
+        while (!stopping.load(std::memory_order_relaxed)) {
+            bool found = false;
+            for (int spin = 0; spin < 64 && !found; ++spin) {
+                found = tryTake(self, task, stolen);
+                if (!found) {
+                    std::this_thread::yield();
+                }
+            }
+            if (found) {
+                execute(task, self, stolen);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeping.fetch_add(1);
+            while (!stopping.load() && queued.load() <= 0) {
+                wake.wait(lock);
+            }
+            sleeping.fetch_sub(1);
+        }
+    }
+
+    /**
+     * Run ready tasks on the calling thread until the graph's remaining
+     * count drops to zero.
+     */
+    void wait(const std::atomic<int>& remaining) {
+        size_t self = ownQueue();
+        Task* task;
+        bool stolen = false;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (tryTake(self, task, stolen)) {
+                execute(task, self, stolen);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    TaskScheduler(const TaskScheduler&);
+    TaskScheduler& operator=(const TaskScheduler&);
+
+public:
+    /**
+     * @param workerCount Threads besides the ones that run graphs; 0 runs
+     *                    every task on the waiting thread
+     */
+    explicit TaskScheduler(unsigned workerCount) : queued(0), sleeping(0), stopping(false) {
+        for (unsigned k = 0; k <= workerCount; ++k) {
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        }
+        resetStats();
+        for (unsigned k = 0; k < workerCount; ++k) {
+            workers.push_back(std::thread([this, k]() { workerLoop(k); }));
+        }
+    }
+
+    ~TaskScheduler() {
+        {
+            std::lock_guard<std::mutex> guard(sleepMutex);
+            stopping.store(true);
+        }
+        wake.notify_all();
+        for (size_t k = 0; k < workers.size(); ++k) {
+            workers[k].join();
+        }
+    }
+
+    /**
+     * Pool sized so the workers and the thread waiting for a graph fill the
+     * machine.
+     */
+    static TaskScheduler& shared() {
+        static TaskScheduler scheduler(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return scheduler;
+    }
+
+    unsigned workerCount() const { return static_cast<unsigned>(workers.size()); }
+
+    /**
+     * Zero the counts and restart the utilization clock.
+     */
+    void resetStats() {
+        for (size_t k = 0; k < queues.size(); ++k) {
+            queues[k]->executed.store(0, std::memory_order_relaxed);
+            queues[k]->stolen.store(0, std::memory_order_relaxed);
+            queues[k]->busyNanoseconds.store(0, std::memory_order_relaxed);
+        }
+        statsStart.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    /**
+     * One entry per worker, then one for the threads waiting on graphs.
+     */
+    std::vector<WorkerStats> stats() const {
+        Clock::duration elapsed = Clock::now().time_since_epoch() - Clock::duration(statsStart.load());
+        double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-9);
+        std::vector<WorkerStats> result;
+        for (size_t k = 0; k < queues.size(); ++k) {
+            WorkerStats entry;
+            entry.tasks = queues[k]->executed.load(std::memory_order_relaxed);
+            entry.steals = queues[k]->stolen.load(std::memory_order_relaxed);
+            entry.busySeconds = queues[k]->busyNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+            entry.utilization = entry.busySeconds / seconds;
+            result.push_back(entry);
+        }
+        return result;
+    }
+
+    /**
+     * One line for a status display: totals, and the workers' mean
+     * utilization.
+     */
+    std::string report() const {
+        std::vector<WorkerStats> entries = stats();
+        uint64_t tasks = 0, steals = 0;
+        double utilization = 0;
+        for (size_t k = 0; k < entries.size(); ++k) {
+            tasks += entries[k].tasks;
+            steals += entries[k].steals;
+        }
+        for (size_t k = 0; k + 1 < entries.size(); ++k) {
+            utilization += entries[k].utilization;
+        }
+        char text[128];
+        std::snprintf(text, sizeof(text), "Pool: %u workers, %llu tasks (%llu stolen), %.1f%% utilization",
+                      workerCount(), static_cast<unsigned long long>(tasks), static_cast<unsigned long long>(steals),
+                      workers.empty() ? 0.0 : 100.0 * utilization / workers.size());
+        return text;
+    }
+};
+
+/**
+ * Tasks and the dependencies between them, run as a whole on a scheduler.
+ * The graph must be acyclic, tasks must not throw, and a graph is run by
+ * one thread at a time; it can be run again once run() returns.
+ */
+class TaskGraph {
+public:
+    typedef size_t Node;
+
+private:
+    typedef TaskScheduler::Task Task;
+
+    TaskScheduler& scheduler;
+    std::deque<Task> nodes;     // Stable addresses while nodes are added
+    std::atomic<int> remaining;
+
+    TaskGraph(const TaskGraph&);
+    TaskGraph& operator=(const TaskGraph&);
+
+public:
+    explicit TaskGraph(TaskScheduler& scheduler = TaskScheduler::shared())
+        : scheduler(scheduler), remaining(0) {}
+
+    Node add(std::function<void()> work) {
+        nodes.emplace_back();
+        Task& task = nodes.back();
+        task.work = std::move(work);
+        task.remaining = &remaining;
+        task.scheduler = &scheduler;
+        return nodes.size() - 1;
+    }
+
+    /**
+     * after starts once before, and every task before spawned, is done.
+     */
+    void precede(Node before, Node after) {
+        nodes[before].successors.push_back(&nodes[after]);
+        ++nodes[after].predecessorCount;
+    }
+
+    size_t size() const { return nodes.size(); }
+
+    /**
+     * Run every task and return when all have completed. The calling
+     * thread runs ready tasks meanwhile.
+     */
+    void run() {
+        if (nodes.empty()) {
+            return;
+        }
+        remaining.store(static_cast<int>(nodes.size()), std::memory_order_relaxed);
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            nodes[k].dependencies.store(nodes[k].predecessorCount, std::memory_order_relaxed);
+            nodes[k].unfinished.store(1, std::memory_order_relaxed);
+        }
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            if (nodes[k].predecessorCount == 0) {
+                scheduler.push(&nodes[k]);
+            }
+        }
+        scheduler.wait(remaining);
+    }
+
+    /**
+     * From inside a running task: run work as its child, so the task and
+     * its successors complete after it. Elsewhere, runs work immediately.
+     */
+    static void spawn(std::function<void()> work) {
+        Task* parent = TaskScheduler::current().task;
+        if (!parent) {
+            work();
+            return;
+        }
+        Task* child = new Task();
+        child->work = std::move(work);
+        child->parent = parent;
+        child->scheduler = parent->scheduler;
+        child->unfinished.store(1, std::memory_order_relaxed);
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+        parent->scheduler->push(child);
+    }
+};
+
+#endif // TASK_GRAPH_H
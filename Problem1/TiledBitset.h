@@ -0,0 +1,459 @@
+#ifndef TILED_BITSET_H
+#define TILED_BITSET_H
+
+#include "MaskKernels.h"
+#include "Morton.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Copy-on-write bitset stored as 64x64-bit tiles.
+ *
+ * Tiles and the table of tile pointers are reference counted, so copying a
+ * bitset (taking a snapshot) only copies one pointer. The first write after
+ * a snapshot copies the tile table once, and every write copies only the
+ * tile it touches. A missing tile reads as all zeros.
+ *
+ * Within a tile the 64 words are laid out either row-major (one word per
+ * row) or in Z-order (one 8x8 block per word, blocks in Morton order).
+ * Z-order keeps the points around a short arc in one or two cache lines;
+ * row words are still available in both layouts.
+ *
+ * Union, intersection, difference and XOR of whole bitsets work a tile at
+ * a time with MaskKernels, and resolve missing or shared tiles without
+ * reading their words: a union with an empty tile shares the other tile,
+ * and an intersection with one drops it.
+ *
+ * Copies are cheap but not thread-safe with respect to each other.
+ */
+class TiledBitset {
+public:
+    static const int TILE_BITS = 64;
+    
+    enum class Layout {
+        RowMajor,  // Word r of a tile is row r
+        ZOrder     // Word k of a tile is the 8x8 block with Morton index k
+    };
+
+private:
+    static_assert(TILE_BITS == Morton::TILE_SIZE, "Z-order layout assumes 64x64 tiles");
+    
+    struct Tile {
+        uint64_t words[TILE_BITS];
+    };
+    typedef std::vector<std::shared_ptr<Tile> > TileTable;
+
+    int rowCount;
+    int colCount;
+    int tileRows;
+    int tileCols;
+    Layout storage;
+    std::shared_ptr<TileTable> table;
+
+    const Tile* findTile(int i, int j) const {
+        return (*table)[(i / TILE_BITS) * tileCols + j / TILE_BITS].get();
+    }
+
+    bool tileRowEmpty(int tileRow) const {
+        for (int w = 0; w < tileCols; ++w) {
+            if ((*table)[tileRow * tileCols + w]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * this = this op other. With the same layout, tile words line up and
+     * whole tiles are combined; otherwise row words are.
+     */
+    template <MaskKernels::Op op>
+    TiledBitset& combine(const TiledBitset& other) {
+        typedef MaskKernels::Op Op;
+        if (storage != other.storage) {
+            for (int i = 0; i < rowCount; ++i) {
+                for (int w = 0; w < tileCols; ++w) {
+                    uint64_t old = word(i, w);
+                    uint64_t updated = MaskKernels::apply<op>(old, other.word(i, w));
+                    if (updated != old) {
+                        setWord(i, w, updated);
+                    }
+                }
+            }
+            return *this;
+        }
+
+        for (size_t k = 0; k < table->size(); ++k) {
+            std::shared_ptr<Tile> mine = (*table)[k];
+            const std::shared_ptr<Tile>& theirs = (*other.table)[k];
+            std::shared_ptr<Tile> result;
+            if (mine == theirs) {
+                if (op == Op::Or || op == Op::And) {
+                    continue;  // x | x = x & x = x
+                }
+            } else if (!theirs) {
+                if (op != Op::And) {
+                    continue;  // x | 0 = x & ~0 = x ^ 0 = x
+                }
+            } else if (!mine) {
+                if (op == Op::And || op == Op::AndNot) {
+                    continue;  // Stays empty
+                }
+                result = theirs;  // 0 | y = 0 ^ y = y, shared
+            } else {
+                // Overwrite a tile nothing else refers to, otherwise write a
+                // new one; a tile that comes out empty is dropped
+                Tile* out = (table.use_count() == 1 && mine.use_count() == 2) ? mine.get() : nullptr;  // Table and local
+                std::shared_ptr<Tile> fresh;
+                if (!out) {
+                    fresh = std::make_shared<Tile>();
+                    out = fresh.get();
+                }
+                if (MaskKernels::combine<op>(mine->words, theirs->words, out->words, TILE_BITS)) {
+                    if (!fresh) {
+                        continue;
+                    }
+                    result = fresh;
+                }
+            }
+            mutableTable()[k] = result;
+        }
+        return *this;
+    }
+
+    /**
+     * Number of set bits of this op other, per tile.
+     *
+     * @param stopAtFirst Return as soon as the count is non-zero
+     */
+    template <MaskKernels::Op op>
+    size_t countCombined(const TiledBitset& other, bool stopAtFirst) const {
+        size_t total = 0;
+        if (storage != other.storage) {
+            for (int i = 0; i < rowCount && !(stopAtFirst && total); ++i) {
+                for (int w = 0; w < tileCols; ++w) {
+                    total += __builtin_popcountll(MaskKernels::apply<op>(word(i, w), other.word(i, w)));
+                }
+            }
+            return total;
+        }
+
+        static const uint64_t zeros[TILE_BITS] = {};
+        for (size_t k = 0; k < table->size() && !(stopAtFirst && total); ++k) {
+            const Tile* mine = (*table)[k].get();
+            const Tile* theirs = (*other.table)[k].get();
+            if (mine || theirs) {
+                total += MaskKernels::countCombined<op>(mine ? mine->words : zeros,
+                                                        theirs ? theirs->words : zeros, TILE_BITS);
+            }
+        }
+        return total;
+    }
+
+    TileTable& mutableTable() {
+        if (table.use_count() > 1) {
+            table = std::make_shared<TileTable>(*table);
+        }
+        return *table;
+    }
+
+    Tile& mutableTile(int tileRow, int tileCol) {
+        std::shared_ptr<Tile>& tile = mutableTable()[tileRow * tileCols + tileCol];
+        if (!tile) {
+            tile = std::make_shared<Tile>();
+            for (int k = 0; k < TILE_BITS; ++k) {
+                tile->words[k] = 0;
+            }
+        } else if (tile.use_count() > 1) {
+            tile = std::make_shared<Tile>(*tile);
+        }
+        return *tile;
+    }
+
+public:
+    TiledBitset() : rowCount(0), colCount(0), tileRows(0), tileCols(0),
+                    storage(Layout::RowMajor), table(std::make_shared<TileTable>()) {}
+
+    TiledBitset(int rows, int cols, Layout layout = Layout::RowMajor)
+        : rowCount(rows), colCount(cols),
+          tileRows((rows + TILE_BITS - 1) / TILE_BITS),
+          tileCols((cols + TILE_BITS - 1) / TILE_BITS),
+          storage(layout),
+          table(std::make_shared<TileTable>(static_cast<size_t>(tileRows) * tileCols)) {}
+
+    int rows() const { return rowCount; }
+    int cols() const { return colCount; }
+    int wordsPerRow() const { return tileCols; }
+    Layout layout() const { return storage; }
+
+    /**
+     * Word and bit of a tile holding point (r, c) of that tile.
+     */
+    static void locate(Layout layout, int r, int c, int& word, int& bit) {
+        if (layout == Layout::ZOrder) {
+            uint32_t index = Morton::encode(r, c);
+            word = static_cast<int>(index >> 6);
+            bit = static_cast<int>(index & 63);
+        } else {
+            word = r;
+            bit = c;
+        }
+    }
+
+    /**
+     * Word w of row i (columns 64w .. 64w+63).
+     */
+    uint64_t word(int i, int w) const {
+        const Tile* tile = findTile(i, w * TILE_BITS);
+        if (!tile) {
+            return 0;
+        }
+        int r = i % TILE_BITS;
+        if (storage == Layout::RowMajor) {
+            return tile->words[r];
+        }
+        
+        // Gather the row from the eight blocks it crosses
+        uint32_t blockRow = Morton::spread(r / Morton::BLOCK_SIZE) << 1;
+        uint64_t value = 0;
+        for (int b = 0; b < TILE_BITS / Morton::BLOCK_SIZE; ++b) {
+            uint64_t block = tile->words[blockRow | Morton::spread(b)];
+            value |= Morton::rowBits(block, r % Morton::BLOCK_SIZE) << (b * Morton::BLOCK_SIZE);
+        }
+        return value;
+    }
+
+    /**
+     * Replace word w of row i; copies the enclosing tile first if it is shared.
+     */
+    void setWord(int i, int w, uint64_t value) {
+        if (value == 0 && !findTile(i, w * TILE_BITS)) {
+            return;  // Already zero; don't allocate a tile
+        }
+        Tile& tile = mutableTile(i / TILE_BITS, w);
+        int r = i % TILE_BITS;
+        if (storage == Layout::RowMajor) {
+            tile.words[r] = value;
+            return;
+        }
+        
+        uint32_t blockRow = Morton::spread(r / Morton::BLOCK_SIZE) << 1;
+        uint64_t rowMask = Morton::rowMask(r % Morton::BLOCK_SIZE);
+        for (int b = 0; b < TILE_BITS / Morton::BLOCK_SIZE; ++b) {
+            uint64_t& block = tile.words[blockRow | Morton::spread(b)];
+            uint64_t bits = (value >> (b * Morton::BLOCK_SIZE)) & 0xFF;
+            block = (block & ~rowMask) | Morton::rowDeposit(bits, r % Morton::BLOCK_SIZE);
+        }
+    }
+
+    /**
+     * Set or clear columns [begin, end) of row i, a word at a time.
+     */
+    void setRange(int i, int begin, int end, bool value) {
+        while (begin < end) {
+            int w = begin / TILE_BITS;
+            int stop = std::min(end, (w + 1) * TILE_BITS);
+            int width = stop - begin;
+            uint64_t mask = (width == TILE_BITS ? ~0ULL : ((1ULL << width) - 1)) << (begin % TILE_BITS);
+            uint64_t old = word(i, w);
+            uint64_t updated = value ? old | mask : old & ~mask;
+            if (updated != old) {
+                setWord(i, w, updated);
+            }
+            begin = stop;
+        }
+    }
+
+    bool get(int i, int j) const {
+        const Tile* tile = findTile(i, j);
+        if (!tile) {
+            return false;
+        }
+        int w, bit;
+        locate(storage, i % TILE_BITS, j % TILE_BITS, w, bit);
+        return (tile->words[w] >> bit) & 1;
+    }
+
+    void set(int i, int j, bool value) {
+        if (get(i, j) == value) {
+            return;
+        }
+        flip(i, j);
+    }
+
+    /**
+     * Flip one bit and return its new state.
+     */
+    bool flip(int i, int j) {
+        int w, bit;
+        locate(storage, i % TILE_BITS, j % TILE_BITS, w, bit);
+        uint64_t& value = mutableTile(i / TILE_BITS, j / TILE_BITS).words[w];
+        value ^= 1ULL << bit;
+        return (value >> bit) & 1;
+    }
+
+    /**
+     * Advance (i, j) to the first set point at or after it in row-major
+     * order. Rows of empty tiles are skipped whole. To visit every set point:
+     *
+     *     for (int i = 0, j = 0; bits.findNext(i, j); ++j) { ... }
+     *
+     * @return false, leaving i at rows(), if there is none
+     */
+    bool findNext(int& i, int& j) const {
+        while (i < rowCount) {
+            if (j == 0 && i % TILE_BITS == 0 && tileRowEmpty(i / TILE_BITS)) {
+                i += TILE_BITS;
+                continue;
+            }
+            if (j < colCount) {
+                int w = j / TILE_BITS;
+                uint64_t bits = word(i, w) & (~0ULL << (j % TILE_BITS));
+                for (;;) {
+                    if (bits) {
+                        j = w * TILE_BITS + __builtin_ctzll(bits);
+                        return true;
+                    }
+                    if (++w == tileCols) {
+                        break;
+                    }
+                    bits = word(i, w);
+                }
+            }
+            ++i;
+            j = 0;
+        }
+        i = rowCount;
+        return false;
+    }
+
+    /**
+     * First set point in row-major order.
+     */
+    bool findFirst(int& i, int& j) const {
+        i = 0;
+        j = 0;
+        return findNext(i, j);
+    }
+
+    /**
+     * Number of set points.
+     */
+    size_t count() const {
+        size_t total = 0;
+        for (size_t k = 0; k < table->size(); ++k) {
+            if ((*table)[k]) {
+                total += MaskKernels::count((*table)[k]->words, TILE_BITS);
+            }
+        }
+        return total;
+    }
+
+    /**
+     * In-place set algebra with a bitset of the same dimensions; the
+     * layouts may differ, but matching ones combine whole tiles.
+     */
+    TiledBitset& unionWith(const TiledBitset& other) { return combine<MaskKernels::Op::Or>(other); }
+    TiledBitset& intersectWith(const TiledBitset& other) { return combine<MaskKernels::Op::And>(other); }
+    TiledBitset& subtract(const TiledBitset& other) { return combine<MaskKernels::Op::AndNot>(other); }
+    TiledBitset& xorWith(const TiledBitset& other) { return combine<MaskKernels::Op::Xor>(other); }
+
+    /**
+     * Number of points set in both bitsets, without building the
+     * intersection; e.g. the overlap of a rasterized circle and the highlights.
+     */
+    size_t intersectionCount(const TiledBitset& other) const {
+        return countCombined<MaskKernels::Op::And>(other, false);
+    }
+
+    /**
+     * Number of points set in exactly one of the bitsets.
+     */
+    size_t differenceCount(const TiledBitset& other) const {
+        return countCombined<MaskKernels::Op::Xor>(other, false);
+    }
+
+    /**
+     * True if any point is set in both bitsets; stops at the first tile
+     * they share a point in.
+     */
+    bool intersects(const TiledBitset& other) const {
+        return countCombined<MaskKernels::Op::And>(other, true) != 0;
+    }
+
+    /**
+     * Reset to all zeros without touching tiles shared with snapshots.
+     */
+    void clear() {
+        table = std::make_shared<TileTable>(static_cast<size_t>(tileRows) * tileCols);
+    }
+
+    /**
+     * True if both bitsets currently share the tile holding word w of row i.
+     * Lets comparisons skip tiles that were not edited between snapshots.
+     */
+    bool sharesTile(const TiledBitset& other, int i, int w) const {
+        size_t index = static_cast<size_t>(i / TILE_BITS) * tileCols + w;
+        return (*table)[index] == (*other.table)[index];
+    }
+
+    /**
+     * Number of allocated tiles not shared with any other bitset; the
+     * memory a snapshot costs beyond the ones it was derived from.
+     */
+    size_t uniqueTileCount() const {
+        size_t count = 0;
+        if (table.use_count() > 1) {
+            return 0;
+        }
+        for (size_t k = 0; k < table->size(); ++k) {
+            if ((*table)[k] && (*table)[k].use_count() == 1) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Number of 64-bit words in the tile-major image used by copyTiles/adopt.
+     */
+    static size_t tileWordCount(int rows, int cols) {
+        size_t tiles = static_cast<size_t>((rows + TILE_BITS - 1) / TILE_BITS) *
+                       ((cols + TILE_BITS - 1) / TILE_BITS);
+        return tiles * TILE_BITS;
+    }
+
+    /**
+     * Write every tile, in table order, to a tile-major image. The words of
+     * each tile keep the bitset's layout.
+     */
+    void copyTiles(uint64_t* image) const {
+        for (size_t k = 0; k < table->size(); ++k) {
+            const std::shared_ptr<Tile>& tile = (*table)[k];
+            for (int r = 0; r < TILE_BITS; ++r) {
+                image[k * TILE_BITS + r] = tile ? tile->words[r] : 0;
+            }
+        }
+    }
+
+    /**
+     * Use a tile-major image in place, e.g. a memory-mapped file.
+     *
+     * Every tile shares ownership of owner, so the image stays valid while any
+     * copy of the bitset refers to it, and is never written: the first edit of
+     * a tile copies it like any other shared tile.
+     */
+    static TiledBitset adopt(int rows, int cols, Layout layout,
+                             const std::shared_ptr<void>& owner, uint64_t* image) {
+        TiledBitset bits(rows, cols, layout);
+        for (size_t k = 0; k < bits.table->size(); ++k) {
+            (*bits.table)[k] = std::shared_ptr<Tile>(
+                owner, reinterpret_cast<Tile*>(image + k * TILE_BITS));
+        }
+        return bits;
+    }
+};
+
+#endif // TILED_BITSET_H
@@ -4,17 +4,57 @@
  * This program demonstrates circle rasterization on a discrete 20x20 grid.
  * Users can click and drag to define circles, which are then rasterized to
  * show which grid points best represent the circle boundary.
+ *
+ * Circles persist: each drag on empty canvas adds one, and the highlights
+ * are the union of all of them. Dragging a circle's outline moves it, the
+ * mouse wheel grows or shrinks it, Delete removes the selected circle and
+ * Escape deselects it.
+ *
+ * Ctrl+Z / Ctrl+Y undo and redo edits; P toggles a comparison with the
+ * previous circle, including the Chamfer and Hausdorff distances between
+ * the two rasterizations. The session is saved on exit (or with S) and restored on
+ * startup. E exports the highlights as an SVG image. Every change is also
+ * logged as a compact delta stream to Problem1.delta (see DeltaStream.h).
+ *
+ * Grid size, window size and the rasterization threshold can be changed
+ * without rebuilding, from Problem1.cfg or the command line (see Settings.h):
+ *   Problem1.exe [--config file] [--grid N] [--threshold T] ...
  */
 
 #include "Config.h"
+#include "Settings.h"
 #include "Geometry.h"
 #include "Grid.h"
 #include "Rasterizer.h"
 #include "Renderer.h"
+#include "History.h"
+#include "Session.h"
+#include "CircleScene.h"
+#include "DistanceTransform.h"
+#include "MaskRectangles.h"
+#include "DeltaStream.h"
+#include "TaskGraph.h"
+#include <cwchar>
+#include <string>
 
 // Forward declarations
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
+/**
+ * Everything an undo step restores. Copying it is O(1): the highlight
+ * bitset, the scene's circles and its coverage counts share their tiles and
+ * chunks with the live state, so history grows with the edits only.
+ */
+struct RasterState {
+    TiledBitset highlights;
+    CircleScene::Snapshot scene;
+    int selectedCircle;
+    bool hasRasterizedCircle;
+    Circle userCircle;
+    Circle innerBound;
+    Circle outerBound;
+};
+
 /**
  * Application state manager.
  * Encapsulates all application state and behavior.
@@ -22,97 +62,432 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 class Application {
 private:
     Grid grid;
-    
+    CircleScene scene;          // Every circle drawn so far; highlights are their union
+
     // Mouse interaction state
-    bool isDragging;
+    bool isDragging;            // Dragging out a new circle
+    bool isMoving;              // Dragging the selected circle
     Point2D dragStartCanvas;    // Where the drag started (canvas space)
     Point2D dragCurrentCanvas;  // Current mouse position during drag (canvas space)
-    
-    // Rasterization results
-    bool hasRasterizedCircle;
-    Circle userCircleGrid;      // User's circle in grid space
+    Circle moveStartGrid;       // Selected circle when the move started
+    RadiusSweep sweep;          // Concentric sweep used to resize a circle
+    int sweepCircle;            // Scene id the sweep was built for, or -1
+
+    // Selected circle and its rasterization bounds
+    int selectedCircle;         // Scene id, or -1
+    bool hasRasterizedCircle;   // A circle is selected and highlights at least one point
+    Circle userCircleGrid;      // Selected circle in grid space
     Circle innerBoundGrid;      // Inner bound circle in grid space
     Circle outerBoundGrid;      // Outer bound circle in grid space
-    
+    bool boundsStale;           // The selection changed since the bounds were computed
+
+    // Undo/redo history
+    History<RasterState> history;
+    RasterState dragStartState; // State at mouse down, recorded once the drag changes the scene
+    bool showPrevious;          // Compare with the previous circle
+
+    Session session;
+
+    // Status line of the next frame, prepared by prepareFrame
+    wchar_t frameStatus[96];
+
+    // Change log of the highlights and selected circle, drained to DELTA_LOG_FILE
+    DeltaRing deltaRing;
+    DeltaEncoder deltaEncoder;
+    DeltaRecorder deltaRecorder;
+
+    RasterState captureState() {
+        updateBounds();
+        RasterState state;
+        state.highlights = grid.snapshotHighlights();
+        state.scene = scene.snapshot();
+        state.selectedCircle = selectedCircle;
+        state.hasRasterizedCircle = hasRasterizedCircle;
+        state.userCircle = userCircleGrid;
+        state.innerBound = innerBoundGrid;
+        state.outerBound = outerBoundGrid;
+        return state;
+    }
+
+    void restoreState(const RasterState& state) {
+        grid.restoreHighlights(state.highlights);
+        scene.restore(state.scene);
+        selectedCircle = state.selectedCircle;
+        hasRasterizedCircle = state.hasRasterizedCircle;
+        userCircleGrid = state.userCircle;
+        innerBoundGrid = state.innerBound;
+        outerBoundGrid = state.outerBound;
+        boundsStale = false;
+    }
+
+    /**
+     * Make a scene circle the selected one. Its bounds are computed by
+     * updateBounds, usually as a task of the next frame.
+     */
+    void select(int id) {
+        selectedCircle = id;
+        userCircleGrid = scene.get(id);
+        boundsStale = true;
+    }
+
+    void deselect() {
+        selectedCircle = -1;
+        hasRasterizedCircle = false;
+        boundsStale = false;
+    }
+
+    /**
+     * Compute the selected circle's bounds if the selection changed.
+     */
+    void updateBounds() {
+        if (boundsStale) {
+            hasRasterizedCircle = scene.boundingCircles(selectedCircle, innerBoundGrid, outerBoundGrid);
+            boundsStale = false;
+        }
+    }
+
+    /**
+     * Send the changes since the last call to the delta stream: the
+     * highlights, and the selected circle with its bounds in grid units.
+     * Every edit is followed by a repaint, so publishing from render()
+     * covers them all. Never waits for the recorder.
+     */
+    void publishDelta() {
+        if (hasRasterizedCircle) {
+            double params[5] = {userCircleGrid.center.x, userCircleGrid.center.y, userCircleGrid.radius,
+                                innerBoundGrid.radius, outerBoundGrid.radius};
+            deltaEncoder.setShape(params, 5);
+        } else {
+            deltaEncoder.clearShape();
+        }
+        deltaEncoder.publish(grid.snapshotHighlights());
+    }
+
+    /**
+     * Report how far apart the current and previous rasterizations are,
+     * given a distance transform of each; nothing if either is empty.
+     */
+    void formatComparison(const TiledBitset& current, const DistanceTransform& currentDistance,
+                          const TiledBitset& previous, const DistanceTransform& previousDistance) {
+        if (currentDistance.empty() || previousDistance.empty()) {
+            return;
+        }
+        std::swprintf(frameStatus, sizeof(frameStatus) / sizeof(frameStatus[0]),
+                      L"Vs previous: Chamfer %.2f, Hausdorff %.2f (grid units)",
+                      DistanceTransform::chamfer(current, currentDistance, previous, previousDistance),
+                      DistanceTransform::hausdorff(current, currentDistance, previous, previousDistance));
+    }
+
+    /**
+     * Report the scene size and how many circles share points with the
+     * selected one.
+     */
+    void formatSceneStatus() {
+        if (selectedCircle >= 0) {
+            size_t overlapping = 0;
+            scene.forEachOverlapping(userCircleGrid, [&](int id) {
+                overlapping += (id != selectedCircle) ? 1 : 0;
+            });
+            std::swprintf(frameStatus, sizeof(frameStatus) / sizeof(frameStatus[0]),
+                          L"%u circles; selected overlaps %u",
+                          static_cast<unsigned>(scene.size()), static_cast<unsigned>(overlapping));
+        } else {
+            std::swprintf(frameStatus, sizeof(frameStatus) / sizeof(frameStatus[0]), L"%u circles",
+                          static_cast<unsigned>(scene.size()));
+        }
+    }
+
+    /**
+     * Prepare the next frame as a graph of tasks: the selected circle's
+     * bounds and then the delta record, alongside either the distance
+     * transforms of the current and previous highlights and their
+     * comparison, or the selected circle's overlaps. Drawing stays on the
+     * calling thread.
+     *
+     * @param previous State compared with, or nullptr
+     */
+    void prepareFrame(const RasterState* previous) {
+        frameStatus[0] = L'\0';
+        TiledBitset current = grid.snapshotHighlights();
+        DistanceTransform currentDistance;
+        DistanceTransform previousDistance;
+
+        TaskGraph frame;
+        TaskGraph::Node bounds = frame.add([this]() { updateBounds(); });
+        TaskGraph::Node delta = frame.add([this]() { publishDelta(); });
+        frame.precede(bounds, delta);
+        if (previous && previous->hasRasterizedCircle) {
+            // Only a selected circle is compared; the transforms need not
+            // wait for its bounds to know that
+            if (selectedCircle >= 0) {
+                TaskGraph::Node currentBuild = frame.add([&]() { currentDistance.build(current); });
+                TaskGraph::Node previousBuild = frame.add([&]() {
+                    previousDistance.build(previous->highlights);
+                });
+                TaskGraph::Node comparison = frame.add([&]() {
+                    if (hasRasterizedCircle) {
+                        formatComparison(current, currentDistance, previous->highlights, previousDistance);
+                    }
+                });
+                frame.precede(bounds, comparison);
+                frame.precede(currentBuild, comparison);
+                frame.precede(previousBuild, comparison);
+            }
+        } else {
+            frame.add([this]() { formatSceneStatus(); });
+        }
+        frame.run();
+    }
+
 public:
     Application()
-        : grid(Config::GRID_SIZE, Config::WINDOW_WIDTH, Config::WINDOW_HEIGHT, Config::GRID_PADDING),
+        : grid(Settings::current().gridSize, Settings::current().windowWidth,
+               Settings::current().windowHeight, Settings::current().gridPadding),
+          scene(Settings::current().gridSize),
           isDragging(false),
-          hasRasterizedCircle(false) {
+          isMoving(false),
+          sweepCircle(-1),
+          selectedCircle(-1),
+          hasRasterizedCircle(false),
+          boundsStale(false),
+          showPrevious(false),
+          session(Config::SESSION_FILE, Settings::current().gridSize),
+          deltaRing(Config::DELTA_RING_BYTES),
+          deltaEncoder(deltaRing),
+          deltaRecorder(deltaRing, Config::DELTA_LOG_FILE) {
+        // Restore the previous session, if any: the highlights straight from
+        // the mapped file and the scene's circles on top of them. Highlights
+        // drawn with another threshold are redrawn from the circles.
+        std::vector<Circle> circles;
+        int selectedIndex = -1;
+        double threshold = 0.0;
+        if (session.load(grid, circles, selectedIndex, threshold)) {
+            if (threshold == Settings::current().threshold) {
+                scene.adoptAll(circles);
+            } else {
+                grid.resetHighlights();
+                scene.addAll(grid, circles);
+            }
+            if (selectedIndex >= 0) {
+                select(selectedIndex);
+            }
+        }
     }
-    
+
+    /**
+     * Save the highlights and every circle of the scene to the session file.
+     */
+    bool saveSession() {
+        std::vector<Circle> circles;
+        int selectedIndex = -1;
+        scene.forEach([&](int id, const Circle& circle) {
+            if (id == selectedCircle) {
+                selectedIndex = static_cast<int>(circles.size());
+            }
+            circles.push_back(circle);
+        });
+        return session.save(grid, circles, selectedIndex, Settings::current().threshold);
+    }
+
     /**
-     * Handle mouse button down event - start circle definition.
+     * Write the highlights to HIGHLIGHTS_SVG_FILE, one rectangle per block
+     * of highlighted points.
+     */
+    bool exportHighlights() const {
+        COLORREF color = Settings::current().highlightColor;
+        unsigned rgb = (GetRValue(color) << 16) | (GetGValue(color) << 8) | GetBValue(color);
+        return MaskRectangles::writeSvg(Config::HIGHLIGHTS_SVG_FILE, grid.snapshotHighlights(), rgb);
+    }
+
+    /**
+     * Handle mouse button down event - pick a circle to move, or start
+     * defining a new one.
      */
     void onMouseDown(int x, int y) {
-        // Reset to clean state for new circle
-        grid.resetHighlights();
-        hasRasterizedCircle = false;
-        
-        // Start dragging
-        isDragging = true;
+        const CoordinateTransform& transform = grid.getTransform();
         dragStartCanvas = Point2D(x, y);
         dragCurrentCanvas = dragStartCanvas;
+
+        // Recorded on mouse up, and only if the drag added or moved a circle
+        dragStartState = captureState();
+
+        double tolerance = transform.canvasDistanceToGrid(Config::PICK_TOLERANCE);
+        int hit = scene.pick(transform.canvasToGrid(dragStartCanvas), tolerance);
+        if (hit >= 0) {
+            select(hit);
+            moveStartGrid = userCircleGrid;
+            isMoving = true;
+            return;
+        }
+
+        // Start dragging out a new circle; existing circles stay
+        deselect();
+        isDragging = true;
     }
-    
+
     /**
-     * Handle mouse move event - update circle preview.
+     * Handle mouse move event - update circle preview, or move the selected
+     * circle, re-rasterizing only that circle.
      */
     void onMouseMove(int x, int y) {
-        if (isDragging) {
+        if (isMoving) {
+            const CoordinateTransform& transform = grid.getTransform();
+            Point2D from = transform.canvasToGrid(dragStartCanvas);
+            Point2D to = transform.canvasToGrid(Point2D(x, y));
+            Circle moved(moveStartGrid.center.x + to.x - from.x,
+                         moveStartGrid.center.y + to.y - from.y, moveStartGrid.radius);
+            scene.move(grid, selectedCircle, moved);
+            select(selectedCircle);
+        } else if (isDragging) {
             dragCurrentCanvas = Point2D(x, y);
         }
     }
-    
+
     /**
      * Handle mouse button up event - finalize and rasterize circle.
      */
     void onMouseUp(int x, int y) {
+        if (isMoving) {
+            isMoving = false;
+            const Circle& moved = scene.get(selectedCircle);
+            if (moved.center.x != moveStartGrid.center.x || moved.center.y != moveStartGrid.center.y) {
+                history.record(dragStartState);
+            }
+            return;
+        }
         if (!isDragging) {
             return;
         }
-        
+
         isDragging = false;
         dragCurrentCanvas = Point2D(x, y);
-        
+
         const CoordinateTransform& transform = grid.getTransform();
         Point2D centerGrid = transform.canvasToGrid(dragStartCanvas);
         Point2D edgeGrid = transform.canvasToGrid(dragCurrentCanvas);
         double radiusGrid = centerGrid.distanceTo(edgeGrid);
-        
+
         // Only rasterize if circle has meaningful size
         if (radiusGrid > 0.1) {
-            userCircleGrid = Circle(centerGrid, radiusGrid);
-            
-            // Rasterize the circle
-            CircleRasterizer::rasterizeOptimized(grid, userCircleGrid);
-            
-            // Calculate bounding circles
-            if (grid.calculateBoundingCircles(centerGrid, innerBoundGrid, outerBoundGrid)) {
-                hasRasterizedCircle = true;
-            }
+            history.record(dragStartState);
+            // Rasterize the circle into the union and calculate its bounds
+            select(scene.add(grid, Circle(centerGrid, radiusGrid)));
         }
     }
-    
+
+    /**
+     * Handle mouse wheel - grow or shrink the selected circle. Its points
+     * come from a radius sweep about its center, so each notch touches only
+     * the points entering or leaving its annulus.
+     *
+     * @param notches Wheel notches; positive grows the circle
+     */
+    void onWheel(int notches) {
+        if (selectedCircle < 0 || isDragging || isMoving || notches == 0) {
+            return;
+        }
+
+        const Circle& circle = scene.get(selectedCircle);
+        if (sweepCircle != selectedCircle || sweep.radius() != circle.radius ||
+            sweep.center().x != circle.center.x || sweep.center().y != circle.center.y) {
+            // Far enough to pass every grid point
+            const int size = grid.getSize();
+            double farX = std::max(circle.center.x, size - 1 - circle.center.x);
+            double farY = std::max(circle.center.y, size - 1 - circle.center.y);
+            double limit = std::sqrt(farX * farX + farY * farY) + Settings::current().threshold;
+            sweep = RadiusSweep(size, circle, std::max(limit, circle.radius));
+            sweepCircle = selectedCircle;
+        }
+
+        const double step = Settings::current().radiusStep;
+        double radius = std::max(step, circle.radius + notches * step);
+        radius = std::min(radius, sweep.limit());
+        if (radius == circle.radius) {
+            return;
+        }
+        history.record(captureState());
+        scene.resize(grid, selectedCircle, sweep, radius);
+        select(selectedCircle);
+    }
+
+    /**
+     * Delete the selected circle, clearing the points no other circle covers.
+     */
+    void deleteSelected() {
+        if (selectedCircle < 0 || isDragging || isMoving) {
+            return;
+        }
+        history.record(captureState());
+        scene.remove(grid, selectedCircle);
+        deselect();
+    }
+
+    /**
+     * Clear the selection without changing the scene.
+     */
+    void clearSelection() {
+        if (!isDragging && !isMoving) {
+            deselect();
+        }
+    }
+
+    /**
+     * Step back one edit.
+     */
+    void undo() {
+        RasterState state = captureState();
+        if (!isDragging && !isMoving && history.undo(state)) {
+            restoreState(state);
+        }
+    }
+
+    /**
+     * Re-apply an undone edit.
+     */
+    void redo() {
+        RasterState state = captureState();
+        if (!isDragging && !isMoving && history.redo(state)) {
+            restoreState(state);
+        }
+    }
+
+    /**
+     * Toggle drawing the previous circle alongside the current one.
+     */
+    void togglePrevious() {
+        showPrevious = !showPrevious;
+    }
+
     /**
      * Render the entire application.
      */
     void render(HDC hdc) {
+        const RasterState* previous = showPrevious ? history.previous() : nullptr;
+        prepareFrame(previous);
         Renderer renderer(hdc);
-        
+
         // Clear background
-        RECT rect = {0, 0, Config::WINDOW_WIDTH, Config::WINDOW_HEIGHT};
+        RECT rect = {0, 0, Settings::current().windowWidth, Settings::current().windowHeight};
         renderer.clearCanvas(rect);
-        
-        // Draw grid points
-        renderer.drawGrid(grid);
-        
+
+        // Draw grid points, with the previous state's highlights for comparison
+        renderer.drawGrid(grid, previous ? &previous->highlights : nullptr);
+        renderer.drawSceneCircles(scene, selectedCircle, grid.getTransform());
+        if (previous && previous->hasRasterizedCircle) {
+            renderer.drawPreviousCircle(previous->userCircle, grid.getTransform());
+        }
+        if (frameStatus[0]) {
+            renderer.drawStatus(frameStatus);
+        }
+        std::string pool = TaskScheduler::shared().report();
+        renderer.drawStatus(std::wstring(pool.begin(), pool.end()).c_str(), 1);
+
         // Draw preview circle while dragging
         if (isDragging) {
             renderer.drawPreviewCircle(dragStartCanvas, dragCurrentCanvas);
         }
-        
-        // Draw final circles after rasterization
+
+        // Draw the selected circle and its bounds
         if (hasRasterizedCircle) {
             renderer.drawFinalCircles(
                 userCircleGrid,
@@ -122,7 +497,7 @@ public:
             );
         }
     }
-    
+
     const Grid& getGrid() const { return grid; }
 };
 
@@ -134,6 +509,14 @@ Application* g_pApp = nullptr;
  */
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, 
                    LPSTR lpCmdLine, int nCmdShow) {
+    // Settings come from Problem1.cfg and the command line, before anything uses them
+    std::string error;
+    if (!Settings::current().parseCommandLine(lpCmdLine ? lpCmdLine : "", error)) {
+        std::wstring message(error.begin(), error.end());
+        MessageBox(nullptr, message.c_str(), L"Invalid Settings", MB_OK | MB_ICONERROR);
+        return 1;
+    }
+    
     // Register window class
     const wchar_t CLASS_NAME[] = L"CircleRasterizerWindow";
     
@@ -147,7 +530,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     
     DWORD style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX;
     
-    RECT windowRect = {0, 0, Config::WINDOW_WIDTH, Config::WINDOW_HEIGHT};
+    RECT windowRect = {0, 0, Settings::current().windowWidth, Settings::current().windowHeight};
     AdjustWindowRect(&windowRect, style, FALSE);
     
     int windowWidth = windowRect.right - windowRect.left;
@@ -195,6 +578,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
         case WM_DESTROY:
+            if (g_pApp) {
+                g_pApp->saveSession();
+            }
             PostQuitMessage(0);
             return 0;
         
@@ -205,14 +591,15 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             if (g_pApp) {
                 // Create off-screen buffer for double buffering
                 HDC memDC = CreateCompatibleDC(hdc);
-                HBITMAP memBitmap = CreateCompatibleBitmap(hdc, Config::WINDOW_WIDTH, Config::WINDOW_HEIGHT);
+                const Settings& settings = Settings::current();
+                HBITMAP memBitmap = CreateCompatibleBitmap(hdc, settings.windowWidth, settings.windowHeight);
                 HBITMAP oldBitmap = (HBITMAP)SelectObject(memDC, memBitmap);
                 
                 // Render to off-screen buffer
                 g_pApp->render(memDC);
                 
                 // Copy the complete buffer to screen in one operation
-                BitBlt(hdc, 0, 0, Config::WINDOW_WIDTH, Config::WINDOW_HEIGHT, memDC, 0, 0, SRCCOPY);
+                BitBlt(hdc, 0, 0, settings.windowWidth, settings.windowHeight, memDC, 0, 0, SRCCOPY);
                 
                 // Clean up
                 SelectObject(memDC, oldBitmap);
@@ -257,6 +644,51 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             return 0;
         }
         
+        case WM_MOUSEWHEEL: {
+            if (g_pApp) {
+                g_pApp->onWheel(GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA);
+                InvalidateRect(hwnd, nullptr, FALSE);
+            }
+            return 0;
+        }
+        
+        case WM_CHAR: {
+            if (g_pApp) {
+                if (wParam == 0x1A) {           // Ctrl+Z
+                    g_pApp->undo();
+                } else if (wParam == 0x19) {    // Ctrl+Y
+                    g_pApp->redo();
+                } else if (wParam == 'p' || wParam == 'P') {
+                    g_pApp->togglePrevious();
+                } else if (wParam == 's' || wParam == 'S') {
+                    if (!g_pApp->saveSession()) {
+                        MessageBox(hwnd, L"Could not save the session file.", L"Save Failed",
+                                   MB_OK | MB_ICONWARNING);
+                    }
+                } else if (wParam == 'e' || wParam == 'E') {
+                    if (!g_pApp->exportHighlights()) {
+                        MessageBox(hwnd, L"Could not write the SVG file.", L"Export Failed",
+                                   MB_OK | MB_ICONWARNING);
+                    }
+                }
+                InvalidateRect(hwnd, nullptr, FALSE);
+            }
+            return 0;
+        }
+        
+        case WM_KEYDOWN: {
+            if (g_pApp) {
+                if (wParam == VK_DELETE) {
+                    g_pApp->deleteSelected();
+                    InvalidateRect(hwnd, nullptr, FALSE);
+                } else if (wParam == VK_ESCAPE) {
+                    g_pApp->clearSelection();
+                    InvalidateRect(hwnd, nullptr, FALSE);
+                }
+            }
+            return 0;
+        }
+        
         case WM_ERASEBKGND:
             // Prevent flickering by handling erase ourselves
             return 1;
@@ -0,0 +1,308 @@
+/**
+ * Asynchronous Jobs
+ *
+ * Fits, rasterizations, image detection and other long work run on the
+ * shared task pool with no thread waiting for them. RunAsync returns a Job at once; Then chains the
+ * next step, which runs on the pool when the previous one has finished, so
+ * fit -> validate -> rasterize needs neither callbacks nested in callbacks
+ * nor joins. The UI thread hears that a job has finished through
+ * OnComplete, e.g. by posting a window message, and collects the result
+ * with TryGet.
+ *
+ * The steps of a chain share a CancelToken. Cancelling skips the steps
+ * that have not started, running steps may poll the token to stop early,
+ * and a cancelled job never delivers a result.
+ *
+ * A Job is also a C++20 coroutine: a function returning Job<T> may
+ * co_await other jobs and co_return its T. Its body runs on the pool, and
+ * each co_await hands the rest of it to the pool once the awaited job has
+ * finished, so no thread blocks on a step. The coroutine's job uses the
+ * first CancelToken among its parameters, and a co_await on a cancelled
+ * job gives an empty optional.
+ *
+ */
+
+#pragma once
+#include "Geometry.h"
+#include "Selection.h"
+#include "TaskGraph.h"
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Flag shared by the steps of a chain of jobs, asking them to stop
+class CancelToken {
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+
+public:
+    CancelToken() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void Cancel() const { flag->store(true, std::memory_order_relaxed); }
+    bool IsCancelled() const { return flag->load(std::memory_order_relaxed); }
+};
+
+enum class JobStatus {
+    Pending,
+    Done,
+    Cancelled
+};
+
+// Handle to work producing a T on a scheduler. Copies refer to the same job.
+// A default-constructed Job refers to none and counts as cancelled.
+template <typename T>
+class Job {
+private:
+    template <typename U> friend class Job;
+
+    struct State {
+        std::mutex mutex;
+        JobStatus status = JobStatus::Pending;
+        std::optional<T> value;
+        std::vector<std::function<void()>> continuations;  // Run once finished
+        CancelToken token;
+        TaskScheduler* scheduler = nullptr;
+    };
+
+    std::shared_ptr<State> state;
+
+    explicit Job(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+    static std::shared_ptr<State> NewState(const CancelToken& token, TaskScheduler& scheduler) {
+        auto state = std::make_shared<State>();
+        state->token = token;
+        state->scheduler = &scheduler;
+        return state;
+    }
+
+    // Record the outcome, which is empty if the step was skipped, and run
+    // what was waiting for it
+    static void Finish(const std::shared_ptr<State>& state, std::optional<T> value) {
+        std::vector<std::function<void()>> continuations;
+        {
+            std::lock_guard<std::mutex> guard(state->mutex);
+            if (value && !state->token.IsCancelled()) {
+                state->value = std::move(value);
+                state->status = JobStatus::Done;
+            } else {
+                state->status = JobStatus::Cancelled;
+            }
+            continuations.swap(state->continuations);
+        }
+        for (auto& continuation : continuations) {
+            continuation();
+        }
+    }
+
+    // Call next on the thread that finishes the job, or now if it has
+    void WhenFinished(std::function<void()> next) const {
+        {
+            std::lock_guard<std::mutex> guard(state->mutex);
+            if (state->status == JobStatus::Pending) {
+                state->continuations.push_back(std::move(next));
+                return;
+            }
+        }
+        next();
+    }
+
+public:
+    // Lets a function returning Job<T> be a coroutine. Its body starts on
+    // the pool, and co_return finishes the job.
+    class promise_type {
+    private:
+        std::shared_ptr<State> state;
+
+        static CancelToken TokenOf() { return CancelToken(); }
+
+        template <typename... Rest>
+        static CancelToken TokenOf(const CancelToken& token, const Rest&...) { return token; }
+
+        template <typename First, typename... Rest>
+        static CancelToken TokenOf(const First&, const Rest&... rest) { return TokenOf(rest...); }
+
+        // Moves the body to the pool, or ends it unstarted if cancelled
+        struct StartOnPool {
+            std::shared_ptr<State> state;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) const {
+                std::shared_ptr<State> job = state;
+                job->scheduler->Post([job, handle]() {
+                    if (job->token.IsCancelled()) {
+                        handle.destroy();
+                        Finish(job, std::nullopt);
+                    } else {
+                        handle.resume();
+                    }
+                });
+            }
+            void await_resume() const noexcept {}
+        };
+
+    public:
+        // Takes the token from the coroutine's parameters
+        template <typename... Args>
+        explicit promise_type(const Args&... args)
+            : state(NewState(TokenOf(args...), TaskScheduler::Shared())) {}
+
+        Job get_return_object() { return Job(state); }
+        StartOnPool initial_suspend() const noexcept { return StartOnPool{state}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_value(T value) { Finish(state, std::move(value)); }
+        void unhandled_exception() const { std::terminate(); }
+    };
+
+    // What co_await on a job waits with. Suspending posts the rest of the
+    // coroutine to the pool for when the job finishes; the result is empty
+    // if the job was cancelled.
+    class Awaiter {
+    private:
+        std::shared_ptr<State> state;
+
+    public:
+        explicit Awaiter(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+        bool await_ready() const {
+            if (!state || state->token.IsCancelled()) {
+                return true;
+            }
+            std::lock_guard<std::mutex> guard(state->mutex);
+            return state->status != JobStatus::Pending;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) const {
+            TaskScheduler* scheduler = state->scheduler;
+            Job(state).WhenFinished([scheduler, handle]() { scheduler->Post([handle]() { handle.resume(); }); });
+        }
+
+        std::optional<T> await_resume() const {
+            if (!state) {
+                return std::nullopt;
+            }
+            std::lock_guard<std::mutex> guard(state->mutex);
+            if (state->status != JobStatus::Done) {
+                return std::nullopt;
+            }
+            return state->value;
+        }
+    };
+
+    Job() {}
+
+    Awaiter operator co_await() const { return Awaiter(state); }
+
+    // Post work(token), which returns the job's value, to the scheduler.
+    // RunAsync is the usual way in.
+    template <typename Work>
+    static Job Start(Work work, const CancelToken& token, TaskScheduler& scheduler) {
+        std::shared_ptr<State> state = NewState(token, scheduler);
+        scheduler.Post([state, work]() mutable {
+            std::optional<T> value;
+            if (!state->token.IsCancelled()) {
+                value = work(state->token);
+            }
+            Finish(state, std::move(value));
+        });
+        return Job(state);
+    }
+
+    // Job for next(value), run on the pool once this job is done. It shares
+    // this job's token and is cancelled without running if this one is.
+    template <typename Next>
+    auto Then(Next next) const -> Job<std::decay_t<decltype(next(std::declval<const T&>()))>> {
+        typedef std::decay_t<decltype(next(std::declval<const T&>()))> U;
+        std::shared_ptr<typename Job<U>::State> after = Job<U>::NewState(state->token, *state->scheduler);
+        std::shared_ptr<State> before = state;
+        WhenFinished([before, after, next]() {
+            if (before->status != JobStatus::Done) {
+                Job<U>::Finish(after, std::nullopt);
+                return;
+            }
+            before->scheduler->Post([before, after, next]() {
+                std::optional<U> value;
+                if (!after->token.IsCancelled()) {
+                    value = next(*before->value);
+                }
+                Job<U>::Finish(after, std::move(value));
+            });
+        });
+        return Job<U>(after);
+    }
+
+    // Call done once the job is done or cancelled, on the thread that
+    // finished it (now, if it has). Keep it short, e.g. post a message to
+    // the window that collects the result.
+    void OnComplete(std::function<void()> done) const {
+        if (!state) {
+            done();
+            return;
+        }
+        WhenFinished(std::move(done));
+    }
+
+    // Cancel this job and the rest of its chain; a finished job keeps its
+    // result
+    void Cancel() const {
+        if (state) {
+            state->token.Cancel();
+        }
+    }
+
+    JobStatus Status() const {
+        if (!state) {
+            return JobStatus::Cancelled;
+        }
+        std::lock_guard<std::mutex> guard(state->mutex);
+        return state->status;
+    }
+
+    // Copy out the result if the job is done; never waits
+    bool TryGet(T& out) const {
+        if (!state) {
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(state->mutex);
+        if (state->status != JobStatus::Done) {
+            return false;
+        }
+        out = *state->value;
+        return true;
+    }
+};
+
+// Run work(token) on the pool and return its job at once
+template <typename Work>
+auto RunAsync(Work work, const CancelToken& token = CancelToken(),
+              TaskScheduler& scheduler = TaskScheduler::Shared())
+    -> Job<std::decay_t<decltype(work(std::declval<const CancelToken&>()))>> {
+    typedef std::decay_t<decltype(work(std::declval<const CancelToken&>()))> T;
+    return Job<T>::Start(std::move(work), token, scheduler);
+}
+
+// Best-fit circle through points, fit on the pool; radius 0 if collinear
+inline Job<Circle> FitCircleAsync(std::vector<Point> points, const CancelToken& token = CancelToken()) {
+    return RunAsync([points = std::move(points)](const CancelToken&) { return FitCircle(points); }, token);
+}
+
+// Best-fit circle to moments summed from the grid's center, in pixels, as
+// LatticeMoments::FitPixelCircle; fit on the pool
+inline Job<Circle> FitCircleAsync(const CircleMoments& moments, const CancelToken& token = CancelToken()) {
+    return RunAsync([moments](const CancelToken&) { return LatticeMoments::FitPixelCircle(moments); }, token);
+}
+
+// Grid points within the ring threshold setting of a circle, rasterized on
+// the pool
+inline Job<TiledBitset> RasterizeAsync(const Circle& circle, const CancelToken& token = CancelToken()) {
+    return RunAsync([circle](const CancelToken&) {
+        const Settings& settings = Settings::Current();
+        return SpansMask(RingSpans(circle, settings.ringThreshold * settings.CellSize()));
+    }, token);
+}
@@ -0,0 +1,141 @@
+/**
+ * Concentric Circle Fitting
+ *
+ * Fits rings that share a center, as on a ring gauge: one center for all
+ * of them and a radius per ring, from labeled points.
+ *
+ * Each ring g is x^2 + y^2 = 2 a x + 2 b y + c_g with a common center
+ * (a, b) and its own offset c_g = r_g^2 - a^2 - b^2, which is linear least
+ * squares in (a, b, c_1, ..., c_G). Each c_g only touches its own ring, so
+ * the normal equations form an arrow matrix; eliminating the c_g (each one
+ * is its ring's mean of z - 2 a x - 2 b y) leaves a 2 x 2 system summed
+ * over the rings' own centered moments. So the solve costs O(rings) after
+ * one pass that gathers a few sums per ring, whatever the point count.
+ *
+ */
+
+#pragma once
+#include "Geometry.h"
+#include "Parallel.h"
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+// Power sums of one ring's points relative to a shared reference point,
+// up to what the joint fit needs (z = x^2 + y^2)
+struct RingMoments {
+    double n, sx, sy;
+    double sxx, sxy, syy;
+    double sxz, syz;
+
+    RingMoments() : n(0), sx(0), sy(0), sxx(0), sxy(0), syy(0), sxz(0), syz(0) {}
+
+    void Add(double x, double y) {
+        double xx = x * x, yy = y * y, z = xx + yy;
+        n += 1;
+        sx += x;
+        sy += y;
+        sxx += xx;
+        sxy += x * y;
+        syy += yy;
+        sxz += x * z;
+        syz += y * z;
+    }
+
+    void Merge(const RingMoments& other) {
+        n += other.n; sx += other.sx; sy += other.sy;
+        sxx += other.sxx; sxy += other.sxy; syy += other.syy;
+        sxz += other.sxz; syz += other.syz;
+    }
+};
+
+struct ConcentricCircles {
+    Point center;
+    std::vector<double> radii;  // Per ring; 0 for a ring without points
+    bool valid;
+
+    ConcentricCircles() : center(), valid(false) {}
+};
+
+// Joint fit from per-ring sums taken relative to reference. The radius of
+// each ring is the RMS distance of its points to the center, as in
+// FitCircle(CircleMoments).
+inline ConcentricCircles SolveConcentricCircles(const std::vector<RingMoments>& rings, const Point& reference) {
+    ConcentricCircles result;
+
+    // Sum the rings' centered moments: the Schur complement of the offsets
+    double Cxx = 0, Cxy = 0, Cyy = 0, Cxz = 0, Cyz = 0;
+    for (const RingMoments& m : rings) {
+        if (m.n == 0) {
+            continue;
+        }
+        double mx = m.sx / m.n, my = m.sy / m.n, mz = (m.sxx + m.syy) / m.n;
+        Cxx += m.sxx - m.sx * mx;
+        Cxy += m.sxy - m.sx * my;
+        Cyy += m.syy - m.sy * my;
+        Cxz += m.sxz - m.sx * mz;
+        Cyz += m.syz - m.sy * mz;
+    }
+
+    // [Cxx Cxy; Cxy Cyy] (2a, 2b) = (Cxz, Cyz)
+    double det = Cxx * Cyy - Cxy * Cxy;
+    if (!(std::abs(det) > 1e-12 * (Cxx + Cyy) * (Cxx + Cyy))) {
+        return result;  // All points on a line (or nearly so)
+    }
+    double a = (Cyy * Cxz - Cxy * Cyz) / det / 2;
+    double b = (Cxx * Cyz - Cxy * Cxz) / det / 2;
+
+    result.radii.assign(rings.size(), 0.0);
+    for (size_t g = 0; g < rings.size(); g++) {
+        const RingMoments& m = rings[g];
+        if (m.n == 0) {
+            continue;
+        }
+        double squared = (m.sxx + m.syy - 2 * (a * m.sx + b * m.sy)) / m.n + a * a + b * b;
+        result.radii[g] = std::sqrt(std::max(0.0, squared));
+    }
+    result.center = Point(reference.x + a, reference.y + b);
+    result.valid = std::isfinite(result.center.x) && std::isfinite(result.center.y);
+    return result;
+}
+
+// Joint fit of count points, point i being pointAt(i) on ring labelAt(i).
+// Points labeled outside [0, ringCount) are skipped. One parallel pass
+// gathers every ring's sums, relative to the first point so that far-off
+// coordinates do not cancel.
+template <typename PointAt, typename LabelAt>
+ConcentricCircles FitConcentricCircles(size_t count, PointAt pointAt, LabelAt labelAt, size_t ringCount,
+                                       unsigned threads = DefaultThreadCount()) {
+    if (count == 0 || ringCount == 0) {
+        return ConcentricCircles();
+    }
+
+    const Point reference = pointAt(0);
+    std::vector<RingMoments> rings(ringCount);
+    std::mutex merge;
+    ParallelFor(count, threads, [&](size_t begin, size_t end) {
+        std::vector<RingMoments> local(ringCount);
+        for (size_t i = begin; i < end; i++) {
+            long long g = static_cast<long long>(labelAt(i));
+            if (g < 0 || g >= static_cast<long long>(ringCount)) {
+                continue;
+            }
+            Point p = pointAt(i);
+            local[g].Add(p.x - reference.x, p.y - reference.y);
+        }
+        std::lock_guard<std::mutex> lock(merge);
+        for (size_t g = 0; g < ringCount; g++) {
+            rings[g].Merge(local[g]);
+        }
+    });
+    return SolveConcentricCircles(rings, reference);
+}
+
+inline ConcentricCircles FitConcentricCircles(const std::vector<Point>& points, const std::vector<int>& labels,
+                                              size_t ringCount) {
+    if (labels.size() != points.size()) {
+        return ConcentricCircles();
+    }
+    return FitConcentricCircles(points.size(), [&](size_t i) { return points[i]; },
+                                [&](size_t i) { return labels[i]; }, ringCount);
+}
@@ -0,0 +1,264 @@
+/**
+ * Concurrent Selection Store
+ *
+ * Lock-free selection state for several producers at once (UI thread,
+ * scripted feeders, detection workers). Selection bits live in atomic
+ * 64-bit words updated with fetch_or / fetch_and / fetch_xor, so no
+ * update is ever lost. The bits returned by each atomic operation tell
+ * the producer exactly which points it changed; the matching moment
+ * deltas go into that producer's own accumulator and are only summed
+ * when a fit is requested.
+ *
+ * A producer's slot is freed when its handle goes away, and the next
+ * producer to register may take it over. The sums stay in the slot and the
+ * new owner adds to them, so nothing a former producer changed is lost.
+ *
+ */
+
+#pragma once
+#include "Config.h"
+#include "Geometry.h"
+#include "Selection.h"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+class ConcurrentSelection {
+public:
+    static constexpr int MAX_PRODUCERS = 16;
+
+private:
+    static constexpr int SUM_COUNT = sizeof(CircleMoments) / sizeof(double);
+
+    // Moment accumulator owned by a single producer. The producer publishes
+    // its running sums under a sequence counter so a reducer on another
+    // thread never sees a half-written set of sums; the producer itself
+    // never waits.
+    struct alignas(64) ProducerSlot {
+        CircleMoments local;                      // Written by the owner only
+        std::atomic<bool> owned;                  // Held by a live Producer
+        std::atomic<unsigned> sequence;
+        std::atomic<double> published[SUM_COUNT];
+
+        ProducerSlot() : owned(false), sequence(0) {
+            for (auto& value : published) {
+                value.store(0.0, std::memory_order_relaxed);
+            }
+        }
+
+        void Publish() {
+            double sums[SUM_COUNT];
+            std::memcpy(sums, &local, sizeof(sums));
+
+            unsigned seq = sequence.load(std::memory_order_relaxed);
+            sequence.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (int k = 0; k < SUM_COUNT; k++) {
+                published[k].store(sums[k], std::memory_order_relaxed);
+            }
+            sequence.store(seq + 2, std::memory_order_release);
+        }
+
+        CircleMoments Read() const {
+            double sums[SUM_COUNT];
+            unsigned before, after;
+            do {
+                before = sequence.load(std::memory_order_acquire);
+                for (int k = 0; k < SUM_COUNT; k++) {
+                    sums[k] = published[k].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = sequence.load(std::memory_order_relaxed);
+            } while ((before & 1) || before != after);
+
+            CircleMoments moments;
+            std::memcpy(&moments, sums, sizeof(sums));
+            return moments;
+        }
+    };
+
+    static_assert(sizeof(CircleMoments) == SUM_COUNT * sizeof(double),
+                  "CircleMoments must be a plain block of sums");
+
+    int size;  // Grid points a side
+    int wordsPerRow;
+    std::vector<std::atomic<uint64_t>> words;
+    ProducerSlot slots[MAX_PRODUCERS];
+    std::atomic<int> slotsUsed;  // Slots ever owned; only those hold sums
+    LatticeMoments lattice;
+
+    std::atomic<uint64_t>& Word(int i, int w) { return words[i * wordsPerRow + w]; }
+
+public:
+    // Handle used by one input thread. Not to be shared between threads; it
+    // frees its slot when destroyed.
+    class Producer {
+    private:
+        ConcurrentSelection* store;
+        ProducerSlot* slot;
+
+        // Apply one masked word operation and record the points it changed
+        void ApplyWord(int i, int w, uint64_t mask, SelectionMode mode) {
+            std::atomic<uint64_t>& word = store->Word(i, w);
+            uint64_t before = 0, after = 0;
+            switch (mode) {
+                case SelectionMode::Set:
+                    before = word.fetch_or(mask, std::memory_order_acq_rel);
+                    after = before | mask;
+                    break;
+                case SelectionMode::Clear:
+                    before = word.fetch_and(~mask, std::memory_order_acq_rel);
+                    after = before & ~mask;
+                    break;
+                case SelectionMode::Toggle:
+                    before = word.fetch_xor(mask, std::memory_order_acq_rel);
+                    after = before ^ mask;
+                    break;
+            }
+
+            int base = w * 64;
+            ForEachRun(after & ~before, [&](int b, int e) {
+                store->lattice.AddRun(slot->local, i, base + b, base + e, 1.0);
+            });
+            ForEachRun(before & ~after, [&](int b, int e) {
+                store->lattice.AddRun(slot->local, i, base + b, base + e, -1.0);
+            });
+        }
+
+        void Release() {
+            if (slot) {
+                slot->owned.store(false, std::memory_order_release);
+                slot = nullptr;
+            }
+        }
+
+    public:
+        Producer() : store(nullptr), slot(nullptr) {}
+        Producer(ConcurrentSelection* store, ProducerSlot* slot) : store(store), slot(slot) {}
+        ~Producer() { Release(); }
+
+        Producer(Producer&& other) : store(other.store), slot(other.slot) {
+            other.slot = nullptr;
+        }
+
+        Producer& operator=(Producer&& other) {
+            if (this != &other) {
+                Release();
+                store = other.store;
+                slot = other.slot;
+                other.slot = nullptr;
+            }
+            return *this;
+        }
+
+        Producer(const Producer&) = delete;
+        Producer& operator=(const Producer&) = delete;
+
+        // False when all producer slots were already taken
+        bool IsValid() const { return slot != nullptr; }
+
+        void TogglePoint(int i, int j) {
+            if (!slot || i < 0 || i >= store->size || j < 0 || j >= store->size) {
+                return;
+            }
+            ApplyWord(i, j / 64, 1ULL << (j % 64), SelectionMode::Toggle);
+            slot->Publish();
+        }
+
+        void ApplySpans(const std::vector<Span>& spans, SelectionMode mode) {
+            if (!slot) {
+                return;
+            }
+            for (const auto& span : spans) {
+                int begin = std::max(span.begin, 0);
+                int end = std::min(span.end, store->size);
+                if (span.row < 0 || span.row >= store->size || begin >= end) {
+                    continue;
+                }
+                for (int w = begin / 64; w <= (end - 1) / 64; w++) {
+                    int base = w * 64;
+                    ApplyWord(span.row, w,
+                              WordMask(std::max(begin - base, 0), std::min(end - base, 64)), mode);
+                }
+            }
+            slot->Publish();
+        }
+
+        // Deselect everything; each point cleared here is counted exactly once
+        // even if other producers are selecting at the same time
+        void Clear() {
+            if (!slot) {
+                return;
+            }
+            for (int i = 0; i < store->size; i++) {
+                for (int w = 0; w < store->wordsPerRow; w++) {
+                    ApplyWord(i, w, ~0ULL, SelectionMode::Clear);
+                }
+            }
+            slot->Publish();
+        }
+    };
+
+    ConcurrentSelection()
+        : size(Settings::Current().gridSize),
+          wordsPerRow((size + 63) / 64),
+          words(static_cast<size_t>(size) * wordsPerRow),
+          slotsUsed(0) {
+        for (auto& word : words) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ConcurrentSelection(const ConcurrentSelection&) = delete;
+    ConcurrentSelection& operator=(const ConcurrentSelection&) = delete;
+
+    // Claim a free producer slot. Lock-free; returns an invalid handle while
+    // all MAX_PRODUCERS slots are held.
+    Producer RegisterProducer() {
+        for (int index = 0; index < MAX_PRODUCERS; index++) {
+            bool expected = false;
+            if (slots[index].owned.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                int used = slotsUsed.load(std::memory_order_relaxed);
+                while (used <= index &&
+                       !slotsUsed.compare_exchange_weak(used, index + 1, std::memory_order_release)) {
+                }
+                return Producer(this, &slots[index]);
+            }
+        }
+        return Producer();
+    }
+
+    bool IsSelected(int i, int j) const {
+        if (i < 0 || i >= size || j < 0 || j >= size) {
+            return false;
+        }
+        uint64_t word = words[i * wordsPerRow + j / 64].load(std::memory_order_acquire);
+        return (word >> (j % 64)) & 1;
+    }
+
+    // Sum the per-producer accumulators. Once producers are quiescent this
+    // equals the moments of the selected points exactly.
+    CircleMoments ReduceMoments() const {
+        CircleMoments total;
+        int count = slotsUsed.load(std::memory_order_acquire);
+        for (int p = 0; p < count; p++) {
+            total.Merge(slots[p].Read());
+        }
+        return total;
+    }
+
+    Circle FitSelectedCircle() const {
+        return LatticeMoments::FitPixelCircle(ReduceMoments());
+    }
+
+    // Copy the current bits into a plain mask, e.g. for Grid::SetSelection
+    SelectionMask SnapshotMask() const {
+        SelectionMask mask(size, size);
+        for (int i = 0; i < size; i++) {
+            for (int w = 0; w < wordsPerRow; w++) {
+                mask.SetWord(i, w, words[i * wordsPerRow + w].load(std::memory_order_acquire));
+            }
+        }
+        return mask;
+    }
+};
@@ -9,17 +9,44 @@
 #pragma once
 #include <windows.h>
 
+// Defaults for the settings that can be changed at startup (see Settings.h)
 constexpr int GRID_SIZE = 20;
 
 constexpr int WINDOW_WIDTH = 800;
 constexpr int WINDOW_HEIGHT = 800;
+constexpr int GRID_PADDING = 0;   // Pixels between the window edge and the grid
 
-constexpr int CELL_SIZE = WINDOW_WIDTH / GRID_SIZE;
+// Lattice points within this many cells of a fitted circle form its ring
+constexpr double RING_THRESHOLD = 0.5;
 
-inline COLORREF GetBackgroundColor() { return RGB(255, 255, 255); }  // White
-inline COLORREF GetGridLineColor() { return RGB(200, 200, 200); }    // Light gray
-inline COLORREF GetUnselectedColor() { return RGB(220, 220, 220); }  // Light gray (unselected)
-inline COLORREF GetSelectedColor() { return RGB(0, 0, 255); }        // Blue
-inline COLORREF GetCircleColor() { return RGB(255, 0, 0); }          // Red
+// Gradient magnitudes for weak and strong image edges (see EdgeDetection.h)
+constexpr int EDGE_LOW_THRESHOLD = 100;
+constexpr int EDGE_HIGH_THRESHOLD = 250;
 
-constexpr int POINT_RADIUS = 5;
+constexpr int BRUSH_RADIUS = 60;  // Pixels
+
+// Store selection bits in Z-order 8x8 blocks rather than row-major words
+constexpr bool Z_ORDER_BITS = true;
+
+// Fits kept for selections seen before (see FitCache.h)
+constexpr size_t FIT_CACHE_SIZE = 256;
+
+constexpr COLORREF BACKGROUND_COLOR = RGB(255, 255, 255);         // White
+constexpr COLORREF GRID_LINE_COLOR = RGB(200, 200, 200);          // Light gray
+constexpr COLORREF UNSELECTED_COLOR = RGB(220, 220, 220);         // Light gray (unselected)
+constexpr COLORREF SELECTED_COLOR = RGB(0, 0, 255);               // Blue
+constexpr COLORREF CIRCLE_COLOR = RGB(255, 0, 0);                 // Red
+constexpr COLORREF REGION_COLOR = RGB(0, 160, 0);                 // Green (region outline)
+constexpr COLORREF PREVIOUS_SELECTED_COLOR = RGB(160, 160, 255);  // Light blue (previous fit's points)
+constexpr COLORREF PREVIOUS_CIRCLE_COLOR = RGB(255, 170, 170);    // Light red (previous fit)
+
+constexpr int POINT_RADIUS = 5;  // At most half a cell
+
+constexpr const char* SESSION_FILE = "Problem2.session";
+constexpr const char* SELECTION_SVG_FILE = "Problem2-selection.svg";  // E key
+constexpr const char* SETTINGS_FILE = "Problem2.cfg";  // Optional overrides, see Settings.h
+
+// Delta stream of selection and fit changes (see DeltaStream.h). The ring
+// should hold a keyframe of the whole grid; a fuller ring drops records.
+constexpr size_t DELTA_RING_BYTES = 1 << 20;
+constexpr const char* DELTA_LOG_FILE = "Problem2.delta";
@@ -0,0 +1,212 @@
+/**
+ * Exact Euclidean Distance Transform
+ *
+ * For every cell of a grid, the squared distance (in cells) to the nearest
+ * set cell of a mask and which cell that is. Computed in linear time with
+ * the Felzenszwalb-Huttenlocher lower envelope of parabolas, separably:
+ * one 1D pass along every row, then one along every column over the row
+ * results. Rows are independent of each other within a pass, as are
+ * columns, so both passes are split across threads.
+ *
+ * Once built, distance-to-selection, snapping and shape comparison
+ * (Chamfer / Hausdorff) are lookups instead of loops over the points.
+ *
+ */
+
+#pragma once
+#include "Selection.h"
+#include "Parallel.h"
+#include "TiledBitset.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+class DistanceTransform {
+private:
+    int rows;
+    int cols;
+    std::vector<double> squared;  // Squared distance to the nearest set cell, row-major
+    std::vector<int> nearest;     // Flat index of that cell, or -1 for an empty mask
+
+    // Scratch for one 1D transform
+    struct Envelope {
+        std::vector<int> v;       // Positions of the parabolas in the envelope
+        std::vector<double> z;    // Boundaries between them
+        void Reserve(int n) {
+            v.resize(n);
+            z.resize(n + 1);
+        }
+    };
+
+    // 1D transform of n samples: d[q] = min over p of (q - p)^2 + f[p], and
+    // arg[q] the minimizing p (-1 if every f is infinite). Infinite samples
+    // contribute no parabola.
+    static void Transform1D(const double* f, int n, double* d, int* arg, Envelope& env) {
+        const double inf = std::numeric_limits<double>::infinity();
+        int k = -1;
+        for (int q = 0; q < n; q++) {
+            if (f[q] == inf) {
+                continue;
+            }
+            double s = -inf;
+            while (k >= 0) {
+                int p = env.v[k];
+                s = ((f[q] + double(q) * q) - (f[p] + double(p) * p)) / (2.0 * (q - p));
+                if (s > env.z[k]) {
+                    break;
+                }
+                k--;
+            }
+            k++;
+            env.v[k] = q;
+            env.z[k] = k == 0 ? -inf : s;
+            env.z[k + 1] = inf;
+        }
+
+        if (k < 0) {
+            std::fill(d, d + n, inf);
+            std::fill(arg, arg + n, -1);
+            return;
+        }
+        k = 0;
+        for (int q = 0; q < n; q++) {
+            while (env.z[k + 1] < q) {
+                k++;
+            }
+            int p = env.v[k];
+            d[q] = double(q - p) * (q - p) + f[p];
+            arg[q] = p;
+        }
+    }
+
+    size_t Index(int i, int j) const {
+        return static_cast<size_t>(i) * cols + j;
+    }
+
+public:
+    DistanceTransform() : rows(0), cols(0) {}
+    explicit DistanceTransform(const TiledBitset& mask, unsigned threads = DefaultThreadCount()) {
+        Build(mask, threads);
+    }
+
+    void Build(const TiledBitset& mask, unsigned threads = DefaultThreadCount()) {
+        const double inf = std::numeric_limits<double>::infinity();
+        rows = mask.Rows();
+        cols = mask.Cols();
+        squared.assign(static_cast<size_t>(rows) * cols, inf);
+        nearest.assign(static_cast<size_t>(rows) * cols, -1);
+        std::vector<int> nearestCol(static_cast<size_t>(rows) * cols);
+
+        // Rows: distance along the row to the nearest set cell in that row
+        ParallelFor(rows, threads, [&](size_t begin, size_t end) {
+            Envelope env;
+            env.Reserve(cols);
+            std::vector<double> f(cols);
+            for (size_t i = begin; i < end; i++) {
+                std::fill(f.begin(), f.end(), inf);
+                for (int w = 0; w < mask.WordsPerRow(); w++) {
+                    ForEachRun(mask.Word(static_cast<int>(i), w), [&](int b, int e) {
+                        std::fill(f.begin() + w * 64 + b, f.begin() + std::min(w * 64 + e, cols), 0.0);
+                    });
+                }
+                Transform1D(f.data(), cols, &squared[i * cols], &nearestCol[i * cols], env);
+            }
+        });
+
+        // Columns: combine the row results, gathering each column contiguously
+        ParallelFor(cols, threads, [&](size_t begin, size_t end) {
+            Envelope env;
+            env.Reserve(rows);
+            std::vector<double> f(rows), d(rows);
+            std::vector<int> arg(rows);
+            for (size_t j = begin; j < end; j++) {
+                for (int i = 0; i < rows; i++) {
+                    f[i] = squared[Index(i, static_cast<int>(j))];
+                }
+                Transform1D(f.data(), rows, d.data(), arg.data(), env);
+                for (int i = 0; i < rows; i++) {
+                    size_t index = Index(i, static_cast<int>(j));
+                    squared[index] = d[i];
+                    nearest[index] = arg[i] < 0 ? -1
+                        : static_cast<int>(Index(arg[i], nearestCol[Index(arg[i], static_cast<int>(j))]));
+                }
+            }
+        });
+    }
+
+    int Rows() const { return rows; }
+    int Cols() const { return cols; }
+
+    // True if the mask had no set cells (every distance is infinite)
+    bool IsEmpty() const {
+        return nearest.empty() || nearest[0] < 0;
+    }
+
+    double SquaredDistance(int i, int j) const {
+        return squared[Index(i, j)];
+    }
+
+    // Distance in cells from (i, j) to the nearest set cell
+    double Distance(int i, int j) const {
+        return std::sqrt(squared[Index(i, j)]);
+    }
+
+    // Snap (i, j) to the nearest set cell; false if the mask is empty
+    bool Nearest(int i, int j, int& snapI, int& snapJ) const {
+        int index = nearest[Index(i, j)];
+        if (index < 0) {
+            return false;
+        }
+        snapI = index / cols;
+        snapJ = index % cols;
+        return true;
+    }
+
+    // Call visit(distance) with this transform's distance at every set cell
+    // of another mask of the same size
+    template <typename Visitor>
+    void ForEachDistanceAt(const TiledBitset& mask, Visitor visit) const {
+        for (int i = 0; i < rows; i++) {
+            for (int w = 0; w < mask.WordsPerRow(); w++) {
+                ForEachRun(mask.Word(i, w), [&](int b, int e) {
+                    for (int j = w * 64 + b; j < w * 64 + e; j++) {
+                        visit(Distance(i, j));
+                    }
+                });
+            }
+        }
+    }
+
+    // Mean distance from the set cells of a mask to this transform's mask
+    // (directed Chamfer distance); 0 if the mask is empty
+    double MeanDistanceFrom(const TiledBitset& mask) const {
+        double sum = 0;
+        size_t count = 0;
+        ForEachDistanceAt(mask, [&](double d) {
+            sum += d;
+            count++;
+        });
+        return count ? sum / count : 0.0;
+    }
+
+    // Largest distance from a set cell of a mask to this transform's mask
+    // (directed Hausdorff distance); 0 if the mask is empty
+    double MaxDistanceFrom(const TiledBitset& mask) const {
+        double largest = 0;
+        ForEachDistanceAt(mask, [&](double d) { largest = std::max(largest, d); });
+        return largest;
+    }
+
+    // Symmetric Chamfer distance: the average of both directed means
+    static double Chamfer(const TiledBitset& a, const DistanceTransform& aDistance,
+                          const TiledBitset& b, const DistanceTransform& bDistance) {
+        return 0.5 * (bDistance.MeanDistanceFrom(a) + aDistance.MeanDistanceFrom(b));
+    }
+
+    // Symmetric Hausdorff distance: the larger directed maximum
+    static double Hausdorff(const TiledBitset& a, const DistanceTransform& aDistance,
+                            const TiledBitset& b, const DistanceTransform& bDistance) {
+        return std::max(bDistance.MaxDistanceFrom(a), aDistance.MaxDistanceFrom(b));
+    }
+};
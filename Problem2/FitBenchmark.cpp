@@ -0,0 +1,171 @@
+/**
+ * Fit Throughput Benchmark
+ *
+ * Times FitCircle against FitHypersphere<2> on the same noisy arc, and
+ * FitHypersphere<3> on a noisy sphere cap, and reports points per second
+ * on one core together with the fits. The mixed-precision fits then run on
+ * the same points stored as float, against the double fits of those float
+ * values, and must agree with them to within MIXED_TOLERANCE of the radius.
+ * Last, concentric rings about one center are fitted jointly, on one
+ * thread and on all, against FitCircle on each ring.
+ *
+ * Console program, independent of Win32:
+ *   g++ -std=c++17 -O2 FitBenchmark.cpp -o FitBenchmark.exe
+ *   FitBenchmark.exe [-points N] [-repeat N] [-rings N]
+ *
+ */
+
+#include "ConcentricFit.h"
+#include "Geometry.h"
+#include "Hypersphere.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// Largest center or radius difference, relative to the radius, allowed
+// between a mixed-precision fit and the double fit of the same values
+const double MIXED_TOLERANCE = 1e-6;
+
+// Best of repeat runs of fit(), in seconds
+template <typename Fit>
+static double BestTime(int repeat, Fit fit) {
+    double best = 1e30;
+    for (int r = 0; r < repeat; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fit();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Largest center or radius difference of two fits, relative to the radius
+template <int D>
+static double RelativeDifference(const Hypersphere<D>& a, const Hypersphere<D>& b) {
+    double difference = std::abs(a.radius - b.radius);
+    for (int j = 0; j < D; j++) {
+        difference = std::max(difference, std::abs(a.center[j] - b.center[j]));
+    }
+    return difference / a.radius;
+}
+
+// Times the double and the mixed-precision fits of the same float values
+template <int D>
+static bool CompareMixed(const char* name, const std::vector<double>& coords, int repeat) {
+    const size_t count = coords.size() / D;
+    std::vector<float> narrow(coords.begin(), coords.end());
+    std::vector<double> widened(narrow.begin(), narrow.end());
+
+    Hypersphere<D> exact, mixed;
+    double doubleSeconds = BestTime(repeat, [&]() { exact = FitHypersphere<D>(widened.data(), count); });
+    double mixedSeconds = BestTime(repeat, [&]() { mixed = FitHypersphereMixed<D>(narrow.data(), count); });
+    double difference = RelativeDifference(exact, mixed);
+    bool agrees = difference <= MIXED_TOLERANCE;
+    std::printf("%s double %6.1f, mixed %6.1f Mpoints/s (%.2fx), difference %.1e of radius%s\n", name,
+                count / doubleSeconds / 1e6, count / mixedSeconds / 1e6, doubleSeconds / mixedSeconds,
+                difference, agrees ? "" : "  ** EXCEEDS TOLERANCE **");
+    return agrees;
+}
+
+int main(int argc, char** argv) {
+    size_t count = 10000000;
+    int repeat = 3;
+    size_t ringCount = 200;
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "-points" && k + 1 < argc) {
+            count = static_cast<size_t>(std::atoll(argv[++k]));
+        } else if (arg == "-repeat" && k + 1 < argc) {
+            repeat = std::atoi(argv[++k]);
+        } else if (arg == "-rings" && k + 1 < argc) {
+            ringCount = static_cast<size_t>(std::atoll(argv[++k]));
+        } else {
+            std::fprintf(stderr, "usage: FitBenchmark [-points N] [-repeat N] [-rings N]\n");
+            return 1;
+        }
+    }
+    if (count < 4 || repeat < 1 || ringCount < 1 || count < 3 * ringCount) {
+        std::fprintf(stderr, "FitBenchmark: need at least 4 points, 3 points per ring and 1 repeat\n");
+        return 1;
+    }
+
+    // A third of a circle of radius 200 px about (400, 300), and a sphere
+    // cap of radius 50 about (1, 2, -3), with Gaussian noise
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 0.5);
+    std::uniform_real_distribution<double> angle(0.0, 2.0 * 3.14159265358979323846);
+    std::vector<Point> circlePoints(count);
+    std::vector<double> circleCoords(2 * count), sphereCoords(3 * count);
+    for (size_t i = 0; i < count; i++) {
+        double t = angle(rng) / 3;
+        circlePoints[i] = Point(400 + 200 * std::cos(t) + noise(rng), 300 + 200 * std::sin(t) + noise(rng));
+        circleCoords[2 * i] = circlePoints[i].x;
+        circleCoords[2 * i + 1] = circlePoints[i].y;
+
+        double azimuth = angle(rng), polar = angle(rng) / 6;
+        sphereCoords[3 * i] = 1 + 50 * std::cos(azimuth) * std::sin(polar) + noise(rng);
+        sphereCoords[3 * i + 1] = 2 + 50 * std::sin(azimuth) * std::sin(polar) + noise(rng);
+        sphereCoords[3 * i + 2] = -3 + 50 * std::cos(polar) + noise(rng);
+    }
+
+    Circle circle;
+    Hypersphere<2> circle2;
+    Hypersphere<3> sphere;
+    double seconds = BestTime(repeat, [&]() { circle = FitCircle(circlePoints); });
+    std::printf("FitCircle            %6.1f Mpoints/s  center (%.3f, %.3f) radius %.3f\n",
+                count / seconds / 1e6, circle.center.x, circle.center.y, circle.radius);
+    seconds = BestTime(repeat, [&]() { circle2 = FitHypersphere<2>(circleCoords.data(), count); });
+    std::printf("FitHypersphere<2>    %6.1f Mpoints/s  center (%.3f, %.3f) radius %.3f\n",
+                count / seconds / 1e6, circle2.center[0], circle2.center[1], circle2.radius);
+    seconds = BestTime(repeat, [&]() { sphere = FitHypersphere<3>(sphereCoords.data(), count); });
+    std::printf("FitHypersphere<3>    %6.1f Mpoints/s  center (%.3f, %.3f, %.3f) radius %.3f\n",
+                count / seconds / 1e6, sphere.center[0], sphere.center[1], sphere.center[2], sphere.radius);
+
+    bool agrees = CompareMixed<2>("Float circle:", circleCoords, repeat);
+    agrees = CompareMixed<3>("Float sphere:", sphereCoords, repeat) && agrees;
+
+    // Full rings of radius 50, 51, ... about (400, 300), the points of all
+    // rings interleaved as a scan would produce them. Fitting each ring on
+    // its own first has to gather its points.
+    std::vector<Point> ringPoints(count);
+    std::vector<int> labels(count);
+    for (size_t i = 0; i < count; i++) {
+        labels[i] = static_cast<int>(i % ringCount);
+        double r = 50.0 + labels[i], t = angle(rng);
+        ringPoints[i] = Point(400 + r * std::cos(t) + noise(rng), 300 + r * std::sin(t) + noise(rng));
+    }
+    ConcentricCircles joint;
+    std::vector<Circle> separate(ringCount);
+    double separateSeconds = BestTime(repeat, [&]() {
+        std::vector<std::vector<Point>> byRing(ringCount);
+        for (size_t i = 0; i < count; i++) {
+            byRing[labels[i]].push_back(ringPoints[i]);
+        }
+        for (size_t g = 0; g < ringCount; g++) {
+            separate[g] = FitCircle(byRing[g]);
+        }
+    });
+    auto jointFit = [&](unsigned threads) {
+        return FitConcentricCircles(count, [&](size_t i) { return ringPoints[i]; },
+                                    [&](size_t i) { return labels[i]; }, ringCount, threads);
+    };
+    double serialSeconds = BestTime(repeat, [&]() { joint = jointFit(1); });
+    double parallelSeconds = BestTime(repeat, [&]() { joint = jointFit(DefaultThreadCount()); });
+    double jointRadiusError = 0, separateRadiusError = 0, separateCenterError = 0;
+    for (size_t g = 0; g < ringCount; g++) {
+        jointRadiusError = std::max(jointRadiusError, std::abs(joint.radii[g] - (50.0 + g)));
+        separateRadiusError = std::max(separateRadiusError, std::abs(separate[g].radius - (50.0 + g)));
+        separateCenterError = std::max(separateCenterError,
+                                       std::hypot(separate[g].center.x - 400, separate[g].center.y - 300));
+    }
+    std::printf("%zu rings: per ring %6.1f ms, joint %6.1f ms on 1 thread, %6.1f ms on %u\n", ringCount,
+                separateSeconds * 1e3, serialSeconds * 1e3, parallelSeconds * 1e3, DefaultThreadCount());
+    std::printf("  center error: joint %.5f, worst ring %.5f; worst radius error: joint %.5f, per ring %.5f\n",
+                std::hypot(joint.center.x - 400, joint.center.y - 300), separateCenterError, jointRadiusError,
+                separateRadiusError);
+    return agrees ? 0 : 2;
+}
@@ -9,12 +9,19 @@
  * - Minimizes algebraic distance to circle
  * - Handles degenerate cases (collinear points)
  * 
+ * The program uses these names unqualified. They live in CircleFitting so
+ * that libgeometry can build them next to the other programs' geometry,
+ * whose Point and Circle differ from these.
+ * 
  */
 
 #pragma once
 #include <cmath>
 #include <vector>
 #include <algorithm>
+#include <limits>
+
+namespace CircleFitting {
 
 struct Point {
     double x;
@@ -33,47 +40,134 @@ struct Circle {
     Circle(double cx, double cy, double r) : center(cx, cy), radius(r) {}
 };
 
-// Best fit circle using algebraic fit (Pratt method)
-// This uses least squares to find the circle that best fits a set of points
-Circle FitCircle(const std::vector<Point>& points) {
-    if (points.size() < 3) {
-        return Circle();  // Need at least 3 points for a circle
+// Raw power sums of a point set up to fourth order.
+// Maintained incrementally by the grid so a fit never has to revisit the points.
+struct CircleMoments {
+    double n, sx, sy;
+    double sxx, sxy, syy;
+    double sxxx, sxxy, sxyy, syyy;
+    double sxxxx, sxxyy, syyyy;
+    
+    CircleMoments() { Clear(); }
+    
+    void Clear() {
+        n = sx = sy = 0;
+        sxx = sxy = syy = 0;
+        sxxx = sxxy = sxyy = syyy = 0;
+        sxxxx = sxxyy = syyyy = 0;
+    }
+    
+    // Add (weight > 0) or remove (weight < 0) a horizontal run of points at
+    // height y, given the run's x power sums px[k] = sum of x^k for k = 0..4
+    void AddRow(double y, const double px[5], double weight) {
+        double y2 = y * y;
+        n += weight * px[0];
+        sx += weight * px[1];
+        sy += weight * y * px[0];
+        sxx += weight * px[2];
+        sxy += weight * y * px[1];
+        syy += weight * y2 * px[0];
+        sxxx += weight * px[3];
+        sxxy += weight * y * px[2];
+        sxyy += weight * y2 * px[1];
+        syyy += weight * y2 * y * px[0];
+        sxxxx += weight * px[4];
+        sxxyy += weight * y2 * px[2];
+        syyyy += weight * y2 * y2 * px[0];
+    }
+    
+    void Merge(const CircleMoments& other) {
+        n += other.n; sx += other.sx; sy += other.sy;
+        sxx += other.sxx; sxy += other.sxy; syy += other.syy;
+        sxxx += other.sxxx; sxxy += other.sxxy; sxyy += other.sxyy; syyy += other.syyy;
+        sxxxx += other.sxxxx; sxxyy += other.sxxyy; syyyy += other.syyyy;
+    }
+    
+    void Add(double x, double y, double weight = 1) {
+        double x2 = x * x;
+        const double px[5] = {1, x, x2, x2 * x, x2 * x2};
+        AddRow(y, px, weight);
     }
+};
+
+// Moments of a point set about its centroid (cx, cy), each divided by the
+// point count, with z = x^2 + y^2: all the Pratt fit and its constrained
+// variants need
+struct CentroidMoments {
+    double cx, cy;
+    double Mxx, Myy, Mxy;
+    double Mxz, Myz, Mzz;
+};
+
+// Centroid moments of the points pointAt(0) .. pointAt(count - 1), in two
+// passes: the centroid, then the moments of the translated points
+template <typename PointAt>
+CentroidMoments GetCentroidMoments(size_t count, PointAt pointAt) {
+    CentroidMoments m = {};
     
     // Calculate centroid
     double sum_x = 0, sum_y = 0;
-    for (const auto& p : points) {
+    for (size_t i = 0; i < count; i++) {
+        Point p = pointAt(i);
         sum_x += p.x;
         sum_y += p.y;
     }
-    double cx = sum_x / points.size();
-    double cy = sum_y / points.size();
+    m.cx = sum_x / count;
+    m.cy = sum_y / count;
     
-    // Translate points to centroid
-    std::vector<Point> translated;
-    translated.reserve(points.size());
-    for (const auto& p : points) {
-        translated.push_back(Point(p.x - cx, p.y - cy));
+    // Calculate statistical moments of the points translated to the centroid
+    for (size_t i = 0; i < count; i++) {
+        Point q = pointAt(i);
+        Point p(q.x - m.cx, q.y - m.cy);
+        double zi = p.x * p.x + p.y * p.y;
+        m.Mxx += p.x * p.x;
+        m.Myy += p.y * p.y;
+        m.Mxy += p.x * p.y;
+        m.Mxz += p.x * zi;
+        m.Myz += p.y * zi;
+        m.Mzz += zi * zi;
     }
+    m.Mxx /= count;
+    m.Myy /= count;
+    m.Mxy /= count;
+    m.Mxz /= count;
+    m.Myz /= count;
+    m.Mzz /= count;
+    return m;
+}
+
+// Centroid moments from maintained power sums, without visiting the points
+inline CentroidMoments GetCentroidMoments(const CircleMoments& s) {
+    CentroidMoments m;
+    double cx = m.cx = s.sx / s.n;
+    double cy = m.cy = s.sy / s.n;
+    double Ex2 = s.sxx / s.n, Exy = s.sxy / s.n, Ey2 = s.syy / s.n;
+    double Ex3 = s.sxxx / s.n, Ex2y = s.sxxy / s.n, Exy2 = s.sxyy / s.n, Ey3 = s.syyy / s.n;
     
-    // Calculate statistical moments
-    double Mxx = 0, Myy = 0, Mxy = 0, Mxz = 0, Myz = 0, Mzz = 0;
-    for (const auto& p : translated) {
-        double zi = p.x * p.x + p.y * p.y;
-        Mxx += p.x * p.x;
-        Myy += p.y * p.y;
-        Mxy += p.x * p.y;
-        Mxz += p.x * zi;
-        Myz += p.y * zi;
-        Mzz += zi * zi;
-    }
-    Mxx /= points.size();
-    Myy /= points.size();
-    Mxy /= points.size();
-    Mxz /= points.size();
-    Myz /= points.size();
-    Mzz /= points.size();
+    // Shift the raw sums to the centroid
+    m.Mxx = Ex2 - cx * cx;
+    m.Myy = Ey2 - cy * cy;
+    m.Mxy = Exy - cx * cy;
+    double Mxxx = Ex3 - 3 * cx * Ex2 + 2 * cx * cx * cx;
+    double Myyy = Ey3 - 3 * cy * Ey2 + 2 * cy * cy * cy;
+    double Mxxy = Ex2y - 2 * cx * Exy - cy * Ex2 + 2 * cx * cx * cy;
+    double Mxyy = Exy2 - 2 * cy * Exy - cx * Ey2 + 2 * cx * cy * cy;
+    double Mxxxx = s.sxxxx / s.n - 4 * cx * Ex3 + 6 * cx * cx * Ex2 - 3 * cx * cx * cx * cx;
+    double Myyyy = s.syyyy / s.n - 4 * cy * Ey3 + 6 * cy * cy * Ey2 - 3 * cy * cy * cy * cy;
+    double Mxxyy = s.sxxyy / s.n - 2 * cx * Exy2 - 2 * cy * Ex2y + cx * cx * Ey2
+                 + cy * cy * Ex2 + 4 * cx * cy * Exy - 3 * cx * cx * cy * cy;
     
+    m.Mxz = Mxxx + Mxyy;
+    m.Myz = Mxxy + Myyy;
+    m.Mzz = Mxxxx + 2 * Mxxyy + Myyyy;
+    return m;
+}
+
+// Solve the Pratt characteristic polynomial for centroid-relative moments.
+// Returns false when the points are collinear (or nearly so).
+inline bool SolvePrattCenter(double Mxx, double Myy, double Mxy,
+                             double Mxz, double Myz, double Mzz,
+                             double& center_x, double& center_y) {
     // Calculate coefficients for circle equation
     double Mz = Mxx + Myy;
     double Cov_xy = Mxx * Myy - Mxy * Mxy;
@@ -115,30 +209,266 @@ Circle FitCircle(const std::vector<Point>& points) {
     
     // Check if DET is too small (collinear or nearly collinear points)
     if (std::abs(DET) < 1e-10) {
-        return Circle();  // Invalid circle - points are collinear
+        return false;  // Invalid circle - points are collinear
+    }
+    
+    center_x = (Mxz * (Myy - xnew) - Myz * Mxy) / DET / 2;
+    center_y = (Myz * (Mxx - xnew) - Mxz * Mxy) / DET / 2;
+    return true;
+}
+
+inline bool IsUsableCircle(double center_x, double center_y, double radius) {
+    return !(std::isnan(center_x) || std::isnan(center_y) || std::isnan(radius) ||
+             std::isinf(center_x) || std::isinf(center_y) || std::isinf(radius) ||
+             radius <= 0 || radius > 10000);
+}
+
+// Average distance from center to the points: the radius of every fit that
+// has the points at hand
+template <typename PointAt>
+double MeanDistance(size_t count, PointAt pointAt, const Point& center) {
+    double sum_r = 0;
+    for (size_t i = 0; i < count; i++) {
+        Point p = pointAt(i);
+        double dx = p.x - center.x;
+        double dy = p.y - center.y;
+        sum_r += std::sqrt(dx * dx + dy * dy);
+    }
+    return sum_r / count;
+}
+
+// Best fit circle using algebraic fit (Pratt method)
+// This uses least squares to find the circle that best fits a set of points.
+// pointAt(i) returns point i of count, so the points can stay in the
+// caller's own storage (e.g. a strided buffer) rather than a vector.
+template <typename PointAt>
+Circle FitCircle(size_t count, PointAt pointAt) {
+    if (count < 3) {
+        return Circle();  // Need at least 3 points for a circle
     }
     
-    double center_x = (Mxz * (Myy - xnew) - Myz * Mxy) / DET / 2;
-    double center_y = (Myz * (Mxx - xnew) - Mxz * Mxy) / DET / 2;
+    CentroidMoments m = GetCentroidMoments(count, pointAt);
+    double center_x, center_y;
+    if (!SolvePrattCenter(m.Mxx, m.Myy, m.Mxy, m.Mxz, m.Myz, m.Mzz, center_x, center_y)) {
+        return Circle();
+    }
     
     // Transform back to original coordinate system
-    center_x += cx;
-    center_y += cy;
+    center_x += m.cx;
+    center_y += m.cy;
     
     // Calculate radius as average distance from center to all points
+    double radius = MeanDistance(count, pointAt, Point(center_x, center_y));
+    
+    if (!IsUsableCircle(center_x, center_y, radius)) {
+        return Circle();  // Invalid circle
+    }
+    
+    return Circle(center_x, center_y, radius);
+}
+
+inline Circle FitCircle(const std::vector<Point>& points) {
+    return FitCircle(points.size(), [&](size_t i) { return points[i]; });
+}
+
+// Best fit circle from maintained power sums (same Pratt solve as above).
+// The radius is the RMS distance to the points, which the sums give exactly;
+// it is slightly larger than FitCircle(points)'s mean distance. Callers that
+// can still visit the points (Grid::FitSelectedCircle) replace it with the
+// mean, so the same points give the same circle either way.
+inline Circle FitCircle(const CircleMoments& s) {
+    if (s.n < 3) {
+        return Circle();
+    }
+    
+    CentroidMoments m = GetCentroidMoments(s);
+    double center_x, center_y;
+    if (!SolvePrattCenter(m.Mxx, m.Myy, m.Mxy, m.Mxz, m.Myz, m.Mzz, center_x, center_y)) {
+        return Circle();
+    }
+    
+    double radius = std::sqrt(center_x * center_x + center_y * center_y + m.Mxx + m.Myy);
+    center_x += m.cx;
+    center_y += m.cy;
+    
+    if (!IsUsableCircle(center_x, center_y, radius)) {
+        return Circle();
+    }
+    
+    return Circle(center_x, center_y, radius);
+}
+
+// Center, relative to the centroid, of the circle of the given radius that
+// best fits the moments. For a fixed radius Pratt's constraint is a constant
+// scale, so this minimizes the sum of (|p - c|^2 - r^2)^2 over c alone. Its
+// stationary points are c = (M - eta I)^-1 (Mxz, Myz) / 2 with
+// |c|^2 = r^2 - tr M - 2 eta, and the minimum has eta below both
+// eigenvalues of M. In M's eigenbasis that is one scalar equation with a
+// single root below them, so a bracketed Newton iteration always finds the
+// global minimum.
+inline bool SolveCenterForRadius(const CentroidMoments& m, double radius,
+                                 double& center_x, double& center_y) {
+    // Eigenvalues l1 >= l2 of M, eigenvectors (cos_t, sin_t) and
+    // (-sin_t, cos_t), each taken from the better conditioned row
+    double half = (m.Mxx - m.Myy) / 2;
+    double spread = std::sqrt(half * half + m.Mxy * m.Mxy);
+    double l1 = (m.Mxx + m.Myy) / 2 + spread;
+    double l2 = (m.Mxx + m.Myy) / 2 - spread;
+    double cos_t = 1, sin_t = 0;
+    if (spread > 0) {
+        double vx = half >= 0 ? spread + half : m.Mxy;
+        double vy = half >= 0 ? m.Mxy : spread - half;
+        double length = std::sqrt(vx * vx + vy * vy);
+        cos_t = vx / length;
+        sin_t = vy / length;
+    }
+    
+    // (Mxz, Myz) / 2 in the eigenbasis
+    double b1 = (cos_t * m.Mxz + sin_t * m.Myz) / 2;
+    double b2 = (cos_t * m.Myz - sin_t * m.Mxz) / 2;
+    double target = radius * radius - m.Mxx - m.Myy;  // |c|^2 + 2 eta at the root
+    
+    // f(eta) = |c(eta)|^2 + 2 eta - target, times (l1 - eta)^2 (l2 - eta)^2:
+    // a polynomial with f's sign below l2, and its slope
+    const double q1 = b1 * b1, q2 = b2 * b2;
+    auto f = [&](double eta, double& slope) {
+        double A = l1 - eta, B = l2 - eta, g = 2 * eta - target;
+        double AB = A * B;
+        slope = -2 * (q1 * B + q2 * A) + 2 * AB * AB - 2 * g * AB * (A + B);
+        return q1 * B * B + q2 * A * A + g * AB * AB;
+    };
+    
+    // Without a b2 term |c(eta)| stays finite up to l2. If |c|^2 + 2 eta is
+    // still short of target there, eta = l2 and the center moves along the
+    // second eigenvector far enough to reach the radius (points on a short
+    // line, or a full circle fitted with a larger radius).
+    double u1 = spread > 0 ? b1 / (2 * spread) : 0;
+    double shortfall = target - 2 * l2 - u1 * u1;
+    double scale = std::max(std::abs(target), l1) + 1e-300;
+    double negligible = 1e-24 * shortfall * scale;
+    if (shortfall > 0 && q2 <= negligible && (spread > 0 || q1 <= negligible)) {
+        double u2 = std::copysign(std::sqrt(shortfall), b2);
+        center_x = cos_t * u1 - sin_t * u2;
+        center_y = sin_t * u1 + cos_t * u2;
+        return std::isfinite(center_x) && std::isfinite(center_y);
+    }
+    
+    // Newton from eta = 0, where the free fit's root usually is, kept
+    // inside a bracket [lo, hi] of the root by bisection
+    double lo = -std::numeric_limits<double>::infinity();
+    double hi = l2;
+    double eta = l2 > 0 ? 0 : l2 - scale;
+    for (int iter = 0; iter < 100; iter++) {
+        double slope;
+        double value = f(eta, slope);
+        if (value == 0) {
+            break;
+        }
+        if (value < 0) {
+            lo = eta;
+        } else {
+            hi = eta;
+        }
+        double next = eta - value / slope;
+        if (!(next > lo && next < hi)) {
+            next = std::isfinite(lo) ? (lo + hi) / 2 : hi - 2 * std::max(hi - eta, scale);
+        }
+        if (std::abs(next - eta) <= 1e-14 * scale) {
+            eta = next;
+            break;
+        }
+        eta = next;
+    }
+    
+    double c1 = b1 / (l1 - eta);
+    double c2 = b2 / (l2 - eta);
+    center_x = cos_t * c1 - sin_t * c2;
+    center_y = sin_t * c1 + cos_t * c2;
+    return std::isfinite(center_x) && std::isfinite(center_y);
+}
+
+// Best fit circle of a known radius (a hole gauge, say): only the center is
+// fitted, with one scalar equation in place of the Pratt solve. Unlike the
+// free fit it also places a circle through 2 points or along a short line.
+template <typename PointAt>
+Circle FitCircleWithRadius(size_t count, PointAt pointAt, double radius) {
+    if (count < 2 || !(radius > 0)) {
+        return Circle();
+    }
+    
+    CentroidMoments m = GetCentroidMoments(count, pointAt);
+    double center_x, center_y;
+    if (!SolveCenterForRadius(m, radius, center_x, center_y) ||
+        !IsUsableCircle(center_x + m.cx, center_y + m.cy, radius)) {
+        return Circle();
+    }
+    return Circle(center_x + m.cx, center_y + m.cy, radius);
+}
+
+inline Circle FitCircleWithRadius(const std::vector<Point>& points, double radius) {
+    return FitCircleWithRadius(points.size(), [&](size_t i) { return points[i]; }, radius);
+}
+
+inline Circle FitCircleWithRadius(const CircleMoments& s, double radius) {
+    if (s.n < 2 || !(radius > 0)) {
+        return Circle();
+    }
+    
+    CentroidMoments m = GetCentroidMoments(s);
+    double center_x, center_y;
+    if (!SolveCenterForRadius(m, radius, center_x, center_y) ||
+        !IsUsableCircle(center_x + m.cx, center_y + m.cy, radius)) {
+        return Circle();
+    }
+    return Circle(center_x + m.cx, center_y + m.cy, radius);
+}
+
+// Best fit circle about a known center (a concentricity check): only the
+// radius is fitted, in closed form. As with FitCircle, it is the mean
+// distance to the points here and the RMS distance from the sums below.
+template <typename PointAt>
+Circle FitCircleWithCenter(size_t count, PointAt pointAt, const Point& center) {
+    if (count < 1) {
+        return Circle();
+    }
+    
     double sum_r = 0;
-    for (const auto& p : points) {
-        double dx = p.x - center_x;
-        double dy = p.y - center_y;
+    for (size_t i = 0; i < count; i++) {
+        Point p = pointAt(i);
+        double dx = p.x - center.x;
+        double dy = p.y - center.y;
         sum_r += std::sqrt(dx * dx + dy * dy);
     }
-    double radius = sum_r / points.size();
+    double radius = sum_r / count;
     
-    if (std::isnan(center_x) || std::isnan(center_y) || std::isnan(radius) ||
-        std::isinf(center_x) || std::isinf(center_y) || std::isinf(radius) ||
-        radius <= 0 || radius > 10000) {
-        return Circle();  // Invalid circle
+    if (!IsUsableCircle(center.x, center.y, radius)) {
+        return Circle();
+    }
+    return Circle(center, radius);
+}
+
+inline Circle FitCircleWithCenter(const std::vector<Point>& points, const Point& center) {
+    return FitCircleWithCenter(points.size(), [&](size_t i) { return points[i]; }, center);
+}
+
+inline Circle FitCircleWithCenter(const CircleMoments& s, const Point& center) {
+    if (s.n < 1) {
+        return Circle();
     }
     
-    return Circle(center_x, center_y, radius);
+    // Mean squared distance: the spread about the centroid plus the
+    // centroid's own offset from the center
+    CentroidMoments m = GetCentroidMoments(s);
+    double dx = m.cx - center.x;
+    double dy = m.cy - center.y;
+    double radius = std::sqrt(m.Mxx + m.Myy + dx * dx + dy * dy);
+    
+    if (!IsUsableCircle(center.x, center.y, radius)) {
+        return Circle();
+    }
+    return Circle(center, radius);
 }
+
+}  // namespace CircleFitting
+
+using namespace CircleFitting;
@@ -3,12 +3,19 @@
  * 
  * Manages a 2D grid of interactive points, handling selection state
  * and coordinate transformations between pixel and grid space.
+ * Selection is kept as a copy-on-write tiled bitset together with the
+ * power sums of the selected points, so region edits and fits never
+ * rescan the grid and snapshots for undo are O(1). A Zobrist hash of the
+ * selection is kept alongside to key cached fits.
  * 
  */
 
 #pragma once
 #include "Config.h"
 #include "Geometry.h"
+#include "Selection.h"
+#include "FitCache.h"
+#include "BatchTransform.h"
 #include <vector>
 
 struct GridPoint {
@@ -20,76 +27,161 @@ struct GridPoint {
     GridPoint(int i, int j) : i(i), j(j), selected(false) {}
     
     Point GetPixelCoords() const {
-        return Point(
-            j * CELL_SIZE + CELL_SIZE / 2.0,
-            i * CELL_SIZE + CELL_SIZE / 2.0
-        );
+        return Point(LatticeCoord(j), LatticeCoord(i));
     }
 };
 
 class Grid {
 private:
-    std::vector<std::vector<GridPoint>> points;
+    int size;  // Points a side
+    SelectionMask selection;
+    CircleMoments moments;
+    LatticeMoments lattice;
+    uint64_t hash;  // Zobrist hash of the selection
     
 public:
-    Grid() {
-        // Initialize grid with all points unselected
-        points.resize(GRID_SIZE);
-        for (int i = 0; i < GRID_SIZE; i++) {
-            points[i].resize(GRID_SIZE);
-            for (int j = 0; j < GRID_SIZE; j++) {
-                points[i][j] = GridPoint(i, j);
-            }
-        }
+    Grid() : size(Settings::Current().gridSize), selection(size, size), hash(0) {
+        // All points start unselected
     }
     
     void TogglePoint(int i, int j) {
-        if (i >= 0 && i < GRID_SIZE && j >= 0 && j < GRID_SIZE) {
-            points[i][j].selected = !points[i][j].selected;
+        if (i >= 0 && i < size && j >= 0 && j < size) {
+            bool selected = selection.Flip(i, j);
+            lattice.AddPoint(moments, i, j, selected ? 1.0 : -1.0);
+            hash ^= ZobristKeys::Get().Key(i, j);
+        }
+    }
+    
+    // Set, clear or toggle every point covered by the spans
+    void ApplySpans(const std::vector<Span>& spans, SelectionMode mode) {
+        for (const auto& span : spans) {
+            selection.ApplySpan(span, mode, [&](int begin, int end, double weight) {
+                lattice.AddRun(moments, span.row, begin, end, weight);
+                hash ^= ZobristKeys::Get().Run(span.row, begin, end);
+            });
         }
     }
     
     bool IsSelected(int i, int j) const {
-        if (i >= 0 && i < GRID_SIZE && j >= 0 && j < GRID_SIZE) {
-            return points[i][j].selected;
+        if (i >= 0 && i < size && j >= 0 && j < size) {
+            return selection.Get(i, j);
         }
         return false;
     }
     
     void Clear() {
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                points[i][j].selected = false;
-            }
-        }
+        selection.Clear();
+        moments.Clear();
+        hash = 0;
+    }
+    
+    // Replace the selection wholesale, e.g. with an undo snapshot or a
+    // snapshot of a concurrent store. Copying a mask is O(1).
+    void SetSelection(const SelectionMask& mask, const CircleMoments& sums) {
+        selection = mask;
+        moments = sums;
+        hash = ZobristKeys::Get().Hash(mask.GetBits());
+    }
+    
+    const SelectionMask& GetSelection() const { return selection; }
+    const CircleMoments& GetMoments() const { return moments; }
+    uint64_t GetHash() const { return hash; }
+    
+    size_t GetSelectedCount() const {
+        return static_cast<size_t>(moments.n);
     }
     
     std::vector<Point> GetSelectedPoints() const {
+        std::vector<int> rows, cols;
+        for (int i = 0; i < size; i++) {
+            for (int w = 0; w < selection.GetWordsPerRow(); w++) {
+                ForEachRun(selection.GetWord(i, w), [&](int begin, int end) {
+                    for (int j = w * 64 + begin; j < w * 64 + end; j++) {
+                        rows.push_back(i);
+                        cols.push_back(j);
+                    }
+                });
+            }
+        }
+        
+        std::vector<double> xs(rows.size()), ys(rows.size());
+        GridToPixels(rows.data(), cols.data(), rows.size(), xs.data(), ys.data());
         std::vector<Point> selectedPoints;
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                if (points[i][j].selected) {
-                    selectedPoints.push_back(points[i][j].GetPixelCoords());
+        selectedPoints.reserve(rows.size());
+        for (size_t k = 0; k < rows.size(); k++) {
+            selectedPoints.push_back(Point(xs[k], ys[k]));
+        }
+        return selectedPoints;
+    }
+    
+    // Best-fit circle through the selection: the center from the maintained
+    // moments, the radius the mean distance to the selected points, as in
+    // FitCircle(GetSelectedPoints())
+    Circle FitSelectedCircle() const {
+        Circle circle = LatticeMoments::FitPixelCircle(moments);
+        if (circle.radius <= 0) {
+            return circle;
+        }
+        double sum_r = 0;
+        DispatchLattice([&](const auto& lattice) {
+            for (int i = 0; i < size; i++) {
+                double dy = LatticeCoord(lattice, i) - circle.center.y;
+                for (int w = 0; w < selection.GetWordsPerRow(); w++) {
+                    ForEachRun(selection.GetWord(i, w), [&](int begin, int end) {
+                        for (int j = w * 64 + begin; j < w * 64 + end; j++) {
+                            double dx = LatticeCoord(lattice, j) - circle.center.x;
+                            sum_r += std::sqrt(dx * dx + dy * dy);
+                        }
+                    });
                 }
             }
+        });
+        circle.radius = sum_r / moments.n;
+        return circle;
+    }
+    
+    // Pixel coordinate of n rows or columns at once; the lattice is the
+    // same along both axes
+    static void IndicesToPixels(const int* index, size_t n, double* coord) {
+        RuntimeLattice lattice = CurrentLattice();
+        IndicesToCoords(index, coord, n, lattice.cellSize, LatticeCoord(lattice, 0));
+    }
+    
+    // Pixel coordinates of n grid points at once (same as GetPixelCoords)
+    static void GridToPixels(const int* i, const int* j, size_t n, double* x, double* y) {
+        IndicesToPixels(j, n, x);
+        IndicesToPixels(i, n, y);
+    }
+    
+    // Nearest grid point to each of n pixel samples (clicks, stroke samples).
+    // i and j are -1 for samples nearest to no grid point. Returns the
+    // number of samples that hit the grid.
+    static size_t PixelsToGrid(const double* x, const double* y, size_t n, int* i, int* j) {
+        RuntimeLattice lattice = CurrentLattice();
+        CoordsToIndices(x, j, n, lattice.cellSize, LatticeCoord(lattice, 0), lattice.gridSize);
+        CoordsToIndices(y, i, n, lattice.cellSize, LatticeCoord(lattice, 0), lattice.gridSize);
+        size_t hits = 0;
+        for (size_t k = 0; k < n; k++) {
+            if (i[k] < 0 || j[k] < 0) {
+                i[k] = j[k] = -1;
+            } else {
+                hits++;
+            }
         }
-        return selectedPoints;
+        return hits;
     }
     
-    // Convert pixel coordinates to grid indices
+    // Convert pixel coordinates to the nearest grid point's indices
     static bool PixelToGrid(int x, int y, int& i, int& j) {
-        j = x / CELL_SIZE;
-        i = y / CELL_SIZE;
-        
-        if (i >= 0 && i < GRID_SIZE && j >= 0 && j < GRID_SIZE) {
-            return true;
-        }
-        return false;
+        double px = x, py = y;
+        return PixelsToGrid(&px, &py, 1, &i, &j) == 1;
     }
     
-    int GetSize() const { return GRID_SIZE; }
+    int GetSize() const { return size; }
     
-    const GridPoint& GetPoint(int i, int j) const {
-        return points[i][j];
+    GridPoint GetPoint(int i, int j) const {
+        GridPoint point(i, j);
+        point.selected = selection.Get(i, j);
+        return point;
     }
 };
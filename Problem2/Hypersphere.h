@@ -0,0 +1,586 @@
+/**
+ * Hypersphere Fitting
+ *
+ * The Pratt fit of FitCircle generalized to D dimensions: circles (D = 2),
+ * spheres (D = 3) and beyond, in float or double.
+ *
+ * A hypersphere is A|x|^2 + B.x + C = 0 under the Pratt constraint
+ * |B|^2 - 4AC = 1. With the points centered on their centroid, M their
+ * covariance, Mxz the moments of x|x|^2 and Mzz of |x|^4, the fit is the
+ * smallest root eta of
+ *
+ *   f(eta) = Mzz - Mxz.(M - eta I)^-1 Mxz - (tr M + 2 eta)^2
+ *
+ * scaled by det(M - eta I), which for D = 2 is exactly the characteristic
+ * polynomial of FitCircle; the center is then (M - eta I)^-1 Mxz / 2. For
+ * D = 2 the moments go to FitCircle's own SolvePrattCenter, so
+ * FitHypersphere<2> and FitCircle give the same circle for the same points.
+ * Higher dimensions use the same Newton iteration from eta = 0 but keep its
+ * best iterate where SolvePrattCenter falls back to 0. The radius is the
+ * mean distance to the center, as in FitCircle.
+ *
+ * Moment accumulation and the D x D Cholesky solves are unrolled at
+ * compile time for each dimension, so each point costs a fixed, branch-free
+ * run of multiply-adds.
+ *
+ * FitHypersphereMixed takes float input and keeps the per-point work in
+ * float, eight points per step, promoting to double per block of points and
+ * for the solve.
+ *
+ */
+
+#pragma once
+#include "Geometry.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+template <int D, typename T = double>
+struct Hypersphere {
+    std::array<T, D> center;
+    T radius;  // 0 when there is no fit
+
+    Hypersphere() : center(), radius(0) {}
+};
+
+namespace HypersphereDetail {
+    // Call f(std::integral_constant<int, I>()) for I = 0 .. N-1, unrolled
+    template <typename F, int... I>
+    inline void UnrollSequence(F&& f, std::integer_sequence<int, I...>) {
+        (f(std::integral_constant<int, I>()), ...);
+    }
+
+    template <int N, typename F>
+    inline void Unroll(F&& f) {
+        UnrollSequence(f, std::make_integer_sequence<int, N>());
+    }
+
+    // Index of (j, k), j <= k, in a packed upper triangle
+    constexpr int Packed(int j, int k, int D) {
+        return j * D - j * (j - 1) / 2 + (k - j);
+    }
+
+    // Centroid-relative moments, each divided by the point count
+    template <int D, typename T>
+    struct CenteredMoments {
+        std::array<T, D * (D + 1) / 2> M;  // Covariance, packed upper triangle
+        std::array<T, D> Mxz;
+        T Mzz;
+    };
+
+    // Cholesky factor of the symmetric matrix M - shift I
+    template <int D, typename T>
+    struct Cholesky {
+        T L[D][D];
+        T det;
+
+        // False unless the matrix is positive definite
+        bool Factor(const std::array<T, D * (D + 1) / 2>& M, T shift) {
+            det = 1;
+            bool ok = true;
+            Unroll<D>([&](auto jc) {
+                constexpr int j = decltype(jc)::value;
+                T diagonal = M[Packed(j, j, D)] - shift;
+                Unroll<j>([&](auto kc) {
+                    constexpr int k = decltype(kc)::value;
+                    diagonal -= L[j][k] * L[j][k];
+                });
+                ok = ok && diagonal > 0;
+                L[j][j] = std::sqrt(diagonal);
+                det *= diagonal;
+                Unroll<D>([&](auto ic) {
+                    constexpr int i = decltype(ic)::value;
+                    if constexpr (i > j) {
+                        T sum = M[Packed(j, i, D)];
+                        Unroll<j>([&](auto kc) {
+                            constexpr int k = decltype(kc)::value;
+                            sum -= L[i][k] * L[j][k];
+                        });
+                        L[i][j] = sum / L[j][j];
+                    }
+                });
+            });
+            return ok;
+        }
+
+        // Solve L y = b
+        std::array<T, D> Forward(const std::array<T, D>& b) const {
+            std::array<T, D> y;
+            Unroll<D>([&](auto ic) {
+                constexpr int i = decltype(ic)::value;
+                T sum = b[i];
+                Unroll<i>([&](auto kc) {
+                    constexpr int k = decltype(kc)::value;
+                    sum -= L[i][k] * y[k];
+                });
+                y[i] = sum / L[i][i];
+            });
+            return y;
+        }
+
+        // Solve L^T x = y
+        std::array<T, D> Backward(const std::array<T, D>& y) const {
+            std::array<T, D> x;
+            Unroll<D>([&](auto rc) {
+                constexpr int i = D - 1 - decltype(rc)::value;
+                T sum = y[i];
+                Unroll<D>([&](auto kc) {
+                    constexpr int k = decltype(kc)::value;
+                    if constexpr (k > i) {
+                        sum -= L[k][i] * x[k];
+                    }
+                });
+                x[i] = sum / L[i][i];
+            });
+            return x;
+        }
+
+        // Trace of the inverse: the squared norms of the columns of L^-1
+        T InverseTrace() const {
+            T trace = 0;
+            Unroll<D>([&](auto cc) {
+                constexpr int c = decltype(cc)::value;
+                std::array<T, D> unit{};
+                unit[c] = 1;
+                std::array<T, D> column = Forward(unit);
+                Unroll<D>([&](auto kc) {
+                    trace += column[decltype(kc)::value] * column[decltype(kc)::value];
+                });
+            });
+            return trace;
+        }
+    };
+
+    // Solve for the center relative to the centroid. False when the points
+    // lie in a hyperplane (or nearly so).
+    template <int D, typename T>
+    bool SolvePrattCenter(const CenteredMoments<D, T>& m, std::array<T, D>& center) {
+        if constexpr (D == 2) {
+            // The circle fit's own solve, in double
+            double center_x, center_y;
+            if (!CircleFitting::SolvePrattCenter(m.M[Packed(0, 0, 2)], m.M[Packed(1, 1, 2)],
+                                                 m.M[Packed(0, 1, 2)], m.Mxz[0], m.Mxz[1], m.Mzz,
+                                                 center_x, center_y)) {
+                return false;
+            }
+            center[0] = static_cast<T>(center_x);
+            center[1] = static_cast<T>(center_y);
+            return true;
+        }
+
+        T Mz = 0;
+        Unroll<D>([&](auto jc) { Mz += m.M[Packed(decltype(jc)::value, decltype(jc)::value, D)]; });
+
+        // f(eta), and the Newton step on det(M - eta I) f(eta), whose
+        // derivative is det (f' - tr((M - eta I)^-1) f)
+        Cholesky<D, T> factor;
+        auto evaluate = [&](T eta, T& value, T& step) {
+            if (!factor.Factor(m.M, eta)) {
+                return false;
+            }
+            std::array<T, D> u = factor.Backward(factor.Forward(m.Mxz));
+            T Mxz_u = 0, u_u = 0;
+            Unroll<D>([&](auto jc) {
+                constexpr int j = decltype(jc)::value;
+                Mxz_u += m.Mxz[j] * u[j];
+                u_u += u[j] * u[j];
+            });
+            T shifted = Mz + 2 * eta;
+            T f = m.Mzz - Mxz_u - shifted * shifted;
+            T df = -u_u - 4 * shifted;
+            value = -factor.det * f;
+            step = f / (df - factor.InverseTrace() * f);
+            return true;
+        };
+
+        // Newton from 0 approaches the smallest root from below. Rather than
+        // falling back to 0 when |value| stops shrinking or the iterations
+        // run out, as SolvePrattCenter does, keep the best iterate: on short
+        // arcs the value reaches its rounding floor before the relative step
+        // does, and the best iterate is then the root to rounding.
+        const T epsilon = std::is_same<T, float>::value ? T(1e-6) : T(1e-12);
+        const int IterMax = 20;
+        T best = 0;
+        T bestValue = std::numeric_limits<T>::infinity();
+        T x = 0;
+        for (int iter = 0; iter < IterMax; iter++) {
+            T value, step;
+            if (!evaluate(x, value, step) || !(std::abs(value) < bestValue)) {
+                break;
+            }
+            best = x;
+            bestValue = std::abs(value);
+            x = best - step;
+            if (x < 0) {
+                break;
+            }
+            if (std::abs((x - best) / x) < epsilon) {
+                best = x;
+                break;
+            }
+        }
+
+        // Same degeneracy test as the 2D fit, on det(M - eta I)
+        if (!factor.Factor(m.M, best) || std::abs(factor.det) < T(1e-10)) {
+            return false;
+        }
+        std::array<T, D> u = factor.Backward(factor.Forward(m.Mxz));
+        Unroll<D>([&](auto jc) { center[decltype(jc)::value] = u[decltype(jc)::value] / 2; });
+        return true;
+    }
+
+    // The fit, with the stride fixed at compile time when Stride > 0
+    template <int D, typename T, int Stride>
+    Hypersphere<D, T> Fit(const T* coords, size_t count, size_t runtimeStride) {
+        const size_t stride = Stride > 0 ? Stride : runtimeStride;
+        Hypersphere<D, T> result;
+        if (count < D + 1) {
+            return result;  // D + 1 points determine a hypersphere
+        }
+
+        // Centroid
+        std::array<T, D> mean{};
+        for (size_t i = 0; i < count; i++) {
+            const T* p = coords + i * stride;
+            Unroll<D>([&](auto jc) { mean[decltype(jc)::value] += p[decltype(jc)::value]; });
+        }
+        Unroll<D>([&](auto jc) { mean[decltype(jc)::value] /= count; });
+
+        // Moments of the points translated to the centroid
+        CenteredMoments<D, T> m{};
+        for (size_t i = 0; i < count; i++) {
+            const T* p = coords + i * stride;
+            std::array<T, D> d;
+            T z = 0;
+            Unroll<D>([&](auto jc) {
+                constexpr int j = decltype(jc)::value;
+                d[j] = p[j] - mean[j];
+                z += d[j] * d[j];
+            });
+            Unroll<D>([&](auto jc) {
+                constexpr int j = decltype(jc)::value;
+                Unroll<D>([&](auto kc) {
+                    constexpr int k = decltype(kc)::value;
+                    if constexpr (k >= j) {
+                        m.M[Packed(j, k, D)] += d[j] * d[k];
+                    }
+                });
+                m.Mxz[j] += d[j] * z;
+            });
+            m.Mzz += z * z;
+        }
+        Unroll<D * (D + 1) / 2>([&](auto jc) { m.M[decltype(jc)::value] /= count; });
+        Unroll<D>([&](auto jc) { m.Mxz[decltype(jc)::value] /= count; });
+        m.Mzz /= count;
+
+        std::array<T, D> center;
+        if (!SolvePrattCenter<D, T>(m, center)) {
+            return result;
+        }
+        Unroll<D>([&](auto jc) { center[decltype(jc)::value] += mean[decltype(jc)::value]; });
+
+        // Radius as the average distance from the center to the points
+        T sum_r = 0;
+        for (size_t i = 0; i < count; i++) {
+            const T* p = coords + i * stride;
+            T squared = 0;
+            Unroll<D>([&](auto jc) {
+                constexpr int j = decltype(jc)::value;
+                T delta = p[j] - center[j];
+                squared += delta * delta;
+            });
+            sum_r += std::sqrt(squared);
+        }
+        T radius = sum_r / count;
+
+        bool usable = std::isfinite(radius) && radius > 0;
+        Unroll<D>([&](auto jc) { usable = usable && std::isfinite(center[decltype(jc)::value]); });
+        if (!usable) {
+            return result;  // Invalid hypersphere
+        }
+        result.center = center;
+        result.radius = radius;
+        return result;
+    }
+
+    // Power sums of points d about some origin, up to |d|^4
+    template <int D>
+    struct MomentSums {
+        double n;
+        std::array<double, D> S1;               // d
+        std::array<double, D * (D + 1) / 2> S2;  // d d^T, packed upper triangle
+        std::array<double, D> S3;               // d |d|^2
+        double S4;                              // |d|^4
+    };
+
+    // The same sums for the points d + shift, from the expansion of
+    // |d + shift|^2 = |d|^2 + 2 shift.d + |shift|^2
+    template <int D>
+    void ShiftOrigin(MomentSums<D>& s, const std::array<double, D>& shift) {
+        double Z = 0, shift_S1 = 0, shift_shift = 0, shift_S2_shift = 0, shift_S3 = 0;
+        std::array<double, D> S2_shift{};  // S2 shift, S2 as a full matrix
+        Unroll<D>([&](auto jc) {
+            constexpr int j = decltype(jc)::value;
+            Z += s.S2[Packed(j, j, D)];
+            shift_S1 += shift[j] * s.S1[j];
+            shift_shift += shift[j] * shift[j];
+            shift_S3 += shift[j] * s.S3[j];
+            Unroll<D>([&](auto kc) {
+                constexpr int k = decltype(kc)::value;
+                S2_shift[j] += s.S2[j <= k ? Packed(j, k, D) : Packed(k, j, D)] * shift[k];
+            });
+        });
+        Unroll<D>([&](auto jc) { shift_S2_shift += shift[decltype(jc)::value] * S2_shift[decltype(jc)::value]; });
+
+        // Highest order first, each from the unshifted lower sums
+        s.S4 += 4 * shift_S2_shift + s.n * shift_shift * shift_shift + 4 * shift_S3 +
+                2 * shift_shift * Z + 4 * shift_shift * shift_S1;
+        Unroll<D>([&](auto jc) {
+            constexpr int j = decltype(jc)::value;
+            s.S3[j] += 2 * S2_shift[j] + shift_shift * s.S1[j] +
+                       shift[j] * (Z + 2 * shift_S1 + s.n * shift_shift);
+        });
+        Unroll<D>([&](auto jc) {
+            constexpr int j = decltype(jc)::value;
+            Unroll<D>([&](auto kc) {
+                constexpr int k = decltype(kc)::value;
+                if constexpr (k >= j) {
+                    s.S2[Packed(j, k, D)] += shift[j] * s.S1[k] + shift[k] * s.S1[j] + s.n * shift[j] * shift[k];
+                }
+            });
+        });
+        Unroll<D>([&](auto jc) { s.S1[decltype(jc)::value] += s.n * shift[decltype(jc)::value]; });
+    }
+
+    // Float accumulation runs LANES independent partial sums, which the
+    // compiler can keep in one vector register each, over blocks of
+    // BLOCK_POINTS points. Within a block each partial sum has at most
+    // BLOCK_POINTS / LANES terms, small enough for float; the lanes are
+    // then added pairwise in double and blocks are summed in double.
+    constexpr int LANES = 8;
+    constexpr size_t BLOCK_POINTS = 256;
+
+    template <int N>
+    double PairwiseSum(const float* lanes) {
+        if constexpr (N == 1) {
+            return lanes[0];
+        } else {
+            return PairwiseSum<N / 2>(lanes) + PairwiseSum<N - N / 2>(lanes + N / 2);
+        }
+    }
+
+    // The LANES points from index i into one row per coordinate, with fill
+    // in the lanes at or past end
+    template <int D, int Stride>
+    inline void Gather(const float* coords, size_t i, size_t end, size_t runtimeStride, const float (&fill)[D],
+                       float (&d)[D][LANES]) {
+        const size_t stride = Stride > 0 ? Stride : runtimeStride;
+        if (i + LANES <= end) {
+            Unroll<D>([&](auto jc) {
+                constexpr int j = decltype(jc)::value;
+                for (int l = 0; l < LANES; l++) {
+                    d[j][l] = coords[(i + l) * stride + j];
+                }
+            });
+            return;
+        }
+        Unroll<D>([&](auto jc) {
+            constexpr int j = decltype(jc)::value;
+            for (int l = 0; l < LANES; l++) {
+                d[j][l] = i + l < end ? coords[(i + l) * stride + j] : fill[j];
+            }
+        });
+    }
+
+    // Sums of the points [begin, end) about their first point, which
+    // removes the absolute offset before the float arithmetic (per-block
+    // centering), then shifted in double to be about origin
+    template <int D, int Stride>
+    void AccumulateBlock(const float* coords, size_t begin, size_t end, size_t runtimeStride,
+                         const std::array<double, D>& origin, MomentSums<D>& total) {
+        const size_t stride = Stride > 0 ? Stride : runtimeStride;
+        constexpr int P = D * (D + 1) / 2;
+        float reference[D];
+        Unroll<D>([&](auto jc) { reference[decltype(jc)::value] = coords[begin * stride + decltype(jc)::value]; });
+
+        float s1[D][LANES] = {}, s2[P][LANES] = {}, s3[D][LANES] = {}, s4[LANES] = {};
+        for (size_t i = begin; i < end; i += LANES) {
+            // Lanes past the end hold the reference and add nothing
+            float d[D][LANES];
+            Gather<D, Stride>(coords, i, end, stride, reference, d);
+
+            for (int l = 0; l < LANES; l++) {
+                Unroll<D>([&](auto jc) { d[decltype(jc)::value][l] -= reference[decltype(jc)::value]; });
+                float z = 0;
+                Unroll<D>([&](auto jc) { z += d[decltype(jc)::value][l] * d[decltype(jc)::value][l]; });
+                Unroll<D>([&](auto jc) {
+                    constexpr int j = decltype(jc)::value;
+                    s1[j][l] += d[j][l];
+                    Unroll<D>([&](auto kc) {
+                        constexpr int k = decltype(kc)::value;
+                        if constexpr (k >= j) {
+                            s2[Packed(j, k, D)][l] += d[j][l] * d[k][l];
+                        }
+                    });
+                    s3[j][l] += d[j][l] * z;
+                });
+                s4[l] += z * z;
+            }
+        }
+
+        MomentSums<D> block;
+        block.n = static_cast<double>(end - begin);
+        Unroll<D>([&](auto jc) {
+            constexpr int j = decltype(jc)::value;
+            block.S1[j] = PairwiseSum<LANES>(s1[j]);
+            block.S3[j] = PairwiseSum<LANES>(s3[j]);
+        });
+        Unroll<P>([&](auto pc) { block.S2[decltype(pc)::value] = PairwiseSum<LANES>(s2[decltype(pc)::value]); });
+        block.S4 = PairwiseSum<LANES>(s4);
+
+        std::array<double, D> shift;
+        Unroll<D>([&](auto jc) { shift[decltype(jc)::value] = reference[decltype(jc)::value] - origin[decltype(jc)::value]; });
+        ShiftOrigin<D>(block, shift);
+
+        total.n += block.n;
+        Unroll<D>([&](auto jc) {
+            total.S1[decltype(jc)::value] += block.S1[decltype(jc)::value];
+            total.S3[decltype(jc)::value] += block.S3[decltype(jc)::value];
+        });
+        Unroll<P>([&](auto pc) { total.S2[decltype(pc)::value] += block.S2[decltype(pc)::value]; });
+        total.S4 += block.S4;
+    }
+
+    // Sum of the distances of the points [begin, end) to center, with the
+    // center split into a float part and the float remainder
+    template <int D, int Stride>
+    double DistanceSum(const float* coords, size_t begin, size_t end, size_t runtimeStride,
+                       const float (&high)[D], const float (&low)[D]) {
+        const size_t stride = Stride > 0 ? Stride : runtimeStride;
+        float sums[LANES] = {};
+        for (size_t i = begin; i < end; i += LANES) {
+            float d[D][LANES];
+            Gather<D, Stride>(coords, i, end, stride, high, d);
+
+            float squared[LANES] = {};
+            for (int l = 0; l < LANES; l++) {
+                Unroll<D>([&](auto jc) {
+                    constexpr int j = decltype(jc)::value;
+                    float delta = (d[j][l] - high[j]) - low[j];
+                    squared[l] += delta * delta;
+                });
+            }
+            for (size_t l = end - i; l < LANES; l++) {
+                squared[l] = 0;  // Lanes past the end add nothing
+            }
+#if defined(__SSE2__)
+            // std::sqrt may set errno, which keeps the compiler from
+            // vectorizing it
+            for (int l = 0; l < LANES; l += 4) {
+                _mm_storeu_ps(sums + l, _mm_add_ps(_mm_loadu_ps(sums + l), _mm_sqrt_ps(_mm_loadu_ps(squared + l))));
+            }
+#else
+            for (int l = 0; l < LANES; l++) {
+                sums[l] += std::sqrt(squared[l]);
+            }
+#endif
+        }
+        return PairwiseSum<LANES>(sums);
+    }
+
+    template <int D, int Stride>
+    Hypersphere<D, double> FitMixed(const float* coords, size_t count, size_t runtimeStride) {
+        const size_t stride = Stride > 0 ? Stride : runtimeStride;
+        Hypersphere<D, double> result;
+        if (count < D + 1) {
+            return result;
+        }
+
+        // One pass of blocks, all summed about the first point
+        std::array<double, D> origin;
+        Unroll<D>([&](auto jc) { origin[decltype(jc)::value] = coords[decltype(jc)::value]; });
+        MomentSums<D> sums{};
+        for (size_t begin = 0; begin < count; begin += BLOCK_POINTS) {
+            AccumulateBlock<D, Stride>(coords, begin, std::min(count, begin + BLOCK_POINTS), stride, origin, sums);
+        }
+
+        // Move the origin to the centroid, then solve in double
+        std::array<double, D> toCentroid, mean;
+        Unroll<D>([&](auto jc) {
+            constexpr int j = decltype(jc)::value;
+            toCentroid[j] = -sums.S1[j] / sums.n;
+            mean[j] = origin[j] - toCentroid[j];
+        });
+        ShiftOrigin<D>(sums, toCentroid);
+        CenteredMoments<D, double> m;
+        Unroll<D * (D + 1) / 2>([&](auto pc) { m.M[decltype(pc)::value] = sums.S2[decltype(pc)::value] / sums.n; });
+        Unroll<D>([&](auto jc) { m.Mxz[decltype(jc)::value] = sums.S3[decltype(jc)::value] / sums.n; });
+        m.Mzz = sums.S4 / sums.n;
+
+        std::array<double, D> center;
+        if (!SolvePrattCenter<D, double>(m, center)) {
+            return result;
+        }
+        float high[D], low[D];
+        Unroll<D>([&](auto jc) {
+            constexpr int j = decltype(jc)::value;
+            center[j] += mean[j];
+            high[j] = static_cast<float>(center[j]);
+            low[j] = static_cast<float>(center[j] - high[j]);
+        });
+
+        double sum_r = 0;
+        for (size_t begin = 0; begin < count; begin += BLOCK_POINTS) {
+            sum_r += DistanceSum<D, Stride>(coords, begin, std::min(count, begin + BLOCK_POINTS), stride, high, low);
+        }
+        double radius = sum_r / count;
+
+        bool usable = std::isfinite(radius) && radius > 0;
+        Unroll<D>([&](auto jc) { usable = usable && std::isfinite(center[decltype(jc)::value]); });
+        if (!usable) {
+            return result;
+        }
+        result.center = center;
+        result.radius = radius;
+        return result;
+    }
+}
+
+// Best-fit hypersphere through count points of D coordinates each. Point i
+// starts at coords[i * stride], so interleaved points use stride = D and
+// points inside larger records a larger stride.
+template <int D, typename T = double>
+Hypersphere<D, T> FitHypersphere(const T* coords, size_t count, size_t stride = D) {
+    static_assert(D >= 1, "A hypersphere needs at least one dimension");
+    if (stride == D) {
+        return HypersphereDetail::Fit<D, T, D>(coords, count, stride);
+    }
+    return HypersphereDetail::Fit<D, T, 0>(coords, count, stride);
+}
+
+// Mixed-precision fit of float points: float loads and float arithmetic
+// in the per-point loops, double for everything per block and the solve.
+// Agrees with FitHypersphere<D, double> on the same values to about 1e-6
+// of the hypersphere's extent.
+template <int D>
+Hypersphere<D, double> FitHypersphereMixed(const float* coords, size_t count, size_t stride = D) {
+    static_assert(D >= 1, "A hypersphere needs at least one dimension");
+    if (stride == D) {
+        return HypersphereDetail::FitMixed<D, D>(coords, count, stride);
+    }
+    return HypersphereDetail::FitMixed<D, 0>(coords, count, stride);
+}
+
+template <int D, typename T>
+Hypersphere<D, T> FitHypersphere(const std::vector<std::array<T, D>>& points) {
+    return FitHypersphere<D, T>(points.empty() ? nullptr : points[0].data(), points.size(), D);
+}
@@ -0,0 +1,123 @@
+/**
+ * Morton (Z-order) Indexing
+ *
+ * Interleaves the bits of a row and a column so that points that are close
+ * in 2D get indices that are close in memory. Uses the BMI2 pdep/pext
+ * instructions when the compiler targets them (-mbmi2) and an equivalent
+ * shift-and-mask sequence otherwise.
+ *
+ * The tiled bitset uses this to store each 64x64 tile as 8x8 blocks: every
+ * 64-bit word holds one block in Z-order, and the blocks of a tile are in
+ * Z-order as well.
+ *
+ */
+
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+constexpr int MORTON_BLOCK_SIZE = 8;   // Rows and columns of a block (one word)
+constexpr int MORTON_TILE_SIZE = 64;   // Rows and columns of a tile
+
+// Bits of block row 0 within a Z-ordered 8x8 block
+constexpr uint64_t MORTON_ROW_MASK = 0x0000000000330033ULL;
+
+// Spread the low 16 bits of v to the even bit positions
+inline uint32_t MortonSpread(uint32_t v) {
+#if defined(__BMI2__)
+    return _pdep_u32(v, 0x55555555u);
+#else
+    v &= 0x0000FFFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+#endif
+}
+
+// Inverse of MortonSpread: gather the even bit positions
+inline uint32_t MortonCompact(uint32_t v) {
+#if defined(__BMI2__)
+    return _pext_u32(v, 0x55555555u);
+#else
+    v &= 0x55555555u;
+    v = (v | (v >> 1)) & 0x33333333u;
+    v = (v | (v >> 2)) & 0x0F0F0F0Fu;
+    v = (v | (v >> 4)) & 0x00FF00FFu;
+    v = (v | (v >> 8)) & 0x0000FFFFu;
+    return v;
+#endif
+}
+
+// Z-order index of (row, col): column bits at even positions, row bits at odd
+inline uint32_t MortonEncode(uint32_t row, uint32_t col) {
+    return (MortonSpread(row) << 1) | MortonSpread(col);
+}
+
+inline void MortonDecode(uint32_t index, uint32_t& row, uint32_t& col) {
+    row = MortonCompact(index >> 1);
+    col = MortonCompact(index);
+}
+
+// Bits of row r (0..7) within a Z-ordered 8x8 block
+inline uint64_t MortonRowMask(int r) {
+    return MORTON_ROW_MASK << (MortonSpread(r) << 1);
+}
+
+// Row r of a Z-ordered 8x8 block as 8 column bits
+inline uint64_t MortonRowBits(uint64_t block, int r) {
+#if defined(__BMI2__)
+    return _pext_u64(block, MortonRowMask(r));
+#else
+    uint64_t v = (block >> (MortonSpread(r) << 1)) & MORTON_ROW_MASK;
+    v = (v | (v >> 2)) & 0x000F000FULL;
+    return (v | (v >> 12)) & 0xFFULL;
+#endif
+}
+
+// Inverse of MortonRowBits: place 8 column bits at row r of a block
+inline uint64_t MortonRowDeposit(uint64_t bits, int r) {
+#if defined(__BMI2__)
+    return _pdep_u64(bits, MortonRowMask(r));
+#else
+    uint64_t v = bits & 0xFFULL;
+    v = (v | (v << 12)) & 0x000F000FULL;
+    v = (v | (v << 2)) & MORTON_ROW_MASK;
+    return v << (MortonSpread(r) << 1);
+#endif
+}
+
+// Call visit(row, col) for every cell in rows [minRow, maxRow] and columns
+// [minCol, maxCol] (inclusive, non-negative) one 8x8 block at a time, with
+// the blocks of each 64x64 tile in Z-order. This is the storage order of a
+// Z-ordered tiled bitset, so consecutive visits stay within a cache line.
+template <typename Visitor>
+inline void ForEachCellTiled(int minRow, int maxRow, int minCol, int maxCol, Visitor visit) {
+    if (minRow > maxRow || minCol > maxCol) {
+        return;
+    }
+    const int blocksPerTile = (MORTON_TILE_SIZE / MORTON_BLOCK_SIZE) * (MORTON_TILE_SIZE / MORTON_BLOCK_SIZE);
+    for (int tileRow = minRow / MORTON_TILE_SIZE; tileRow <= maxRow / MORTON_TILE_SIZE; tileRow++) {
+        for (int tileCol = minCol / MORTON_TILE_SIZE; tileCol <= maxCol / MORTON_TILE_SIZE; tileCol++) {
+            for (uint32_t block = 0; block < static_cast<uint32_t>(blocksPerTile); block++) {
+                uint32_t blockRow, blockCol;
+                MortonDecode(block, blockRow, blockCol);
+                int row0 = tileRow * MORTON_TILE_SIZE + static_cast<int>(blockRow) * MORTON_BLOCK_SIZE;
+                int col0 = tileCol * MORTON_TILE_SIZE + static_cast<int>(blockCol) * MORTON_BLOCK_SIZE;
+                int rowBegin = std::max(row0, minRow);
+                int rowEnd = std::min(row0 + MORTON_BLOCK_SIZE - 1, maxRow);
+                int colBegin = std::max(col0, minCol);
+                int colEnd = std::min(col0 + MORTON_BLOCK_SIZE - 1, maxCol);
+                for (int row = rowBegin; row <= rowEnd; row++) {
+                    for (int col = colBegin; col <= colEnd; col++) {
+                        visit(row, col);
+                    }
+                }
+            }
+        }
+    }
+}
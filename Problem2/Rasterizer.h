@@ -9,6 +9,7 @@
 #include <windows.h>
 #include "Geometry.h"
 #include <cmath>
+#include <vector>
 
 class Rasterizer {
 public:
@@ -49,26 +50,47 @@ public:
         DeleteObject(pen);
     }
     
-    // Draw grid lines
-    static void DrawGrid(HDC hdc, int gridSize, int cellSize, COLORREF color) {
+    // Draw a closed outline through the given pixel coordinates
+    static void DrawPolygonOutline(HDC hdc, const std::vector<Point>& points, COLORREF color) {
+        if (points.size() < 2) {
+            return;
+        }
+        
+        std::vector<POINT> pts(points.size() + 1);
+        for (size_t k = 0; k < points.size(); k++) {
+            pts[k].x = static_cast<LONG>(points[k].x);
+            pts[k].y = static_cast<LONG>(points[k].y);
+        }
+        pts[points.size()] = pts[0];
+        
+        HPEN pen = CreatePen(PS_SOLID, 1, color);
+        HPEN oldPen = (HPEN)SelectObject(hdc, pen);
+        
+        Polyline(hdc, pts.data(), static_cast<int>(pts.size()));
+        
+        SelectObject(hdc, oldPen);
+        DeleteObject(pen);
+    }
+    
+    // Draw grid lines, the first cell's corner at (origin, origin)
+    static void DrawGrid(HDC hdc, int gridSize, int cellSize, COLORREF color, int origin = 0) {
         HPEN pen = CreatePen(PS_SOLID, 1, color);
         HPEN oldPen = (HPEN)SelectObject(hdc, pen);
         
-        int width = gridSize * cellSize;
-        int height = gridSize * cellSize;
+        int end = origin + gridSize * cellSize;
         
         // Draw vertical lines
         for (int i = 0; i <= gridSize; i++) {
-            int x = i * cellSize;
-            MoveToEx(hdc, x, 0, NULL);
-            LineTo(hdc, x, height);
+            int x = origin + i * cellSize;
+            MoveToEx(hdc, x, origin, NULL);
+            LineTo(hdc, x, end);
         }
         
         // Draw horizontal lines
         for (int i = 0; i <= gridSize; i++) {
-            int y = i * cellSize;
-            MoveToEx(hdc, 0, y, NULL);
-            LineTo(hdc, width, y);
+            int y = origin + i * cellSize;
+            MoveToEx(hdc, origin, y, NULL);
+            LineTo(hdc, end, y);
         }
         
         SelectObject(hdc, oldPen);
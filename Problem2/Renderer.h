@@ -9,9 +9,21 @@
 #pragma once
 #include <windows.h>
 #include "Config.h"
+#include "Settings.h"
 #include "Grid.h"
 #include "Rasterizer.h"
 #include "Geometry.h"
+#include "MaskRectangles.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Rectangles of points to draw in each color, prepared off the UI thread;
+// the renderer only issues the fills
+struct CellLayers {
+    std::vector<CellRect> selected;
+    std::vector<CellRect> dropped;  // Previous fit's points that are no longer selected
+};
 
 class Renderer {
 private:
@@ -21,24 +33,74 @@ private:
     HBITMAP hbmOld;
     int width;
     int height;
+    int gridSize;
+    int cellSize;
+    int padding;       // Pixels from the window's corner to the grid's
+    int pointRadius;   // POINT_RADIUS, within half a cell
+    
+    // One cell (background, grid lines and its point) per point color, as
+    // pattern brushes: a FillRect then draws a whole rectangle of points
+    HBITMAP cellBitmaps[3];
+    HBRUSH cellBrushes[3];
+    enum CellKind { UNSELECTED_CELL, SELECTED_CELL, PREVIOUS_CELL };
+    
+    void CreateCellBrush(CellKind kind, COLORREF pointColor) {
+        HDC cellDC = CreateCompatibleDC(hdcMem);
+        cellBitmaps[kind] = CreateCompatibleBitmap(hdcMem, cellSize, cellSize);
+        HBITMAP oldBitmap = (HBITMAP)SelectObject(cellDC, cellBitmaps[kind]);
+        
+        RECT rect = {0, 0, cellSize, cellSize};
+        HBRUSH bgBrush = CreateSolidBrush(GetBackgroundColor());
+        FillRect(cellDC, &rect, bgBrush);
+        DeleteObject(bgBrush);
+        Rasterizer::DrawGrid(cellDC, 1, cellSize, GetGridLineColor());
+        Rasterizer::DrawFilledCircle(cellDC, cellSize / 2, cellSize / 2, pointRadius, pointColor);
+        
+        SelectObject(cellDC, oldBitmap);
+        DeleteDC(cellDC);
+        cellBrushes[kind] = CreatePatternBrush(cellBitmaps[kind]);
+    }
+    
+    // Draw rectangles of points with a cell brush, one fill each
+    void FillCells(const std::vector<CellRect>& cells, CellKind kind) {
+        for (const CellRect& cell : cells) {
+            RECT rect = {padding + cell.left * cellSize, padding + cell.top * cellSize,
+                         padding + cell.right * cellSize, padding + cell.bottom * cellSize};
+            FillRect(hdcMem, &rect, cellBrushes[kind]);
+        }
+    }
     
 public:
     Renderer(HWND hwnd, int width, int height) 
-        : hwnd(hwnd), width(width), height(height) {
+        : hwnd(hwnd), width(width), height(height), gridSize(Settings::Current().gridSize),
+          cellSize(Settings::Current().CellSize()), padding(Settings::Current().gridPadding),
+          pointRadius(std::min(POINT_RADIUS, cellSize / 2)) {
         HDC hdc = GetDC(hwnd);
         hdcMem = CreateCompatibleDC(hdc);
         hbmMem = CreateCompatibleBitmap(hdc, width, height);
         hbmOld = (HBITMAP)SelectObject(hdcMem, hbmMem);
         ReleaseDC(hwnd, hdc);
+        // Start the cell brushes' pattern at the grid's corner
+        SetBrushOrgEx(hdcMem, padding, padding, NULL);
+        
+        CreateCellBrush(UNSELECTED_CELL, GetUnselectedColor());
+        CreateCellBrush(SELECTED_CELL, GetSelectedColor());
+        CreateCellBrush(PREVIOUS_CELL, GetPreviousSelectedColor());
     }
     
     ~Renderer() {
+        for (int kind = 0; kind < 3; kind++) {
+            DeleteObject(cellBrushes[kind]);
+            DeleteObject(cellBitmaps[kind]);
+        }
         SelectObject(hdcMem, hbmOld);
         DeleteObject(hbmMem);
         DeleteDC(hdcMem);
     }
     
-    void Render(const Grid& grid, const Circle* bestFitCircle = nullptr) {
+    void Render(const CellLayers& cells, const Circle* bestFitCircle = nullptr,
+                const std::vector<Point>* regionOutline = nullptr,
+                const Circle* previousCircle = nullptr) {
         // Clear background
         RECT rect = {0, 0, width, height};
         HBRUSH bgBrush = CreateSolidBrush(GetBackgroundColor());
@@ -46,29 +108,38 @@ public:
         DeleteObject(bgBrush);
         
         // Draw grid lines
-        Rasterizer::DrawGrid(hdcMem, GRID_SIZE, CELL_SIZE, GetGridLineColor());
+        Rasterizer::DrawGrid(hdcMem, gridSize, cellSize, GetGridLineColor(), padding);
+        
+        // Draw all grid points a rectangle of equal points at a time: every
+        // point unselected, then the selection, then points of the previous
+        // selection that are no longer selected. The fills are aligned to the
+        // cells, so the result matches drawing point by point.
+        RECT gridRect = {padding, padding, padding + gridSize * cellSize, padding + gridSize * cellSize};
+        FillRect(hdcMem, &gridRect, cellBrushes[UNSELECTED_CELL]);
+        FillCells(cells.selected, SELECTED_CELL);
+        FillCells(cells.dropped, PREVIOUS_CELL);
         
-        // Draw all grid points
-        for (int i = 0; i < grid.GetSize(); i++) {
-            for (int j = 0; j < grid.GetSize(); j++) {
-                const GridPoint& gp = grid.GetPoint(i, j);
-                Point pixelPos = gp.GetPixelCoords();
-                
-                COLORREF color = gp.selected ? GetSelectedColor() : GetUnselectedColor();
-                Rasterizer::DrawFilledCircle(
-                    hdcMem, 
-                    static_cast<int>(pixelPos.x), 
-                    static_cast<int>(pixelPos.y), 
-                    POINT_RADIUS, 
-                    color
-                );
-            }
+        // Draw the previous fit underneath the current one for comparison
+        if (previousCircle && previousCircle->radius > 0) {
+            Rasterizer::DrawCircleOutline(hdcMem, *previousCircle, GetPreviousCircleColor(), 1);
         }
         
         // Draw best fit circle if available
         if (bestFitCircle && bestFitCircle->radius > 0) {
             Rasterizer::DrawCircleOutline(hdcMem, *bestFitCircle, GetCircleColor(), 2);
         }
+        
+        // Draw the region being selected, if any
+        if (regionOutline) {
+            Rasterizer::DrawPolygonOutline(hdcMem, *regionOutline, GetRegionColor());
+        }
+    }
+    
+    // Draw a line of text in the top-left corner, over the last Render
+    void DrawStatus(const std::string& text, int line = 0) {
+        SetBkMode(hdcMem, TRANSPARENT);
+        SetTextColor(hdcMem, GetCircleColor());
+        TextOut(hdcMem, 8, 8 + 18 * line, text.c_str(), static_cast<int>(text.size()));
     }
     
     void Present() {
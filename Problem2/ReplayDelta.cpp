@@ -0,0 +1,239 @@
+/**
+ * Delta Stream Replay
+ *
+ * Plays back a recorded delta stream (DeltaStream.h) with DeltaReplay and
+ * reports its records and the final selection and fit, optionally writing
+ * the selection as a PBM image. The three programs share the record
+ * format, so this reads Problem1.delta and ExtraCredit.delta as well.
+ *
+ * With -check it instead runs random edits through DeltaEncoder, a ring
+ * small enough to drop records, and DeltaReplay, and verifies that every
+ * synced replay matches the state the encoder last sent, and that records
+ * with out-of-range rows, runs or dimensions are rejected.
+ *
+ * Console program, independent of Win32:
+ *   g++ -std=c++17 -O2 ReplayDelta.cpp -o ReplayDelta.exe
+ *   ReplayDelta.exe Problem2.delta [-pbm selection.pbm]
+ *   ReplayDelta.exe -check [-edits N] [-size N]
+ *
+ */
+
+#include "DeltaStream.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// Ring of the round-trip check, and the edits the consumer then and again
+// stops reading for, long enough to fill it
+const size_t RING_BYTES = 1 << 14;
+const int STALL_EDITS = 500;
+
+// Write the bitset as a binary PBM, set points black
+static bool WritePbm(const TiledBitset& bits, const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    std::fprintf(file, "P4\n%d %d\n", bits.Cols(), bits.Rows());
+    std::vector<uint8_t> row((bits.Cols() + 7) / 8);
+    for (int i = 0; i < bits.Rows(); i++) {
+        std::fill(row.begin(), row.end(), 0);
+        for (int j = 0; j < bits.Cols(); j++) {
+            if (bits.Get(i, j)) {
+                row[j / 8] |= static_cast<uint8_t>(0x80 >> (j % 8));
+            }
+        }
+        std::fwrite(row.data(), 1, row.size(), file);
+    }
+    return std::fclose(file) == 0;
+}
+
+static int Replay(const std::string& path, const std::string& pbmPath) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::fprintf(stderr, "ReplayDelta: cannot open %s\n", path.c_str());
+        return 1;
+    }
+    DeltaReplay replay;
+    std::vector<uint8_t> record;
+    size_t records = 0, keyframes = 0, applied = 0, bytes = 0;
+    while (DeltaReplay::ReadRecord(file, record)) {
+        records++;
+        bytes += record.size();
+        keyframes += !record.empty() && record[0] == 1;
+        applied += replay.Apply(record.data(), record.size());
+    }
+    std::fclose(file);
+
+    std::printf("%zu records (%zu keyframes, %zu bytes), %zu applied, %zu skipped or malformed\n",
+                records, keyframes, bytes, applied, records - applied);
+    if (!replay.Synced()) {
+        std::printf("not synced: the stream ends before a keyframe after its last gap\n");
+        return 1;
+    }
+    const TiledBitset& bits = replay.GetBits();
+    std::printf("selection %dx%d, %zu points set\n", bits.Cols(), bits.Rows(), bits.Count());
+    const std::vector<double>& shape = replay.GetShape();
+    std::printf("shape:");
+    for (double value : shape) {
+        std::printf(" %.4f", value);
+    }
+    std::printf(shape.empty() ? " none\n" : "\n");
+
+    if (!pbmPath.empty() && !WritePbm(bits, pbmPath)) {
+        std::fprintf(stderr, "ReplayDelta: cannot write %s\n", pbmPath.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// Record holding a delta header (sequence 0, no shape) and the given rows,
+// each row given as its rowGap, one run gap and one length-and-set value
+static std::vector<uint8_t> DeltaRecord(bool keyframe, uint64_t rows, uint64_t cols,
+                                        const std::vector<uint64_t>& rowFields) {
+    std::vector<uint8_t> record;
+    record.push_back(keyframe ? 1 : 0);
+    PutVarint(record, 0);
+    if (keyframe) {
+        PutVarint(record, rows);
+        PutVarint(record, cols);
+    }
+    record.push_back(0);
+    PutVarint(record, rowFields.size() / 3);
+    for (size_t k = 0; k + 2 < rowFields.size(); k += 3) {
+        PutVarint(record, rowFields[k]);
+        PutVarint(record, 1);
+        PutVarint(record, rowFields[k + 1]);
+        PutVarint(record, rowFields[k + 2]);
+    }
+    return record;
+}
+
+// Malformed records must be refused, and leave the replay waiting for a
+// keyframe; returns the number that were not
+static int CheckMalformed() {
+    struct Case {
+        const char* name;
+        std::vector<uint8_t> record;
+    };
+    const uint64_t huge = ~0ULL >> 1;
+    const Case cases[] = {
+        {"zero rows", DeltaRecord(true, 0, 64, {})},
+        {"oversized keyframe", DeltaRecord(true, MAX_DELTA_SIDE + 1, 64, {})},
+        {"zero row gap", DeltaRecord(true, 64, 64, {0, 0, (4 << 1) | 1})},
+        {"row gap wrapping negative", DeltaRecord(true, 64, 64, {huge, 0, (4 << 1) | 1})},
+        {"run gap wrapping negative", DeltaRecord(true, 64, 64, {1, huge, (4 << 1) | 1})},
+        {"run past the last column", DeltaRecord(true, 64, 64, {1, 60, (8 << 1) | 1})},
+        {"row past the last row", DeltaRecord(true, 64, 64, {65, 0, (4 << 1) | 1})},
+    };
+    const std::vector<uint8_t> good = DeltaRecord(true, 64, 64, {1, 0, (4 << 1) | 1});
+
+    int failures = 0;
+    for (const Case& c : cases) {
+        DeltaReplay replay;
+        if (!replay.Apply(good.data(), good.size()) || replay.Apply(c.record.data(), c.record.size()) ||
+            replay.Synced()) {
+            std::printf("malformed record accepted: %s\n", c.name);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// Random edits through the encoder, a small ring and the replay
+static int CheckRoundTrip(int edits, int size) {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> coordinate(0, size - 1);
+    std::uniform_int_distribution<int> extent(1, std::max(1, size / 8));
+
+    DeltaRing ring(RING_BYTES);
+    DeltaEncoder encoder(ring);
+    DeltaReplay replay;
+    TiledBitset state(size, size);
+    TiledBitset sent = state;
+    std::vector<double> sentShape;
+    std::vector<uint8_t> record;
+    size_t compared = 0, mismatches = 0;
+    int stalled = 0;  // Edits left before the consumer reads again
+
+    for (int e = 0; e < edits; e++) {
+        // A point, a row run or a block, set or cleared
+        int i = coordinate(random), j = coordinate(random);
+        int kind = random() % 3;
+        int height = kind == 2 ? extent(random) : 1;
+        int width = kind == 0 ? 1 : extent(random);
+        bool value = random() % 3 != 0;
+        for (int r = i; r < std::min(size, i + height); r++) {
+            for (int c = j; c < std::min(size, j + width); c++) {
+                state.Set(r, c, value);
+            }
+        }
+        std::vector<double> shape = {double(i), double(j), double(width)};
+        if (random() % 4 == 0) {
+            shape.clear();
+        }
+        encoder.SetShape(shape.data(), static_cast<int>(shape.size()));
+
+        if (encoder.Publish(state)) {
+            sent = state;
+            sentShape = shape;
+        }
+        // Now and then the consumer stops reading long enough for the ring
+        // to fill, so records are dropped and a keyframe follows
+        if (stalled > 0 || random() % 100 == 0) {
+            stalled = stalled > 0 ? stalled - 1 : STALL_EDITS;
+            continue;
+        }
+        while (ring.TryPop(record)) {
+            replay.Apply(record.data(), record.size());
+        }
+        if (replay.Synced()) {
+            compared++;
+            if (replay.GetBits().DifferenceCount(sent) != 0 || replay.GetShape() != sentShape) {
+                mismatches++;
+            }
+        }
+    }
+
+    std::printf("%d edits: %zu keyframes, %zu records dropped, %zu states compared, %zu mismatches\n",
+                edits, encoder.Keyframes(), encoder.Dropped(), compared, mismatches);
+    return mismatches == 0 && compared > 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    bool check = false;
+    int edits = 20000, size = 256;
+    std::string path, pbmPath;
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "-check") {
+            check = true;
+        } else if (arg == "-edits" && k + 1 < argc) {
+            edits = std::atoi(argv[++k]);
+        } else if (arg == "-size" && k + 1 < argc) {
+            size = std::atoi(argv[++k]);
+        } else if (arg == "-pbm" && k + 1 < argc) {
+            pbmPath = argv[++k];
+        } else if (path.empty()) {
+            path = arg;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+    if (check ? (edits < 1 || size < 1 || size > int(MAX_DELTA_SIDE)) : path.empty()) {
+        std::fprintf(stderr, "usage: ReplayDelta file.delta [-pbm selection.pbm]\n"
+                             "       ReplayDelta -check [-edits N] [-size N]\n");
+        return 1;
+    }
+    if (!check) {
+        return Replay(path, pbmPath);
+    }
+
+    int failures = CheckMalformed();
+    failures += CheckRoundTrip(edits, size);
+    std::printf(failures ? "FAILED\n" : "ok\n");
+    return failures ? 1 : 0;
+}
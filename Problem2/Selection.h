@@ -0,0 +1,403 @@
+/**
+ * Region Selection
+ *
+ * Stores the selection state as a tiled bitset and builds the row
+ * spans covered by rectangle, brush (disc), ring and lasso (polygon) regions.
+ * Regions are applied a 64-bit word at a time with masked operations.
+ *
+ */
+
+#pragma once
+#include "Config.h"
+#include "Settings.h"
+#include "Geometry.h"
+#include "TiledBitset.h"
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+enum class SelectionMode {
+    Set,     // Select every point in the region
+    Clear,   // Deselect every point in the region
+    Toggle   // Flip every point in the region
+};
+
+// Columns [begin, end) of one grid row
+struct Span {
+    int row;
+    int begin;
+    int end;
+
+    Span() : row(0), begin(0), end(0) {}
+    Span(int row, int begin, int end) : row(row), begin(begin), end(end) {}
+};
+
+inline int CountTrailingZeros(uint64_t word) {
+    return __builtin_ctzll(word);
+}
+
+inline int PopCount(uint64_t word) {
+    return __builtin_popcountll(word);
+}
+
+// Bits [begin, end) of a word, 0 <= begin < end <= 64
+inline uint64_t WordMask(int begin, int end) {
+    uint64_t high = (end == 64) ? ~0ULL : ((1ULL << end) - 1);
+    return high & ~((1ULL << begin) - 1);
+}
+
+// Call visit(begin, end) for each run of consecutive set bits in a word
+template <typename Visitor>
+inline void ForEachRun(uint64_t bits, Visitor visit) {
+    while (bits) {
+        int begin = CountTrailingZeros(bits);
+        uint64_t shifted = ~(bits >> begin);
+        int length = shifted ? CountTrailingZeros(shifted) : 64 - begin;
+        visit(begin, begin + length);
+        bits &= ~WordMask(begin, begin + length);
+    }
+}
+
+// Storage layout of selection bits, from Z_ORDER_BITS
+inline TiledBitset::Layout SelectionLayout() {
+    return Z_ORDER_BITS ? TiledBitset::Layout::ZOrder : TiledBitset::Layout::RowMajor;
+}
+
+// Selection bits on top of a copy-on-write tiled bitset, so copying a mask
+// (for undo history) is O(1) and edits copy only the tiles they touch
+class SelectionMask {
+private:
+    TiledBitset bits;
+
+public:
+    SelectionMask(int rows, int cols) : bits(rows, cols, SelectionLayout()) {}
+    explicit SelectionMask(const TiledBitset& bits) : bits(bits) {}
+
+    bool Get(int i, int j) const {
+        return bits.Get(i, j);
+    }
+
+    // Flip one bit and return its new state
+    bool Flip(int i, int j) {
+        return bits.Flip(i, j);
+    }
+
+    void Clear() {
+        bits.Clear();
+    }
+
+    // Apply a span with masked word updates. changed(begin, end, weight) is
+    // called for each run of columns that became selected (+1) or deselected (-1).
+    template <typename Callback>
+    void ApplySpan(const Span& span, SelectionMode mode, Callback changed) {
+        int begin = std::max(span.begin, 0);
+        int end = std::min(span.end, bits.Cols());
+        if (span.row < 0 || span.row >= bits.Rows() || begin >= end) {
+            return;
+        }
+
+        for (int w = begin / 64; w <= (end - 1) / 64; w++) {
+            int base = w * 64;
+            uint64_t mask = WordMask(std::max(begin - base, 0), std::min(end - base, 64));
+            uint64_t before = bits.Word(span.row, w);
+            uint64_t after = before;
+            switch (mode) {
+                case SelectionMode::Set:    after = before | mask;  break;
+                case SelectionMode::Clear:  after = before & ~mask; break;
+                case SelectionMode::Toggle: after = before ^ mask;  break;
+            }
+            if (after == before) {
+                continue;  // Nothing changed; leave a shared tile shared
+            }
+            bits.SetWord(span.row, w, after);
+
+            ForEachRun(after & ~before, [&](int b, int e) { changed(base + b, base + e, 1.0); });
+            ForEachRun(before & ~after, [&](int b, int e) { changed(base + b, base + e, -1.0); });
+        }
+    }
+
+    size_t Count() const {
+        return bits.Count();
+    }
+
+    // Selected points also set in mask, e.g. a circle's ring from SpansMask
+    size_t CountIn(const TiledBitset& mask) const {
+        return bits.IntersectionCount(mask);
+    }
+
+    void SetWord(int i, int w, uint64_t value) {
+        bits.SetWord(i, w, value);
+    }
+
+    uint64_t GetWord(int i, int w) const { return bits.Word(i, w); }
+    int GetWordsPerRow() const { return bits.WordsPerRow(); }
+    const TiledBitset& GetBits() const { return bits; }
+};
+
+// Layout of the lattice in window pixels: GridSize() points a side,
+// CellSize() pixels apart, the first cell's corner Padding() pixels in from
+// the window's. FixedLattice makes the three compile-time constants, so the
+// clamps and coordinates of the span kernels below fold into the code;
+// RuntimeLattice carries any other layout to the same kernels.
+struct RuntimeLattice {
+    int gridSize;
+    int cellSize;
+    int padding;
+
+    int GridSize() const { return gridSize; }
+    int CellSize() const { return cellSize; }
+    int Padding() const { return padding; }
+};
+
+template <int Size, int Cell, int Pad>
+struct FixedLattice {
+    static constexpr int GridSize() { return Size; }
+    static constexpr int CellSize() { return Cell; }
+    static constexpr int Padding() { return Pad; }
+
+    static bool Matches(const RuntimeLattice& lattice) {
+        return lattice.gridSize == Size && lattice.cellSize == Cell && lattice.padding == Pad;
+    }
+};
+
+// Size points a side in the default window
+template <int Size>
+using DefaultWindowLattice =
+    FixedLattice<Size, (std::min(WINDOW_WIDTH, WINDOW_HEIGHT) - 2 * GRID_PADDING) / Size, GRID_PADDING>;
+
+// The layout from the settings in effect
+inline RuntimeLattice CurrentLattice() {
+    const Settings& settings = Settings::Current();
+    return RuntimeLattice{settings.gridSize, settings.CellSize(), settings.gridPadding};
+}
+
+// Call kernel(lattice) with the FixedLattice of the current layout when it
+// is a common one, the default window with GRID_SIZE, 64 or 100 points a
+// side, and with the RuntimeLattice otherwise
+template <typename Kernel>
+inline void DispatchLattice(Kernel&& kernel) {
+    RuntimeLattice lattice = CurrentLattice();
+    if (DefaultWindowLattice<GRID_SIZE>::Matches(lattice)) {
+        kernel(DefaultWindowLattice<GRID_SIZE>());
+    } else if (DefaultWindowLattice<64>::Matches(lattice)) {
+        kernel(DefaultWindowLattice<64>());
+    } else if (DefaultWindowLattice<100>::Matches(lattice)) {
+        kernel(DefaultWindowLattice<100>());
+    } else {
+        kernel(lattice);
+    }
+}
+
+// Pixel coordinate of the lattice point at a given row or column
+template <typename Lattice>
+inline double LatticeCoord(const Lattice& lattice, int index) {
+    return lattice.Padding() + index * lattice.CellSize() + lattice.CellSize() / 2.0;
+}
+
+inline double LatticeCoord(int index) {
+    return LatticeCoord(CurrentLattice(), index);
+}
+
+// Pixel coordinate of the lattice's center, along either axis
+template <typename Lattice>
+inline double LatticeCenter(const Lattice& lattice) {
+    return lattice.Padding() + lattice.GridSize() * lattice.CellSize() / 2.0;
+}
+
+// Columns whose lattice x lies in [x0, x1], as a span in the given row
+template <typename Lattice>
+inline Span LatticeSpan(const Lattice& lattice, int row, double x0, double x1) {
+    const double first = lattice.Padding() + lattice.CellSize() / 2.0;
+    int begin = static_cast<int>(std::ceil((x0 - first) / lattice.CellSize()));
+    int end = static_cast<int>(std::floor((x1 - first) / lattice.CellSize())) + 1;
+    return Span(row, std::max(begin, 0), std::min(end, lattice.GridSize()));
+}
+
+// Power sums of lattice coordinates, so any run of columns adds its sums to a
+// CircleMoments in O(1). Coordinates are measured from the lattice center to
+// keep the fourth-order sums well conditioned.
+class LatticeMoments {
+private:
+    RuntimeLattice lattice;
+    double center;
+    std::vector<double> columnPowerSums[5];  // Prefix sums of x^k over columns
+
+public:
+    LatticeMoments() : lattice(CurrentLattice()), center(LatticeCenter(lattice)) {
+        for (int k = 0; k < 5; k++) {
+            columnPowerSums[k].assign(lattice.gridSize + 1, 0.0);
+        }
+        for (int j = 0; j < lattice.gridSize; j++) {
+            double power = 1;
+            for (int k = 0; k < 5; k++) {
+                columnPowerSums[k][j + 1] = columnPowerSums[k][j] + power;
+                power *= X(j);
+            }
+        }
+    }
+
+    double X(int j) const { return LatticeCoord(lattice, j) - center; }
+    double Y(int i) const { return LatticeCoord(lattice, i) - center; }
+
+    void AddPoint(CircleMoments& moments, int i, int j, double weight) const {
+        moments.Add(X(j), Y(i), weight);
+    }
+
+    void AddRun(CircleMoments& moments, int i, int begin, int end, double weight) const {
+        double px[5];
+        for (int k = 0; k < 5; k++) {
+            px[k] = columnPowerSums[k][end] - columnPowerSums[k][begin];
+        }
+        moments.AddRow(Y(i), px, weight);
+    }
+
+    // Pixel coordinate the moments are measured from, along either axis
+    static double Origin() {
+        return LatticeCenter(CurrentLattice());
+    }
+
+    // Fit in moment coordinates and move the result back to pixels
+    static Circle FitPixelCircle(const CircleMoments& moments) {
+        Circle circle = FitCircle(moments);
+        if (circle.radius > 0) {
+            circle.center.x += Origin();
+            circle.center.y += Origin();
+        }
+        return circle;
+    }
+};
+
+// Spans of lattice points inside the axis-aligned rectangle with corners a, b
+template <typename Lattice>
+inline std::vector<Span> RectangleSpans(const Lattice& lattice, const Point& a, const Point& b) {
+    std::vector<Span> spans;
+    double x0 = std::min(a.x, b.x), x1 = std::max(a.x, b.x);
+    double y0 = std::min(a.y, b.y), y1 = std::max(a.y, b.y);
+
+    for (int i = 0; i < lattice.GridSize(); i++) {
+        double y = LatticeCoord(lattice, i);
+        if (y < y0 || y > y1) continue;
+        Span span = LatticeSpan(lattice, i, x0, x1);
+        if (span.begin < span.end) {
+            spans.push_back(span);
+        }
+    }
+    return spans;
+}
+
+// Spans of lattice points inside a disc (circle brush)
+template <typename Lattice>
+inline std::vector<Span> BrushSpans(const Lattice& lattice, const Point& center, double radius) {
+    std::vector<Span> spans;
+    for (int i = 0; i < lattice.GridSize(); i++) {
+        double dy = LatticeCoord(lattice, i) - center.y;
+        if (std::abs(dy) > radius) continue;
+        double half = std::sqrt(radius * radius - dy * dy);
+        Span span = LatticeSpan(lattice, i, center.x - half, center.x + half);
+        if (span.begin < span.end) {
+            spans.push_back(span);
+        }
+    }
+    return spans;
+}
+
+// Spans of lattice points within halfWidth of a circle: the circle rasterized
+// as a ring, as the outer disc's span minus the inner disc's in each row
+template <typename Lattice>
+inline std::vector<Span> RingSpans(const Lattice& lattice, const Circle& circle, double halfWidth) {
+    std::vector<Span> spans;
+    double outer = circle.radius + halfWidth;
+    double inner = circle.radius - halfWidth;
+    for (const auto& span : BrushSpans(lattice, circle.center, outer)) {
+        double dy = LatticeCoord(lattice, span.row) - circle.center.y;
+        if (inner <= 0 || std::abs(dy) >= inner) {
+            spans.push_back(span);
+            continue;
+        }
+        double half = std::sqrt(inner * inner - dy * dy);
+        Span hole = LatticeSpan(lattice, span.row, circle.center.x - half, circle.center.x + half);
+        if (hole.begin >= hole.end) {
+            spans.push_back(span);
+            continue;
+        }
+        if (span.begin < hole.begin) {
+            spans.push_back(Span(span.row, span.begin, hole.begin));
+        }
+        if (hole.end < span.end) {
+            spans.push_back(Span(span.row, hole.end, span.end));
+        }
+    }
+    return spans;
+}
+
+// Spans of lattice points inside a closed polygon (lasso), using a scanline
+// fill with the even-odd rule at each lattice row
+template <typename Lattice>
+inline std::vector<Span> LassoSpans(const Lattice& lattice, const std::vector<Point>& polygon) {
+    std::vector<Span> spans;
+    if (polygon.size() < 3) {
+        return spans;
+    }
+
+    std::vector<double> crossings;
+    for (int i = 0; i < lattice.GridSize(); i++) {
+        double y = LatticeCoord(lattice, i);
+        crossings.clear();
+
+        for (size_t k = 0; k < polygon.size(); k++) {
+            const Point& p = polygon[k];
+            const Point& q = polygon[(k + 1) % polygon.size()];
+            // Half-open edge test so shared vertices are counted once
+            if ((p.y <= y && q.y > y) || (q.y <= y && p.y > y)) {
+                double t = (y - p.y) / (q.y - p.y);
+                crossings.push_back(p.x + t * (q.x - p.x));
+            }
+        }
+
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t k = 0; k + 1 < crossings.size(); k += 2) {
+            Span span = LatticeSpan(lattice, i, crossings[k], crossings[k + 1]);
+            if (span.begin < span.end) {
+                spans.push_back(span);
+            }
+        }
+    }
+    return spans;
+}
+
+// The span kernels above for the current layout, specialized for the
+// common ones (see DispatchLattice)
+inline std::vector<Span> RectangleSpans(const Point& a, const Point& b) {
+    std::vector<Span> spans;
+    DispatchLattice([&](const auto& lattice) { spans = RectangleSpans(lattice, a, b); });
+    return spans;
+}
+
+inline std::vector<Span> BrushSpans(const Point& center, double radius) {
+    std::vector<Span> spans;
+    DispatchLattice([&](const auto& lattice) { spans = BrushSpans(lattice, center, radius); });
+    return spans;
+}
+
+inline std::vector<Span> RingSpans(const Circle& circle, double halfWidth) {
+    std::vector<Span> spans;
+    DispatchLattice([&](const auto& lattice) { spans = RingSpans(lattice, circle, halfWidth); });
+    return spans;
+}
+
+inline std::vector<Span> LassoSpans(const std::vector<Point>& polygon) {
+    std::vector<Span> spans;
+    DispatchLattice([&](const auto& lattice) { spans = LassoSpans(lattice, polygon); });
+    return spans;
+}
+
+// Lattice points covered by spans as a bitset, e.g. RingSpans of a fitted
+// circle, to compare or combine with a selection a word at a time
+inline TiledBitset SpansMask(const std::vector<Span>& spans) {
+    SelectionMask mask(Settings::Current().gridSize, Settings::Current().gridSize);
+    for (const Span& span : spans) {
+        mask.ApplySpan(span, SelectionMode::Set, [](int, int, double) {});
+    }
+    return mask.GetBits();
+}
@@ -0,0 +1,272 @@
+/**
+ * Runtime Settings
+ *
+ * The constants in Config.h are the defaults. They can be overridden by a
+ * settings file of "key = value" lines ('#' starts a comment) and then by
+ * "--key value" options on the command line; "--config path" names a
+ * different settings file. Settings are fixed once the application starts.
+ *
+ * Keys: grid, width, height, padding, threshold (fit ring half-width in
+ * cells), low and high (edge detection thresholds), brush (pixels), and
+ * the colors background, lines, unselected, selected, circle, region,
+ * previous and previous-circle as red,green,blue (0 to 255 each).
+ *
+ */
+
+#pragma once
+#include <windows.h>
+#include "Config.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct Settings {
+    int gridSize = GRID_SIZE;
+    int windowWidth = WINDOW_WIDTH;
+    int windowHeight = WINDOW_HEIGHT;
+    int gridPadding = GRID_PADDING;
+    double ringThreshold = RING_THRESHOLD;
+    int lowThreshold = EDGE_LOW_THRESHOLD;
+    int highThreshold = EDGE_HIGH_THRESHOLD;
+    int brushRadius = BRUSH_RADIUS;
+
+    COLORREF backgroundColor = BACKGROUND_COLOR;
+    COLORREF gridLineColor = GRID_LINE_COLOR;
+    COLORREF unselectedColor = UNSELECTED_COLOR;
+    COLORREF selectedColor = SELECTED_COLOR;
+    COLORREF circleColor = CIRCLE_COLOR;
+    COLORREF regionColor = REGION_COLOR;
+    COLORREF previousSelectedColor = PREVIOUS_SELECTED_COLOR;
+    COLORREF previousCircleColor = PREVIOUS_CIRCLE_COLOR;
+
+    // The settings in effect for the whole program
+    static Settings& Current() {
+        static Settings settings;
+        return settings;
+    }
+
+    // Pixels between neighboring grid points: the grid fills the smaller
+    // side of the window inside the padding
+    int CellSize() const {
+        return (std::min(windowWidth, windowHeight) - 2 * gridPadding) / gridSize;
+    }
+
+    // Set one value by key. Returns false with a message for an unknown key
+    // or a value out of range.
+    bool Set(const std::string& key, const std::string& value, std::string& error) {
+        if (key == "grid") {
+            return ParseInt(key, value, 2, 4096, gridSize, error);
+        } else if (key == "width") {
+            return ParseInt(key, value, 100, 8192, windowWidth, error);
+        } else if (key == "height") {
+            return ParseInt(key, value, 100, 8192, windowHeight, error);
+        } else if (key == "padding") {
+            return ParseInt(key, value, 0, 1000, gridPadding, error);
+        } else if (key == "threshold") {
+            return ParseDouble(key, value, 0.05, 10.0, ringThreshold, error);
+        } else if (key == "low") {
+            return ParseInt(key, value, 0, 2040, lowThreshold, error);
+        } else if (key == "high") {
+            return ParseInt(key, value, 0, 2040, highThreshold, error);
+        } else if (key == "brush") {
+            return ParseInt(key, value, 1, 4096, brushRadius, error);
+        }
+
+        const struct { const char* key; COLORREF Settings::*color; } colors[] = {
+            {"background", &Settings::backgroundColor},
+            {"lines", &Settings::gridLineColor},
+            {"unselected", &Settings::unselectedColor},
+            {"selected", &Settings::selectedColor},
+            {"circle", &Settings::circleColor},
+            {"region", &Settings::regionColor},
+            {"previous", &Settings::previousSelectedColor},
+            {"previous-circle", &Settings::previousCircleColor},
+        };
+        for (const auto& entry : colors) {
+            if (key == entry.key) {
+                return ParseColor(key, value, this->*entry.color, error);
+            }
+        }
+        error = "unknown setting '" + key + "'";
+        return false;
+    }
+
+    // Apply a settings file. A missing file is not an error when optional.
+    bool LoadFile(const std::string& path, bool optional, std::string& error) {
+        FILE* file = std::fopen(path.c_str(), "r");
+        if (!file) {
+            if (optional) {
+                return true;
+            }
+            error = "cannot open " + path;
+            return false;
+        }
+
+        char buffer[512];
+        int lineNumber = 0;
+        bool ok = true;
+        while (ok && std::fgets(buffer, sizeof(buffer), file)) {
+            lineNumber++;
+            std::string line(buffer);
+            line = Trim(line.substr(0, line.find('#')));
+            if (line.empty()) {
+                continue;
+            }
+            size_t equals = line.find('=');
+            if (equals == std::string::npos) {
+                error = "expected key = value";
+                ok = false;
+            } else {
+                ok = Set(Trim(line.substr(0, equals)), Trim(line.substr(equals + 1)), error);
+            }
+            if (!ok) {
+                error = path + ":" + std::to_string(lineNumber) + ": " + error;
+            }
+        }
+        std::fclose(file);
+        return ok;
+    }
+
+    // Apply "--key value" options from a command line, after the settings
+    // file (SETTINGS_FILE, or the one "--config path" names). Other words
+    // are handed back in rest, joined by spaces, e.g. an image to open.
+    bool ParseCommandLine(const std::string& commandLine, std::string& rest, std::string& error) {
+        std::string configPath = SETTINGS_FILE;
+        bool configGiven = false;
+        std::vector<std::string> words = Split(commandLine);
+        for (size_t k = 0; k + 1 < words.size(); k++) {
+            if (words[k] == "--config") {
+                configPath = words[k + 1];
+                configGiven = true;
+            }
+        }
+        if (!LoadFile(configPath, !configGiven, error)) {
+            return false;
+        }
+
+        rest.clear();
+        for (size_t k = 0; k < words.size(); k++) {
+            if (words[k].compare(0, 2, "--") != 0) {
+                rest += (rest.empty() ? "" : " ") + words[k];
+                continue;
+            }
+            if (k + 1 >= words.size()) {
+                error = "expected a value after '" + words[k] + "'";
+                return false;
+            }
+            if (words[k] != "--config" && !Set(words[k].substr(2), words[k + 1], error)) {
+                return false;
+            }
+            k++;
+        }
+        return Validate(error);
+    }
+
+    // Checks between settings, once all of them are in
+    bool Validate(std::string& error) const {
+        if (CellSize() < 4) {
+            error = "the grid does not fit the window: cells would be under 4 pixels";
+            return false;
+        }
+        if (lowThreshold > highThreshold) {
+            error = "low must not exceed high";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static std::string Trim(const std::string& text) {
+        size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) {
+            return std::string();
+        }
+        size_t last = text.find_last_not_of(" \t\r\n");
+        return text.substr(first, last - first + 1);
+    }
+
+    // Whitespace-separated words; double quotes group a word with spaces
+    static std::vector<std::string> Split(const std::string& text) {
+        std::vector<std::string> words;
+        size_t k = 0;
+        while (k < text.size()) {
+            while (k < text.size() && (text[k] == ' ' || text[k] == '\t')) {
+                k++;
+            }
+            if (k == text.size()) {
+                break;
+            }
+            std::string word;
+            bool quoted = false;
+            while (k < text.size() && (quoted || (text[k] != ' ' && text[k] != '\t'))) {
+                if (text[k] == '"') {
+                    quoted = !quoted;
+                } else {
+                    word += text[k];
+                }
+                k++;
+            }
+            words.push_back(word);
+        }
+        return words;
+    }
+
+    static bool ParseInt(const std::string& key, const std::string& value, int low, int high,
+                         int& out, std::string& error) {
+        char* end = nullptr;
+        errno = 0;
+        long parsed = std::strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || errno != 0 || parsed < low || parsed > high) {
+            error = key + " must be an integer from " + std::to_string(low) + " to " + std::to_string(high);
+            return false;
+        }
+        out = static_cast<int>(parsed);
+        return true;
+    }
+
+    static bool ParseDouble(const std::string& key, const std::string& value, double low, double high,
+                            double& out, std::string& error) {
+        char* end = nullptr;
+        errno = 0;
+        double parsed = std::strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0' || errno != 0 || !(parsed >= low && parsed <= high)) {
+            char range[64];
+            std::snprintf(range, sizeof(range), " must be a number from %g to %g", low, high);
+            error = key + range;
+            return false;
+        }
+        out = parsed;
+        return true;
+    }
+
+    // Red, green and blue from 0 to 255, separated by commas
+    static bool ParseColor(const std::string& key, const std::string& value, COLORREF& out,
+                           std::string& error) {
+        int channels[3];
+        size_t begin = 0;
+        for (int c = 0; c < 3; c++) {
+            size_t end = c < 2 ? value.find(',', begin) : value.size();
+            std::string part = end == std::string::npos ? std::string() : Trim(value.substr(begin, end - begin));
+            if (!ParseInt(key, part, 0, 255, channels[c], error)) {
+                error = key + " must be a color as red,green,blue from 0 to 255";
+                return false;
+            }
+            begin = end + 1;
+        }
+        out = RGB(channels[0], channels[1], channels[2]);
+        return true;
+    }
+};
+
+// Colors in use
+inline COLORREF GetBackgroundColor() { return Settings::Current().backgroundColor; }
+inline COLORREF GetGridLineColor() { return Settings::Current().gridLineColor; }
+inline COLORREF GetUnselectedColor() { return Settings::Current().unselectedColor; }
+inline COLORREF GetSelectedColor() { return Settings::Current().selectedColor; }
+inline COLORREF GetCircleColor() { return Settings::Current().circleColor; }
+inline COLORREF GetRegionColor() { return Settings::Current().regionColor; }
+inline COLORREF GetPreviousSelectedColor() { return Settings::Current().previousSelectedColor; }
+inline COLORREF GetPreviousCircleColor() { return Settings::Current().previousCircleColor; }
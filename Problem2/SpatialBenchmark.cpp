@@ -0,0 +1,208 @@
+/**
+ * Spatial Index Check and Benchmark
+ *
+ * First checks SpatialIndex (SpatialIndex.h) against brute force: picks,
+ * k-nearest and radius queries over a lattice and a scattered point set,
+ * with queries inside, beside and far outside the points, and radii from
+ * zero to infinite. Then builds the index over a large random point set
+ * and reports the build time and the time per pick, 8-NN and radius query.
+ *
+ * Console program, independent of Win32:
+ *   g++ -std=c++17 -O2 -pthread SpatialBenchmark.cpp -o SpatialBenchmark.exe
+ *   SpatialBenchmark.exe [-points N] [-queries N]
+ *
+ */
+
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// Neighbors asked of the k-nearest queries
+const int NEIGHBORS = 8;
+
+// Queries checked against brute force per point set
+const int CHECK_QUERIES = 2000;
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Squared distances from q to every point, ascending
+static std::vector<double> SortedDistances(const std::vector<Point>& points, const Point& q) {
+    std::vector<double> distances;
+    for (const Point& p : points) {
+        distances.push_back(SquaredDistance(p, q));
+    }
+    std::sort(distances.begin(), distances.end());
+    return distances;
+}
+
+// Compare one query's pick, k-nearest and radius results with brute force;
+// returns the number of disagreements
+static int CheckQuery(const SpatialIndex& index, const std::vector<Point>& points, const Point& q,
+                      double radius) {
+    int failures = 0;
+    std::vector<double> distances = SortedDistances(points, q);
+
+    // Pick: any point at the nearest distance, or none beyond the limit
+    int pick = index.Pick(q, radius);
+    bool anyWithin = !distances.empty() && distances[0] <= radius * radius;
+    if (anyWithin != (pick >= 0) || (pick >= 0 && SquaredDistance(points[pick], q) != distances[0])) {
+        failures++;
+    }
+
+    // k-nearest: the same distances, ties broken either way
+    auto nearest = index.KNearest(q, NEIGHBORS);
+    if (nearest.size() != std::min<size_t>(NEIGHBORS, points.size())) {
+        failures++;
+    } else {
+        for (size_t k = 0; k < nearest.size(); k++) {
+            if (std::abs(nearest[k].first - std::sqrt(distances[k])) > 1e-9 * (1 + nearest[k].first)) {
+                failures++;
+                break;
+            }
+        }
+    }
+
+    // Radius: exactly the points within it
+    std::vector<int> within = index.WithinRadius(q, radius);
+    std::vector<int> expected;
+    for (size_t k = 0; k < points.size(); k++) {
+        if (SquaredDistance(points[k], q) <= radius * radius) {
+            expected.push_back(static_cast<int>(k));
+        }
+    }
+    std::sort(within.begin(), within.end());
+    if (within != expected || index.CountWithinRadius(q, radius) != expected.size()) {
+        failures++;
+    }
+    return failures;
+}
+
+// Queries over the points' bounds and well beyond them on every side
+static int CheckPoints(const char* name, const std::vector<Point>& points, std::mt19937& random) {
+    SpatialIndex index(points);
+    double minX = 1e300, maxX = -1e300, minY = 1e300, maxY = -1e300;
+    for (const Point& p : points) {
+        minX = std::min(minX, p.x);
+        maxX = std::max(maxX, p.x);
+        minY = std::min(minY, p.y);
+        maxY = std::max(maxY, p.y);
+    }
+    double span = std::max(maxX - minX, maxY - minY);
+    std::uniform_real_distribution<double> x(minX - 2 * span, maxX + 2 * span);
+    std::uniform_real_distribution<double> y(minY - 2 * span, maxY + 2 * span);
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    int failures = 0;
+    const double inf = std::numeric_limits<double>::infinity();
+    const Point fixed[] = {Point(-100, 5), Point(1e6, 5), Point(5, -1e6), Point(5, 1e300), Point(-1e300, -1e300)};
+    for (const Point& q : fixed) {
+        failures += CheckQuery(index, points, q, 1);
+        failures += CheckQuery(index, points, q, inf);
+    }
+    for (int k = 0; k < CHECK_QUERIES; k++) {
+        Point q(x(random), y(random));
+        double choice = unit(random);
+        double radius = choice < 0.05 ? 0.0 : choice < 0.1 ? inf : unit(random) * span * 0.3;
+        failures += CheckQuery(index, points, q, radius);
+    }
+    std::printf("%s: %zu points, %d queries, %d mismatches\n", name, points.size(), CHECK_QUERIES + 10,
+                failures);
+    return failures;
+}
+
+static int Check() {
+    std::mt19937 random(1);
+    std::vector<Point> lattice;
+    for (int i = 0; i < 27; i++) {
+        for (int j = 0; j < 37; j++) {
+            lattice.push_back(Point(j, i));
+        }
+    }
+    int failures = CheckPoints("37x27 lattice", lattice, random);
+
+    // Clustered, with duplicates and a thin outlying strip
+    std::normal_distribution<double> spread(0, 3);
+    std::vector<Point> scattered;
+    for (int k = 0; k < 3000; k++) {
+        scattered.push_back(Point(50 + spread(random), 20 + spread(random)));
+    }
+    for (int k = 0; k < 100; k++) {
+        scattered.push_back(scattered[k]);
+        scattered.push_back(Point(200 + k, -40));
+    }
+    failures += CheckPoints("scattered", scattered, random);
+    return failures;
+}
+
+static void Benchmark(size_t count, int queries) {
+    std::mt19937 random(2);
+    std::uniform_real_distribution<double> coordinate(0, 1000);
+    std::vector<Point> points(count);
+    for (Point& p : points) {
+        p = Point(coordinate(random), coordinate(random));
+    }
+    std::vector<Point> probes(queries);
+    for (Point& q : probes) {
+        q = Point(coordinate(random), coordinate(random));
+    }
+    // About eight points within the radius
+    double radius = 1000 * std::sqrt(NEIGHBORS / (3.14159265358979 * count));
+
+    auto start = std::chrono::steady_clock::now();
+    SpatialIndex index(points);
+    double build = Seconds(start);
+
+    size_t sink = 0;
+    start = std::chrono::steady_clock::now();
+    for (const Point& q : probes) {
+        sink += index.Pick(q);
+    }
+    double pick = Seconds(start);
+    start = std::chrono::steady_clock::now();
+    for (const Point& q : probes) {
+        sink += index.KNearest(q, NEIGHBORS).size();
+    }
+    double knn = Seconds(start);
+    start = std::chrono::steady_clock::now();
+    for (const Point& q : probes) {
+        sink += index.CountWithinRadius(q, radius);
+    }
+    double within = Seconds(start);
+
+    std::printf("%zu points: build %.3f s; per query: pick %.2f us, %d-NN %.2f us, radius %.2f us (%zu)\n",
+                count, build, 1e6 * pick / queries, NEIGHBORS, 1e6 * knn / queries, 1e6 * within / queries,
+                sink % 10);
+}
+
+int main(int argc, char** argv) {
+    size_t count = 1000000;
+    int queries = 100000;
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "-points" && k + 1 < argc) {
+            count = std::strtoull(argv[++k], nullptr, 10);
+        } else if (arg == "-queries" && k + 1 < argc) {
+            queries = std::atoi(argv[++k]);
+        } else {
+            std::fprintf(stderr, "usage: SpatialBenchmark [-points N] [-queries N]\n");
+            return 1;
+        }
+    }
+    if (count < 1 || queries < 1) {
+        std::fprintf(stderr, "usage: SpatialBenchmark [-points N] [-queries N]\n");
+        return 1;
+    }
+
+    int failures = Check();
+    Benchmark(count, queries);
+    std::printf(failures ? "FAILED\n" : "ok\n");
+    return failures ? 1 : 0;
+}
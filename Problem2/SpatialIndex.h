@@ -0,0 +1,343 @@
+/**
+ * Spatial Index for Arbitrary Point Sets
+ *
+ * Picking and neighborhood queries over points that do not lie on the grid
+ * lattice (e.g. imported scan data), where Grid::PixelToGrid cannot be used.
+ * Two structures are built over the same points:
+ *
+ * - An implicit k-d tree: the points are reordered so that every subrange
+ *   [begin, end) is a subtree whose median (begin + end) / 2 splits on x or
+ *   y by depth. No node pointers are stored; small ranges are leaves that
+ *   are scanned linearly. Used for nearest-point picking and k-NN.
+ * - A uniform bucket grid: points sorted by cell with an offset table
+ *   (about two points per cell). Used for radius queries.
+ *
+ * Both keep point coordinates in contiguous arrays in query order and are
+ * built in parallel. Queries are read-only and may run concurrently.
+ *
+ */
+
+#pragma once
+#include "Geometry.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+inline double SquaredDistance(const Point& a, const Point& b) {
+    double dx = a.x - b.x;
+    double dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+class KdTree {
+private:
+    static constexpr int LEAF_SIZE = 8;
+
+    struct Entry {
+        Point point;
+        int id;  // Input index
+    };
+    std::vector<Entry> entries;  // Tree order
+
+    static double Axis(const Point& p, int depth) {
+        return (depth & 1) ? p.y : p.x;
+    }
+
+    void BuildRange(int begin, int end, int depth, int parallelDepth) {
+        if (end - begin <= LEAF_SIZE) {
+            return;
+        }
+        int mid = begin + (end - begin) / 2;
+        std::nth_element(entries.begin() + begin, entries.begin() + mid, entries.begin() + end,
+                         [depth](const Entry& a, const Entry& b) {
+                             return Axis(a.point, depth) < Axis(b.point, depth);
+                         });
+
+        if (depth < parallelDepth) {
+            TaskGraph halves;
+            halves.Add([=]() { BuildRange(begin, mid, depth + 1, parallelDepth); });
+            halves.Add([=]() { BuildRange(mid + 1, end, depth + 1, parallelDepth); });
+            halves.Run();
+        } else {
+            BuildRange(begin, mid, depth + 1, parallelDepth);
+            BuildRange(mid + 1, end, depth + 1, parallelDepth);
+        }
+    }
+
+    // Visit candidate points nearest-subtree first. visit(k, d2) returns the
+    // current pruning radius (squared).
+    template <typename Visitor>
+    double Search(int begin, int end, int depth, const Point& q, double bound, Visitor& visit) const {
+        if (end - begin <= LEAF_SIZE) {
+            for (int k = begin; k < end; k++) {
+                double d2 = SquaredDistance(entries[k].point, q);
+                if (d2 <= bound) {
+                    bound = visit(k, d2);
+                }
+            }
+            return bound;
+        }
+
+        int mid = begin + (end - begin) / 2;
+        double diff = Axis(q, depth) - Axis(entries[mid].point, depth);
+        double d2 = SquaredDistance(entries[mid].point, q);
+        if (d2 <= bound) {
+            bound = visit(mid, d2);
+        }
+
+        if (diff < 0) {
+            bound = Search(begin, mid, depth + 1, q, bound, visit);
+            if (diff * diff <= bound) {
+                bound = Search(mid + 1, end, depth + 1, q, bound, visit);
+            }
+        } else {
+            bound = Search(mid + 1, end, depth + 1, q, bound, visit);
+            if (diff * diff <= bound) {
+                bound = Search(begin, mid, depth + 1, q, bound, visit);
+            }
+        }
+        return bound;
+    }
+
+public:
+    void Build(const std::vector<Point>& input, unsigned threads = DefaultThreadCount()) {
+        entries.resize(input.size());
+        for (size_t k = 0; k < input.size(); k++) {
+            entries[k].point = input[k];
+            entries[k].id = static_cast<int>(k);
+        }
+        int parallelDepth = 0;
+        while ((1u << parallelDepth) < threads) {
+            parallelDepth++;
+        }
+        BuildRange(0, static_cast<int>(entries.size()), 0, parallelDepth);
+    }
+
+    size_t Size() const { return entries.size(); }
+
+    // Input index of the point nearest to q within maxDistance, or -1
+    int Nearest(const Point& q, double maxDistance = std::numeric_limits<double>::infinity(),
+                double* distance = nullptr) const {
+        int best = -1;
+        double bestD2 = maxDistance * maxDistance;
+        auto visit = [&](int k, double d2) {
+            if (d2 < bestD2 || best < 0) {
+                best = k;
+                bestD2 = d2;
+            }
+            return bestD2;
+        };
+        Search(0, static_cast<int>(entries.size()), 0, q, bestD2, visit);
+        if (best < 0) {
+            return -1;
+        }
+        if (distance) {
+            *distance = std::sqrt(bestD2);
+        }
+        return entries[best].id;
+    }
+
+    // The k points nearest to q as (distance, input index), nearest first
+    std::vector<std::pair<double, int>> KNearest(const Point& q, int k) const {
+        std::priority_queue<std::pair<double, int>> heap;  // Max-heap of squared distances
+        auto visit = [&](int index, double d2) {
+            if (static_cast<int>(heap.size()) < k) {
+                heap.push(std::make_pair(d2, index));
+            } else if (d2 < heap.top().first) {
+                heap.pop();
+                heap.push(std::make_pair(d2, index));
+            }
+            return static_cast<int>(heap.size()) < k ? std::numeric_limits<double>::infinity()
+                                                      : heap.top().first;
+        };
+        if (k > 0) {
+            Search(0, static_cast<int>(entries.size()), 0, q,
+                   std::numeric_limits<double>::infinity(), visit);
+        }
+
+        std::vector<std::pair<double, int>> result(heap.size());
+        for (size_t r = result.size(); r-- > 0;) {
+            result[r] = std::make_pair(std::sqrt(heap.top().first), entries[heap.top().second].id);
+            heap.pop();
+        }
+        return result;
+    }
+};
+
+class BucketGrid {
+private:
+    double minX, minY;
+    double cellSize;
+    int cols, rows;
+    std::vector<int> cellStart;  // Offset of each cell's points; rows * cols + 1 entries
+    std::vector<Point> points;   // Points in cell order
+    std::vector<int> ids;        // Input index of each point in cell order
+
+    int Cell(const Point& p) const {
+        int c = std::min(cols - 1, std::max(0, static_cast<int>((p.x - minX) / cellSize)));
+        int r = std::min(rows - 1, std::max(0, static_cast<int>((p.y - minY) / cellSize)));
+        return r * cols + c;
+    }
+
+public:
+    BucketGrid() : minX(0), minY(0), cellSize(1), cols(1), rows(1), cellStart(2, 0) {}
+
+    void Build(const std::vector<Point>& input, unsigned threads = DefaultThreadCount()) {
+        size_t n = input.size();
+        minX = minY = std::numeric_limits<double>::infinity();
+        double maxX = -minX, maxY = -minY;
+        for (const auto& p : input) {
+            minX = std::min(minX, p.x);
+            maxX = std::max(maxX, p.x);
+            minY = std::min(minY, p.y);
+            maxY = std::max(maxY, p.y);
+        }
+        if (n == 0) {
+            minX = minY = maxX = maxY = 0;
+        }
+
+        // About two points per cell, without letting a thin set explode the cell count
+        double width = maxX - minX, height = maxY - minY;
+        double targetCells = std::max(1.0, n / 2.0);
+        cellSize = std::sqrt(width * height / targetCells);
+        cellSize = std::max(cellSize, std::max(width, height) / targetCells);
+        if (!(cellSize > 0)) {
+            cellSize = 1;
+        }
+        cols = static_cast<int>(width / cellSize) + 1;
+        rows = static_cast<int>(height / cellSize) + 1;
+        size_t cellCount = static_cast<size_t>(cols) * rows;
+
+        // Parallel counting sort by cell. Cells are hit at random, so shared
+        // atomic counters see little contention and need far less memory
+        // than per-thread histograms with this many cells.
+        std::vector<int> cells(n);
+        std::vector<std::atomic<int>> counts(cellCount);
+        for (auto& count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        ParallelFor(n, threads, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                cells[k] = Cell(input[k]);
+                counts[cells[k]].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+        cellStart.assign(cellCount + 1, 0);
+        int offset = 0;
+        for (size_t c = 0; c < cellCount; c++) {
+            cellStart[c] = offset;
+            offset += counts[c].load(std::memory_order_relaxed);
+            counts[c].store(cellStart[c], std::memory_order_relaxed);  // Next write position
+        }
+        cellStart[cellCount] = offset;
+
+        // Order within a cell depends on scheduling; queries do not care
+        points.resize(n);
+        ids.resize(n);
+        ParallelFor(n, threads, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                int position = counts[cells[k]].fetch_add(1, std::memory_order_relaxed);
+                points[position] = input[k];
+                ids[position] = static_cast<int>(k);
+            }
+        });
+    }
+
+    // Call visit(inputIndex, point) for every point within radius of q
+    template <typename Visitor>
+    void ForEachWithin(const Point& q, double radius, Visitor visit) const {
+        if (points.empty() || !(radius >= 0)) {
+            return;
+        }
+        // Clamp in double before converting: the cell range of a query far
+        // outside the points, or with an infinite radius, does not fit an int
+        auto cell = [this](double offset, int count) {
+            return static_cast<int>(std::min(double(count), std::max(-1.0, std::floor(offset / cellSize))));
+        };
+        int c0 = std::max(0, cell(q.x - radius - minX, cols));
+        int c1 = std::min(cols - 1, cell(q.x + radius - minX, cols));
+        int r0 = std::max(0, cell(q.y - radius - minY, rows));
+        int r1 = std::min(rows - 1, cell(q.y + radius - minY, rows));
+        if (c0 > c1 || r0 > r1) {
+            return;  // Entirely beside the points
+        }
+        double r2 = radius * radius;
+        for (int r = r0; r <= r1; r++) {
+            // Cells of a row are contiguous, so scan the row's points as one range
+            for (int k = cellStart[r * cols + c0]; k < cellStart[r * cols + c1 + 1]; k++) {
+                if (SquaredDistance(points[k], q) <= r2) {
+                    visit(ids[k], points[k]);
+                }
+            }
+        }
+    }
+};
+
+class SpatialIndex {
+private:
+    std::vector<Point> points;
+    KdTree tree;
+    BucketGrid buckets;
+
+public:
+    SpatialIndex() {}
+    explicit SpatialIndex(const std::vector<Point>& input, unsigned threads = DefaultThreadCount()) {
+        Build(input, threads);
+    }
+
+    void Build(const std::vector<Point>& input, unsigned threads = DefaultThreadCount()) {
+        points = input;
+        // Each build parallelizes internally; splitting the threads lets both run at once
+        unsigned treeThreads = std::max(1u, threads / 2);
+        TaskGraph builds;
+        builds.Add([&]() { tree.Build(points, treeThreads); });
+        builds.Add([&]() { buckets.Build(points, std::max(1u, threads - treeThreads)); });
+        builds.Run();
+    }
+
+    size_t Size() const { return points.size(); }
+    const Point& GetPoint(int index) const { return points[index]; }
+
+    // Index of the point nearest to a click, or -1 if none is within maxDistance
+    int Pick(const Point& q, double maxDistance = std::numeric_limits<double>::infinity()) const {
+        return tree.Nearest(q, maxDistance);
+    }
+
+    // Indices of all points within radius of q, in no particular order
+    std::vector<int> WithinRadius(const Point& q, double radius) const {
+        std::vector<int> result;
+        buckets.ForEachWithin(q, radius, [&](int index, const Point&) { result.push_back(index); });
+        return result;
+    }
+
+    size_t CountWithinRadius(const Point& q, double radius) const {
+        size_t count = 0;
+        buckets.ForEachWithin(q, radius, [&](int, const Point&) { count++; });
+        return count;
+    }
+
+    // The k points nearest to q as (distance, index), nearest first
+    std::vector<std::pair<double, int>> KNearest(const Point& q, int k) const {
+        return tree.KNearest(q, k);
+    }
+
+    // Outlier score of every point: the distance to its k-th nearest other
+    // point. Isolated points (noise in scan data) score high.
+    std::vector<double> OutlierScores(int k, unsigned threads = DefaultThreadCount()) const {
+        std::vector<double> scores(points.size(), 0.0);
+        ParallelFor(points.size(), threads, [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++) {
+                // k + 1 neighbors, since the point itself is its own nearest
+                auto neighbors = tree.KNearest(points[p], k + 1);
+                scores[p] = neighbors.empty() ? 0.0 : neighbors.back().first;
+            }
+        });
+        return scores;
+    }
+};
@@ -6,67 +6,431 @@
  * 
  * Features:
  * - Interactive point selection via mouse click
+ * - Rectangle, brush and lasso region selection
  * - Pratt algebraic circle fitting algorithm
  * - Validation for collinear points
  * - Real-time visualization
+ * - Chamfer and Hausdorff distance between the fit and the selection
+ * - Circle detection in PGM/PPM images (Canny edges)
  * 
  * Controls:
- * - Click: Toggle point selection
+ * - Click: Toggle point selection (point tool)
+ * - P / R / B / L keys: Point, rectangle, brush or lasso tool
+ * - Drag (region tools): Select region; Ctrl+drag deselects, Shift+drag toggles
  * - G key: Generate best-fit circle
  * - C key: Clear all selections
+ * - Ctrl+Z / Ctrl+Y: Undo / redo selection changes
+ * - V key: Compare with the previous fit
+ * - S key: Save the session (also saved on exit and restored on startup)
+ * - E key: Export the selection as an SVG image
+ * - Esc: Cancel the image detection in progress
+ * 
+ * Each update runs as a graph of tasks on the shared work-stealing pool
+ * (see TaskGraph.h): fitting, rasterizing the fit, both distance transforms
+ * and the cell rectangles overlap where they do not depend on each other.
+ * 
+ * Every change to the selection or fit is also logged as a compact delta
+ * stream to Problem2.delta (see DeltaStream.h).
+ * 
+ * Running "Problem2.exe image.pgm" selects the grid points the image's edges
+ * pass through and fits a circle to every edge pixel. Detection runs as an
+ * asynchronous job (see AsyncJob.h), so the window stays responsive.
+ * 
+ * The grid size, window size, padding, ring threshold, edge thresholds,
+ * brush radius and colors can be changed in Problem2.cfg or on the command
+ * line (see Settings.h).
  * 
  */
 
 #include <windows.h>
+#include <windowsx.h>
 #include "Config.h"
+#include "Settings.h"
 #include "Grid.h"
 #include "Renderer.h"
 #include "Geometry.h"
+#include "Selection.h"
+#include "FitCache.h"
+#include "History.h"
+#include "Session.h"
+#include "MaskRectangles.h"
+#include "DeltaStream.h"
+#include "DistanceTransform.h"
+#include "EdgeDetection.h"
+#include "TaskGraph.h"
+#include "AsyncJob.h"
+#include "ConcurrentSelection.h"
+#include <algorithm>
+#include <cstdio>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 // Forward declarations
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
+// Posted to the window when an image detection job finishes
+constexpr UINT WM_IMAGE_DETECTED = WM_APP + 1;
+
+// What detecting an image's edges hands back to the UI thread
+struct ImageDetection {
+    std::string error;                         // Empty on success
+    SelectionMask selection{Settings::Current().gridSize,
+                            Settings::Current().gridSize};  // Grid points the edges pass through
+    CircleMoments moments;                     // Their lattice moments
+    Circle circle;                             // Fit to every edge pixel
+    size_t ringPoints = 0;                     // Grid points on the fit's ring
+    size_t ringEdgePoints = 0;                 // Of those, selected by edges
+};
+
+// Everything an undo step restores. Copying it is O(1): the selection mask
+// shares its tiles with the live grid until one of them is edited.
+struct SelectionState {
+    SelectionMask selection;
+    CircleMoments moments;
+    Circle bestFitCircle;
+    bool showCircle;
+};
+
+enum class SelectionTool {
+    Point,
+    Rectangle,
+    Brush,
+    Lasso
+};
+
 class Application {
 private:
     Grid grid;
     std::unique_ptr<Renderer> renderer;
     Circle bestFitCircle;
     bool showCircle;
+    
+    // Region selection state
+    SelectionTool tool;
+    SelectionMode regionMode;
+    bool isDragging;
+    Point dragStart;
+    std::vector<Point> regionOutline;  // Rectangle corners, lasso path or brush outline
+    
+    // Undo/redo and comparison with the previous fit
+    History<SelectionState> history;
+    SelectionMask lastFitSelection;      // Selection the current fit was made from
+    SelectionMask previousFitSelection;
+    Circle previousFitCircle;
+    bool showPrevious;
+    
+    Session session;
+    FitCache<Circle> fitCache;           // Fits by selection hash
+    Job<ImageDetection> imageJob;        // Detection in progress, if any
+    std::string imageReport;             // How well the last detection's fit matches its edges
+    
+    // What the next frame draws, prepared by PrepareFrame
+    CellLayers frameCells;
+    std::string frameReport;
+    
+    // Change log of the selection and fit, drained to DELTA_LOG_FILE
+    DeltaRing deltaRing;
+    DeltaEncoder deltaEncoder;
+    DeltaRecorder deltaRecorder;
+    
+    SelectionState CaptureState() const {
+        return SelectionState{grid.GetSelection(), grid.GetMoments(), bestFitCircle, showCircle};
+    }
+    
+    void RestoreState(const SelectionState& state) {
+        grid.SetSelection(state.selection, state.moments);
+        bestFitCircle = state.bestFitCircle;
+        showCircle = state.showCircle;
+    }
+    
+    void ApplyBrush(const Point& center) {
+        const int radius = Settings::Current().brushRadius;
+        grid.ApplySpans(BrushSpans(center, radius), regionMode);
+        
+        regionOutline.clear();
+        const int segments = 32;
+        for (int k = 0; k < segments; k++) {
+            double t = 2.0 * 3.14159265358979323846 * k / segments;
+            regionOutline.push_back(Point(center.x + radius * std::cos(t),
+                                          center.y + radius * std::sin(t)));
+        }
+    }
+    
+    // Prepare the next frame as a graph of tasks: refit the selection if
+    // asked, rasterize the fit as a ring (the points within the threshold
+    // setting of it, half a cell by default), compare it with the
+    // selection using distance transforms of both, and decompose the points
+    // into rectangles to fill, a band of rows per task. Returns false if the
+    // refit found the points collinear.
+    bool PrepareFrame(bool refit) {
+        const int size = grid.GetSize();
+        const int cellSize = Settings::Current().CellSize();
+        const int bandRows = 64;
+        const int bandCount = (size + bandRows - 1) / bandRows;
+        bool compare = showPrevious && previousFitCircle.radius > 0;
+        bool fitted = true;
+        
+        TiledBitset selected, ring;
+        DistanceTransform selectedDistance, ringDistance;
+        std::vector<std::vector<CellRect>> bands(bandCount);
+        std::vector<CellRect> dropped;
+        
+        TaskGraph graph;
+        TaskGraph::Node extract = graph.Add([&]() {
+            selected = grid.GetSelection().GetBits();  // Shares the tiles, O(1)
+        });
+        TaskGraph::Node fit = extract;
+        if (refit) {
+            // Refitting a selection seen before is a cache lookup
+            fit = graph.Add([&]() {
+                Circle circle = fitCache.Get(grid.GetHash(), [&]() { return grid.FitSelectedCircle(); });
+                if (circle.radius > 0) {
+                    if (showCircle) {
+                        // Keep the fit being replaced; the mask copy is O(1)
+                        previousFitCircle = bestFitCircle;
+                        previousFitSelection = lastFitSelection;
+                    }
+                    bestFitCircle = circle;
+                    lastFitSelection = grid.GetSelection();
+                    showCircle = true;
+                } else {
+                    showCircle = false;
+                    fitted = false;
+                }
+                compare = showPrevious && previousFitCircle.radius > 0;
+            });
+            graph.Precede(extract, fit);
+        }
+        
+        // The fit tells whether there is a circle to report on, so the report
+        // tasks check it when they run rather than when they are added
+        TaskGraph::Node selection = graph.Add([&]() {
+            if (showCircle) {
+                selectedDistance.Build(selected);
+            }
+        });
+        TaskGraph::Node raster = graph.Add([&]() {
+            if (showCircle) {
+                ring = SpansMask(RingSpans(bestFitCircle, Settings::Current().ringThreshold * cellSize));
+            }
+        });
+        TaskGraph::Node ringField = graph.Add([&]() {
+            if (showCircle) {
+                ringDistance.Build(ring);
+            }
+        });
+        TaskGraph::Node report = graph.Add([&]() {
+            if (!showCircle) {
+                frameReport.clear();
+            } else if (ringDistance.IsEmpty()) {
+                frameReport = "Fit circle misses the grid";
+            } else {
+                double chamfer = DistanceTransform::Chamfer(ring, ringDistance, selected, selectedDistance);
+                double hausdorff = DistanceTransform::Hausdorff(ring, ringDistance, selected, selectedDistance);
+                char text[96];
+                std::snprintf(text, sizeof(text), "Fit vs selection: Chamfer %.1f px, Hausdorff %.1f px",
+                              chamfer * cellSize, hausdorff * cellSize);
+                frameReport = text;
+            }
+        });
+        graph.Precede(fit, selection);
+        graph.Precede(fit, raster);
+        graph.Precede(raster, ringField);
+        graph.Precede(selection, report);
+        graph.Precede(ringField, report);
+        
+        // Rectangles of selected points, one child task per band of rows
+        TaskGraph::Node tiles = graph.Add([&]() {
+            for (int band = 0; band < bandCount; band++) {
+                TaskGraph::Spawn([&, band]() {
+                    bands[band].clear();
+                    ForEachMaskRectangleInRows(selected, band * bandRows,
+                                               std::min(size, (band + 1) * bandRows),
+                                               [&](const CellRect& cell) { bands[band].push_back(cell); });
+                });
+            }
+        });
+        TaskGraph::Node droppedTiles = graph.Add([&]() {
+            if (compare) {
+                TiledBitset previous = previousFitSelection.GetBits();
+                previous.Subtract(selected);
+                dropped = MaskRectangles(previous);
+            }
+        });
+        TaskGraph::Node gather = graph.Add([&]() {
+            frameCells.selected.clear();
+            for (const auto& band : bands) {
+                frameCells.selected.insert(frameCells.selected.end(), band.begin(), band.end());
+            }
+            frameCells.dropped.swap(dropped);
+        });
+        graph.Precede(extract, tiles);
+        graph.Precede(fit, droppedTiles);
+        graph.Precede(tiles, gather);
+        graph.Precede(droppedTiles, gather);
+        
+        graph.Run();
+        return fitted;
+    }
+    
+    // Draw the frame PrepareFrame left
+    void DrawFrame() {
+        bool compare = showPrevious && previousFitCircle.radius > 0;
+        renderer->Render(frameCells, showCircle ? &bestFitCircle : nullptr,
+                         isDragging ? &regionOutline : nullptr,
+                         compare ? &previousFitCircle : nullptr);
+        if (showCircle) {
+            renderer->DrawStatus(frameReport);
+            renderer->DrawStatus(fitCache.Report(), 1);
+        }
+        renderer->DrawStatus(TaskScheduler::Shared().Report(), 2);
+        if (imageJob.Status() == JobStatus::Pending) {
+            renderer->DrawStatus("Detecting edges... (Esc cancels)", 3);
+        } else if (!imageReport.empty()) {
+            renderer->DrawStatus(imageReport, 3);
+        }
+        renderer->Present();
+    }
+    
+    // Send the changes since the last call to the delta stream. Every edit
+    // ends in Render, so publishing there covers them all; never waits.
+    void PublishDelta() {
+        if (showCircle) {
+            double params[3] = {bestFitCircle.center.x, bestFitCircle.center.y, bestFitCircle.radius};
+            deltaEncoder.SetShape(params, 3);
+        } else {
+            deltaEncoder.ClearShape();
+        }
+        deltaEncoder.Publish(grid.GetSelection().GetBits());
+    }
+    
+    void SetRectangleOutline(const Point& corner) {
+        regionOutline.clear();
+        regionOutline.push_back(dragStart);
+        regionOutline.push_back(Point(corner.x, dragStart.y));
+        regionOutline.push_back(corner);
+        regionOutline.push_back(Point(dragStart.x, corner.y));
+    }
 
 public:
-    Application() : showCircle(false) {}
+    Application()
+        : showCircle(false), tool(SelectionTool::Point),
+          regionMode(SelectionMode::Set), isDragging(false),
+          lastFitSelection(grid.GetSize(), grid.GetSize()), previousFitSelection(grid.GetSize(), grid.GetSize()),
+          showPrevious(false), session(SESSION_FILE),
+          deltaRing(DELTA_RING_BYTES), deltaEncoder(deltaRing), deltaRecorder(deltaRing, DELTA_LOG_FILE) {
+        // Restore the previous session, if any, straight from the mapped file
+        if (session.Load(grid, bestFitCircle, showCircle)) {
+            lastFitSelection = grid.GetSelection();
+        }
+    }
 
     /**
      * Initialize renderer after window creation.
      * @param hwnd Window handle
      */
     void InitializeRenderer(HWND hwnd) {
-        renderer = std::make_unique<Renderer>(hwnd, WINDOW_WIDTH, WINDOW_HEIGHT);
+        renderer = std::make_unique<Renderer>(hwnd, Settings::Current().windowWidth,
+                                              Settings::Current().windowHeight);
     }
 
     /**
      * Render the current state.
      */
     void Render() {
+        PublishDelta();
         if (renderer) {
-            renderer->Render(grid, showCircle ? &bestFitCircle : nullptr);
-            renderer->Present();
+            PrepareFrame(false);
+            DrawFrame();
         }
     }
 
+    /**
+     * Select the tool used by subsequent mouse drags.
+     * @param newTool Point, rectangle, brush or lasso
+     */
+    void SetTool(SelectionTool newTool) {
+        tool = newTool;
+        isDragging = false;
+        Render();
+    }
+
     /**
      * Handle mouse button down event.
      * @param x Mouse x coordinate
      * @param y Mouse y coordinate
+     * @param mode Set, clear or toggle, from the held modifier keys
      */
-    void OnMouseDown(int x, int y) {
-        int i, j;
-        if (Grid::PixelToGrid(x, y, i, j)) {
-            grid.TogglePoint(i, j);
-            showCircle = false;  // Hide circle when grid changes
-            Render();
+    void OnMouseDown(int x, int y, SelectionMode mode) {
+        if (tool == SelectionTool::Point) {
+            int i, j;
+            if (Grid::PixelToGrid(x, y, i, j)) {
+                history.Record(CaptureState());
+                grid.TogglePoint(i, j);
+                showCircle = false;  // Hide circle when grid changes
+                Render();
+            }
+            return;
+        }
+        
+        history.Record(CaptureState());
+        isDragging = true;
+        regionMode = mode;
+        dragStart = Point(x, y);
+        regionOutline.assign(1, dragStart);
+        showCircle = false;
+        
+        if (tool == SelectionTool::Brush) {
+            // Overlapping dabs would flip points back and forth, so a brush
+            // stroke only ever sets or clears
+            if (regionMode == SelectionMode::Toggle) {
+                regionMode = SelectionMode::Set;
+            }
+            ApplyBrush(dragStart);
         }
+        Render();
+    }
+
+    /**
+     * Handle mouse move event while a region tool is dragging.
+     * @param x Mouse x coordinate
+     * @param y Mouse y coordinate
+     */
+    void OnMouseMove(int x, int y) {
+        if (!isDragging) {
+            return;
+        }
+        
+        Point current(x, y);
+        switch (tool) {
+            case SelectionTool::Rectangle: SetRectangleOutline(current); break;
+            case SelectionTool::Brush:     ApplyBrush(current);          break;
+            case SelectionTool::Lasso:     regionOutline.push_back(current); break;
+            case SelectionTool::Point:     break;
+        }
+        Render();
+    }
+
+    /**
+     * Handle mouse button up event - apply the dragged region.
+     * @param x Mouse x coordinate
+     * @param y Mouse y coordinate
+     */
+    void OnMouseUp(int x, int y) {
+        if (!isDragging) {
+            return;
+        }
+        
+        isDragging = false;
+        if (tool == SelectionTool::Rectangle) {
+            grid.ApplySpans(RectangleSpans(dragStart, Point(x, y)), regionMode);
+        } else if (tool == SelectionTool::Lasso) {
+            regionOutline.push_back(Point(x, y));
+            grid.ApplySpans(LassoSpans(regionOutline), regionMode);
+        }
+        Render();
     }
 
     /**
@@ -74,28 +438,205 @@ public:
      * @param hwnd Window handle for message boxes
      */
     void GenerateCircle(HWND hwnd) {
-        std::vector<Point> selectedPoints = grid.GetSelectedPoints();
-        
-        if (selectedPoints.size() < 3) {
+        if (grid.GetSelectedCount() < 3) {
             showCircle = false;
             MessageBox(hwnd, 
                       "Please select at least 3 points to fit a circle.", 
                       "Not Enough Points", 
                       MB_OK | MB_ICONINFORMATION);
-        } else {
-            bestFitCircle = FitCircle(selectedPoints);
-            if (bestFitCircle.radius > 0) {
-                showCircle = true;
-            } else {
-                showCircle = false;
-                MessageBox(hwnd, 
-                          "Cannot fit a circle through collinear points.\n"
-                          "Please select points that are not in a straight line.", 
-                          "Invalid Point Configuration", 
-                          MB_OK | MB_ICONWARNING);
+            Render();
+            return;
+        }
+        
+        // Refit as part of preparing the frame, so rasterizing and comparing
+        // the new circle start as soon as the fit is ready
+        bool fitted = PrepareFrame(true);
+        PublishDelta();
+        if (renderer) {
+            DrawFrame();
+        }
+        if (!fitted) {
+            MessageBox(hwnd, 
+                      "Cannot fit a circle through collinear points.\n"
+                      "Please select points that are not in a straight line.", 
+                      "Invalid Point Configuration", 
+                      MB_OK | MB_ICONWARNING);
+        }
+    }
+
+    /**
+     * Start detecting edges in an image, to use them as the selection: the
+     * grid points whose cells an edge crosses are selected, and the circle
+     * is fit to the moments of every edge pixel, scaled to the canvas. The
+     * work runs on the pool; FinishImage applies the result. Starting
+     * another detection cancels this one.
+     * @param hwnd Window to notify with WM_IMAGE_DETECTED
+     * @param path PGM or PPM file
+     */
+    void DetectImage(HWND hwnd, const std::string& path) {
+        imageJob.Cancel();
+        imageReport.clear();
+        imageJob = DetectImageAsync(path, CancelToken());
+        imageJob.OnComplete([hwnd]() { PostMessage(hwnd, WM_IMAGE_DETECTED, 0, 0); });
+        Render();
+    }
+
+    /**
+     * The detection, as a coroutine on the pool: find the edges and mark
+     * their cells, then fit the circle and rasterize its ring as jobs of
+     * their own, counting how many of the ring's points the edges select.
+     * @param path PGM or PPM file
+     * @param token Cancels every step
+     */
+    static Job<ImageDetection> DetectImageAsync(std::string path, CancelToken token) {
+        ImageDetection result;
+        GrayImage image;
+        if (!LoadPnm(path, image, result.error) || token.IsCancelled()) {
+            co_return result;
+        }
+        const Settings& settings = Settings::Current();
+        EdgeDetector edgeDetector(settings.lowThreshold, settings.highThreshold);
+        edgeDetector.Detect(image);
+        if (token.IsCancelled()) {
+            co_return result;
+        }
+        // Placed over the grid, in pixels from its corner
+        const int size = settings.gridSize;
+        const double side = size * settings.CellSize();
+        ImagePlacement placement = ImagePlacement::Fit(image.width, image.height, side, side);
+        
+        // Mark the cells a band of image rows at a time, each band a
+        // producer of the shared store; a cell crossed by edges of two
+        // bands is selected, and counted in the moments, once
+        ConcurrentSelection cells;
+        unsigned bands = std::min<unsigned>(DefaultThreadCount(), ConcurrentSelection::MAX_PRODUCERS);
+        ParallelFor(static_cast<size_t>(image.height), bands, [&](size_t begin, size_t end) {
+            TiledBitset band(size, size, SelectionLayout());
+            edgeDetector.MarkCells(placement, settings.CellSize(), band, static_cast<int>(begin),
+                                   static_cast<int>(end));
+            std::vector<Span> spans;
+            for (int i = 0; i < size; i++) {
+                for (int w = 0; w < band.WordsPerRow(); w++) {
+                    ForEachRun(band.Word(i, w), [&](int b, int e) {
+                        spans.push_back(Span(i, w * 64 + b, w * 64 + e));
+                    });
+                }
             }
+            ConcurrentSelection::Producer producer = cells.RegisterProducer();
+            producer.ApplySpans(spans, SelectionMode::Set);
+        });
+        result.selection = cells.SnapshotMask();
+        result.moments = cells.ReduceMoments();
+        
+        // Sum in the same coordinates as the lattice moments, from the
+        // grid's center
+        std::optional<Circle> circle = co_await FitCircleAsync(edgeDetector.EdgeMoments<CircleMoments>(
+            placement.Shifted(-side / 2.0, -side / 2.0)), token);
+        if (!circle) {
+            co_return result;
+        }
+        result.circle = *circle;
+        if (circle->radius > 0) {
+            std::optional<TiledBitset> ring = co_await RasterizeAsync(*circle, token);
+            if (ring) {
+                result.ringPoints = ring->Count();
+                result.ringEdgePoints = ring->IntersectionCount(result.selection.GetBits());
+            }
+        }
+        co_return result;
+    }
+
+    /**
+     * Apply the detection that just finished, if it was not cancelled.
+     * @param hwnd Window handle for message boxes
+     */
+    void FinishImage(HWND hwnd) {
+        if (imageJob.Status() == JobStatus::Pending) {
+            return;  // Notice from a job cancelled since
+        }
+        ImageDetection result;
+        bool done = imageJob.TryGet(result);
+        imageJob = Job<ImageDetection>();
+        if (!done) {
+            Render();
+            return;
+        }
+        if (!result.error.empty()) {
+            Render();
+            MessageBox(hwnd, result.error.c_str(), "Could Not Load Image", MB_OK | MB_ICONWARNING);
+            return;
         }
         
+        history.Record(CaptureState());
+        grid.SetSelection(result.selection, result.moments);
+        if (result.ringPoints > 0) {
+            char text[96];
+            std::snprintf(text, sizeof(text), "Image fit: edges select %zu of %zu ring points (%.0f%%)",
+                          result.ringEdgePoints, result.ringPoints,
+                          100.0 * result.ringEdgePoints / result.ringPoints);
+            imageReport = text;
+        }
+        showCircle = result.circle.radius > 0;
+        if (showCircle) {
+            bestFitCircle = result.circle;
+            lastFitSelection = grid.GetSelection();
+        }
+        Render();
+    }
+
+    /**
+     * Cancel the image detection in progress, if any.
+     */
+    void CancelImage() {
+        imageJob.Cancel();
+    }
+
+    /**
+     * Step back one selection change.
+     */
+    void Undo() {
+        SelectionState state = CaptureState();
+        if (!isDragging && history.Undo(state)) {
+            RestoreState(state);
+            Render();
+        }
+    }
+
+    /**
+     * Re-apply an undone selection change.
+     */
+    void Redo() {
+        SelectionState state = CaptureState();
+        if (!isDragging && history.Redo(state)) {
+            RestoreState(state);
+            Render();
+        }
+    }
+
+    /**
+     * Save the selection, its moments and the current fit to the session file.
+     * @return true on success
+     */
+    bool SaveSession() {
+        return session.Save(grid, bestFitCircle, showCircle);
+    }
+
+    /**
+     * Write the selection to SELECTION_SVG_FILE, one rectangle per block of
+     * selected points.
+     * @return true on success
+     */
+    bool ExportSelection() {
+        COLORREF color = GetSelectedColor();
+        unsigned rgb = (GetRValue(color) << 16) | (GetGValue(color) << 8) | GetBValue(color);
+        return WriteMaskSvg(SELECTION_SVG_FILE, grid.GetSelection().GetBits(), Settings::Current().CellSize(), rgb);
+    }
+
+    /**
+     * Toggle drawing the previous fit and its points alongside the current one.
+     */
+    void TogglePrevious() {
+        showPrevious = !showPrevious;
         Render();
     }
 
@@ -103,8 +644,10 @@ public:
      * Clear all selected points and hide circle.
      */
     void Clear() {
+        history.Record(CaptureState());
         grid.Clear();
         showCircle = false;
+        imageReport.clear();
         Render();
     }
 };
@@ -112,6 +655,14 @@ public:
 Application* g_app = nullptr;
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // Settings come from Problem2.cfg and the command line, before anything
+    // uses them; what is left of the command line is an image to open
+    std::string imagePath, error;
+    if (!Settings::Current().ParseCommandLine(lpCmdLine ? lpCmdLine : "", imagePath, error)) {
+        MessageBox(NULL, error.c_str(), "Invalid Settings", MB_OK | MB_ICONERROR);
+        return 1;
+    }
+    
     // Create application instance
     Application app;
     g_app = &app;
@@ -128,14 +679,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     RegisterClass(&wc);
     
     // Calculate window size to account for borders
-    RECT windowRect = {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+    RECT windowRect = {0, 0, Settings::Current().windowWidth, Settings::Current().windowHeight};
     AdjustWindowRect(&windowRect, WS_OVERLAPPEDWINDOW, FALSE);
     
     // Create window
     HWND hwnd = CreateWindowEx(
         0,
         CLASS_NAME,
-        "Problem 2 - Click Points, Press G for Circle, C to Clear",
+        "Problem 2 - Click Points (P/R/B/L Tools), Press G for Circle, C to Clear",
         WS_OVERLAPPEDWINDOW,
         CW_USEDEFAULT, CW_USEDEFAULT,
         windowRect.right - windowRect.left,
@@ -156,6 +707,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     
     app.Render();
     
+    // An image on the command line replaces the restored selection
+    if (!imagePath.empty()) {
+        app.DetectImage(hwnd, imagePath);
+    }
+    
     MSG msg = {};
     while (GetMessage(&msg, NULL, 0, 0)) {
         TranslateMessage(&msg);
@@ -168,9 +724,18 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
         case WM_DESTROY:
+            if (g_app) {
+                g_app->SaveSession();
+            }
             PostQuitMessage(0);
             return 0;
             
+        case WM_IMAGE_DETECTED:
+            if (g_app) {
+                g_app->FinishImage(hwnd);
+            }
+            return 0;
+            
         case WM_PAINT: {
             PAINTSTRUCT ps;
             BeginPaint(hwnd, &ps);
@@ -182,11 +747,34 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         }
         
         case WM_LBUTTONDOWN: {
-            int x = LOWORD(lParam);
-            int y = HIWORD(lParam);
+            int x = GET_X_LPARAM(lParam);
+            int y = GET_Y_LPARAM(lParam);
+            
+            SelectionMode mode = SelectionMode::Set;
+            if (wParam & MK_CONTROL) {
+                mode = SelectionMode::Clear;
+            } else if (wParam & MK_SHIFT) {
+                mode = SelectionMode::Toggle;
+            }
             
             if (g_app) {
-                g_app->OnMouseDown(x, y);
+                SetCapture(hwnd);
+                g_app->OnMouseDown(x, y, mode);
+            }
+            return 0;
+        }
+        
+        case WM_MOUSEMOVE: {
+            if (g_app && (wParam & MK_LBUTTON)) {
+                g_app->OnMouseMove(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
+            }
+            return 0;
+        }
+        
+        case WM_LBUTTONUP: {
+            if (g_app) {
+                ReleaseCapture();
+                g_app->OnMouseUp(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
             }
             return 0;
         }
@@ -204,6 +792,30 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                     g_app->Clear();
                 }
             }
+            else if (g_app) {
+                switch (key) {
+                    case 0x1A: g_app->Undo(); break;  // Ctrl+Z
+                    case 0x19: g_app->Redo(); break;  // Ctrl+Y
+                    case 0x1B: g_app->CancelImage(); break;  // Esc
+                    case 'v': case 'V': g_app->TogglePrevious(); break;
+                    case 's': case 'S':
+                        if (!g_app->SaveSession()) {
+                            MessageBox(hwnd, "Could not save the session file.", "Save Failed",
+                                       MB_OK | MB_ICONWARNING);
+                        }
+                        break;
+                    case 'e': case 'E':
+                        if (!g_app->ExportSelection()) {
+                            MessageBox(hwnd, "Could not write the SVG file.", "Export Failed",
+                                       MB_OK | MB_ICONWARNING);
+                        }
+                        break;
+                    case 'p': case 'P': g_app->SetTool(SelectionTool::Point);     break;
+                    case 'r': case 'R': g_app->SetTool(SelectionTool::Rectangle); break;
+                    case 'b': case 'B': g_app->SetTool(SelectionTool::Brush);     break;
+                    case 'l': case 'L': g_app->SetTool(SelectionTool::Lasso);     break;
+                }
+            }
             return 0;
         }
     }
@@ -0,0 +1,502 @@
+/**
+ * Delta Stream
+ *
+ * Compact change log of a selection bitset and the fitted shape, for a
+ * recorder, a remote viewer or a test oracle to replay the state with
+ * bandwidth proportional to each change.
+ *
+ * The encoder keeps an O(1) snapshot of the bitset it last published and
+ * diffs the next one against it. Tiles the two still share were not edited
+ * in between and are skipped without reading their words, so an update
+ * costs time proportional to the tiles it touched. Changed bits go out as
+ * run-length encoded set and clear runs per row, with LEB128 varints.
+ *
+ * Records pass through a single-producer, single-consumer lock-free ring.
+ * The producer never waits: a record that does not fit is dropped, and
+ * the next one is a keyframe carrying the whole state, which the consumer
+ * recognizes from the gap in sequence numbers.
+ *
+ * Record format (integers are varints, shape parameters raw doubles):
+ *   record = size type sequence [rows cols] shape rowCount row*
+ *   type   = 0 for a delta, 1 for a keyframe (rows and cols follow; the
+ *            state is cleared before its runs are applied)
+ *   shape  = 0 if unchanged, else 1 + parameter count, then the parameters
+ *   row    = rowGap runCount (gap ((length << 1) | set))*
+ * rowGap is the distance from the previous changed row (the first is
+ * row + 1), so it is at least 1; each gap is measured from the end of the
+ * previous run. A keyframe's rows and cols are at most MAX_DELTA_SIDE.
+ *
+ */
+
+#pragma once
+#include "TiledBitset.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+constexpr int MAX_SHAPE_PARAMS = 8;
+constexpr uint64_t MAX_DELTA_SIDE = 1 << 16;    // Rows or columns of a keyframe
+constexpr uint64_t MAX_DELTA_RECORD = 1 << 30;  // Bytes of a recorded record
+
+inline void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Read a varint at data[pos], advancing pos; false if it runs past size
+inline bool GetVarint(const uint8_t* data, size_t size, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < size; shift += 7) {
+        uint8_t byte = data[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Byte ring for one producer thread and one consumer thread. Each record is
+// stored behind its varint size and published by a single release store, so
+// the consumer only ever sees whole records. Neither side takes a lock.
+class DeltaRing {
+private:
+    std::vector<uint8_t> buffer;
+    size_t mask;
+
+    // Monotonic byte counts; the producer writes head, the consumer tail
+    alignas(64) std::atomic<size_t> head;
+    size_t cachedTail;  // Producer's last view of tail
+    alignas(64) std::atomic<size_t> tail;
+    size_t cachedHead;  // Consumer's last view of head
+
+    void CopyIn(size_t at, const uint8_t* data, size_t n) {
+        size_t offset = at & mask;
+        size_t first = std::min(n, buffer.size() - offset);
+        std::memcpy(buffer.data() + offset, data, first);
+        std::memcpy(buffer.data(), data + first, n - first);
+    }
+
+    void CopyOut(size_t at, uint8_t* data, size_t n) const {
+        size_t offset = at & mask;
+        size_t first = std::min(n, buffer.size() - offset);
+        std::memcpy(data, buffer.data() + offset, first);
+        std::memcpy(data + first, buffer.data(), n - first);
+    }
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit DeltaRing(size_t capacity) : head(0), cachedTail(0), tail(0), cachedHead(0) {
+        size_t size = 64;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    size_t Capacity() const { return buffer.size(); }
+
+    // Producer: append one record, or return false at once if it does not fit
+    bool TryPush(const uint8_t* record, size_t n) {
+        uint8_t prefix[10];
+        size_t prefixSize = 0;
+        for (uint64_t value = n; ; value >>= 7) {
+            prefix[prefixSize++] = static_cast<uint8_t>(value >= 0x80 ? (value | 0x80) : value);
+            if (value < 0x80) {
+                break;
+            }
+        }
+
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h + prefixSize + n - cachedTail > buffer.size()) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h + prefixSize + n - cachedTail > buffer.size()) {
+                return false;
+            }
+        }
+        CopyIn(h, prefix, prefixSize);
+        CopyIn(h + prefixSize, record, n);
+        head.store(h + prefixSize + n, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: take the oldest record, or return false if there is none
+    bool TryPop(std::vector<uint8_t>& record) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t == cachedHead) {
+                return false;
+            }
+        }
+
+        uint64_t n = 0;
+        for (int shift = 0; ; shift += 7) {
+            uint8_t byte = buffer[t++ & mask];
+            n |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        record.resize(n);
+        CopyOut(t, record.data(), n);
+        tail.store(t + n, std::memory_order_release);
+        return true;
+    }
+};
+
+// Producer side: diffs each published state against the previous one and
+// pushes the record to the ring
+class DeltaEncoder {
+private:
+    DeltaRing& ring;
+    TiledBitset last;          // State as of the last record the ring took
+    double shape[MAX_SHAPE_PARAMS];
+    int shapeCount;
+    bool shapeChanged;
+    bool resync;               // Next record must be a keyframe
+    uint64_t sequence;
+    size_t dropped;
+    size_t keyframes;
+    std::vector<uint8_t> record;
+
+    // Row runs of before ^ after, merged across words, as (gap, length, set)
+    void EncodeRow(const TiledBitset& before, const TiledBitset& after, int i,
+                   const std::vector<int>& words, std::vector<uint8_t>& runs, int& runCount) {
+        int cursor = 0;                 // End of the last run written
+        int openBegin = -1, openEnd = -1;
+        bool openSet = false;
+        auto flush = [&]() {
+            if (openBegin >= 0) {
+                PutVarint(runs, openBegin - cursor);
+                PutVarint(runs, (static_cast<uint64_t>(openEnd - openBegin) << 1) | (openSet ? 1 : 0));
+                cursor = openEnd;
+                runCount++;
+            }
+        };
+
+        for (int w : words) {
+            uint64_t old = before.Word(i, w);
+            uint64_t now = after.Word(i, w);
+            uint64_t changed = old ^ now;
+            int base = w * 64;
+            while (changed) {
+                int begin = __builtin_ctzll(changed);
+                bool set = (now >> begin) & 1;
+                uint64_t same = (set ? now : old) & changed;
+                uint64_t rest = ~(same >> begin);
+                int length = rest ? __builtin_ctzll(rest) : 64 - begin;
+                if (openEnd == base + begin && openSet == set) {
+                    openEnd += length;  // Continues a run from the previous word
+                } else {
+                    flush();
+                    openBegin = base + begin;
+                    openEnd = base + begin + length;
+                    openSet = set;
+                }
+                changed &= (length + begin == 64) ? 0 : ~0ULL << (begin + length);
+            }
+        }
+        flush();
+    }
+
+    // Record of the changes from before to current; false if nothing changed
+    bool Encode(const TiledBitset& before, const TiledBitset& current, bool keyframe) {
+        record.clear();
+        record.push_back(keyframe ? 1 : 0);
+        PutVarint(record, sequence);
+        if (keyframe) {
+            PutVarint(record, current.Rows());
+            PutVarint(record, current.Cols());
+        }
+        if (shapeChanged || keyframe) {
+            record.push_back(static_cast<uint8_t>(1 + shapeCount));
+            for (int k = 0; k < shapeCount; k++) {
+                uint8_t bytes[sizeof(double)];
+                std::memcpy(bytes, &shape[k], sizeof(double));
+                record.insert(record.end(), bytes, bytes + sizeof(double));
+            }
+        } else {
+            record.push_back(0);
+        }
+
+        std::vector<uint8_t> rows;
+        std::vector<uint8_t> runs;
+        std::vector<int> words;
+        int rowCount = 0;
+        int previousRow = -1;
+        int tileRows = (current.Rows() + TiledBitset::TILE_BITS - 1) / TiledBitset::TILE_BITS;
+        for (int tileRow = 0; tileRow < tileRows; tileRow++) {
+            int top = tileRow * TiledBitset::TILE_BITS;
+            words.clear();
+            for (int w = 0; w < current.WordsPerRow(); w++) {
+                if (!current.SharesTile(before, top, w)) {
+                    words.push_back(w);  // Edited since before (or never shared)
+                }
+            }
+            if (words.empty()) {
+                continue;
+            }
+            int bottom = std::min(top + TiledBitset::TILE_BITS, current.Rows());
+            for (int i = top; i < bottom; i++) {
+                runs.clear();
+                int runCount = 0;
+                EncodeRow(before, current, i, words, runs, runCount);
+                if (runCount == 0) {
+                    continue;
+                }
+                PutVarint(rows, i - previousRow);
+                PutVarint(rows, runCount);
+                rows.insert(rows.end(), runs.begin(), runs.end());
+                previousRow = i;
+                rowCount++;
+            }
+        }
+        if (!keyframe && rowCount == 0 && !shapeChanged) {
+            return false;
+        }
+        PutVarint(record, rowCount);
+        record.insert(record.end(), rows.begin(), rows.end());
+        return true;
+    }
+
+public:
+    explicit DeltaEncoder(DeltaRing& ring)
+        : ring(ring), shapeCount(0), shapeChanged(false), resync(true),
+          sequence(0), dropped(0), keyframes(0) {}
+
+    // Fitted shape to send with the next record; count 0 for none
+    void SetShape(const double* params, int count) {
+        count = std::min(count, MAX_SHAPE_PARAMS);
+        if (count <= 0) {
+            ClearShape();
+            return;
+        }
+        if (count == shapeCount && std::equal(params, params + count, shape)) {
+            return;
+        }
+        std::copy(params, params + count, shape);
+        shapeCount = count;
+        shapeChanged = true;
+    }
+
+    // No fitted shape to send with the next record
+    void ClearShape() {
+        shapeChanged = shapeChanged || shapeCount != 0;
+        shapeCount = 0;
+    }
+
+    // Push the changes since the last published state, if any. Never waits;
+    // returns false if the ring was full and the record was dropped.
+    bool Publish(const TiledBitset& current) {
+        bool keyframe = resync;
+        if (!Encode(keyframe ? TiledBitset(current.Rows(), current.Cols(), current.GetLayout()) : last,
+                    current, keyframe)) {
+            return true;
+        }
+        if (!ring.TryPush(record.data(), record.size())) {
+            resync = true;
+            dropped++;
+            return false;
+        }
+        if (keyframe) {
+            keyframes++;
+        }
+        resync = false;
+        shapeChanged = false;
+        sequence++;
+        last = current;  // O(1); later edits copy only the tiles they touch
+        return true;
+    }
+
+    size_t Dropped() const { return dropped; }
+    size_t Keyframes() const { return keyframes; }
+};
+
+// Consumer side: rebuilds the state from records. After a gap in sequence
+// numbers it ignores deltas until the next keyframe.
+class DeltaReplay {
+private:
+    TiledBitset bits;
+    std::vector<double> shape;
+    uint64_t expected;
+    bool synced;
+
+    void ApplyRun(int i, int begin, int end, bool set) {
+        for (int w = begin / 64; w <= (end - 1) / 64; w++) {
+            int base = w * 64;
+            int b = std::max(begin - base, 0);
+            int e = std::min(end - base, 64);
+            uint64_t high = (e == 64) ? ~0ULL : ((1ULL << e) - 1);
+            uint64_t runMask = high & ~((1ULL << b) - 1);
+            uint64_t word = bits.Word(i, w);
+            bits.SetWord(i, w, set ? (word | runMask) : (word & ~runMask));
+        }
+    }
+
+    // Apply without touching synced on failure; see Apply
+    bool ApplyRecord(const uint8_t* data, size_t size) {
+        size_t pos = 0;
+        uint64_t sequence, rows = 0, cols = 0;
+        if (size < 1) {
+            return false;
+        }
+        bool keyframe = data[pos++] == 1;
+        if (!GetVarint(data, size, pos, sequence)) {
+            return false;
+        }
+        if (keyframe) {
+            if (!GetVarint(data, size, pos, rows) || !GetVarint(data, size, pos, cols) ||
+                rows < 1 || rows > MAX_DELTA_SIDE || cols < 1 || cols > MAX_DELTA_SIDE) {
+                return false;
+            }
+        } else if (!synced || sequence != expected) {
+            return false;
+        }
+
+        if (pos >= size) {
+            return false;
+        }
+        int shapeTag = data[pos++];
+        if (shapeTag > MAX_SHAPE_PARAMS + 1 || (shapeTag && pos + (shapeTag - 1) * sizeof(double) > size)) {
+            return false;
+        }
+        if (keyframe) {
+            bits = TiledBitset(static_cast<int>(rows), static_cast<int>(cols));
+        }
+        if (shapeTag) {
+            shape.resize(shapeTag - 1);
+            for (double& value : shape) {
+                std::memcpy(&value, data + pos, sizeof(double));
+                pos += sizeof(double);
+            }
+        }
+
+        uint64_t rowCount;
+        if (!GetVarint(data, size, pos, rowCount)) {
+            return false;
+        }
+        int64_t i = -1;
+        for (uint64_t r = 0; r < rowCount; r++) {
+            uint64_t rowGap, runCount;
+            if (!GetVarint(data, size, pos, rowGap) || !GetVarint(data, size, pos, runCount) ||
+                rowGap < 1 || rowGap > MAX_DELTA_SIDE) {
+                return false;
+            }
+            i += static_cast<int64_t>(rowGap);
+            int64_t cursor = 0;
+            for (uint64_t k = 0; k < runCount; k++) {
+                uint64_t gap, lengthAndSet;
+                if (!GetVarint(data, size, pos, gap) || !GetVarint(data, size, pos, lengthAndSet) ||
+                    gap > MAX_DELTA_SIDE || (lengthAndSet >> 1) > MAX_DELTA_SIDE) {
+                    return false;
+                }
+                int64_t begin = cursor + static_cast<int64_t>(gap);
+                int64_t end = begin + static_cast<int64_t>(lengthAndSet >> 1);
+                if (i < 0 || i >= bits.Rows() || begin < 0 || end > bits.Cols() || begin >= end) {
+                    return false;
+                }
+                ApplyRun(static_cast<int>(i), static_cast<int>(begin), static_cast<int>(end), lengthAndSet & 1);
+                cursor = end;
+            }
+        }
+        synced = true;
+        expected = sequence + 1;
+        return true;
+    }
+
+public:
+    DeltaReplay() : expected(0), synced(false) {}
+
+    // Apply one record (without its size prefix). Returns false if it was
+    // skipped while waiting for a keyframe, or is malformed; either way the
+    // deltas that follow are skipped until the next keyframe, since a
+    // malformed record may have been applied in part.
+    bool Apply(const uint8_t* data, size_t size) {
+        if (!ApplyRecord(data, size)) {
+            synced = false;
+            return false;
+        }
+        return true;
+    }
+
+    bool Synced() const { return synced; }
+    const TiledBitset& GetBits() const { return bits; }
+    const std::vector<double>& GetShape() const { return shape; }
+
+    // Read the next size-prefixed record of a recorded stream
+    static bool ReadRecord(FILE* file, std::vector<uint8_t>& record) {
+        uint64_t n = 0;
+        for (int shift = 0; ; shift += 7) {
+            int byte = std::fgetc(file);
+            if (byte == EOF || shift >= 64) {
+                return false;
+            }
+            n |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        if (n > MAX_DELTA_RECORD) {
+            return false;
+        }
+        record.resize(n);
+        return std::fread(record.data(), 1, n, file) == n;
+    }
+};
+
+// Consumer thread that drains a ring into a file in the same size-prefixed
+// format, for DeltaReplay::ReadRecord to play back
+class DeltaRecorder {
+private:
+    DeltaRing& ring;
+    FILE* file;
+    std::atomic<bool> running;
+    std::thread worker;
+
+    void Drain() {
+        std::vector<uint8_t> record, prefix;
+        while (ring.TryPop(record)) {
+            prefix.clear();
+            PutVarint(prefix, record.size());
+            std::fwrite(prefix.data(), 1, prefix.size(), file);
+            std::fwrite(record.data(), 1, record.size(), file);
+        }
+    }
+
+public:
+    // Does nothing if the file cannot be opened
+    DeltaRecorder(DeltaRing& ring, const char* path)
+        : ring(ring), file(std::fopen(path, "wb")), running(file != nullptr) {
+        if (file) {
+            worker = std::thread([this]() {
+                while (running.load(std::memory_order_acquire)) {
+                    Drain();
+                    std::fflush(file);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+                Drain();
+            });
+        }
+    }
+
+    ~DeltaRecorder() {
+        running.store(false, std::memory_order_release);
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (file) {
+            std::fclose(file);
+        }
+    }
+
+    bool IsRecording() const { return file != nullptr; }
+};
@@ -0,0 +1,448 @@
+/**
+ * Image Edge Detection
+ *
+ * Loads grayscale images from PGM or PPM files (binary or ASCII; color is
+ * converted to luma) and finds their edges with the Canny method: Sobel
+ * gradients, non-maximum suppression along the gradient direction, then
+ * hysteresis between a low and a high threshold.
+ *
+ * The Sobel stage uses SSE2 (eight pixels per step, 16-bit lanes) when the
+ * compiler targets it and a scalar loop otherwise; both paths produce
+ * identical results. The gradient and suppression stages and the moment
+ * reduction are split across threads by rows; hysteresis is a single
+ * linear flood fill.
+ *
+ * Edges go to the fitters without an intermediate point list: the moments
+ * a fit needs are summed straight from the edge bitset, a row at a time.
+ * The image-sized buffers (gradients, labels, edge words, the edge
+ * bitset's tiles and the per-row moment sums) are kept between frames, so
+ * a stream of same-sized images allocates them only on the first; after
+ * that only the small task graphs of the parallel loops are allocated.
+ *
+ */
+
+#pragma once
+#include "Parallel.h"
+#include "TiledBitset.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct GrayImage {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;  // Row-major, one byte per pixel
+
+    GrayImage() : width(0), height(0) {}
+    GrayImage(int width, int height) : width(width), height(height),
+                                       pixels(static_cast<size_t>(width) * height, 0) {}
+};
+
+// Read a PGM (P2, P5) or PPM (P3, P6) file into a grayscale image. Samples
+// with a maxval other than 255 are rescaled to 0..255. Returns false with a
+// message on error.
+inline bool LoadPnm(const std::string& path, GrayImage& image, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = "Cannot open " + path;
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t pos = 0;
+
+    // Header fields are separated by whitespace and '#' comments
+    auto readNumber = [&](long& value) {
+        for (;;) {
+            while (pos < data.size() && std::isspace(static_cast<unsigned char>(data[pos]))) {
+                pos++;
+            }
+            if (pos < data.size() && data[pos] == '#') {
+                while (pos < data.size() && data[pos] != '\n') {
+                    pos++;
+                }
+                continue;
+            }
+            break;
+        }
+        if (pos >= data.size() || !std::isdigit(static_cast<unsigned char>(data[pos]))) {
+            return false;
+        }
+        value = 0;
+        while (pos < data.size() && std::isdigit(static_cast<unsigned char>(data[pos])) && value < 1000000) {
+            value = value * 10 + (data[pos++] - '0');
+        }
+        return true;
+    };
+
+    if (data.size() < 2 || data[0] != 'P' || !std::strchr("2356", data[1])) {
+        error = path + " is not a PGM or PPM file";
+        return false;
+    }
+    char format = data[1];
+    pos = 2;
+    long width, height, maxval;
+    if (!readNumber(width) || !readNumber(height) || !readNumber(maxval) ||
+        width < 1 || height < 1 || width > 65536 || height > 65536 || maxval < 1 || maxval > 65535) {
+        error = path + " has a bad header";
+        return false;
+    }
+
+    bool color = (format == '3' || format == '6');
+    bool binary = (format == '5' || format == '6');
+    size_t samples = static_cast<size_t>(width) * height * (color ? 3 : 1);
+    size_t sampleBytes = maxval > 255 ? 2 : 1;
+    std::vector<long> values;
+    if (binary) {
+        pos++;  // Single whitespace byte after maxval
+        if (data.size() < pos || data.size() - pos < samples * sampleBytes) {
+            error = path + " is truncated";
+            return false;
+        }
+    } else {
+        values.resize(samples);
+        for (size_t k = 0; k < samples; k++) {
+            if (!readNumber(values[k])) {
+                error = path + " is truncated";
+                return false;
+            }
+        }
+    }
+
+    auto sample = [&](size_t k) -> long {
+        long v;
+        if (!binary) {
+            v = std::min(values[k], maxval);
+        } else if (sampleBytes == 2) {
+            v = (static_cast<uint8_t>(data[pos + 2 * k]) << 8) | static_cast<uint8_t>(data[pos + 2 * k + 1]);
+            v = std::min(v, maxval);
+        } else {
+            v = std::min<long>(static_cast<uint8_t>(data[pos + k]), maxval);
+        }
+        return maxval == 255 ? v : (v * 255 + maxval / 2) / maxval;
+    };
+
+    image = GrayImage(static_cast<int>(width), static_cast<int>(height));
+    for (size_t p = 0; p < image.pixels.size(); p++) {
+        long gray = color ? (77 * sample(3 * p) + 150 * sample(3 * p + 1) + 29 * sample(3 * p + 2) + 128) >> 8
+                          : sample(p);
+        image.pixels[p] = static_cast<uint8_t>(gray);
+    }
+    return true;
+}
+
+// Where an image lies on the canvas: image pixel (x, y) is centered at
+// canvas (originX + (x + 0.5) * scale, originY + (y + 0.5) * scale)
+struct ImagePlacement {
+    double scale;
+    double originX;
+    double originY;
+
+    ImagePlacement() : scale(1), originX(0), originY(0) {}
+    ImagePlacement(double scale, double originX, double originY)
+        : scale(scale), originX(originX), originY(originY) {}
+
+    // Largest placement of the image centered in a canvas
+    static ImagePlacement Fit(int width, int height, double canvasWidth, double canvasHeight) {
+        double scale = std::min(canvasWidth / width, canvasHeight / height);
+        return ImagePlacement(scale, (canvasWidth - width * scale) / 2, (canvasHeight - height * scale) / 2);
+    }
+
+    // The same placement with the canvas origin moved by (dx, dy)
+    ImagePlacement Shifted(double dx, double dy) const {
+        return ImagePlacement(scale, originX + dx, originY + dy);
+    }
+
+    double X(int x) const { return originX + (x + 0.5) * scale; }
+    double Y(int y) const { return originY + (y + 0.5) * scale; }
+};
+
+class EdgeDetector {
+private:
+    int lowThreshold;    // Gradient magnitude (|gx| + |gy|, 0..2040) a weak edge needs
+    int highThreshold;   // Gradient magnitude a strong edge needs
+    unsigned threads;
+
+    int width;
+    int height;
+    std::vector<int16_t> gradientX;
+    std::vector<int16_t> gradientY;
+    std::vector<uint16_t> magnitude;
+    std::vector<uint8_t> labels;   // NONE, WEAK, STRONG or EDGE per pixel
+    int wordsPerRow;
+    std::vector<uint64_t> edgeWords;  // Row-major edge bits
+    std::vector<size_t> stack;
+    TiledBitset edges;
+    size_t edgeCount;
+
+    enum : uint8_t { NONE = 0, WEAK = 1, STRONG = 2, EDGE = 3 };
+
+    // Sobel gradients of rows [begin, end); the one-pixel border stays zero
+    void Gradients(const GrayImage& image, int begin, int end) {
+        const int w = width;
+        for (int y = std::max(begin, 1); y < std::min(end, height - 1); y++) {
+            const uint8_t* above = &image.pixels[static_cast<size_t>(y - 1) * w];
+            const uint8_t* row = above + w;
+            const uint8_t* below = row + w;
+            int16_t* gx = &gradientX[static_cast<size_t>(y) * w];
+            int16_t* gy = &gradientY[static_cast<size_t>(y) * w];
+            uint16_t* mag = &magnitude[static_cast<size_t>(y) * w];
+            int x = 1;
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            auto load = [&](const uint8_t* p) {
+                return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+            };
+            for (; x + 9 <= w; x += 8) {
+                __m128i a0 = load(above + x - 1), a1 = load(above + x), a2 = load(above + x + 1);
+                __m128i b0 = load(row + x - 1), b2 = load(row + x + 1);
+                __m128i c0 = load(below + x - 1), c1 = load(below + x), c2 = load(below + x + 1);
+                __m128i vx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(a2, c2), _mm_slli_epi16(b2, 1)),
+                                           _mm_add_epi16(_mm_add_epi16(a0, c0), _mm_slli_epi16(b0, 1)));
+                __m128i vy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(c0, c2), _mm_slli_epi16(c1, 1)),
+                                           _mm_add_epi16(_mm_add_epi16(a0, a2), _mm_slli_epi16(a1, 1)));
+                __m128i absX = _mm_max_epi16(vx, _mm_sub_epi16(zero, vx));
+                __m128i absY = _mm_max_epi16(vy, _mm_sub_epi16(zero, vy));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(gx + x), vx);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(gy + x), vy);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(mag + x), _mm_add_epi16(absX, absY));
+            }
+#endif
+            for (; x < w - 1; x++) {
+                int vx = (above[x + 1] + 2 * row[x + 1] + below[x + 1]) - (above[x - 1] + 2 * row[x - 1] + below[x - 1]);
+                int vy = (below[x - 1] + 2 * below[x] + below[x + 1]) - (above[x - 1] + 2 * above[x] + above[x + 1]);
+                gx[x] = static_cast<int16_t>(vx);
+                gy[x] = static_cast<int16_t>(vy);
+                mag[x] = static_cast<uint16_t>(std::abs(vx) + std::abs(vy));
+            }
+        }
+    }
+
+    // Keep pixels of rows [begin, end) that are local maxima across the
+    // edge, labelled weak or strong by magnitude
+    void Suppress(int begin, int end) {
+        const int w = width;
+        for (int y = std::max(begin, 1); y < std::min(end, height - 1); y++) {
+            size_t base = static_cast<size_t>(y) * w;
+            for (int x = 1; x < w - 1; x++) {
+                size_t p = base + x;
+#if defined(__SSE2__)
+                // Most of an image is flat: skip eight weak pixels at once
+                if (x + 8 <= w - 1 && (x & 7) == 1) {
+                    __m128i m8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&magnitude[p]));
+                    if (_mm_movemask_epi8(_mm_cmplt_epi16(m8, _mm_set1_epi16(static_cast<int16_t>(lowThreshold)))) == 0xFFFF) {
+                        std::memset(&labels[p], NONE, 8);
+                        x += 7;
+                        continue;
+                    }
+                }
+#endif
+                int m = magnitude[p];
+                uint8_t label = NONE;
+                if (m >= lowThreshold) {
+                    // Neighbors along the gradient, in 45 degree sectors
+                    // (tan 22.5 ~ 0.4142)
+                    int vx = gradientX[p], vy = gradientY[p];
+                    int ax = std::abs(vx), ay = std::abs(vy);
+                    ptrdiff_t step;
+                    if (ay * 10000 <= ax * 4142) {
+                        step = 1;
+                    } else if (ax * 10000 <= ay * 4142) {
+                        step = w;
+                    } else {
+                        step = ((vx > 0) == (vy > 0)) ? w + 1 : w - 1;
+                    }
+                    // Strict on one side so a plateau keeps exactly one pixel
+                    if (m > magnitude[p - step] && m >= magnitude[p + step]) {
+                        label = m >= highThreshold ? STRONG : WEAK;
+                    }
+                }
+                labels[p] = label;
+            }
+        }
+    }
+
+    // Index of the first STRONG label at or after p, or labels.size()
+    size_t NextStrong(size_t p) const {
+        const size_t count = labels.size();
+#if defined(__SSE2__)
+        const __m128i strong = _mm_set1_epi8(STRONG);
+        for (; p + 16 <= count; p += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&labels[p]));
+            int hits = _mm_movemask_epi8(_mm_cmpeq_epi8(block, strong));
+            if (hits) {
+                return p + __builtin_ctz(hits);
+            }
+        }
+#endif
+        while (p < count && labels[p] != STRONG) {
+            p++;
+        }
+        return p;
+    }
+
+    void MarkEdge(size_t p) {
+        labels[p] = EDGE;
+        size_t y = p / width, x = p % width;
+        edgeWords[y * wordsPerRow + x / 64] |= 1ULL << (x % 64);
+        stack.push_back(p);
+    }
+
+    // Promote weak pixels connected (8-neighborhood) to strong ones, setting
+    // the bit of every edge pixel in edgeWords
+    void Hysteresis() {
+        const int w = width;
+        const ptrdiff_t offsets[8] = {-w - 1, -w, -w + 1, -1, 1, w - 1, w, w + 1};
+        std::fill(edgeWords.begin(), edgeWords.end(), 0);
+        stack.clear();
+        for (size_t p = NextStrong(0); p < labels.size(); p = NextStrong(p + 1)) {
+            MarkEdge(p);
+            while (!stack.empty()) {
+                size_t q = stack.back();
+                stack.pop_back();
+                // Labels on the border are NONE, so neighbors stay in bounds
+                for (ptrdiff_t offset : offsets) {
+                    size_t r = q + offset;
+                    if (labels[r] == WEAK || labels[r] == STRONG) {
+                        MarkEdge(r);
+                    }
+                }
+            }
+        }
+    }
+
+    // Copy the edge words into the edge bitset. Every word is written, so
+    // the tiles of the previous frame are overwritten in place rather than
+    // reallocated; only tiles a caller still shares are copied.
+    void PackEdges() {
+        if (edges.Rows() != height || edges.Cols() != width) {
+            edges = TiledBitset(height, width, TiledBitset::Layout::RowMajor);
+        }
+        edgeCount = 0;
+        for (int y = 0; y < height; y++) {
+            for (int w = 0; w < wordsPerRow; w++) {
+                uint64_t word = edgeWords[static_cast<size_t>(y) * wordsPerRow + w];
+                edges.SetWord(y, w, word);  // A zero word allocates no tile
+                edgeCount += __builtin_popcountll(word);
+            }
+        }
+    }
+
+    // Per-row sums for EdgeMoments, one buffer per calling thread and
+    // Moments type, so repeated calls reuse it
+    template <typename Moments>
+    static std::vector<Moments>& RowMomentsBuffer() {
+        static thread_local std::vector<Moments> buffer;
+        return buffer;
+    }
+
+public:
+    explicit EdgeDetector(int lowThreshold = 100, int highThreshold = 250,
+                          unsigned threads = DefaultThreadCount())
+        : lowThreshold(lowThreshold), highThreshold(highThreshold), threads(threads),
+          width(0), height(0), wordsPerRow(0), edgeCount(0) {}
+
+    // Find the edges of an image. The result stays valid until the next call.
+    const TiledBitset& Detect(const GrayImage& image) {
+        if (image.width != width || image.height != height) {
+            width = image.width;
+            height = image.height;
+            size_t count = static_cast<size_t>(width) * height;
+            gradientX.assign(count, 0);
+            gradientY.assign(count, 0);
+            magnitude.assign(count, 0);
+            labels.assign(count, NONE);
+            wordsPerRow = (width + 63) / 64;
+            edgeWords.assign(static_cast<size_t>(height) * wordsPerRow, 0);
+        }
+
+        size_t rows = static_cast<size_t>(height);
+        ParallelFor(rows, threads, [&](size_t begin, size_t end) {
+            Gradients(image, static_cast<int>(begin), static_cast<int>(end));
+        });
+        ParallelFor(rows, threads, [&](size_t begin, size_t end) {
+            Suppress(static_cast<int>(begin), static_cast<int>(end));
+        });
+        Hysteresis();
+        PackEdges();
+        return edges;
+    }
+
+    const TiledBitset& Edges() const { return edges; }
+    size_t EdgeCount() const { return edgeCount; }
+
+    // Call visit(y, begin, end) for each run of edge pixels in rows [rowBegin, rowEnd)
+    template <typename Visitor>
+    void ForEachEdgeRun(int rowBegin, int rowEnd, Visitor visit) const {
+        for (int y = rowBegin; y < rowEnd; y++) {
+            for (int w = 0; w < edges.WordsPerRow(); w++) {
+                uint64_t bits = edges.Word(y, w);
+                while (bits) {
+                    int begin = __builtin_ctzll(bits);
+                    uint64_t rest = ~(bits >> begin);
+                    int length = rest ? __builtin_ctzll(rest) : 64 - begin;
+                    visit(y, w * 64 + begin, w * 64 + begin + length);
+                    bits &= (begin + length == 64) ? 0 : (~0ULL << (begin + length));
+                }
+            }
+        }
+    }
+
+    // Sums of the edge pixels' canvas positions, for a moment-based fit.
+    // Moments needs Add(x, y) and Merge(other); each row is summed
+    // separately and the rows are merged in order, so the result does not
+    // depend on the thread count.
+    template <typename Moments>
+    Moments EdgeMoments(const ImagePlacement& placement) const {
+        // A reference, so the loop's tasks use the calling thread's buffer
+        std::vector<Moments>& rowMoments = RowMomentsBuffer<Moments>();
+        rowMoments.assign(height, Moments());
+        ParallelFor(static_cast<size_t>(height), threads, [&](size_t begin, size_t end) {
+            ForEachEdgeRun(static_cast<int>(begin), static_cast<int>(end), [&](int y, int b, int e) {
+                double py = placement.Y(y);
+                for (int x = b; x < e; x++) {
+                    rowMoments[y].Add(placement.X(x), py);
+                }
+            });
+        });
+        Moments total;
+        for (const auto& row : rowMoments) {
+            total.Merge(row);
+        }
+        return total;
+    }
+
+    // Set the cells of a grid that contain an edge pixel's canvas position,
+    // for a grid of square cells starting at the canvas origin
+    void MarkCells(const ImagePlacement& placement, double cellSize, TiledBitset& cells) const {
+        MarkCells(placement, cellSize, cells, 0, height);
+    }
+
+    // The same for the edge pixels in image rows [rowBegin, rowEnd) only, so
+    // bands of rows can be marked separately
+    void MarkCells(const ImagePlacement& placement, double cellSize, TiledBitset& cells,
+                   int rowBegin, int rowEnd) const {
+        ForEachEdgeRun(rowBegin, rowEnd, [&](int y, int b, int e) {
+            int i = static_cast<int>(std::floor(placement.Y(y) / cellSize));
+            if (i < 0 || i >= cells.Rows()) {
+                return;
+            }
+            for (int x = b; x < e; x++) {
+                int j = static_cast<int>(std::floor(placement.X(x) / cellSize));
+                if (j >= 0 && j < cells.Cols()) {
+                    cells.Set(i, j, true);
+                }
+            }
+        });
+    }
+};
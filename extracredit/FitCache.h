@@ -0,0 +1,151 @@
+/**
+ * Fit Result Cache
+ *
+ * Zobrist hashing of the selection, and a least-recently-used cache of
+ * fits keyed on the hash.
+ *
+ * Every grid point has a fixed random 64-bit key, and the hash of a
+ * selection is the XOR of the keys of its selected points. Toggling a
+ * point is one XOR, and a run of points in a row is one XOR of two prefix
+ * values, so the grid keeps the hash current as it edits. Toggling points
+ * back and forth returns to an earlier hash, and a fit of a selection seen
+ * before is then a cache lookup. Distinct selections share a hash with
+ * probability about 2^-64.
+ *
+ */
+
+#pragma once
+#include "Config.h"
+#include "Settings.h"
+#include "TiledBitset.h"
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ZobristKeys {
+private:
+    int size;  // Grid points a side
+    // prefix[i * (size + 1) + j] is the XOR of the keys of row i, columns
+    // 0 to j - 1
+    std::vector<uint64_t> prefix;
+
+    ZobristKeys() : size(Settings::Current().gridSize), prefix(static_cast<size_t>(size) * (size + 1)) {
+        // SplitMix64 from a fixed seed, so hashes are the same on every run
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (int i = 0; i < size; i++) {
+            uint64_t running = 0;
+            for (int j = 0; j <= size; j++) {
+                prefix[Index(i, j)] = running;
+                state += 0x9E3779B97F4A7C15ULL;
+                uint64_t z = state;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                running ^= z ^ (z >> 31);
+            }
+        }
+    }
+
+    size_t Index(int i, int j) const {
+        return static_cast<size_t>(i) * (size + 1) + j;
+    }
+
+public:
+    static const ZobristKeys& Get() {
+        static const ZobristKeys keys;
+        return keys;
+    }
+
+    // Key of one point
+    uint64_t Key(int i, int j) const {
+        return prefix[Index(i, j)] ^ prefix[Index(i, j + 1)];
+    }
+
+    // XOR of the keys of columns [begin, end) of row i
+    uint64_t Run(int i, int begin, int end) const {
+        return prefix[Index(i, begin)] ^ prefix[Index(i, end)];
+    }
+
+    // Hash of a whole selection, for one replaced wholesale
+    uint64_t Hash(const TiledBitset& bits) const {
+        uint64_t hash = 0;
+        for (int i = 0; i < size; i++) {
+            for (int w = 0; w < bits.WordsPerRow(); w++) {
+                uint64_t word = bits.Word(i, w);
+                while (word) {
+                    int j = w * 64 + __builtin_ctzll(word);
+                    if (j < size) {
+                        hash ^= Key(i, j);
+                    }
+                    word &= word - 1;
+                }
+            }
+        }
+        return hash;
+    }
+};
+
+template <typename Result>
+class FitCache {
+private:
+    using Entry = std::pair<uint64_t, Result>;
+
+    std::list<Entry> entries;  // Most recently used first
+    std::unordered_map<uint64_t, typename std::list<Entry>::iterator> index;
+    size_t capacity;
+    size_t hits;
+    size_t misses;
+
+public:
+    explicit FitCache(size_t capacity = FIT_CACHE_SIZE) : capacity(capacity), hits(0), misses(0) {}
+
+    // The fit of the selection with this hash: cached, or fit() and cached
+    template <typename Fit>
+    Result Get(uint64_t hash, Fit fit) {
+        auto found = index.find(hash);
+        if (found != index.end()) {
+            hits++;
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->second;
+        }
+
+        misses++;
+        Result result = fit();
+        if (capacity == 0) {
+            return result;
+        }
+        if (entries.size() == capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(hash, result);
+        index[hash] = entries.begin();
+        return result;
+    }
+
+    size_t GetHits() const { return hits; }
+    size_t GetMisses() const { return misses; }
+    size_t GetSize() const { return entries.size(); }
+
+    double HitRate() const {
+        size_t lookups = hits + misses;
+        return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+    }
+
+    // Approximate heap use: list nodes, map nodes and the bucket array
+    size_t MemoryBytes() const {
+        size_t listNode = sizeof(Entry) + 2 * sizeof(void*);
+        size_t mapNode = sizeof(typename decltype(index)::value_type) + 2 * sizeof(void*);
+        return entries.size() * listNode + index.size() * mapNode + index.bucket_count() * sizeof(void*);
+    }
+
+    // One line for the status display
+    std::string Report() const {
+        char text[96];
+        std::snprintf(text, sizeof(text), "Fit cache: %zu hits, %zu misses (%.0f%%), %zu entries, %.1f KB",
+                      hits, misses, HitRate() * 100.0, entries.size(), MemoryBytes() / 1024.0);
+        return text;
+    }
+};
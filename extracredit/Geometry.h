@@ -10,6 +10,9 @@
  * - Handles degenerate cases (collinear points)
  * - Supports arbitrary ellipse rotations
  * 
+ * The program uses these names unqualified. They live in EllipseFitting so
+ * that libgeometry can build them next to the other programs' geometry,
+ * whose Point differs from this one.
  * 
  */
 
@@ -18,6 +21,8 @@
 #include <vector>
 #include <algorithm>
 
+namespace EllipseFitting {
+
 struct Point {
     double x;
     double y;
@@ -88,6 +93,69 @@ inline void SolveLinearSystem(const std::vector<std::vector<double>>& A,
     }
 }
 
+// Ellipse two standard deviations out along the principal axes of a
+// point set with mean (mx, my) and covariance [mxx mxy; mxy myy]
+inline EllipseShape EllipseFromCovariance(double mx, double my, double mxx, double myy, double mxy) {
+    // Estimate ellipse parameters from covariance
+    double theta = 0.5 * std::atan2(2 * mxy, mxx - myy);
+    double cos_t = std::cos(theta);
+    double sin_t = std::sin(theta);
+    
+    // Compute variance along principal axes
+    double var1 = mxx * cos_t * cos_t + myy * sin_t * sin_t + 2 * mxy * cos_t * sin_t;
+    double var2 = mxx * sin_t * sin_t + myy * cos_t * cos_t - 2 * mxy * cos_t * sin_t;
+    
+    // Scale factor (2 standard deviations to encompass most points)
+    double a_axis = 2 * std::sqrt(std::abs(var1));
+    double b_axis = 2 * std::sqrt(std::abs(var2));
+    
+    // Ensure a >= b (a is semi-major axis)
+    if (b_axis > a_axis) {
+        std::swap(a_axis, b_axis);
+        theta += 3.14159265358979323846 / 2.0;
+    }
+    
+    // Validate result
+    if (std::isnan(a_axis) || std::isnan(b_axis) || std::isnan(theta) ||
+        a_axis <= 0 || b_axis <= 0 || a_axis > 10000 || b_axis > 10000) {
+        return EllipseShape();
+    }
+    
+    return EllipseShape(Point(mx, my), a_axis, b_axis, theta);
+}
+
+// Raw sums of a point set up to second order: all the covariance fit uses,
+// so a fit can be made from sums gathered without a point list
+struct PointMoments {
+    double n, sx, sy;
+    double sxx, sxy, syy;
+    
+    PointMoments() : n(0), sx(0), sy(0), sxx(0), sxy(0), syy(0) {}
+    
+    void Add(double x, double y) {
+        n += 1;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        syy += y * y;
+    }
+    
+    void Merge(const PointMoments& other) {
+        n += other.n; sx += other.sx; sy += other.sy;
+        sxx += other.sxx; sxy += other.sxy; syy += other.syy;
+    }
+    
+    // The sums of the same points moved by (dx, dy)
+    void Translate(double dx, double dy) {
+        sxx += 2 * dx * sx + n * dx * dx;
+        syy += 2 * dy * sy + n * dy * dy;
+        sxy += dx * sy + dy * sx + n * dx * dy;
+        sx += n * dx;
+        sy += n * dy;
+    }
+};
+
 // Best fit ellipse using Direct Least Squares method
 // Fits an ellipse of the form: Ax² + Bxy + Cy² + Dx + Ey + F = 0
 // with constraint B² - 4AC < 0 (ensures it's an ellipse)
@@ -230,30 +298,258 @@ inline EllipseShape FitEllipse(const std::vector<Point>& points) {
     myy /= n;
     mxy /= n;
     
-    // Estimate ellipse parameters from covariance
-    double theta = 0.5 * std::atan2(2 * mxy, mxx - myy);
-    double cos_t = std::cos(theta);
-    double sin_t = std::sin(theta);
+    return EllipseFromCovariance(mx, my, mxx, myy, mxy);
+}
+
+// The covariance fit of FitEllipse(points) for points left in the caller's
+// storage: pointAt(i) returns point i of count. Two passes, no copies.
+template <typename PointAt>
+EllipseShape FitEllipse(size_t count, PointAt pointAt) {
+    if (count < 5) {
+        return EllipseShape();
+    }
     
-    // Compute variance along principal axes
-    double var1 = mxx * cos_t * cos_t + myy * sin_t * sin_t + 2 * mxy * cos_t * sin_t;
-    double var2 = mxx * sin_t * sin_t + myy * cos_t * cos_t - 2 * mxy * cos_t * sin_t;
+    double mx = 0, my = 0;
+    for (size_t i = 0; i < count; i++) {
+        Point p = pointAt(i);
+        mx += p.x;
+        my += p.y;
+    }
+    mx /= count;
+    my /= count;
     
-    // Scale factor (2 standard deviations to encompass most points)
-    double a_axis = 2 * std::sqrt(std::abs(var1));
-    double b_axis = 2 * std::sqrt(std::abs(var2));
+    double var_x = 0, var_y = 0, covar = 0;
+    for (size_t i = 0; i < count; i++) {
+        Point p = pointAt(i);
+        double dx = p.x - mx;
+        double dy = p.y - my;
+        var_x += dx * dx;
+        var_y += dy * dy;
+        covar += dx * dy;
+    }
+    if (std::abs(var_x * var_y - covar * covar) < 1e-6) {
+        return EllipseShape();  // Points are essentially collinear
+    }
     
-    // Ensure a >= b (a is semi-major axis)
-    if (b_axis > a_axis) {
-        std::swap(a_axis, b_axis);
-        theta += 3.14159265358979323846 / 2.0;
+    return EllipseFromCovariance(mx, my, var_x / count, var_y / count, covar / count);
+}
+
+// Sums of the float points [begin, end) in float, about the block's first
+// point so that the absolute offset never enters float arithmetic. Eight
+// running sums per moment, one vector register each, each of at most
+// ELLIPSE_BLOCK / 8 terms, are added pairwise in double.
+const size_t ELLIPSE_BLOCK = 256;
+
+template <int Stride>
+PointMoments FloatBlockMoments(const float* xy, size_t begin, size_t end, size_t runtimeStride,
+                               double originX, double originY) {
+    const size_t stride = Stride > 0 ? Stride : runtimeStride;
+    const int LANES = 8;
+    const float refX = xy[begin * stride];
+    const float refY = xy[begin * stride + 1];
+    float sx[LANES] = {}, sy[LANES] = {}, sxx[LANES] = {}, sxy[LANES] = {}, syy[LANES] = {};
+    for (size_t i = begin; i < end; i += LANES) {
+        // Lanes past the end sit on the reference and add nothing
+        float x[LANES], y[LANES];
+        for (int l = 0; l < LANES; l++) {
+            bool inside = i + l < end;
+            x[l] = inside ? xy[(i + l) * stride] : refX;
+            y[l] = inside ? xy[(i + l) * stride + 1] : refY;
+        }
+        for (int l = 0; l < LANES; l++) {
+            float dx = x[l] - refX;
+            float dy = y[l] - refY;
+            sx[l] += dx;
+            sy[l] += dy;
+            sxx[l] += dx * dx;
+            sxy[l] += dx * dy;
+            syy[l] += dy * dy;
+        }
     }
     
-    // Validate result
+    auto pairwise = [](const float* v) {
+        return ((static_cast<double>(v[0]) + v[1]) + (static_cast<double>(v[2]) + v[3])) +
+               ((static_cast<double>(v[4]) + v[5]) + (static_cast<double>(v[6]) + v[7]));
+    };
+    PointMoments block;
+    block.n = static_cast<double>(end - begin);
+    block.sx = pairwise(sx);
+    block.sy = pairwise(sy);
+    block.sxx = pairwise(sxx);
+    block.sxy = pairwise(sxy);
+    block.syy = pairwise(syy);
+    block.Translate(refX - originX, refY - originY);
+    return block;
+}
+
+// Best fit ellipse from point sums; the same covariance fit as
+// FitEllipse(points), without visiting the points
+inline EllipseShape FitEllipse(const PointMoments& m) {
+    if (m.n < 5) {
+        return EllipseShape();
+    }
+    
+    double mx = m.sx / m.n;
+    double my = m.sy / m.n;
+    double var_x = m.sxx - m.sx * mx;
+    double var_y = m.syy - m.sy * my;
+    double covar = m.sxy - m.sx * my;
+    if (std::abs(var_x * var_y - covar * covar) < 1e-6) {
+        return EllipseShape();  // Points are essentially collinear
+    }
+    
+    return EllipseFromCovariance(mx, my, var_x / m.n, var_y / m.n, covar / m.n);
+}
+
+// Mixed-precision FitEllipse of count float points, x and y of point i at
+// xy[i * stride] and xy[i * stride + 1]: float loads and sums per block
+// (FloatBlockMoments), double from the block sums on. One pass, and it
+// agrees with the double fit of the same values to about 1e-6 of the axes.
+inline EllipseShape FitEllipse(const float* xy, size_t count, size_t stride = 2) {
+    if (count < 5) {
+        return EllipseShape();
+    }
+    
+    // Sum about the first point, then fit and move the center back
+    const double originX = xy[0];
+    const double originY = xy[1];
+    PointMoments m;
+    for (size_t begin = 0; begin < count; begin += ELLIPSE_BLOCK) {
+        size_t end = std::min(count, begin + ELLIPSE_BLOCK);
+        m.Merge(stride == 2 ? FloatBlockMoments<2>(xy, begin, end, stride, originX, originY)
+                            : FloatBlockMoments<0>(xy, begin, end, stride, originX, originY));
+    }
+    EllipseShape ellipse = FitEllipse(m);
+    if (ellipse.valid) {
+        ellipse.center.x += originX;
+        ellipse.center.y += originY;
+    }
+    return ellipse;
+}
+
+// Mean and covariance of a point set: all the constrained fits below use
+struct PointCovariance {
+    double mx, my;
+    double mxx, myy, mxy;
+};
+
+// Two passes over pointAt(0) .. pointAt(count - 1): the mean, then the
+// covariance about it
+template <typename PointAt>
+PointCovariance GetCovariance(size_t count, PointAt pointAt) {
+    PointCovariance c = {};
+    for (size_t i = 0; i < count; i++) {
+        Point p = pointAt(i);
+        c.mx += p.x;
+        c.my += p.y;
+    }
+    c.mx /= count;
+    c.my /= count;
+    
+    for (size_t i = 0; i < count; i++) {
+        Point p = pointAt(i);
+        double dx = p.x - c.mx;
+        double dy = p.y - c.my;
+        c.mxx += dx * dx;
+        c.myy += dy * dy;
+        c.mxy += dx * dy;
+    }
+    c.mxx /= count;
+    c.myy /= count;
+    c.mxy /= count;
+    return c;
+}
+
+inline PointCovariance GetCovariance(const PointMoments& m) {
+    PointCovariance c;
+    c.mx = m.sx / m.n;
+    c.my = m.sy / m.n;
+    c.mxx = (m.sxx - m.sx * c.mx) / m.n;
+    c.myy = (m.syy - m.sy * c.my) / m.n;
+    c.mxy = (m.sxy - m.sx * c.my) / m.n;
+    return c;
+}
+
+// The same validation as EllipseFromCovariance
+inline EllipseShape MakeEllipse(double mx, double my, double a_axis, double b_axis, double theta) {
     if (std::isnan(a_axis) || std::isnan(b_axis) || std::isnan(theta) ||
         a_axis <= 0 || b_axis <= 0 || a_axis > 10000 || b_axis > 10000) {
         return EllipseShape();
     }
-    
     return EllipseShape(Point(mx, my), a_axis, b_axis, theta);
 }
+
+// Axis-aligned ellipse: the covariance fit with the rotation fixed at 0
+// (or pi/2 when taller than wide). The axes come straight from the
+// variances along x and y, with no rotation to find.
+inline EllipseShape AxisAlignedEllipse(const PointCovariance& c) {
+    double a_axis = 2 * std::sqrt(c.mxx);
+    double b_axis = 2 * std::sqrt(c.myy);
+    if (b_axis > a_axis) {
+        return MakeEllipse(c.mx, c.my, b_axis, a_axis, 3.14159265358979323846 / 2.0);
+    }
+    return MakeEllipse(c.mx, c.my, a_axis, b_axis, 0);
+}
+
+// Ellipse with minor-to-major axis ratio aspect (0 < aspect <= 1; 1 is a
+// circle). The major axis lies along the covariance's principal direction,
+// and its length is the least-squares match of the ellipse's principal
+// variances (a^2 / 4, aspect^2 a^2 / 4) to the points'.
+inline EllipseShape FixedAspectEllipse(const PointCovariance& c, double aspect) {
+    if (!(aspect > 0 && aspect <= 1)) {
+        return EllipseShape();
+    }
+    
+    double theta = 0.5 * std::atan2(2 * c.mxy, c.mxx - c.myy);
+    double half = (c.mxx - c.myy) / 2;
+    double spread = std::sqrt(half * half + c.mxy * c.mxy);
+    double var1 = (c.mxx + c.myy) / 2 + spread;
+    double var2 = (c.mxx + c.myy) / 2 - spread;
+    double k2 = aspect * aspect;
+    double a_axis = 2 * std::sqrt((var1 + k2 * var2) / (1 + k2 * k2));
+    return MakeEllipse(c.mx, c.my, a_axis, aspect * a_axis, theta);
+}
+
+// Best fit axis-aligned ellipse (at least 4 points)
+template <typename PointAt>
+EllipseShape FitAxisAlignedEllipse(size_t count, PointAt pointAt) {
+    if (count < 4) {
+        return EllipseShape();
+    }
+    return AxisAlignedEllipse(GetCovariance(count, pointAt));
+}
+
+inline EllipseShape FitAxisAlignedEllipse(const std::vector<Point>& points) {
+    return FitAxisAlignedEllipse(points.size(), [&](size_t i) { return points[i]; });
+}
+
+inline EllipseShape FitAxisAlignedEllipse(const PointMoments& m) {
+    if (m.n < 4) {
+        return EllipseShape();
+    }
+    return AxisAlignedEllipse(GetCovariance(m));
+}
+
+// Best fit ellipse of a known aspect ratio (at least 4 points)
+template <typename PointAt>
+EllipseShape FitEllipseWithAspect(size_t count, PointAt pointAt, double aspect) {
+    if (count < 4) {
+        return EllipseShape();
+    }
+    return FixedAspectEllipse(GetCovariance(count, pointAt), aspect);
+}
+
+inline EllipseShape FitEllipseWithAspect(const std::vector<Point>& points, double aspect) {
+    return FitEllipseWithAspect(points.size(), [&](size_t i) { return points[i]; }, aspect);
+}
+
+inline EllipseShape FitEllipseWithAspect(const PointMoments& m, double aspect) {
+    if (m.n < 4) {
+        return EllipseShape();
+    }
+    return FixedAspectEllipse(GetCovariance(m), aspect);
+}
+
+}  // namespace EllipseFitting
+
+using namespace EllipseFitting;
@@ -3,14 +3,84 @@
  * 
  * Manages a 2D grid of interactive points, handling selection state
  * and coordinate transformations between pixel and grid space.
+ * A Zobrist hash of the selection is kept to key cached fits.
  * 
  */
 
 #pragma once
 #include "Config.h"
+#include "Settings.h"
 #include "Geometry.h"
+#include "TiledBitset.h"
+#include "FitCache.h"
+#include "BatchTransform.h"
+#include <algorithm>
 #include <vector>
 
+// Layout of the lattice in window pixels: GridSize() points a side,
+// CellSize() pixels apart, the first cell's corner Padding() pixels in from
+// the window's. FixedLattice makes the three compile-time constants, so
+// kernels written against a lattice fold its coordinates into the code;
+// RuntimeLattice carries any other layout to the same kernels.
+struct RuntimeLattice {
+    int gridSize;
+    int cellSize;
+    int padding;
+
+    int GridSize() const { return gridSize; }
+    int CellSize() const { return cellSize; }
+    int Padding() const { return padding; }
+};
+
+template <int Size, int Cell, int Pad>
+struct FixedLattice {
+    static constexpr int GridSize() { return Size; }
+    static constexpr int CellSize() { return Cell; }
+    static constexpr int Padding() { return Pad; }
+
+    static bool Matches(const RuntimeLattice& lattice) {
+        return lattice.gridSize == Size && lattice.cellSize == Cell && lattice.padding == Pad;
+    }
+};
+
+// Size points a side in the default window
+template <int Size>
+using DefaultWindowLattice =
+    FixedLattice<Size, (std::min(WINDOW_WIDTH, WINDOW_HEIGHT) - 2 * GRID_PADDING) / Size, GRID_PADDING>;
+
+// The layout from the settings in effect
+inline RuntimeLattice CurrentLattice() {
+    const Settings& settings = Settings::Current();
+    return RuntimeLattice{settings.gridSize, settings.CellSize(), settings.gridPadding};
+}
+
+// Call kernel(lattice) with the FixedLattice of the current layout when it
+// is a common one, the default window with GRID_SIZE, 64 or 100 points a
+// side, and with the RuntimeLattice otherwise
+template <typename Kernel>
+inline void DispatchLattice(Kernel&& kernel) {
+    RuntimeLattice lattice = CurrentLattice();
+    if (DefaultWindowLattice<GRID_SIZE>::Matches(lattice)) {
+        kernel(DefaultWindowLattice<GRID_SIZE>());
+    } else if (DefaultWindowLattice<64>::Matches(lattice)) {
+        kernel(DefaultWindowLattice<64>());
+    } else if (DefaultWindowLattice<100>::Matches(lattice)) {
+        kernel(DefaultWindowLattice<100>());
+    } else {
+        kernel(lattice);
+    }
+}
+
+// Pixel coordinate of the lattice point at a given row or column
+template <typename Lattice>
+inline double LatticeCoord(const Lattice& lattice, int index) {
+    return lattice.Padding() + index * lattice.CellSize() + lattice.CellSize() / 2.0;
+}
+
+inline double LatticeCoord(int index) {
+    return LatticeCoord(CurrentLattice(), index);
+}
+
 struct GridPoint {
     int i;  // Grid row
     int j;  // Grid column
@@ -21,80 +91,118 @@ struct GridPoint {
     
     // Get the pixel coordinates for this grid point (center of cell)
     Point GetPixelCoords() const {
-        return Point(
-            j * CELL_SIZE + CELL_SIZE / 2.0,
-            i * CELL_SIZE + CELL_SIZE / 2.0
-        );
+        return Point(LatticeCoord(j), LatticeCoord(i));
     }
 };
 
+// Storage layout of selection bits, from Z_ORDER_BITS
+inline TiledBitset::Layout SelectionLayout() {
+    return Z_ORDER_BITS ? TiledBitset::Layout::ZOrder : TiledBitset::Layout::RowMajor;
+}
+
 class Grid {
 private:
-    std::vector<std::vector<GridPoint>> points;
+    int size;               // Points a side
+    TiledBitset selection;  // Copy-on-write, so snapshots for undo are O(1)
+    uint64_t hash;          // Zobrist hash of the selection
+    size_t selectedCount;
     
 public:
-    Grid() {
-        // Initialize grid with all points unselected
-        points.resize(GRID_SIZE);
-        for (int i = 0; i < GRID_SIZE; i++) {
-            points[i].resize(GRID_SIZE);
-            for (int j = 0; j < GRID_SIZE; j++) {
-                points[i][j] = GridPoint(i, j);
-            }
-        }
+    Grid() : size(Settings::Current().gridSize), selection(size, size, SelectionLayout()), hash(0),
+             selectedCount(0) {
+        // All points start unselected
     }
     
     // Toggle a point's selection state
     void TogglePoint(int i, int j) {
-        if (i >= 0 && i < GRID_SIZE && j >= 0 && j < GRID_SIZE) {
-            points[i][j].selected = !points[i][j].selected;
+        if (i >= 0 && i < size && j >= 0 && j < size) {
+            bool selected = selection.Flip(i, j);
+            selectedCount += selected ? 1 : -1;
+            hash ^= ZobristKeys::Get().Key(i, j);
         }
     }
     
     // Check if a point is selected
     bool IsSelected(int i, int j) const {
-        if (i >= 0 && i < GRID_SIZE && j >= 0 && j < GRID_SIZE) {
-            return points[i][j].selected;
+        if (i >= 0 && i < size && j >= 0 && j < size) {
+            return selection.Get(i, j);
         }
         return false;
     }
     
     // Clear all selections
     void Clear() {
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                points[i][j].selected = false;
-            }
-        }
+        selection.Clear();
+        hash = 0;
+        selectedCount = 0;
+    }
+    
+    // O(1) snapshot of the selection, and restoring one
+    const TiledBitset& GetSelection() const { return selection; }
+    void SetSelection(const TiledBitset& snapshot) {
+        selection = snapshot;
+        hash = ZobristKeys::Get().Hash(selection);
+        selectedCount = selection.Count();
     }
     
-    // Get all selected points in pixel coordinates
+    uint64_t GetHash() const { return hash; }
+    size_t GetSelectedCount() const { return selectedCount; }
+    
+    // Get all selected points in pixel coordinates, computed directly
+    // against the current lattice
     std::vector<Point> GetSelectedPoints() const {
         std::vector<Point> selectedPoints;
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                if (points[i][j].selected) {
-                    selectedPoints.push_back(points[i][j].GetPixelCoords());
-                }
+        selectedPoints.reserve(selectedCount);
+        DispatchLattice([&](const auto& lattice) {
+            for (int i = 0, j = 0; selection.FindNext(i, j); j++) {
+                selectedPoints.push_back(Point(LatticeCoord(lattice, j), LatticeCoord(lattice, i)));
             }
-        }
+        });
         return selectedPoints;
     }
     
-    // Convert pixel coordinates to grid indices
-    static bool PixelToGrid(int x, int y, int& i, int& j) {
-        j = x / CELL_SIZE;
-        i = y / CELL_SIZE;
-        
-        if (i >= 0 && i < GRID_SIZE && j >= 0 && j < GRID_SIZE) {
-            return true;
+    // Pixel coordinate of n rows or columns at once; the lattice is the
+    // same along both axes
+    static void IndicesToPixels(const int* index, size_t n, double* coord) {
+        RuntimeLattice lattice = CurrentLattice();
+        IndicesToCoords(index, coord, n, lattice.cellSize, LatticeCoord(lattice, 0));
+    }
+    
+    // Pixel coordinates of n grid points at once (same as GetPixelCoords)
+    static void GridToPixels(const int* i, const int* j, size_t n, double* x, double* y) {
+        IndicesToPixels(j, n, x);
+        IndicesToPixels(i, n, y);
+    }
+    
+    // Nearest grid point to each of n pixel samples (clicks, stroke samples).
+    // i and j are -1 for samples nearest to no grid point. Returns the
+    // number of samples that hit the grid.
+    static size_t PixelsToGrid(const double* x, const double* y, size_t n, int* i, int* j) {
+        RuntimeLattice lattice = CurrentLattice();
+        CoordsToIndices(x, j, n, lattice.cellSize, LatticeCoord(lattice, 0), lattice.gridSize);
+        CoordsToIndices(y, i, n, lattice.cellSize, LatticeCoord(lattice, 0), lattice.gridSize);
+        size_t hits = 0;
+        for (size_t k = 0; k < n; k++) {
+            if (i[k] < 0 || j[k] < 0) {
+                i[k] = j[k] = -1;
+            } else {
+                hits++;
+            }
         }
-        return false;
+        return hits;
+    }
+    
+    // Convert pixel coordinates to the nearest grid point's indices
+    static bool PixelToGrid(int x, int y, int& i, int& j) {
+        double px = x, py = y;
+        return PixelsToGrid(&px, &py, 1, &i, &j) == 1;
     }
     
-    int GetSize() const { return GRID_SIZE; }
+    int GetSize() const { return size; }
     
-    const GridPoint& GetPoint(int i, int j) const {
-        return points[i][j];
+    GridPoint GetPoint(int i, int j) const {
+        GridPoint point(i, j);
+        point.selected = selection.Get(i, j);
+        return point;
     }
 };
@@ -0,0 +1,61 @@
+/**
+ * Undo/Redo History
+ *
+ * Stacks of application states. States are stored by value, so they should
+ * be cheap to copy; selections held in a TiledBitset share every tile that
+ * was not edited, keeping each entry proportional to what changed.
+ *
+ */
+
+#pragma once
+#include <cstddef>
+#include <deque>
+
+template <typename State>
+class History {
+private:
+    std::deque<State> undoStack;
+    std::deque<State> redoStack;
+    size_t limit;
+
+public:
+    explicit History(size_t maxEntries = 500) : limit(maxEntries) {}
+
+    // Record the state as it was before an edit. Clears the redo stack.
+    void Record(const State& before) {
+        undoStack.push_back(before);
+        if (undoStack.size() > limit) {
+            undoStack.pop_front();
+        }
+        redoStack.clear();
+    }
+
+    // Step back one edit. Returns false if there is nothing to undo.
+    bool Undo(State& current) {
+        if (undoStack.empty()) {
+            return false;
+        }
+        redoStack.push_back(current);
+        current = undoStack.back();
+        undoStack.pop_back();
+        return true;
+    }
+
+    // Re-apply an undone edit. Returns false if there is nothing to redo.
+    bool Redo(State& current) {
+        if (redoStack.empty()) {
+            return false;
+        }
+        undoStack.push_back(current);
+        current = redoStack.back();
+        redoStack.pop_back();
+        return true;
+    }
+
+    // Most recent state before the current one, or nullptr.
+    const State* Previous() const {
+        return undoStack.empty() ? nullptr : &undoStack.back();
+    }
+
+    size_t Size() const { return undoStack.size() + redoStack.size(); }
+};
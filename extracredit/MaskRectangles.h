@@ -0,0 +1,133 @@
+/**
+ * Mask Rectangles
+ *
+ * Decomposes a bitset into axis-aligned rectangles of set points, so a
+ * selection is drawn with one fill per rectangle and exported as compact
+ * vector output.
+ *
+ * The decomposition is greedy: the maximal runs of set points in each row
+ * are found a word at a time, and a run with exactly the columns of a
+ * rectangle ending in the row above extends that rectangle downward
+ * instead of starting a new one. A region then costs about one rectangle
+ * per row where its outline moves, so the count follows the boundary
+ * rather than the area: a filled rectangle is one, a filled disc r rows
+ * tall about r.
+ *
+ */
+
+#pragma once
+#include "TiledBitset.h"
+#include <cstdio>
+#include <vector>
+
+// Grid points in rows [top, bottom) and columns [left, right)
+struct CellRect {
+    int top;
+    int left;
+    int bottom;
+    int right;
+
+    CellRect() : top(0), left(0), bottom(0), right(0) {}
+    CellRect(int top, int left, int bottom, int right) : top(top), left(left), bottom(bottom), right(right) {}
+
+    size_t Area() const {
+        return static_cast<size_t>(bottom - top) * (right - left);
+    }
+};
+
+// Call visit(begin, end) for each maximal run of set points [begin, end) in
+// row i, left to right; runs may cross word boundaries
+template <typename Visitor>
+inline void ForEachRowRun(const TiledBitset& bits, int i, Visitor visit) {
+    int open = -1;  // Start of a run reaching the end of the previous word
+    for (int w = 0; w < bits.WordsPerRow(); w++) {
+        uint64_t word = bits.Word(i, w);
+        int base = w * 64;
+        if (open >= 0) {
+            if (word == ~0ULL) {
+                continue;
+            }
+            int length = __builtin_ctzll(~word);
+            visit(open, base + length);
+            open = -1;
+            word &= ~((1ULL << length) - 1);
+        }
+        while (word) {
+            int begin = __builtin_ctzll(word);
+            uint64_t rest = ~(word >> begin);
+            int length = rest ? __builtin_ctzll(rest) : 64;
+            if (begin + length >= 64) {
+                open = base + begin;
+                break;
+            }
+            visit(base + begin, base + begin + length);
+            word &= ~(((1ULL << length) - 1) << begin);
+        }
+    }
+    if (open >= 0) {
+        visit(open, bits.WordsPerRow() * 64);
+    }
+}
+
+// Call visit(rect) for each rectangle of the greedy decomposition of rows
+// [top, bottom). Every set point is in exactly one rectangle; rectangles
+// come out as they close, roughly top to bottom. Bands of rows can be
+// decomposed independently, e.g. on separate threads.
+template <typename Visitor>
+inline void ForEachMaskRectangleInRows(const TiledBitset& bits, int top, int bottom, Visitor visit) {
+    std::vector<CellRect> open, next;  // Rectangles reaching the previous row, left to right
+    for (int i = top; i < bottom; i++) {
+        next.clear();
+        size_t k = 0;
+        ForEachRowRun(bits, i, [&](int begin, int end) {
+            // Rectangles starting left of this run cannot match a later run
+            while (k < open.size() && open[k].left < begin) {
+                visit(open[k++]);
+            }
+            if (k < open.size() && open[k].left == begin && open[k].right == end) {
+                open[k].bottom = i + 1;
+                next.push_back(open[k++]);
+            } else {
+                next.push_back(CellRect(i, begin, i + 1, end));
+            }
+        });
+        while (k < open.size()) {
+            visit(open[k++]);
+        }
+        open.swap(next);
+    }
+    for (const CellRect& rect : open) {
+        visit(rect);
+    }
+}
+
+template <typename Visitor>
+inline void ForEachMaskRectangle(const TiledBitset& bits, Visitor visit) {
+    ForEachMaskRectangleInRows(bits, 0, bits.Rows(), visit);
+}
+
+inline std::vector<CellRect> MaskRectangles(const TiledBitset& bits) {
+    std::vector<CellRect> rects;
+    ForEachMaskRectangle(bits, [&](const CellRect& rect) { rects.push_back(rect); });
+    return rects;
+}
+
+// Write the set points as an SVG image with one <rect> per rectangle, each
+// point a cellSize-pixel square filled with rgb (0xRRGGBB). Returns false if
+// the file could not be written.
+inline bool WriteMaskSvg(const char* path, const TiledBitset& bits, int cellSize, unsigned rgb) {
+    FILE* file = std::fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    std::fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+                       "shape-rendering=\"crispEdges\">\n<g fill=\"#%06x\">\n",
+                 bits.Cols() * cellSize, bits.Rows() * cellSize, rgb & 0xFFFFFF);
+    ForEachMaskRectangle(bits, [&](const CellRect& rect) {
+        std::fprintf(file, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\"/>\n", rect.left * cellSize,
+                     rect.top * cellSize, (rect.right - rect.left) * cellSize, (rect.bottom - rect.top) * cellSize);
+    });
+    std::fprintf(file, "</g>\n</svg>\n");
+    bool written = !std::ferror(file);
+    return std::fclose(file) == 0 && written;
+}
@@ -0,0 +1,32 @@
+/**
+ * Parallel Loops
+ *
+ * Minimal fork-join helpers shared by the bulk builders and transforms.
+ * Chunks run as task graphs on the shared scheduler (TaskGraph.h), so
+ * batch jobs and interactive updates share one pool of threads, and a loop
+ * inside a task does not oversubscribe the machine.
+ *
+ */
+
+#pragma once
+#include "TaskGraph.h"
+#include <algorithm>
+#include <vector>
+
+// Run body(begin, end) over [0, count) split into one chunk per thread
+template <typename Body>
+inline void ParallelFor(size_t count, unsigned threads, Body body) {
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(count / 1024 + 1)));
+    if (threads == 1) {
+        body(size_t(0), count);
+        return;
+    }
+    TaskGraph chunks;
+    size_t chunk = (count + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t begin = std::min(count, t * chunk);
+        size_t end = std::min(count, begin + chunk);
+        chunks.Add([=, &body]() { body(begin, end); });
+    }
+    chunks.Run();
+}
@@ -71,26 +71,25 @@ public:
         DeleteObject(pen);
     }
     
-    // Draw grid lines
-    static void DrawGrid(HDC hdc, int gridSize, int cellSize, COLORREF color) {
+    // Draw grid lines, the first cell's corner at (origin, origin)
+    static void DrawGrid(HDC hdc, int gridSize, int cellSize, COLORREF color, int origin = 0) {
         HPEN pen = CreatePen(PS_SOLID, 1, color);
         HPEN oldPen = (HPEN)SelectObject(hdc, pen);
         
-        int width = gridSize * cellSize;
-        int height = gridSize * cellSize;
+        int end = origin + gridSize * cellSize;
         
         // Draw vertical lines
         for (int i = 0; i <= gridSize; i++) {
-            int x = i * cellSize;
-            MoveToEx(hdc, x, 0, NULL);
-            LineTo(hdc, x, height);
+            int x = origin + i * cellSize;
+            MoveToEx(hdc, x, origin, NULL);
+            LineTo(hdc, x, end);
         }
         
         // Draw horizontal lines
         for (int i = 0; i <= gridSize; i++) {
-            int y = i * cellSize;
-            MoveToEx(hdc, 0, y, NULL);
-            LineTo(hdc, width, y);
+            int y = origin + i * cellSize;
+            MoveToEx(hdc, origin, y, NULL);
+            LineTo(hdc, end, y);
         }
         
         SelectObject(hdc, oldPen);
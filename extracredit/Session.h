@@ -0,0 +1,233 @@
+/**
+ * Session Persistence
+ *
+ * Keeps the selection and the last fitted ellipse in a memory-mapped
+ * file laid out for use in place: a fixed header followed by three slots of
+ * selection tiles. Loading maps the file and hands the active slot's tiles
+ * straight to the selection bitset, so startup costs only the page faults
+ * of the tiles actually read. Saving writes a slot that is neither the
+ * active one nor the loaded one, flushes it, and then flips the header's
+ * active slot. Tiles of the loaded slot, which the live selection and undo
+ * history may still share, are never overwritten, and neither is the
+ * active slot, so a crash mid-save leaves the previous session intact.
+ *
+ */
+
+#pragma once
+#include <windows.h>
+#include "Config.h"
+#include "Settings.h"
+#include "Geometry.h"
+#include "Grid.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+// A read-write view of a whole file
+class MappedFile {
+private:
+    HANDLE file;
+    HANDLE mapping;
+    void* view;
+    size_t size;
+
+    MappedFile() : file(INVALID_HANDLE_VALUE), mapping(NULL), view(nullptr), size(0) {}
+
+public:
+    // Map the file, creating it or growing it to minSize bytes if needed.
+    // Returns nullptr on failure.
+    static std::shared_ptr<MappedFile> Open(const char* path, size_t minSize) {
+        std::shared_ptr<MappedFile> mapped(new MappedFile());
+        mapped->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                                   NULL, minSize ? OPEN_ALWAYS : OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL, NULL);
+        if (mapped->file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(mapped->file, &fileSize)) {
+            return nullptr;
+        }
+        size_t size = std::max(static_cast<size_t>(fileSize.QuadPart), minSize);
+        if (size == 0) {
+            return nullptr;
+        }
+
+        mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READWRITE,
+                                             static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                             static_cast<DWORD>(size & 0xFFFFFFFFu), NULL);
+        if (mapped->mapping == NULL) {
+            return nullptr;
+        }
+        mapped->view = MapViewOfFile(mapped->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (!mapped->view) {
+            return nullptr;
+        }
+        mapped->size = size;
+        return mapped;
+    }
+
+    ~MappedFile() {
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    uint8_t* Data() { return static_cast<uint8_t*>(view); }
+    size_t Size() const { return size; }
+
+    // Write a range of the view back to disk
+    bool Flush(size_t offset, size_t bytes) {
+        return FlushViewOfFile(Data() + offset, bytes) && FlushFileBuffers(file);
+    }
+};
+
+// One saved state: where its selection tiles are, plus the values that go with them
+struct SessionSlot {
+    uint64_t offset;           // Byte offset of the selection tiles
+    double fitCenterX;         // Last fit (pixel coordinates)
+    double fitCenterY;
+    double fitA;               // Semi-major axis
+    double fitB;               // Semi-minor axis
+    double fitAngle;           // Rotation in radians
+    uint32_t fitValid;
+    uint32_t showFit;
+};
+
+// File header, used in place. Plain fixed-size fields only.
+struct SessionHeader {
+    char magic[8];             // "ECSESS"
+    uint32_t version;
+    uint32_t activeSlot;       // Slot holding the current state
+    int32_t rows;
+    int32_t cols;
+    uint32_t layout;           // TiledBitset::Layout of the tiles
+    int32_t cellSize;          // Lattice layout in pixels, which the
+    int32_t padding;           // saved fit's coordinates depend on
+    uint32_t reserved;
+    uint64_t slotBytes;
+    SessionSlot slots[3];      // Active, loaded and one to write next
+};
+
+class Session {
+private:
+    static constexpr uint32_t VERSION = 4;
+    static constexpr size_t HEADER_BYTES = 4096;  // Keeps tile slots page aligned
+
+    std::string path;
+    std::shared_ptr<MappedFile> file;
+    int loadedSlot;  // Slot the live selection may share tiles with, or -1
+
+    static size_t SlotBytes() {
+        int size = Settings::Current().gridSize;
+        return TiledBitset::TileWordCount(size, size) * sizeof(uint64_t);
+    }
+
+    static size_t FileBytes() {
+        return HEADER_BYTES + 3 * SlotBytes();
+    }
+
+    SessionHeader* Header() {
+        return reinterpret_cast<SessionHeader*>(file->Data());
+    }
+
+    bool IsValid() {
+        if (!file || file->Size() < FileBytes()) {
+            return false;
+        }
+        const SessionHeader* header = Header();
+        const Settings& settings = Settings::Current();
+        return std::memcmp(header->magic, "ECSESS", 7) == 0 &&
+               header->version == VERSION &&
+               header->rows == settings.gridSize && header->cols == settings.gridSize &&
+               header->cellSize == settings.CellSize() && header->padding == settings.gridPadding &&
+               header->layout == static_cast<uint32_t>(SelectionLayout()) &&
+               header->activeSlot < 3 && header->slotBytes == SlotBytes() &&
+               header->slots[0].offset + SlotBytes() <= file->Size() &&
+               header->slots[1].offset + SlotBytes() <= file->Size() &&
+               header->slots[2].offset + SlotBytes() <= file->Size();
+    }
+
+public:
+    explicit Session(const std::string& path) : path(path), loadedSlot(-1) {}
+
+    // Restore a saved session into the grid. The selection tiles are used
+    // straight from the mapped file. Returns false if there is no usable session.
+    bool Load(Grid& grid, EllipseShape& fit, bool& showFit) {
+        file = MappedFile::Open(path.c_str(), 0);
+        if (!IsValid()) {
+            file.reset();
+            return false;
+        }
+
+        const SessionHeader* header = Header();
+        loadedSlot = static_cast<int>(header->activeSlot);
+        const SessionSlot& slot = header->slots[loadedSlot];
+        uint64_t* tiles = reinterpret_cast<uint64_t*>(file->Data() + slot.offset);
+
+        TiledBitset bits = TiledBitset::Adopt(header->rows, header->cols, SelectionLayout(), file, tiles);
+        grid.SetSelection(bits);
+        fit = EllipseShape(Point(slot.fitCenterX, slot.fitCenterY), slot.fitA, slot.fitB, slot.fitAngle);
+        fit.valid = slot.fitValid != 0;
+        showFit = slot.showFit != 0;
+        return true;
+    }
+
+    // Save the grid and fit. Writes the slot that is neither active nor
+    // loaded, flushes it, then publishes it by flipping the header's active slot.
+    bool Save(const Grid& grid, const EllipseShape& fit, bool showFit) {
+        if (!file || !IsValid()) {
+            // New or incompatible file: lay it out from scratch
+            loadedSlot = -1;
+            file = MappedFile::Open(path.c_str(), FileBytes());
+            if (!file) {
+                return false;
+            }
+            SessionHeader* header = Header();
+            *header = SessionHeader();
+            std::memcpy(header->magic, "ECSESS", 7);
+            header->version = VERSION;
+            header->activeSlot = 1;
+            header->rows = Settings::Current().gridSize;
+            header->cols = Settings::Current().gridSize;
+            header->cellSize = Settings::Current().CellSize();
+            header->padding = Settings::Current().gridPadding;
+            header->layout = static_cast<uint32_t>(SelectionLayout());
+            header->slotBytes = SlotBytes();
+            header->slots[0].offset = HEADER_BYTES;
+            header->slots[1].offset = HEADER_BYTES + SlotBytes();
+            header->slots[2].offset = HEADER_BYTES + 2 * SlotBytes();
+        }
+
+        SessionHeader* header = Header();
+        // Never write the published state, nor the loaded one the live tiles
+        // may still share
+        uint32_t target = 0;
+        while (target == header->activeSlot || static_cast<int>(target) == loadedSlot) {
+            target++;
+        }
+        SessionSlot& slot = header->slots[target];
+
+        grid.GetSelection().CopyTiles(reinterpret_cast<uint64_t*>(file->Data() + slot.offset));
+        slot.fitCenterX = fit.center.x;
+        slot.fitCenterY = fit.center.y;
+        slot.fitA = fit.a;
+        slot.fitB = fit.b;
+        slot.fitAngle = fit.angle;
+        slot.fitValid = fit.valid ? 1 : 0;
+        slot.showFit = showFit ? 1 : 0;
+        if (!file->Flush(static_cast<size_t>(slot.offset), SlotBytes()) ||
+            !file->Flush(0, sizeof(SessionHeader))) {
+            return false;
+        }
+
+        // Publish the new state only once it is on disk
+        header->activeSlot = target;
+        return file->Flush(0, sizeof(SessionHeader));
+    }
+};
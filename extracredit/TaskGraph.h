@@ -0,0 +1,449 @@
+/**
+ * Task Graph Scheduler
+ *
+ * Work-stealing thread pool that runs graphs of tasks with dependencies.
+ * Each worker owns a deque of ready tasks: it pushes and pops at the back,
+ * so it goes on with the task it just made ready while its data is still
+ * in cache, and idle workers steal from the front of the others' deques.
+ *
+ * A running task may spawn child tasks. It then completes, and releases
+ * the tasks that depend on it, only once its children have: the rest of
+ * the task is a continuation of the children. A stage can therefore fan
+ * out into pieces whose number is only known when it runs.
+ *
+ * A thread waiting for a graph runs ready tasks instead of blocking, so
+ * graphs can be run from inside tasks (a ParallelFor in a stage) without
+ * deadlock, and the UI thread works alongside the pool while it waits. A
+ * worker runs any ready task; any other thread runs only the tasks of the
+ * graph it waits for, so a UI thread never picks up a long background job.
+ * Tasks posted on their own go to the workers' deques in turn.
+ * Each worker counts the tasks it ran, how many it stole and the time it
+ * spent in them, for utilization reports.
+ *
+ */
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+inline unsigned DefaultThreadCount() {
+    unsigned threads = std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+class TaskGraph;
+
+class TaskScheduler {
+public:
+    struct WorkerStats {
+        uint64_t tasks;      // Tasks run
+        uint64_t steals;     // Of those, taken from another deque
+        double busySeconds;  // Time spent running tasks
+        double utilization;  // busySeconds over the time since ResetStats
+    };
+
+private:
+    friend class TaskGraph;
+    typedef std::chrono::steady_clock Clock;
+
+    struct Task {
+        std::function<void()> work;
+        std::vector<Task*> successors;
+        std::atomic<int> dependencies{0};   // Predecessors not yet complete
+        std::atomic<int> unfinished{0};     // This task and its live children
+        int predecessorCount = 0;
+        Task* parent = nullptr;             // Task that spawned this one
+        std::atomic<int>* remaining = nullptr;  // Graph nodes left, for graph nodes
+        const void* graph = nullptr;        // Graph of this task or its spawner, if any
+        TaskScheduler* scheduler = nullptr;
+    };
+
+    // Ready tasks behind a spinlock, held only to push or pop a pointer.
+    // The owner works at the back, thieves at the front.
+    struct alignas(64) Queue {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        std::deque<Task*> tasks;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<uint64_t> busyNanoseconds{0};
+
+        void Lock() {
+            while (lock.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+        void Unlock() { lock.clear(std::memory_order_release); }
+    };
+
+    // What the calling thread is doing for which scheduler
+    struct ThreadState {
+        TaskScheduler* scheduler = nullptr;  // Set for this scheduler's workers
+        size_t queue = 0;
+        Task* task = nullptr;                // Task running on this thread
+    };
+
+    static ThreadState& Current() {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    // One queue per worker, then one shared by every other thread
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int64_t> queued{0};     // Tasks in all queues
+    std::atomic<size_t> nextPost{0};    // Worker queue for the next posted task
+    std::atomic<int> sleeping{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int64_t> statsStart;    // Clock ticks at the last ResetStats
+
+    size_t OwnQueue() const {
+        const ThreadState& state = Current();
+        return state.scheduler == this ? state.queue : workers.size();
+    }
+
+    void Push(Task* task) {
+        PushTo(OwnQueue(), task);
+    }
+
+    void PushTo(size_t index, Task* task) {
+        Queue& queue = *queues[index];
+        queue.Lock();
+        queue.tasks.push_back(task);
+        queue.Unlock();
+        queued.fetch_add(1);
+        if (sleeping.load() > 0) {
+            // Taking the lock orders this with a worker between its check
+            // of queued and its wait, so the wakeup cannot be lost
+            std::lock_guard<std::mutex> guard(sleepMutex);
+            wake.notify_one();
+        }
+    }
+
+    // Own queue's newest task, else the oldest task of another queue
+    bool TryTake(size_t self, Task*& task, bool& stolen) {
+        if (queued.load(std::memory_order_relaxed) <= 0) {
+            return false;
+        }
+        for (size_t k = 0; k < queues.size(); k++) {
+            size_t index = (self + k) % queues.size();
+            Queue& queue = *queues[index];
+            queue.Lock();
+            if (!queue.tasks.empty()) {
+                if (k == 0) {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                } else {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                }
+                queue.Unlock();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                stolen = k != 0;
+                return true;
+            }
+            queue.Unlock();
+        }
+        return false;
+    }
+
+    // A task of graph from any queue: the newest of the calling thread's
+    // queue, else the oldest of a worker's
+    bool TryTakeFrom(const void* graph, size_t self, Task*& task, bool& stolen) {
+        if (queued.load(std::memory_order_relaxed) <= 0) {
+            return false;
+        }
+        for (size_t k = 0; k < queues.size(); k++) {
+            size_t index = (self + k) % queues.size();
+            Queue& queue = *queues[index];
+            queue.Lock();
+            auto match = [graph](const Task* t) { return t->graph == graph; };
+            auto found = queue.tasks.end();
+            if (k == 0) {
+                auto newest = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(), match);
+                if (newest != queue.tasks.rend()) {
+                    found = std::prev(newest.base());
+                }
+            } else {
+                found = std::find_if(queue.tasks.begin(), queue.tasks.end(), match);
+            }
+            if (found != queue.tasks.end()) {
+                task = *found;
+                queue.tasks.erase(found);
+                queue.Unlock();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                stolen = k != 0;
+                return true;
+            }
+            queue.Unlock();
+        }
+        return false;
+    }
+
+    void Execute(Task* task, size_t self, bool stolen) {
+        ThreadState& state = Current();
+        Task* outer = state.task;
+        state.task = task;
+        Clock::time_point start = Clock::now();
+        task->work();
+        uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        state.task = outer;
+
+        Queue& queue = *queues[self];
+        queue.busyNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        queue.executed.fetch_add(1, std::memory_order_relaxed);
+        if (stolen) {
+            queue.stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        Complete(task);
+    }
+
+    // Called once for a task's own work and once per child; the last call
+    // releases its successors and completes its parent or graph node
+    void Complete(Task* task) {
+        if (task->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        for (Task* successor : task->successors) {
+            if (successor->dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                Push(successor);
+            }
+        }
+        if (task->parent) {
+            Task* parent = task->parent;
+            delete task;  // Children belong to no graph
+            Complete(parent);
+        } else if (task->remaining) {
+            task->remaining->fetch_sub(1, std::memory_order_release);
+        } else {
+            delete task;  // Posted on its own
+        }
+    }
+
+    void WorkerLoop(size_t self) {
+        ThreadState& state = Current();
+        state.scheduler = this;
+        state.queue = self;
+        Task* task;
+        bool stolen;
+        while (!stopping.load(std::memory_order_relaxed)) {
+            bool found = false;
+            for (int spin = 0; spin < 64 && !found; spin++) {
+                found = TryTake(self, task, stolen);
+                if (!found) {
+                    std::this_thread::yield();
+                }
+            }
+            if (found) {
+                Execute(task, self, stolen);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeping.fetch_add(1);
+            wake.wait(lock, [&]() { return stopping.load() || queued.load() > 0; });
+            sleeping.fetch_sub(1);
+        }
+    }
+
+    // Run ready tasks on the calling thread until the graph's remaining
+    // count drops to zero: any task on a worker, the graph's own elsewhere
+    void Wait(const std::atomic<int>& remaining) {
+        size_t self = OwnQueue();
+        bool worker = self < workers.size();
+        Task* task;
+        bool stolen;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (worker ? TryTake(self, task, stolen) : TryTakeFrom(&remaining, self, task, stolen)) {
+                Execute(task, self, stolen);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+public:
+    // workerCount threads besides the ones that run graphs; 0 runs every
+    // task on the waiting thread
+    explicit TaskScheduler(unsigned workerCount) {
+        for (unsigned k = 0; k <= workerCount; k++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        ResetStats();
+        for (unsigned k = 0; k < workerCount; k++) {
+            workers.emplace_back([this, k]() { WorkerLoop(k); });
+        }
+    }
+
+    ~TaskScheduler() {
+        {
+            std::lock_guard<std::mutex> guard(sleepMutex);
+            stopping.store(true);
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Pool shared by interactive updates and batch jobs, sized so the
+    // workers and one waiting thread fill the machine. It keeps at least one
+    // worker, so posted tasks run while nobody waits.
+    static TaskScheduler& Shared() {
+        static TaskScheduler scheduler(std::max(DefaultThreadCount(), 2u) - 1);
+        return scheduler;
+    }
+
+    // Run work on a worker without a graph; nothing waits for it. It may
+    // spawn children like a graph task. From a worker it joins that worker's
+    // deque, from any other thread the workers' deques in turn, where only
+    // workers take it. Needs at least one worker.
+    void Post(std::function<void()> work) {
+        Task* task = new Task();
+        task->work = std::move(work);
+        task->scheduler = this;
+        task->unfinished.store(1, std::memory_order_relaxed);
+        if (Current().scheduler == this || workers.empty()) {
+            Push(task);
+        } else {
+            PushTo(nextPost.fetch_add(1, std::memory_order_relaxed) % workers.size(), task);
+        }
+    }
+
+    unsigned WorkerCount() const { return static_cast<unsigned>(workers.size()); }
+
+    void ResetStats() {
+        for (auto& queue : queues) {
+            queue->executed.store(0, std::memory_order_relaxed);
+            queue->stolen.store(0, std::memory_order_relaxed);
+            queue->busyNanoseconds.store(0, std::memory_order_relaxed);
+        }
+        statsStart.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    // One entry per worker, then one for the threads waiting on graphs
+    std::vector<WorkerStats> Stats() const {
+        Clock::duration elapsed = Clock::now().time_since_epoch() - Clock::duration(statsStart.load());
+        double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-9);
+        std::vector<WorkerStats> stats;
+        for (const auto& queue : queues) {
+            WorkerStats entry;
+            entry.tasks = queue->executed.load(std::memory_order_relaxed);
+            entry.steals = queue->stolen.load(std::memory_order_relaxed);
+            entry.busySeconds = queue->busyNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+            entry.utilization = entry.busySeconds / seconds;
+            stats.push_back(entry);
+        }
+        return stats;
+    }
+
+    // One line for a status display
+    std::string Report() const {
+        std::vector<WorkerStats> stats = Stats();
+        uint64_t tasks = 0, steals = 0;
+        double utilization = 0;
+        for (const WorkerStats& entry : stats) {
+            tasks += entry.tasks;
+            steals += entry.steals;
+        }
+        for (size_t k = 0; k + 1 < stats.size(); k++) {
+            utilization += stats[k].utilization;
+        }
+        char text[128];
+        std::snprintf(text, sizeof(text), "Pool: %u workers, %llu tasks (%llu stolen), %.1f%% utilization",
+                      WorkerCount(), static_cast<unsigned long long>(tasks), static_cast<unsigned long long>(steals),
+                      workers.empty() ? 0.0 : 100.0 * utilization / workers.size());
+        return text;
+    }
+};
+
+// Tasks and the dependencies between them, run as a whole on a scheduler.
+// The graph must be acyclic, tasks must not throw, and a graph is run by
+// one thread at a time; it can be run again once Run returns.
+class TaskGraph {
+public:
+    typedef size_t Node;
+
+private:
+    typedef TaskScheduler::Task Task;
+
+    TaskScheduler& scheduler;
+    std::deque<Task> nodes;  // Stable addresses while nodes are added
+    std::atomic<int> remaining{0};
+
+public:
+    explicit TaskGraph(TaskScheduler& scheduler = TaskScheduler::Shared()) : scheduler(scheduler) {}
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    Node Add(std::function<void()> work) {
+        nodes.emplace_back();
+        Task& task = nodes.back();
+        task.work = std::move(work);
+        task.remaining = &remaining;
+        task.graph = &remaining;
+        task.scheduler = &scheduler;
+        return nodes.size() - 1;
+    }
+
+    // after starts once before, and every task before spawned, is done
+    void Precede(Node before, Node after) {
+        nodes[before].successors.push_back(&nodes[after]);
+        nodes[after].predecessorCount++;
+    }
+
+    size_t Size() const { return nodes.size(); }
+
+    // Run every task and return when all have completed. The calling
+    // thread runs ready tasks meanwhile.
+    void Run() {
+        if (nodes.empty()) {
+            return;
+        }
+        remaining.store(static_cast<int>(nodes.size()), std::memory_order_relaxed);
+        for (Task& task : nodes) {
+            task.dependencies.store(task.predecessorCount, std::memory_order_relaxed);
+            task.unfinished.store(1, std::memory_order_relaxed);
+        }
+        for (Task& task : nodes) {
+            if (task.predecessorCount == 0) {
+                scheduler.Push(&task);
+            }
+        }
+        scheduler.Wait(remaining);
+    }
+
+    // From inside a running task: run work as its child, so the task and
+    // its successors complete after it. Elsewhere, runs work immediately.
+    static void Spawn(std::function<void()> work) {
+        Task* parent = TaskScheduler::Current().task;
+        if (!parent) {
+            work();
+            return;
+        }
+        Task* child = new Task();
+        child->work = std::move(work);
+        child->parent = parent;
+        child->graph = parent->graph;
+        child->scheduler = parent->scheduler;
+        child->unfinished.store(1, std::memory_order_relaxed);
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+        parent->scheduler->Push(child);
+    }
+};
@@ -0,0 +1,394 @@
+/**
+ * Copy-on-write Tiled Bitset
+ *
+ * Bitset stored as 64x64-bit tiles. Tiles and the table of tile pointers
+ * are reference counted, so copying a bitset (taking a snapshot) only
+ * copies one pointer. The first write after a snapshot copies the tile
+ * table once, and every write copies only the tile it touches. A missing
+ * tile reads as all zeros.
+ *
+ * Within a tile the 64 words are laid out either row-major (one word per
+ * row) or in Z-order (one 8x8 block per word, blocks in Morton order).
+ * Z-order keeps the points around a short arc in one or two cache lines;
+ * row words are still available in both layouts.
+ *
+ * Union, intersection, difference and XOR of whole bitsets work a tile at
+ * a time with the mask kernels, and resolve missing or shared tiles without
+ * reading their words: a union with an empty tile shares the other tile,
+ * and an intersection with one drops it.
+ *
+ */
+
+#pragma once
+#include "MaskKernels.h"
+#include "Morton.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Copies are cheap but not thread-safe with respect to each other
+class TiledBitset {
+public:
+    static const int TILE_BITS = 64;
+
+    enum class Layout {
+        RowMajor,  // Word r of a tile is row r
+        ZOrder     // Word k of a tile is the 8x8 block with Morton index k
+    };
+
+private:
+    static_assert(TILE_BITS == MORTON_TILE_SIZE, "Z-order layout assumes 64x64 tiles");
+
+    struct Tile {
+        uint64_t words[TILE_BITS];
+    };
+    typedef std::vector<std::shared_ptr<Tile> > TileTable;
+
+    int rowCount;
+    int colCount;
+    int tileRows;
+    int tileCols;
+    Layout layout;
+    std::shared_ptr<TileTable> table;
+
+    const Tile* FindTile(int i, int j) const {
+        return (*table)[(i / TILE_BITS) * tileCols + j / TILE_BITS].get();
+    }
+
+    bool TileRowEmpty(int tileRow) const {
+        for (int w = 0; w < tileCols; w++) {
+            if ((*table)[tileRow * tileCols + w]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // this = this op other. With the same layout tile words line up and
+    // whole tiles are combined; otherwise row words are.
+    template <MaskOp op>
+    TiledBitset& Combine(const TiledBitset& other) {
+        if (layout != other.layout) {
+            for (int i = 0; i < rowCount; i++) {
+                for (int w = 0; w < tileCols; w++) {
+                    uint64_t old = Word(i, w);
+                    uint64_t updated = ApplyMask<op>(old, other.Word(i, w));
+                    if (updated != old) {
+                        SetWord(i, w, updated);
+                    }
+                }
+            }
+            return *this;
+        }
+
+        for (size_t k = 0; k < table->size(); k++) {
+            std::shared_ptr<Tile> mine = (*table)[k];
+            const std::shared_ptr<Tile>& theirs = (*other.table)[k];
+            std::shared_ptr<Tile> result;
+            if (mine == theirs) {
+                if (op == MaskOp::Or || op == MaskOp::And) {
+                    continue;  // x | x = x & x = x
+                }
+            } else if (!theirs) {
+                if (op != MaskOp::And) {
+                    continue;  // x | 0 = x & ~0 = x ^ 0 = x
+                }
+            } else if (!mine) {
+                if (op == MaskOp::And || op == MaskOp::AndNot) {
+                    continue;  // Stays empty
+                }
+                result = theirs;  // 0 | y = 0 ^ y = y, shared
+            } else {
+                // Overwrite a tile nothing else refers to, otherwise write a
+                // new one; a tile that comes out empty is dropped
+                Tile* out = (table.use_count() == 1 && mine.use_count() == 2) ? mine.get() : nullptr;  // Table and local
+                std::shared_ptr<Tile> fresh;
+                if (!out) {
+                    fresh = std::make_shared<Tile>();
+                    out = fresh.get();
+                }
+                if (CombineMaskWords<op>(mine->words, theirs->words, out->words, TILE_BITS)) {
+                    if (!fresh) {
+                        continue;
+                    }
+                    result = fresh;
+                }
+            }
+            MutableTable()[k] = result;
+        }
+        return *this;
+    }
+
+    // Number of set bits of this op other, tile by tile; stops once it is
+    // non-zero if stopAtFirst
+    template <MaskOp op>
+    size_t CountCombined(const TiledBitset& other, bool stopAtFirst) const {
+        size_t total = 0;
+        if (layout != other.layout) {
+            for (int i = 0; i < rowCount && !(stopAtFirst && total); i++) {
+                for (int w = 0; w < tileCols; w++) {
+                    total += __builtin_popcountll(ApplyMask<op>(Word(i, w), other.Word(i, w)));
+                }
+            }
+            return total;
+        }
+
+        static const uint64_t zeros[TILE_BITS] = {};
+        for (size_t k = 0; k < table->size() && !(stopAtFirst && total); k++) {
+            const Tile* mine = (*table)[k].get();
+            const Tile* theirs = (*other.table)[k].get();
+            if (mine || theirs) {
+                total += CountMaskWords<op>(mine ? mine->words : zeros, theirs ? theirs->words : zeros, TILE_BITS);
+            }
+        }
+        return total;
+    }
+
+    TileTable& MutableTable() {
+        if (table.use_count() > 1) {
+            table = std::make_shared<TileTable>(*table);
+        }
+        return *table;
+    }
+
+    Tile& MutableTile(int tileRow, int tileCol) {
+        std::shared_ptr<Tile>& tile = MutableTable()[tileRow * tileCols + tileCol];
+        if (!tile) {
+            tile = std::make_shared<Tile>();
+            for (int k = 0; k < TILE_BITS; ++k) {
+                tile->words[k] = 0;
+            }
+        } else if (tile.use_count() > 1) {
+            tile = std::make_shared<Tile>(*tile);
+        }
+        return *tile;
+    }
+
+public:
+    TiledBitset() : rowCount(0), colCount(0), tileRows(0), tileCols(0),
+                    layout(Layout::RowMajor), table(std::make_shared<TileTable>()) {}
+
+    TiledBitset(int rows, int cols, Layout layout = Layout::RowMajor)
+        : rowCount(rows), colCount(cols),
+          tileRows((rows + TILE_BITS - 1) / TILE_BITS),
+          tileCols((cols + TILE_BITS - 1) / TILE_BITS),
+          layout(layout),
+          table(std::make_shared<TileTable>(static_cast<size_t>(tileRows) * tileCols)) {}
+
+    int Rows() const { return rowCount; }
+    int Cols() const { return colCount; }
+    int WordsPerRow() const { return tileCols; }
+    Layout GetLayout() const { return layout; }
+
+    // Word and bit of a tile holding point (r, c) of that tile
+    static void Locate(Layout layout, int r, int c, int& word, int& bit) {
+        if (layout == Layout::ZOrder) {
+            uint32_t index = MortonEncode(r, c);
+            word = static_cast<int>(index >> 6);
+            bit = static_cast<int>(index & 63);
+        } else {
+            word = r;
+            bit = c;
+        }
+    }
+
+    // Word w of row i (columns 64w .. 64w+63).
+    uint64_t Word(int i, int w) const {
+        const Tile* tile = FindTile(i, w * TILE_BITS);
+        if (!tile) {
+            return 0;
+        }
+        int r = i % TILE_BITS;
+        if (layout == Layout::RowMajor) {
+            return tile->words[r];
+        }
+
+        // Gather the row from the eight blocks it crosses
+        uint32_t blockRow = MortonSpread(r / MORTON_BLOCK_SIZE) << 1;
+        uint64_t value = 0;
+        for (int b = 0; b < TILE_BITS / MORTON_BLOCK_SIZE; ++b) {
+            uint64_t block = tile->words[blockRow | MortonSpread(b)];
+            value |= MortonRowBits(block, r % MORTON_BLOCK_SIZE) << (b * MORTON_BLOCK_SIZE);
+        }
+        return value;
+    }
+
+    // Replace word w of row i; copies the enclosing tile first if it is shared.
+    void SetWord(int i, int w, uint64_t value) {
+        if (value == 0 && !FindTile(i, w * TILE_BITS)) {
+            return;  // Already zero; don't allocate a tile
+        }
+        Tile& tile = MutableTile(i / TILE_BITS, w);
+        int r = i % TILE_BITS;
+        if (layout == Layout::RowMajor) {
+            tile.words[r] = value;
+            return;
+        }
+
+        uint32_t blockRow = MortonSpread(r / MORTON_BLOCK_SIZE) << 1;
+        uint64_t rowMask = MortonRowMask(r % MORTON_BLOCK_SIZE);
+        for (int b = 0; b < TILE_BITS / MORTON_BLOCK_SIZE; ++b) {
+            uint64_t& block = tile.words[blockRow | MortonSpread(b)];
+            uint64_t bits = (value >> (b * MORTON_BLOCK_SIZE)) & 0xFF;
+            block = (block & ~rowMask) | MortonRowDeposit(bits, r % MORTON_BLOCK_SIZE);
+        }
+    }
+
+    bool Get(int i, int j) const {
+        const Tile* tile = FindTile(i, j);
+        if (!tile) {
+            return false;
+        }
+        int word, bit;
+        Locate(layout, i % TILE_BITS, j % TILE_BITS, word, bit);
+        return (tile->words[word] >> bit) & 1;
+    }
+
+    void Set(int i, int j, bool value) {
+        if (Get(i, j) == value) {
+            return;
+        }
+        Flip(i, j);
+    }
+
+    // Flip one bit and return its new state.
+    bool Flip(int i, int j) {
+        int word, bit;
+        Locate(layout, i % TILE_BITS, j % TILE_BITS, word, bit);
+        uint64_t& w = MutableTile(i / TILE_BITS, j / TILE_BITS).words[word];
+        w ^= 1ULL << bit;
+        return (w >> bit) & 1;
+    }
+
+    // Advance (i, j) to the first set point at or after it in row-major
+    // order, skipping rows of empty tiles whole; false, leaving i at Rows(),
+    // if there is none. To visit every set point:
+    //   for (int i = 0, j = 0; bits.FindNext(i, j); j++) { ... }
+    bool FindNext(int& i, int& j) const {
+        while (i < rowCount) {
+            if (j == 0 && i % TILE_BITS == 0 && TileRowEmpty(i / TILE_BITS)) {
+                i += TILE_BITS;
+                continue;
+            }
+            if (j < colCount) {
+                int w = j / TILE_BITS;
+                uint64_t bits = Word(i, w) & (~0ULL << (j % TILE_BITS));
+                for (;;) {
+                    if (bits) {
+                        j = w * TILE_BITS + __builtin_ctzll(bits);
+                        return true;
+                    }
+                    if (++w == tileCols) {
+                        break;
+                    }
+                    bits = Word(i, w);
+                }
+            }
+            i++;
+            j = 0;
+        }
+        i = rowCount;
+        return false;
+    }
+
+    // First set point in row-major order
+    bool FindFirst(int& i, int& j) const {
+        i = 0;
+        j = 0;
+        return FindNext(i, j);
+    }
+
+    // Number of set points
+    size_t Count() const {
+        size_t total = 0;
+        for (size_t k = 0; k < table->size(); k++) {
+            if ((*table)[k]) {
+                total += CountBits((*table)[k]->words, TILE_BITS);
+            }
+        }
+        return total;
+    }
+
+    // In-place set algebra with a bitset of the same dimensions; the layouts
+    // may differ, but matching ones combine whole tiles
+    TiledBitset& UnionWith(const TiledBitset& other) { return Combine<MaskOp::Or>(other); }
+    TiledBitset& IntersectWith(const TiledBitset& other) { return Combine<MaskOp::And>(other); }
+    TiledBitset& Subtract(const TiledBitset& other) { return Combine<MaskOp::AndNot>(other); }
+    TiledBitset& XorWith(const TiledBitset& other) { return Combine<MaskOp::Xor>(other); }
+
+    // Number of points set in both bitsets, without building the
+    // intersection; e.g. the overlap of a rasterized circle and a selection
+    size_t IntersectionCount(const TiledBitset& other) const {
+        return CountCombined<MaskOp::And>(other, false);
+    }
+
+    // Number of points set in exactly one of the bitsets
+    size_t DifferenceCount(const TiledBitset& other) const {
+        return CountCombined<MaskOp::Xor>(other, false);
+    }
+
+    // True if any point is set in both bitsets; stops at the first tile
+    // they share a point in
+    bool Intersects(const TiledBitset& other) const {
+        return CountCombined<MaskOp::And>(other, true) != 0;
+    }
+
+    // Reset to all zeros without touching tiles shared with snapshots.
+    void Clear() {
+        table = std::make_shared<TileTable>(static_cast<size_t>(tileRows) * tileCols);
+    }
+
+    // True if both bitsets currently share the tile holding word w of row i.
+    // Lets comparisons skip tiles that were not edited between snapshots.
+    bool SharesTile(const TiledBitset& other, int i, int w) const {
+        size_t index = static_cast<size_t>(i / TILE_BITS) * tileCols + w;
+        return (*table)[index] == (*other.table)[index];
+    }
+
+    // Number of allocated tiles not shared with any other bitset; the
+    // memory a snapshot costs beyond the ones it was derived from.
+    size_t UniqueTileCount() const {
+        size_t count = 0;
+        if (table.use_count() > 1) {
+            return 0;
+        }
+        for (size_t k = 0; k < table->size(); ++k) {
+            if ((*table)[k] && (*table)[k].use_count() == 1) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // Number of 64-bit words in the tile-major image used by CopyTiles/Adopt
+    static size_t TileWordCount(int rows, int cols) {
+        size_t tiles = static_cast<size_t>((rows + TILE_BITS - 1) / TILE_BITS) *
+                       ((cols + TILE_BITS - 1) / TILE_BITS);
+        return tiles * TILE_BITS;
+    }
+
+    // Write every tile, in table order, to a tile-major image. The words of
+    // each tile keep the bitset's layout.
+    void CopyTiles(uint64_t* image) const {
+        for (size_t k = 0; k < table->size(); ++k) {
+            const std::shared_ptr<Tile>& tile = (*table)[k];
+            for (int r = 0; r < TILE_BITS; ++r) {
+                image[k * TILE_BITS + r] = tile ? tile->words[r] : 0;
+            }
+        }
+    }
+
+    // Use a tile-major image in place, e.g. a memory-mapped file. Every tile
+    // shares ownership of owner, so the image stays valid while any copy of
+    // the bitset refers to it, and is never written: the first edit of a
+    // tile copies it like any other shared tile.
+    static TiledBitset Adopt(int rows, int cols, Layout layout,
+                             const std::shared_ptr<void>& owner, uint64_t* image) {
+        TiledBitset bits(rows, cols, layout);
+        for (size_t k = 0; k < bits.table->size(); ++k) {
+            (*bits.table)[k] = std::shared_ptr<Tile>(
+                owner, reinterpret_cast<Tile*>(image + k * TILE_BITS));
+        }
+        return bits;
+    }
+};
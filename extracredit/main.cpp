@@ -11,24 +11,56 @@
  * - Support for rotated ellipses
  * - Validation for collinear points
  * - Real-time visualization
+ * - Ellipse detection in PGM/PPM images (Canny edges)
  * 
  * Controls:
  * - Click: Toggle point selection
  * - G key: Generate best-fit ellipse
+ * - Ctrl+Z / Ctrl+Y: Undo / redo selection changes
+ * - V key: Compare with the previous fit
+ * - S key: Save the session (also saved on exit and restored on startup)
+ * - E key: Export the selection as an SVG image
  * - C key: Clear all selections
  * 
+ * Every change to the selection or fit is also logged as a compact delta
+ * stream to ExtraCredit.delta (see DeltaStream.h).
+ * 
+ * Running "ExtraCredit.exe image.pgm" selects the grid points the image's
+ * edges pass through and fits an ellipse to every edge pixel.
+ * 
+ * The grid size, window size, padding, edge thresholds and colors can be
+ * changed in ExtraCredit.cfg or on the command line (see Settings.h).
+ * 
  */
 
 #include <windows.h>
 #include "Config.h"
+#include "Settings.h"
 #include "Grid.h"
 #include "Renderer.h"
 #include "Geometry.h"
+#include "FitCache.h"
+#include "History.h"
+#include "Session.h"
+#include "MaskRectangles.h"
+#include "DeltaStream.h"
+#include "EdgeDetection.h"
+#include "TaskGraph.h"
+#include <algorithm>
 #include <memory>
+#include <string>
 
 // Forward declarations
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
+// Everything an undo step restores. Copying it is O(1): the selection
+// shares its tiles with the live grid until one of them is edited.
+struct SelectionState {
+    TiledBitset selection;
+    EllipseShape bestFitEllipse;
+    bool showEllipse;
+};
+
 /**
  * Application state manager for Extra Credit.
  * Encapsulates all application state and behavior to avoid global variables.
@@ -39,25 +71,169 @@ private:
     std::unique_ptr<Renderer> renderer;
     EllipseShape bestFitEllipse;
     bool showEllipse;
+    
+    // Undo/redo and comparison with the previous fit
+    History<SelectionState> history;
+    TiledBitset lastFitSelection;        // Selection the current fit was made from
+    TiledBitset previousFitSelection;
+    EllipseShape previousFitEllipse;
+    bool showPrevious;
+    
+    Session session;
+    FitCache<EllipseShape> fitCache;     // Fits by selection hash
+    EdgeDetector edgeDetector;
+    
+    // What the next frame draws, prepared by PrepareFrame
+    CellLayers frameCells;
+    
+    // Change log of the selection and fit, drained to DELTA_LOG_FILE
+    DeltaRing deltaRing;
+    DeltaEncoder deltaEncoder;
+    DeltaRecorder deltaRecorder;
+    
+    SelectionState CaptureState() const {
+        return SelectionState{grid.GetSelection(), bestFitEllipse, showEllipse};
+    }
+    
+    void RestoreState(const SelectionState& state) {
+        grid.SetSelection(state.selection);
+        bestFitEllipse = state.bestFitEllipse;
+        showEllipse = state.showEllipse;
+    }
+    
+    // Send the changes since the last call to the delta stream. Every edit
+    // ends in Render, so publishing there covers them all; never waits.
+    void PublishDelta() {
+        if (showEllipse) {
+            const EllipseShape& e = bestFitEllipse;
+            double params[5] = {e.center.x, e.center.y, e.a, e.b, e.angle};
+            deltaEncoder.SetShape(params, 5);
+        } else {
+            deltaEncoder.ClearShape();
+        }
+        deltaEncoder.Publish(grid.GetSelection());
+    }
+    
+    // Prepare the next frame as a graph of tasks: refit the selection if
+    // asked, log the change, and decompose the selected points into
+    // rectangles to fill, a band of rows per task, alongside the points the
+    // previous fit had that are no longer selected. Returns false if the
+    // refit found the points collinear.
+    bool PrepareFrame(bool refit) {
+        const int size = grid.GetSize();
+        const int bandRows = 64;
+        const int bandCount = (size + bandRows - 1) / bandRows;
+        bool fitted = true;
+        
+        TiledBitset selected;
+        std::vector<std::vector<CellRect>> bands(bandCount);
+        std::vector<CellRect> dropped;
+        
+        TaskGraph graph;
+        TaskGraph::Node extract = graph.Add([&]() {
+            selected = grid.GetSelection();  // Shares the tiles, O(1)
+        });
+        TaskGraph::Node fit = extract;
+        if (refit) {
+            // Refitting a selection seen before is a cache lookup
+            fit = graph.Add([&]() {
+                EllipseShape ellipse = fitCache.Get(grid.GetHash(), [&]() {
+                    return FitEllipse(grid.GetSelectedPoints());
+                });
+                if (ellipse.valid) {
+                    if (showEllipse) {
+                        // Keep the fit being replaced; the selection copy is O(1)
+                        previousFitEllipse = bestFitEllipse;
+                        previousFitSelection = lastFitSelection;
+                    }
+                    bestFitEllipse = ellipse;
+                    lastFitSelection = grid.GetSelection();
+                    showEllipse = true;
+                } else {
+                    showEllipse = false;
+                    fitted = false;
+                }
+            });
+            graph.Precede(extract, fit);
+        }
+        TaskGraph::Node delta = graph.Add([&]() { PublishDelta(); });
+        graph.Precede(fit, delta);
+        
+        // Rectangles of selected points, one child task per band of rows
+        TaskGraph::Node tiles = graph.Add([&]() {
+            for (int band = 0; band < bandCount; band++) {
+                TaskGraph::Spawn([&, band]() {
+                    bands[band].clear();
+                    ForEachMaskRectangleInRows(selected, band * bandRows,
+                                               std::min(size, (band + 1) * bandRows),
+                                               [&](const CellRect& cell) { bands[band].push_back(cell); });
+                });
+            }
+        });
+        TaskGraph::Node droppedTiles = graph.Add([&]() {
+            if (showPrevious && previousFitEllipse.valid) {
+                TiledBitset previous = previousFitSelection;
+                previous.Subtract(selected);
+                dropped = MaskRectangles(previous);
+            }
+        });
+        TaskGraph::Node gather = graph.Add([&]() {
+            frameCells.selected.clear();
+            for (const auto& band : bands) {
+                frameCells.selected.insert(frameCells.selected.end(), band.begin(), band.end());
+            }
+            frameCells.dropped.swap(dropped);
+        });
+        graph.Precede(extract, tiles);
+        graph.Precede(fit, droppedTiles);
+        graph.Precede(tiles, gather);
+        graph.Precede(droppedTiles, gather);
+        
+        graph.Run();
+        return fitted;
+    }
+    
+    // Draw the frame PrepareFrame left
+    void DrawFrame() {
+        bool compare = showPrevious && previousFitEllipse.valid;
+        renderer->Render(frameCells, showEllipse ? &bestFitEllipse : nullptr,
+                         compare ? &previousFitEllipse : nullptr);
+        if (showEllipse) {
+            renderer->DrawStatus(fitCache.Report());
+        }
+        renderer->DrawStatus(TaskScheduler::Shared().Report(), 1);
+        renderer->Present();
+    }
 
 public:
-    Application() : showEllipse(false) {}
+    Application()
+        : showEllipse(false), lastFitSelection(grid.GetSize(), grid.GetSize()),
+          previousFitSelection(grid.GetSize(), grid.GetSize()), showPrevious(false),
+          session(SESSION_FILE), edgeDetector(Settings::Current().lowThreshold, Settings::Current().highThreshold),
+          deltaRing(DELTA_RING_BYTES), deltaEncoder(deltaRing),
+          deltaRecorder(deltaRing, DELTA_LOG_FILE) {
+        // Restore the previous session, if any, straight from the mapped file
+        if (session.Load(grid, bestFitEllipse, showEllipse)) {
+            lastFitSelection = grid.GetSelection();
+        }
+    }
 
     /**
      * Initialize renderer after window creation.
      * @param hwnd Window handle
      */
     void InitializeRenderer(HWND hwnd) {
-        renderer = std::make_unique<Renderer>(hwnd, WINDOW_WIDTH, WINDOW_HEIGHT);
+        renderer = std::make_unique<Renderer>(hwnd, Settings::Current().windowWidth,
+                                              Settings::Current().windowHeight);
     }
 
     /**
      * Render the current state.
      */
     void Render() {
+        PrepareFrame(false);
         if (renderer) {
-            renderer->Render(grid, showEllipse ? &bestFitEllipse : nullptr);
-            renderer->Present();
+            DrawFrame();
         }
     }
 
@@ -69,6 +245,7 @@ public:
     void OnMouseDown(int x, int y) {
         int i, j;
         if (Grid::PixelToGrid(x, y, i, j)) {
+            history.Record(CaptureState());
             grid.TogglePoint(i, j);
             showEllipse = false;  // Hide ellipse when grid changes
             Render();
@@ -80,28 +257,114 @@ public:
      * @param hwnd Window handle for message boxes
      */
     void GenerateEllipse(HWND hwnd) {
-        std::vector<Point> selectedPoints = grid.GetSelectedPoints();
-        
-        if (selectedPoints.size() < 5) {
+        if (grid.GetSelectedCount() < 5) {
             showEllipse = false;
             MessageBox(hwnd, 
                       "Please select at least 5 points to fit an ellipse.", 
                       "Not Enough Points", 
                       MB_OK | MB_ICONINFORMATION);
-        } else {
-            bestFitEllipse = FitEllipse(selectedPoints);
-            if (bestFitEllipse.valid) {
-                showEllipse = true;
-            } else {
-                showEllipse = false;
-                MessageBox(hwnd, 
-                          "Cannot fit an ellipse through collinear points.\n"
-                          "Please select points that are not in a straight line.", 
-                          "Invalid Point Configuration", 
-                          MB_OK | MB_ICONWARNING);
-            }
+            Render();
+            return;
+        }
+        
+        // Refit as part of preparing the frame, so the rectangles of the
+        // selection are found while the fit runs
+        bool fitted = PrepareFrame(true);
+        if (renderer) {
+            DrawFrame();
+        }
+        if (!fitted) {
+            MessageBox(hwnd, 
+                      "Cannot fit an ellipse through collinear points.\n"
+                      "Please select points that are not in a straight line.", 
+                      "Invalid Point Configuration", 
+                      MB_OK | MB_ICONWARNING);
+        }
+    }
+
+    /**
+     * Detect edges in an image and use them as the selection: the grid points
+     * whose cells an edge crosses are selected, and the ellipse is fit to
+     * every edge pixel, scaled to the canvas.
+     * @param hwnd Window handle for message boxes
+     * @param path PGM or PPM file
+     */
+    void DetectImage(HWND hwnd, const std::string& path) {
+        GrayImage image;
+        std::string error;
+        if (!LoadPnm(path, image, error)) {
+            MessageBox(hwnd, error.c_str(), "Could Not Load Image", MB_OK | MB_ICONWARNING);
+            return;
         }
+        edgeDetector.Detect(image);
+        // Placed over the grid, in pixels from its corner
+        const Settings& settings = Settings::Current();
+        const int size = grid.GetSize();
+        const double side = size * settings.CellSize();
+        ImagePlacement placement = ImagePlacement::Fit(image.width, image.height, side, side);
+        
+        TiledBitset cells(size, size, SelectionLayout());
+        edgeDetector.MarkCells(placement, settings.CellSize(), cells);
+        history.Record(CaptureState());
+        grid.SetSelection(cells);
         
+        // Fit in window pixels, like the grid points
+        EllipseShape ellipse = FitEllipse(edgeDetector.EdgeMoments<PointMoments>(
+            placement.Shifted(settings.gridPadding, settings.gridPadding)));
+        showEllipse = ellipse.valid;
+        if (showEllipse) {
+            bestFitEllipse = ellipse;
+            lastFitSelection = grid.GetSelection();
+        }
+        Render();
+    }
+
+    /**
+     * Step back one selection change.
+     */
+    void Undo() {
+        SelectionState state = CaptureState();
+        if (history.Undo(state)) {
+            RestoreState(state);
+            Render();
+        }
+    }
+
+    /**
+     * Re-apply an undone selection change.
+     */
+    void Redo() {
+        SelectionState state = CaptureState();
+        if (history.Redo(state)) {
+            RestoreState(state);
+            Render();
+        }
+    }
+
+    /**
+     * Save the selection and the current fit to the session file.
+     * @return true on success
+     */
+    bool SaveSession() {
+        return session.Save(grid, bestFitEllipse, showEllipse);
+    }
+
+    /**
+     * Write the selection to SELECTION_SVG_FILE, one rectangle per block of
+     * selected points.
+     * @return true on success
+     */
+    bool ExportSelection() {
+        COLORREF color = GetSelectedColor();
+        unsigned rgb = (GetRValue(color) << 16) | (GetGValue(color) << 8) | GetBValue(color);
+        return WriteMaskSvg(SELECTION_SVG_FILE, grid.GetSelection(), Settings::Current().CellSize(), rgb);
+    }
+
+    /**
+     * Toggle drawing the previous fit and its points alongside the current one.
+     */
+    void TogglePrevious() {
+        showPrevious = !showPrevious;
         Render();
     }
 
@@ -109,6 +372,7 @@ public:
      * Clear all selected points and hide ellipse.
      */
     void Clear() {
+        history.Record(CaptureState());
         grid.Clear();
         showEllipse = false;
         Render();
@@ -121,6 +385,14 @@ Application* g_app = nullptr;
  * Windows entry point.
  */
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // Settings come from ExtraCredit.cfg and the command line, before
+    // anything uses them; what is left of the command line is an image to open
+    std::string imagePath, error;
+    if (!Settings::Current().ParseCommandLine(lpCmdLine ? lpCmdLine : "", imagePath, error)) {
+        MessageBox(NULL, error.c_str(), "Invalid Settings", MB_OK | MB_ICONERROR);
+        return 1;
+    }
+    
     // Create application instance
     Application app;
     g_app = &app;
@@ -136,7 +408,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     RegisterClass(&wc);
     
     // Calculate window size to account for borders
-    RECT windowRect = {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+    RECT windowRect = {0, 0, Settings::Current().windowWidth, Settings::Current().windowHeight};
     AdjustWindowRect(&windowRect, WS_OVERLAPPEDWINDOW, FALSE);
     
     // Create window
@@ -166,6 +438,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Initial render
     app.Render();
     
+    // An image on the command line replaces the restored selection
+    if (!imagePath.empty()) {
+        app.DetectImage(hwnd, imagePath);
+    }
+    
     // Message loop
     MSG msg = {};
     while (GetMessage(&msg, NULL, 0, 0)) {
@@ -182,6 +459,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
         case WM_DESTROY:
+            if (g_app) {
+                g_app->SaveSession();
+            }
             PostQuitMessage(0);
             return 0;
             
@@ -218,6 +498,33 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                     g_app->Clear();
                 }
             }
+            else if (key == 'v' || key == 'V') {
+                if (g_app) {
+                    g_app->TogglePrevious();
+                }
+            }
+            else if (key == 's' || key == 'S') {
+                if (g_app && !g_app->SaveSession()) {
+                    MessageBox(hwnd, "Could not save the session file.", "Save Failed",
+                               MB_OK | MB_ICONWARNING);
+                }
+            }
+            else if (key == 'e' || key == 'E') {
+                if (g_app && !g_app->ExportSelection()) {
+                    MessageBox(hwnd, "Could not write the SVG file.", "Export Failed",
+                               MB_OK | MB_ICONWARNING);
+                }
+            }
+            else if (key == 0x1A) {  // Ctrl+Z
+                if (g_app) {
+                    g_app->Undo();
+                }
+            }
+            else if (key == 0x19) {  // Ctrl+Y
+                if (g_app) {
+                    g_app->Redo();
+                }
+            }
             return 0;
         }
     }
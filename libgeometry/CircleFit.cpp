@@ -0,0 +1,33 @@
+/**
+ * Circle Fitting Entry Points
+ *
+ * The C interface to Problem 2's Pratt fit, reading the points in place.
+ *
+ */
+
+#define GEOMETRY_BUILD
+#include "geometry.h"
+#include "Span.h"
+#include "../Problem2/Geometry.h"
+
+extern "C" GEOM_API uint32_t geom_abi_version(void) {
+    return GEOM_ABI_VERSION;
+}
+
+extern "C" GEOM_API int geom_fit_circle(const GeomPoints* points, GeomCircle* circle) {
+    if (!IsValidSpan(points) || !circle) {
+        return GEOM_INVALID_ARGUMENT;
+    }
+    const GeomPoints span = *points;
+    Circle fit = FitCircle(span.count, [&](size_t i) {
+        return Point(SpanValue(span.x, span.stride, i), SpanValue(span.y, span.stride, i));
+    });
+    circle->cx = fit.center.x;
+    circle->cy = fit.center.y;
+    circle->radius = fit.radius;
+    return fit.radius > 0 ? GEOM_OK : GEOM_NO_RESULT;
+}
+
+extern "C" GEOM_API int geom_fit_circles(const GeomPoints* sets, size_t count, GeomCircle* circles, int* status) {
+    return FitBatch(sets, count, circles, status, geom_fit_circle);
+}
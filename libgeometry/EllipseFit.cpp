@@ -0,0 +1,33 @@
+/**
+ * Ellipse Fitting Entry Points
+ *
+ * The C interface to the extra credit program's covariance fit, reading
+ * the points in place.
+ *
+ */
+
+#define GEOMETRY_BUILD
+#include "geometry.h"
+#include "Span.h"
+#include "../extracredit/Geometry.h"
+
+extern "C" GEOM_API int geom_fit_ellipse(const GeomPoints* points, GeomEllipse* ellipse) {
+    if (!IsValidSpan(points) || !ellipse) {
+        return GEOM_INVALID_ARGUMENT;
+    }
+    const GeomPoints span = *points;
+    EllipseShape fit = FitEllipse(span.count, [&](size_t i) {
+        return Point(SpanValue(span.x, span.stride, i), SpanValue(span.y, span.stride, i));
+    });
+    ellipse->cx = fit.center.x;
+    ellipse->cy = fit.center.y;
+    ellipse->a = fit.a;
+    ellipse->b = fit.b;
+    ellipse->angle = fit.angle;
+    return fit.valid ? GEOM_OK : GEOM_NO_RESULT;
+}
+
+extern "C" GEOM_API int geom_fit_ellipses(const GeomPoints* sets, size_t count, GeomEllipse* ellipses,
+                                          int* status) {
+    return FitBatch(sets, count, ellipses, status, geom_fit_ellipse);
+}
@@ -0,0 +1,109 @@
+/**
+ * Rasterization Entry Points
+ *
+ * The C interface to Problem 1's circle rasterization and bounding
+ * circles, writing to and reading from caller-owned masks.
+ *
+ */
+
+#define GEOMETRY_BUILD
+#include "geometry.h"
+#include "../Problem1/Rasterizer.h"
+#include <cmath>
+#include <limits>
+
+namespace {
+    // Grid coordinates beyond this would overflow the int bounding box
+    const double MAX_COORDINATE = 1e9;
+
+    bool IsValidMask(const GeomMask* mask) {
+        return mask && mask->words && mask->width > 0 && mask->height > 0 &&
+               mask->stride >= (static_cast<size_t>(mask->width) + 63) / 64;
+    }
+
+    bool IsValidCircle(const GeomCircle* circle) {
+        return circle && std::abs(circle->cx) < MAX_COORDINATE && std::abs(circle->cy) < MAX_COORDINATE &&
+               circle->radius < MAX_COORDINATE && !std::isnan(circle->radius);
+    }
+
+    // Sets the mask bits of the points CircleRasterizer visits
+    struct MaskKernel {
+        Circle circle;
+        GeomMask* mask;
+
+        void operator()(int row, int col) const {
+            if (row < mask->height && col < mask->width) {
+                mask->words[static_cast<size_t>(row) * mask->stride + static_cast<size_t>(col) / 64] |=
+                    uint64_t(1) << (col % 64);
+            }
+        }
+
+        template <typename Params>
+        void operator()(const Params& params) const {
+            CircleRasterizer::forEachPointNearWith(params, circle, *this);
+        }
+    };
+}
+
+extern "C" GEOM_API int geom_rasterize_circle(const GeomCircle* circle, double threshold, GeomMask* mask) {
+    return geom_rasterize_circles(circle, 1, threshold, mask);
+}
+
+extern "C" GEOM_API int geom_rasterize_circles(const GeomCircle* circles, size_t count, double threshold,
+                                               GeomMask* mask) {
+    if (!IsValidMask(mask) || !(threshold >= 0 && threshold < MAX_COORDINATE) || (count > 0 && !circles)) {
+        return GEOM_INVALID_ARGUMENT;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!IsValidCircle(&circles[i])) {
+            return GEOM_INVALID_ARGUMENT;
+        }
+    }
+
+    // The rasterizer clamps to a square grid; points past the mask are dropped
+    const int size = std::max(mask->width, mask->height);
+    for (size_t i = 0; i < count; i++) {
+        MaskKernel kernel = {Circle(circles[i].cx, circles[i].cy, circles[i].radius), mask};
+        if (kernel.circle.isValid()) {
+            RasterDispatch::run(size, threshold, kernel);
+        }
+    }
+    return GEOM_OK;
+}
+
+extern "C" GEOM_API int geom_bounding_circles(double cx, double cy, const GeomMask* mask,
+                                              GeomCircle* inner, GeomCircle* outer) {
+    if (!IsValidMask(mask) || !inner || !outer) {
+        return GEOM_INVALID_ARGUMENT;
+    }
+
+    const Point2D center(cx, cy);
+    double minDistance = std::numeric_limits<double>::max();
+    double maxDistance = 0.0;
+    bool hasPoints = false;
+    const size_t wordsPerRow = (static_cast<size_t>(mask->width) + 63) / 64;
+    for (int row = 0; row < mask->height; ++row) {
+        const uint64_t* words = mask->words + static_cast<size_t>(row) * mask->stride;
+        for (size_t w = 0; w < wordsPerRow; ++w) {
+            uint64_t word = words[w];
+            if (w == wordsPerRow - 1 && mask->width % 64 != 0) {
+                word &= (uint64_t(1) << (mask->width % 64)) - 1;  // Ignore padding bits
+            }
+            while (word) {
+                int col = static_cast<int>(w * 64) + __builtin_ctzll(word);
+                double dist = center.distanceTo(Point2D(col, row));
+                minDistance = std::min(minDistance, dist);
+                maxDistance = std::max(maxDistance, dist);
+                hasPoints = true;
+                word &= word - 1;
+            }
+        }
+    }
+
+    if (!hasPoints) {
+        return GEOM_NO_RESULT;
+    }
+    *inner = {cx, cy, minDistance};
+    *outer = {cx, cy, maxDistance};
+    return GEOM_OK;
+}
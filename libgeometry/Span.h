@@ -0,0 +1,42 @@
+/**
+ * Point Spans
+ *
+ * Reads points in place from the caller buffers described by a GeomPoints.
+ *
+ */
+
+#pragma once
+#include "geometry.h"
+#include <cstring>
+
+// Usable span: coordinates and a stride whenever there are points to read
+inline bool IsValidSpan(const GeomPoints* points) {
+    return points && (points->count == 0 || (points->x && points->y && points->stride > 0));
+}
+
+// Coordinate of point i. memcpy allows strides that leave doubles unaligned,
+// such as packed records, and compiles to a plain load otherwise.
+inline double SpanValue(const double* base, size_t stride, size_t i) {
+    double value;
+    std::memcpy(&value, reinterpret_cast<const char*>(base) + i * stride, sizeof(value));
+    return value;
+}
+
+// Call fit(points) for each span of a batch and store its status
+template <typename Result, typename Fit>
+int FitBatch(const GeomPoints* sets, size_t count, Result* results, int* status, Fit fit) {
+    if (count > 0 && (!sets || !results)) {
+        return GEOM_INVALID_ARGUMENT;
+    }
+    int overall = GEOM_OK;
+    for (size_t i = 0; i < count; i++) {
+        int result = fit(&sets[i], &results[i]);
+        if (status) {
+            status[i] = result;
+        }
+        if (result == GEOM_INVALID_ARGUMENT) {
+            overall = GEOM_INVALID_ARGUMENT;
+        }
+    }
+    return overall;
+}
@@ -0,0 +1,8 @@
+@echo off
+echo Building the geometry library...
+g++ -std=c++17 -O2 -shared -static-libgcc -static-libstdc++ CircleFit.cpp EllipseFit.cpp Raster.cpp -o geometry.dll -Wl,--out-implib,libgeometry.dll.a
+if %errorlevel% equ 0 (
+    echo Build successful! Link against geometry.dll with libgeometry.dll.a
+) else (
+    echo Build failed!
+)
@@ -0,0 +1,136 @@
+/**
+ * Geometry Library - C Interface
+ *
+ * The circle fit (Problem 2), ellipse fit (extra credit), circle
+ * rasterization and bounding circles (Problem 1) as a shared library with
+ * a stable C ABI, for use in-process from C, Rust or anything else with a
+ * C FFI.
+ *
+ * Nothing is copied or allocated across the boundary: points are read in
+ * place from caller buffers described by a pointer, a count and a byte
+ * stride, and masks are written into caller-owned bitsets. The batch entry
+ * points take arrays of spans and results, one call per batch.
+ *
+ * All functions are thread-safe and may be called concurrently; none keeps
+ * state between calls.
+ */
+
+#ifndef GEOMETRY_LIB_H
+#define GEOMETRY_LIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(GEOMETRY_BUILD)
+#    define GEOM_API __declspec(dllexport)
+#  else
+#    define GEOM_API __declspec(dllimport)
+#  endif
+#else
+#  define GEOM_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a signature or structure below changes */
+#define GEOM_ABI_VERSION 1
+
+/* Status codes */
+#define GEOM_OK 0                 /* Result written */
+#define GEOM_NO_RESULT 1          /* Too few points, collinear points or an empty mask */
+#define GEOM_INVALID_ARGUMENT -1  /* Null pointer, zero stride or bad mask size */
+
+/* Problem 1's default: sqrt(2)/2 grid units from the circle */
+#define GEOM_DEFAULT_THRESHOLD 0.7071
+
+/*
+ * A span of points in caller memory. Point i is at
+ * *(const double*)((const char*)x + i * stride), and likewise for y.
+ * Interleaved x, y pairs use y = x + 1 and stride = 2 * sizeof(double);
+ * separate arrays use stride = sizeof(double).
+ */
+typedef struct GeomPoints {
+    const double* x;
+    const double* y;
+    size_t count;
+    size_t stride;  /* Bytes from one point to the next */
+} GeomPoints;
+
+typedef struct GeomCircle {
+    double cx;
+    double cy;
+    double radius;
+} GeomCircle;
+
+typedef struct GeomEllipse {
+    double cx;
+    double cy;
+    double a;      /* Semi-major axis */
+    double b;      /* Semi-minor axis */
+    double angle;  /* Rotation of the major axis, in radians */
+} GeomEllipse;
+
+/*
+ * A caller-owned bitset of width x height grid points. Point (row, col)
+ * is bit col % 64 of words[row * stride + col / 64] and sits at
+ * x = col, y = row. stride is in 64-bit words and must be at least
+ * (width + 63) / 64.
+ */
+typedef struct GeomMask {
+    uint64_t* words;
+    int32_t width;
+    int32_t height;
+    size_t stride;
+} GeomMask;
+
+/* GEOM_ABI_VERSION of the loaded library */
+GEOM_API uint32_t geom_abi_version(void);
+
+/*
+ * Pratt algebraic best-fit circle, the same fit as Problem 2. Needs at
+ * least 3 points.
+ */
+GEOM_API int geom_fit_circle(const GeomPoints* points, GeomCircle* circle);
+
+/*
+ * Fit count point sets. status may be null; otherwise status[i] receives
+ * the result of set i. Sets without a fit get a zero circle. Returns
+ * GEOM_INVALID_ARGUMENT if any span is invalid, GEOM_OK otherwise.
+ */
+GEOM_API int geom_fit_circles(const GeomPoints* sets, size_t count, GeomCircle* circles, int* status);
+
+/*
+ * Covariance best-fit ellipse, the same fit as the extra credit program.
+ * Needs at least 5 points.
+ */
+GEOM_API int geom_fit_ellipse(const GeomPoints* points, GeomEllipse* ellipse);
+
+/* Batch form of geom_fit_ellipse, as geom_fit_circles */
+GEOM_API int geom_fit_ellipses(const GeomPoints* sets, size_t count, GeomEllipse* ellipses, int* status);
+
+/*
+ * Set the mask bit of every grid point within threshold of the circle's
+ * boundary, as Problem 1 highlights it. Other bits are left as they are,
+ * so clear the mask first for a single circle.
+ */
+GEOM_API int geom_rasterize_circle(const GeomCircle* circle, double threshold, GeomMask* mask);
+
+/* Rasterize count circles into the same mask: the union of their points */
+GEOM_API int geom_rasterize_circles(const GeomCircle* circles, size_t count, double threshold,
+                                    GeomMask* mask);
+
+/*
+ * Problem 1's bounding circles of the set points about a center: inner
+ * through the nearest set point, outer through the farthest.
+ */
+GEOM_API int geom_bounding_circles(double cx, double cy, const GeomMask* mask,
+                                   GeomCircle* inner, GeomCircle* outer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GEOMETRY_LIB_H */